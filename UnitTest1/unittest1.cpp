@@ -62,6 +62,20 @@ namespace UnitTest1
             Assert::AreEqual(ret, 0);
         }
 
+        TEST_METHOD(picotable)
+        {
+            int ret = picotable_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(cnx_table_bench)
+        {
+            int ret = cnx_table_bench_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
         TEST_METHOD(picolog_basic)
         {
             int ret = picolog_basic_test();
@@ -202,6 +216,104 @@ namespace UnitTest1
             Assert::AreEqual(ret, 0);
         }
 
+        TEST_METHOD(sockloop_recvmmsg)
+        {
+            int ret = sockloop_recvmmsg_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(sockloop_gro)
+        {
+            int ret = sockloop_gro_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(sockloop_cid_steering)
+        {
+            int ret = sockloop_cid_steering_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(sockloop_workers)
+        {
+            int ret = sockloop_workers_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(sockloop_commands)
+        {
+            int ret = sockloop_commands_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(sockloop_wake_up)
+        {
+            int ret = sockloop_wake_up_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(sockloop_command_add_to_stream)
+        {
+            int ret = sockloop_command_add_to_stream_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(sockloop_command_mark_active)
+        {
+            int ret = sockloop_command_mark_active_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(sockloop_command_datagram)
+        {
+            int ret = sockloop_command_datagram_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(sockloop_command_close)
+        {
+            int ret = sockloop_command_close_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(sockloop_sendmmsg)
+        {
+            int ret = sockloop_sendmmsg_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(sockloop_txtime)
+        {
+            int ret = sockloop_txtime_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(sockloop_busy_poll)
+        {
+            int ret = sockloop_busy_poll_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(sockloop_uring)
+        {
+            int ret = sockloop_uring_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
         TEST_METHOD(splay)
         {
             int ret = splay_test();
@@ -209,6 +321,62 @@ namespace UnitTest1
             Assert::AreEqual(ret, 0);
         }
 
+        TEST_METHOD(picowheel)
+        {
+            int ret = picowheel_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(wake_wheel_bench)
+        {
+            int ret = wake_wheel_bench_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(slab)
+        {
+            int ret = slab_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(arena)
+        {
+            int ret = arena_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(stream_churn)
+        {
+            int ret = stream_churn_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(huge_page_pool)
+        {
+            int ret = huge_page_pool_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(packet_pool)
+        {
+            int ret = packet_pool_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(data_node_reorder)
+        {
+            int ret = data_node_reorder_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
         TEST_METHOD(create_cnx)
         {
             int ret = create_cnx_test();
@@ -368,6 +536,20 @@ namespace UnitTest1
 
             Assert::AreEqual(ret, 0);
         }
+
+        TEST_METHOD(stream_ready_queue)
+        {
+            int ret = stream_ready_queue_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(stream_weighted)
+        {
+            int ret = stream_weighted_test();
+
+            Assert::AreEqual(ret, 0);
+        }
         TEST_METHOD(stream_retransmit_copy)
         {
             int ret = test_copy_for_retransmit();
@@ -392,6 +574,12 @@ namespace UnitTest1
         TEST_METHOD(stateless_blowback) {
             int ret = test_stateless_blowback();
 
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(stateless_reset_jumbo) {
+            int ret = stateless_reset_jumbo_test();
+
             Assert::AreEqual(ret, 0);
         }
 
@@ -430,6 +618,13 @@ namespace UnitTest1
             Assert::AreEqual(ret, 0);
         }
 
+        TEST_METHOD(sack_ring_bench)
+        {
+            int ret = sack_ring_bench_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
         TEST_METHOD(ack_of_ack)
         {
             int ret = ack_of_ack_test();
@@ -525,6 +720,13 @@ namespace UnitTest1
         {
             int ret = pacing_repeat_test();
 
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(pacing_offload)
+        {
+            int ret = pacing_offload_test();
+
             Assert::AreEqual(ret, 0);
         }
 
@@ -1152,6 +1354,13 @@ namespace UnitTest1
             Assert::AreEqual(ret, 0);
         }
 
+        TEST_METHOD(mtu_jumbo)
+        {
+            int ret = mtu_jumbo_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
         TEST_METHOD(mtu_drop_bbr)
         {
             int ret = mtu_drop_bbr_test();
@@ -2212,6 +2421,13 @@ namespace UnitTest1
             Assert::AreEqual(ret, 0);
         }
 
+        TEST_METHOD(flow_control_memory_cap)
+        {
+            int ret = flow_control_memory_cap_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
         TEST_METHOD(bbr)
         {
             int ret = bbr_test();
@@ -2463,6 +2679,18 @@ namespace UnitTest1
             Assert::AreEqual(ret, 0);
         }
 
+        TEST_METHOD(stream_buffer) {
+            int ret = stream_buffer_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(iovec_receive) {
+            int ret = iovec_receive_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
         TEST_METHOD(queue_network_input) {
             int ret = queue_network_input_test();
 
@@ -2551,6 +2779,36 @@ namespace UnitTest1
             Assert::AreEqual(ret, 0);
         }
 
+        TEST_METHOD(cnx_memory_budget) {
+            int ret = cnx_memory_budget_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(cnx_hibernate) {
+            int ret = cnx_hibernate_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(cnx_stress_workers) {
+            int ret = cnx_stress_workers_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(cnx_stress_wheel) {
+            int ret = cnx_stress_wheel_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
+        TEST_METHOD(cnx_handshake_rate) {
+            int ret = cnx_handshake_rate_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
         TEST_METHOD(cert_verify_bad_cert) {
             int ret = cert_verify_bad_cert_test();
 
@@ -3496,6 +3754,12 @@ namespace UnitTest1
             Assert::AreEqual(ret, 0);
         }
 
+        TEST_METHOD(quicperf_weighted) {
+            int ret = quicperf_weighted_test();
+
+            Assert::AreEqual(ret, 0);
+        }
+
         TEST_METHOD(grease_quic_bit_one_way) {
             int ret = grease_quic_bit_one_way_test();
 
@@ -282,6 +282,16 @@ char const* quicperf_parse_priority(char const* text, uint8_t* priority)
     return text;
 }
 
+char const* quicperf_parse_weight(char const* text, uint8_t* weight)
+{
+    uint64_t number = 0;
+
+    text = quicperf_parse_letter_number_param(text, 'w', 255, &number);
+    *weight = (uint8_t)number;
+
+    return text;
+}
+
 char const* quicperf_parse_client_server(char const* text, int * is_client_media)
 {
     if (*text == 'C') {
@@ -310,6 +320,10 @@ char const* quicperf_parse_media_desc(char const* text, quicperf_stream_desc_t*
         text = quicperf_parse_priority(quicperf_parse_stream_spaces(text), &desc->priority);
     }
 
+    if (text != NULL) {
+        text = quicperf_parse_weight(quicperf_parse_stream_spaces(text), &desc->weight);
+    }
+
     if (text != NULL) {
         text = quicperf_parse_client_server(quicperf_parse_stream_spaces(text), &desc->is_client_media);
     }
@@ -473,7 +487,13 @@ static void quicperf_stream_ctx_delete(void* tree, picosplay_node_t* node)
 }
 
 /* Parsing and formating of the stream header sent in client requests.
+ * Media requests with a stream weight use the mark 0xFFFFFFFC and
+ * carry the weight in an additional 17th byte.
  */
+static size_t quicperf_media_header_size(quicperf_stream_ctx_t* stream_ctx)
+{
+    return (stream_ctx->is_weighted) ? 17 : 16;
+}
 
 size_t quicperf_parse_request_header(picoquic_cnx_t * cnx, quicperf_stream_ctx_t* stream_ctx, uint8_t * bytes, size_t length)
 {
@@ -488,16 +508,17 @@ size_t quicperf_parse_request_header(picoquic_cnx_t * cnx, quicperf_stream_ctx_t
         /* check whether this is a media header */
         if (stream_ctx->nb_post_bytes == 8) {
             uint64_t high32 = stream_ctx->response_size >> 32;
-            if (high32 >= 0xFFFFFFFD && high32 < 0xFFFFFFFF) {
+            if (high32 >= 0xFFFFFFFC && high32 < 0xFFFFFFFF) {
                 stream_ctx->is_media = 1;
                 stream_ctx->is_datagram = ((high32 & 1) != 0);
+                stream_ctx->is_weighted = (high32 == 0xFFFFFFFC);
                 stream_ctx->frame_size = stream_ctx->response_size & 0xFFFFFFFF;
                 stream_ctx->response_size = 0;
             }
         }
     }
     /* If this is a media header, parse the next 8 bytes */
-    while (stream_ctx->is_media && stream_ctx->nb_post_bytes < 16) {
+    while (stream_ctx->is_media && stream_ctx->nb_post_bytes < quicperf_media_header_size(stream_ctx)) {
         uint8_t b = bytes[byte_index++];
         if (stream_ctx->nb_post_bytes == 8) {
             stream_ctx->priority = b;
@@ -516,9 +537,14 @@ size_t quicperf_parse_request_header(picoquic_cnx_t * cnx, quicperf_stream_ctx_t
         else if (stream_ctx->nb_post_bytes <= 12) {
             stream_ctx->nb_frames = (stream_ctx->nb_frames << 8) + b;
         }
-        else {
+        else if (stream_ctx->nb_post_bytes < 16) {
             stream_ctx->first_frame_size = (stream_ctx->first_frame_size << 8) + b;
         }
+        else {
+            stream_ctx->weight = b;
+            picoquic_set_weighted_scheduling(cnx, 1);
+            picoquic_set_stream_weight(cnx, stream_ctx->stream_id, stream_ctx->weight);
+        }
         stream_ctx->nb_post_bytes++;
     }
 
@@ -529,13 +555,15 @@ size_t quicperf_prepare_media_request_bytes(quicperf_stream_ctx_t* stream_ctx, u
 {
     size_t byte_index = 0;
 
-    if (stream_ctx->frame_bytes_sent < 16) {
-        uint8_t request[16];
+    size_t header_size = quicperf_media_header_size(stream_ctx);
+
+    if (stream_ctx->frame_bytes_sent < header_size) {
+        uint8_t request[17];
 
         request[0] = 0xff;
         request[1] = 0xff;
         request[2] = 0xff;
-        request[3] = (stream_ctx->is_datagram) ? 0xfd : 0xfe;
+        request[3] = (stream_ctx->is_weighted) ? 0xfc : ((stream_ctx->is_datagram) ? 0xfd : 0xfe);
         request[4] = (uint8_t)((stream_ctx->frame_size >> 24) & 0xff);
         request[5] = (uint8_t)((stream_ctx->frame_size >> 16) & 0xff);
         request[6] = (uint8_t)((stream_ctx->frame_size >> 8) & 0xff);
@@ -548,8 +576,9 @@ size_t quicperf_prepare_media_request_bytes(quicperf_stream_ctx_t* stream_ctx, u
         request[13] = (uint8_t)((stream_ctx->first_frame_size >> 16) & 0xff);
         request[14] = (uint8_t)((stream_ctx->first_frame_size >> 8) & 0xff);
         request[15] = (uint8_t)(stream_ctx->first_frame_size & 0xff);
+        request[16] = stream_ctx->weight;
 
-        while (stream_ctx->frame_bytes_sent < 16 && byte_index < available) {
+        while (stream_ctx->frame_bytes_sent < header_size && byte_index < available) {
             buffer[byte_index] = request[stream_ctx->frame_bytes_sent];
             stream_ctx->frame_bytes_sent++;
             byte_index++;
@@ -690,6 +719,10 @@ quicperf_stream_ctx_t* quicperf_request_media_stream_from_scenario(picoquic_cnx_
         stream_ctx->frequency = stream_desc->frequency;
         stream_ctx->is_media = 1;
         stream_ctx->is_datagram = (stream_desc->media_type == quicperf_media_datagram);
+        if (!stream_ctx->is_datagram && stream_desc->weight != 0) {
+            stream_ctx->weight = stream_desc->weight;
+            stream_ctx->is_weighted = 1;
+        }
         stream_ctx->start_time = desc_start_time;
         if (stream_desc->reset_delay > 0) {
             stream_ctx->reset_delay = stream_desc->reset_delay;
@@ -1147,7 +1180,7 @@ int quicperf_receive_data_from_client(picoquic_cnx_t* cnx, quicperf_stream_ctx_t
     stream_ctx->nb_post_bytes += (length - byte_index);
 
     if (fin_or_event == picoquic_callback_stream_fin) {
-        if (stream_ctx->nb_post_bytes < 8 || (stream_ctx->is_media && stream_ctx->nb_post_bytes < 16)) {
+        if (stream_ctx->nb_post_bytes < 8 || (stream_ctx->is_media && stream_ctx->nb_post_bytes < quicperf_media_header_size(stream_ctx))) {
             stream_ctx->response_size = 0;
             stream_ctx->is_media = 0;
             stream_ctx->is_datagram = 0;
@@ -1364,7 +1397,7 @@ int quicperf_prepare_media_request(picoquic_cnx_t* cnx, quicperf_stream_ctx_t* s
 {
 
     int ret = 0;
-    size_t send_limit = 16;
+    size_t send_limit = quicperf_media_header_size(stream_ctx);
     size_t available = length;
     int is_fin = 0;
     uint8_t* buffer;
@@ -61,6 +61,7 @@ typedef struct st_quicperf_stream_desc_t {
     uint8_t priority;
     int is_infinite; /* Set if the response size was set to "-xxx" */
     int is_client_media;
+    uint8_t weight; /* If not zero, request weighted scheduling of the media stream */
 } quicperf_stream_desc_t;
 
 typedef struct st_quicperf_stream_report_t {
@@ -105,6 +106,7 @@ typedef struct st_quicperf_stream_ctx {
 
     uint8_t priority;
     uint8_t frequency;
+    uint8_t weight;
     /* Variables for receiving media */
     uint64_t nb_frames_received;
     uint64_t frames_bytes_received;
@@ -114,6 +116,7 @@ typedef struct st_quicperf_stream_ctx {
     /* Flags */
     unsigned int is_media : 1;
     unsigned int is_datagram : 1;
+    unsigned int is_weighted : 1; /* Media request header carries a stream weight */
     unsigned int is_activated : 1;
     unsigned int stop_for_fin : 1;
     unsigned int is_stopped : 1;
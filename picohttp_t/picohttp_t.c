@@ -113,6 +113,7 @@ static const picoquic_test_def_t test_table[] = {
     { "quicperf_media", quicperf_media_test },
     { "quicperf_multi", quicperf_multi_test },
     { "quicperf_overflow", quicperf_overflow_test },
+    { "quicperf_weighted", quicperf_weighted_test },
     { "cc_compete_cubic2", cc_compete_cubic2_test },
     { "cc_compete_prague2", cc_compete_prague2_test },
     { "cc_compete_c4c4", cc_compete_c4c4_test },
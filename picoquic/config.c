@@ -347,7 +347,7 @@ static int config_set_option(option_table_line_t* option_desc, option_param_t* p
         break;
     case picoquic_option_MTU_MAX:
         config->mtu_max = config_atoi(params, nb_params, 0, &ret);
-        if (config->mtu_max <= 0 || config->mtu_max > PICOQUIC_MAX_PACKET_SIZE) {
+        if (config->mtu_max <= 0 || config->mtu_max > PICOQUIC_MAX_PACKET_SIZE_LIMIT) {
             fprintf(stderr, "Invalid max mtu: %s\n", config_optval_param_string(opval_buffer, 256, params, nb_params, 0));
             ret = -1;
         }
@@ -861,6 +861,10 @@ picoquic_quic_t* picoquic_create_and_configure(picoquic_quic_config_t* config,
         }
 
         if (config->mtu_max > 0) {
+            if (config->mtu_max > PICOQUIC_MAX_PACKET_SIZE &&
+                picoquic_set_max_packet_size(quic, config->mtu_max) != 0) {
+                fprintf(stderr, "Could not set max packet size to %d.\n", config->mtu_max);
+            }
             picoquic_set_mtu_max(quic, config->mtu_max);
         }
 
@@ -116,6 +116,7 @@ char const* picoquic_error_name(uint64_t error_code)
     case PICOQUIC_ERROR_PATH_NOT_READY: e_name = "path not ready"; break;
     case PICOQUIC_ERROR_PATH_LIMIT_EXCEEDED: e_name = "path limit exceeded"; break;
     case PICOQUIC_ERROR_REDIRECTED: e_name = "redirected to proxy (not an error)"; break; /* Not an error: the packet was captured by a proxy, no further processing needed */
+    case PICOQUIC_ERROR_NETWORK_QUEUE_FULL: e_name = "network thread queue full"; break;
 
     default:
         if (error_code > 0x100 && error_code < 0x200) {
@@ -141,8 +141,11 @@ int picoquic_delete_stream_if_closed(picoquic_cnx_t* cnx, picoquic_stream_head_t
         ret = 1;
     }
     
-    /* We only delete the stream if there are no pending retransmissions */
-    if (stream->is_closed && picoquic_is_stream_acked(stream)) {
+    /* We only delete the stream if there are no pending retransmissions,
+     * and no data segments held by the application */
+    if (stream->is_closed && picoquic_is_stream_acked(stream) &&
+        (stream->iovec_receive_fn == NULL ||
+        (!stream->is_iovec_delivering && picosplay_first(&stream->stream_data_tree) == NULL))) {
         picoquic_delete_stream(cnx, stream);
     }
 
@@ -175,6 +178,7 @@ void picoquic_update_stream_initial_remote(picoquic_cnx_t* cnx)
                 stream->maxdata_remote = cnx->remote_parameters.initial_max_stream_data_bidi_local;
             }
         }
+        picoquic_update_output_stream(cnx, stream);
         stream = picoquic_next_stream(stream);
     };
 }
@@ -261,10 +265,7 @@ void picoquic_enforce_reset_stream_frame(picoquic_cnx_t* cnx, picoquic_stream_he
         picoquic_stream_queue_node_t* not_needed = next;
         next = next->next_stream_data;
 
-        if (not_needed->bytes != NULL) {
-            free(not_needed->bytes);
-        }
-        free(not_needed);
+        picoquic_stream_queue_node_free(stream, not_needed);
     }
     /* reset the queue pointer */
     if (previous == NULL) {
@@ -273,6 +274,10 @@ void picoquic_enforce_reset_stream_frame(picoquic_cnx_t* cnx, picoquic_stream_he
     else {
         previous->next_stream_data = NULL;
     }
+    /* Data already sent is repeated from the packet copies if needed,
+     * the application buffers can be released */
+    picoquic_release_sent_stream_buffers(stream);
+    picoquic_update_output_stream(cnx, stream);
 }
 
 uint8_t* picoquic_format_reset_stream_frame(picoquic_cnx_t* cnx, picoquic_stream_head_t* stream,
@@ -343,7 +348,7 @@ const uint8_t * picoquic_apply_reset_stream_frame(picoquic_cnx_t* cnx, const uin
         stream->reset_offset = reliable_size;
         stream->remote_error = error_code_64;
 
-        if (stream->consumed_offset >= stream->reset_offset) {
+        if (((stream->iovec_receive_fn == NULL) ? stream->consumed_offset : stream->delivered_offset) >= stream->reset_offset) {
             picoquic_signal_stream_reset(cnx, stream);
         }
     }
@@ -1087,6 +1092,7 @@ uint8_t* picoquic_format_stop_sending_frame(picoquic_stream_head_t* stream,
             *more_data = 1;
         }
     }
+    picoquic_update_output_stream(stream->cnx, stream);
 
     return bytes;
 }
@@ -1284,6 +1290,85 @@ void picoquic_stream_data_callback(picoquic_cnx_t* cnx, picoquic_stream_head_t*
     picoquic_stream_data_chunk_callback(cnx, stream, NULL, 0);
 }
 
+/* Scatter-gather delivery. The data nodes that are contiguous from the
+ * delivered offset are passed to the application as a single array of
+ * segments. The nodes remain in the stream data tree until the application
+ * releases them, and the consumed offset and the flow control credit only
+ * advance on release. Returns 1 if the stream was deleted, because the
+ * application released the last segments of a closed stream.
+ */
+int picoquic_stream_iovec_callback(picoquic_cnx_t* cnx, picoquic_stream_head_t* stream)
+{
+    int is_deleted = 0;
+    int more_data = 1;
+    uint64_t stream_id = stream->stream_id;
+
+    /* Deletion is deferred until the callbacks return */
+    stream->is_iovec_delivering = 1;
+
+    while (more_data) {
+        picoquic_iovec_t iov[PICOQUIC_STREAM_IOVEC_MAX];
+        size_t nb_iov = 0;
+        uint64_t offset = stream->delivered_offset;
+        int fin = 0;
+        picoquic_stream_data_node_t target;
+        picoquic_stream_data_node_t* data;
+
+        memset(&target, 0, offsetof(struct st_picoquic_stream_data_node_t, data));
+        target.offset = stream->delivered_offset;
+        data = (picoquic_stream_data_node_t*)picosplay_find_previous(&stream->stream_data_tree, &target);
+        if (data == NULL) {
+            data = (picoquic_stream_data_node_t*)picosplay_first(&stream->stream_data_tree);
+        }
+
+        more_data = 0;
+        while (data != NULL && data->offset <= stream->delivered_offset) {
+            if (data->offset + data->length > stream->delivered_offset) {
+                size_t start = (size_t)(stream->delivered_offset - data->offset);
+
+                if (nb_iov >= PICOQUIC_STREAM_IOVEC_MAX) {
+                    more_data = 1;
+                    break;
+                }
+                iov[nb_iov].bytes = data->bytes + start;
+                iov[nb_iov].length = data->length - start;
+                stream->delivered_offset += iov[nb_iov].length;
+                nb_iov++;
+            }
+            data = (picoquic_stream_data_node_t*)picosplay_next(&data->stream_data_node);
+        }
+
+        if (stream->reset_received && !stream->reset_signalled && stream->delivered_offset >= stream->reset_offset) {
+            picoquic_signal_stream_reset(cnx, stream);
+            break;
+        }
+        if (stream->delivered_offset >= stream->fin_offset && stream->fin_received && !stream->fin_signalled && !more_data) {
+            fin = 1;
+            stream->fin_signalled = 1;
+        }
+        if ((nb_iov > 0 || fin) && !stream->stop_sending_requested && !stream->is_discarded) {
+            int ret = stream->iovec_receive_fn(cnx, stream->stream_id, fin, iov, nb_iov, offset, stream->iovec_receive_ctx);
+            if (ret != 0) {
+                uint64_t err = (ret >= PICOQUIC_ERROR_CLASS) ? PICOQUIC_TRANSPORT_INTERNAL_ERROR : (uint64_t)ret;
+                picoquic_log_app_message(cnx, "Iovec callback (l=%zu) on stream %" PRIu64 " returns error 0x%x",
+                    nb_iov, stream->stream_id, ret);
+                picoquic_connection_error(cnx, err, 0);
+                break;
+            }
+        }
+    }
+
+    stream->is_iovec_delivering = 0;
+
+    /* The application may have released the last segments from within the callback */
+    if (stream->fin_signalled || stream->reset_signalled) {
+        (void)picoquic_delete_stream_if_closed(cnx, stream);
+        is_deleted = (picoquic_find_stream(cnx, stream_id) == NULL);
+    }
+
+    return is_deleted;
+}
+
 static int add_chunk_node(picoquic_quic_t * quic, picosplay_tree_t* tree, uint64_t offset,
     size_t length, int is_last_frame, 
     const uint8_t* bytes, int* chunk_added, picoquic_stream_data_node_t * received_data)
@@ -1291,9 +1376,12 @@ static int add_chunk_node(picoquic_quic_t * quic, picosplay_tree_t* tree, uint64
     int ret = 0;
 
     picoquic_stream_data_node_t* node = received_data;
-    
-    if (received_data == NULL || received_data->bytes != NULL || !is_last_frame) {
-        node = picoquic_stream_data_node_alloc(quic);
+
+    /* Small chunks are copied in a node of the matching size class, instead
+     * of holding the full buffer of the received packet. */
+    if (received_data == NULL || received_data->bytes != NULL || !is_last_frame ||
+        length <= PICOQUIC_DATA_NODE_COPY_MAX) {
+        node = picoquic_stream_data_node_alloc_ex(quic, length);
         if (node == NULL) {
             ret = PICOQUIC_ERROR_MEMORY;
         }
@@ -1315,6 +1403,7 @@ static int add_chunk_node(picoquic_quic_t * quic, picosplay_tree_t* tree, uint64
 
     if (node != NULL){
         picosplay_insert(tree, node);
+        picoquic_stream_data_node_charge(tree, node);
         *chunk_added = 1;
     }
 
@@ -1339,7 +1428,7 @@ int picoquic_queue_network_input(picoquic_quic_t * quic, picosplay_tree_t* tree,
     if (frame_data_offset < input_end) {
 
         picoquic_stream_data_node_t target;
-        memset(&target, 0, sizeof(picoquic_stream_data_node_t));
+        memset(&target, 0, offsetof(struct st_picoquic_stream_data_node_t, data));
         target.offset = frame_data_offset;
 
         picoquic_stream_data_node_t* prev = (picoquic_stream_data_node_t*)picosplay_find_previous(tree, &target);
@@ -1388,6 +1477,7 @@ static int picoquic_stream_network_input(picoquic_cnx_t* cnx, uint64_t stream_id
     picoquic_stream_data_node_t* received_data, int is_last_frame, uint64_t current_time)
 {
     int ret = 0;
+    int is_iovec_deleted = 0;
     uint64_t should_notify = 0;
     /* Is there such a stream, is it still open? */
     picoquic_stream_head_t* stream;
@@ -1435,6 +1525,23 @@ static int picoquic_stream_network_input(picoquic_cnx_t* cnx, uint64_t stream_id
                 uint64_t err = (ret >= PICOQUIC_ERROR_CLASS) ? PICOQUIC_TRANSPORT_INTERNAL_ERROR : (uint64_t)ret;
                 ret = picoquic_connection_error(cnx, err, 0);
             }
+        } else if (stream->iovec_receive_fn != NULL) {
+            /* Data is always queued, so the segments remain valid until released */
+            int new_data_available = 0;
+
+            ret = picoquic_queue_network_input(cnx->quic, &stream->stream_data_tree, stream->delivered_offset,
+                offset, bytes, length, is_last_frame, received_data, &new_data_available);
+            if (ret != 0) {
+                ret = picoquic_connection_error(cnx, (int64_t)ret, 0);
+            }
+            else {
+                if (new_data_available) {
+                    cnx->latest_receive_time = current_time;
+                }
+                if (new_data_available || should_notify) {
+                    is_iovec_deleted = picoquic_stream_iovec_callback(cnx, stream);
+                }
+            }
         } else if (stream->consumed_offset >= offset &&  cnx->callback_fn != NULL){
             if (new_fin_offset >= stream->consumed_offset) {
                 /* Arrival of in sequence bytes */
@@ -1472,7 +1579,7 @@ static int picoquic_stream_network_input(picoquic_cnx_t* cnx, uint64_t stream_id
     /* Either the direct receive or the data queueing can set the "fin_signalled" bit when all data expected
      * on the stream has been received. The stream can be closed when all data is sent and received */
 
-    if (ret == 0) {
+    if (ret == 0 && !is_iovec_deleted) {
         int is_deleted = 0;
 
         if (stream->fin_signalled) {
@@ -1537,105 +1644,235 @@ const uint8_t* picoquic_decode_stream_frame(picoquic_cnx_t* cnx, const uint8_t*
     return bytes;
 }
 
-picoquic_stream_head_t* picoquic_find_ready_stream_path(picoquic_cnx_t* cnx, picoquic_path_t * path_x, int is_coalesced)
+/* The queues of output streams are updated when the state of streams changes.
+ * The state is verified again for the streams examined by the sender, in
+ * case a change was not signalled. */
+static int picoquic_is_stream_in_queue(picoquic_cnx_t* cnx, picoquic_stream_head_t* stream,
+    picoquic_stream_level_t* level, picoquic_stream_queue_t* queue)
 {
-    picoquic_stream_head_t* first_stream = cnx->first_output_stream;
-    picoquic_stream_head_t* stream = first_stream;
-    picoquic_stream_head_t* found_stream = NULL;
+    if (stream->stream_priority == level->stream_priority) {
+        picoquic_update_output_stream(cnx, stream);
+    }
+    return stream->output_queue == queue;
+}
 
+static int picoquic_stream_has_data_to_send(picoquic_stream_head_t* stream)
+{
+    return (stream->is_active ||
+        (stream->send_queue != NULL && stream->send_queue->length > stream->send_queue->offset) ||
+        (stream->fin_requested && !stream->fin_sent));
+}
 
-    /* Look for a ready stream */
-    while (stream != NULL) {
-        int has_data = 0;
-        picoquic_stream_head_t* next_stream = stream->next_output_stream;
+/* Check that a stream with data to send can be used on the specified path,
+ * and in the packet being prepared */
+static int picoquic_stream_can_send_data(picoquic_cnx_t* cnx, picoquic_stream_head_t* stream,
+    picoquic_path_t* path_x, int is_coalesced)
+{
+    int can_send = 1;
 
-        if (next_stream != NULL && is_coalesced && next_stream->is_not_coalesced) {
-            stream = next_stream->next_output_stream;
-            continue;
-        }
+    if (is_coalesced && stream->is_not_coalesced) {
+        /* Data of this stream shall not be mixed with other data in the same packet */
+        can_send = 0;
+    }
+    else if (path_x != NULL && stream->affinity_path != path_x && stream->affinity_path != NULL) {
+        /* Only consider the streams that meet path affinity requirements */
+        can_send = 0;
+    }
+    else if (stream->sent_offset == 0 && IS_CLIENT_STREAM_ID(stream->stream_id) == cnx->client_mode &&
+        stream->stream_id > ((IS_BIDIR_STREAM_ID(stream->stream_id)) ? cnx->max_stream_id_bidir_remote : cnx->max_stream_id_unidir_remote)) {
+        /* The stream is not yet allowed by the peer */
+        can_send = 0;
+    }
 
-        if (found_stream != NULL && stream->stream_priority > found_stream->stream_priority) {
-            /* All the streams at that priority level have been examined,
-             * the current selection is validated */
-            break;
-        }
+    return can_send;
+}
 
-        /* The tests for "have data" should excatly replicate the tests in
-         * the formating of a stream frame */
-        if (stream->stop_sending_requested && !stream->stop_sending_sent) {
-            /* will send a stop sending frame.
-            * this takes precedence over FIFO vs round-robin processing */
-            found_stream = stream;
-            has_data = 1;
-            break;
-        }
-        else if (stream->reset_sent) {
-            /* No data will be sent after a reset */
-            has_data = 0;
+/* Order of service: by stream ID in FIFO levels, by last time data was sent
+ * and then stream ID in round robin levels. */
+static int picoquic_stream_goes_before(picoquic_stream_head_t* stream, picoquic_stream_head_t* other, int is_fifo)
+{
+    return (!is_fifo && stream->last_time_data_sent != other->last_time_data_sent) ?
+        (stream->last_time_data_sent < other->last_time_data_sent) : (stream->stream_id < other->stream_id);
+}
+
+/* Weighted scheduling of a round robin level, by deficit round robin.
+ * The stream at the head of the ready queue keeps its turn as long as it
+ * has a positive deficit. When the deficit is exhausted, the stream moves
+ * to the end of the queue, and the next stream receives a quantum of bytes
+ * proportional to its weight. The deficit is debited of the bytes actually
+ * sent, and may go negative if the last frame was larger than the credit.
+ * Returns the first stream of the queue that can send, or NULL. */
+static picoquic_stream_head_t* picoquic_find_weighted_stream_in_level(picoquic_cnx_t* cnx,
+    picoquic_stream_level_t* level, picoquic_path_t* path_x, int is_coalesced)
+{
+    picoquic_stream_head_t* stream;
+
+    while ((stream = level->ready.first) != NULL) {
+        if (picoquic_is_stream_in_queue(cnx, stream, level, &level->ready)) {
+            if (stream->stream_deficit > 0) {
+                break;
+            }
+            picoquic_stream_queue_rotate(&level->ready);
+            stream = level->ready.first;
+            stream->stream_deficit += (int64_t)stream->stream_weight * PICOQUIC_STREAM_WEIGHT_QUANTUM;
         }
-        else if (stream->reset_requested && 
-            (stream->reliable_size == 0 || picoquic_check_sack_list(&stream->sack_list, 0, stream->reliable_size))) {
-            /* will queue a reset frame --
-            * this takes precedence over FIFO vs round-robin processing */
-            found_stream = stream;
-            has_data = 1;
+    }
+
+    while (stream != NULL) {
+        picoquic_stream_head_t* next_stream = stream->next_queued_stream;
+
+        if (picoquic_is_stream_in_queue(cnx, stream, level, &level->ready) &&
+            picoquic_stream_can_send_data(cnx, stream, path_x, is_coalesced)) {
             break;
         }
-        else if (cnx->maxdata_remote > cnx->data_sent && stream->sent_offset < stream->maxdata_remote && (stream->is_active ||
-            (stream->send_queue != NULL && stream->send_queue->length > stream->send_queue->offset) ||
-            (stream->fin_requested && !stream->fin_sent))) {
-            has_data = 1;
-        }
-        else {
-            has_data = 0;
+        stream = next_stream;
+    }
+
+    return stream;
+}
+
+/* Find the stream that shall send next at a given priority level, or NULL.
+ * The selection and the setting of the blocked flags replicate the linear
+ * scan of the output streams at that level. */
+static picoquic_stream_head_t* picoquic_find_ready_stream_in_level(picoquic_cnx_t* cnx,
+    picoquic_stream_level_t* level, picoquic_path_t* path_x, int is_coalesced)
+{
+    int is_fifo = (level->stream_priority & 1) != 0;
+    int has_credit = cnx->maxdata_remote > cnx->data_sent;
+    picoquic_stream_head_t* control_stream = NULL;
+    picoquic_stream_head_t* data_stream = NULL;
+    picoquic_stream_head_t* found_stream = NULL;
+    picoquic_stream_head_t* stream_blocked_first = NULL;
+    picoquic_stream_head_t* flow_blocked_first = NULL;
+    picoquic_stream_head_t* stream = level->control.first;
+    picoquic_stream_head_t* next_stream;
+    uint64_t scan_limit = UINT64_MAX;
+
+    /* Pending stop sending or reset frames take precedence over FIFO vs round-robin processing */
+    while (stream != NULL && control_stream == NULL) {
+        next_stream = stream->next_queued_stream;
+        if (!picoquic_is_stream_in_queue(cnx, stream, level, &level->control) ||
+            (is_coalesced && stream->is_not_coalesced)) {
+            /* Not a candidate */
+        }
+        else if ((stream->stop_sending_requested && !stream->stop_sending_sent) ||
+            stream->reliable_size == 0 || picoquic_check_sack_list(&stream->sack_list, 0, stream->reliable_size)) {
+            control_stream = stream;
+        }
+        else if (has_credit && stream->sent_offset < stream->maxdata_remote && picoquic_stream_has_data_to_send(stream)) {
+            /* The reset waits until the reliable part of the stream is delivered */
+            if (picoquic_stream_can_send_data(cnx, stream, path_x, is_coalesced) &&
+                (data_stream == NULL || picoquic_stream_goes_before(stream, data_stream, is_fifo))) {
+                data_stream = stream;
+            }
+        }
+        else if (stream->is_active ||
+            (stream->send_queue != NULL && stream->send_queue->length > stream->send_queue->offset)) {
+            /* Blocked by flow control */
+            if (stream->sent_offset >= stream->maxdata_remote) {
+                if (stream_blocked_first == NULL) {
+                    stream_blocked_first = stream;
+                }
+            }
+            else if (flow_blocked_first == NULL) {
+                flow_blocked_first = stream;
+            }
         }
+        stream = next_stream;
+    }
 
-        /* implement affinity scheduling */
-        if (has_data && path_x != NULL && stream->affinity_path != path_x && stream->affinity_path != NULL) {
-            /* Only consider the streams that meet path affinity requirements */
-            has_data = 0;
+    if (has_credit && !is_fifo && cnx->is_weighted_scheduling) {
+        stream = picoquic_find_weighted_stream_in_level(cnx, level, path_x, is_coalesced);
+        if (stream != NULL && (data_stream == NULL || picoquic_stream_goes_before(stream, data_stream, is_fifo))) {
+            data_stream = stream;
         }
-        
-        if (has_data) {
-            /* Check that this stream is actually available for sending data */
-            if (stream->sent_offset == 0) {
-                if (IS_CLIENT_STREAM_ID(stream->stream_id) == cnx->client_mode) {
-                    if (stream->stream_id > ((IS_BIDIR_STREAM_ID(stream->stream_id)) ? cnx->max_stream_id_bidir_remote : cnx->max_stream_id_unidir_remote)) {
-                        has_data = 0;
-                    }
-                }
+    }
+    else if (has_credit) {
+        /* The ready queue is in order of service, the first stream that can send is selected. */
+        stream = level->ready.first;
+        while (stream != NULL) {
+            next_stream = stream->next_queued_stream;
+            if (is_fifo && control_stream != NULL && stream->stream_id > control_stream->stream_id) {
+                break;
             }
-            if (has_data) {
-                /* Something can be sent */
-                if ((stream->stream_priority & 1) != 0) {
-                    /* This priority level requests FIFO processing, so we return the first available stream */
-                    found_stream = stream;
-                    break;
-                }
-                else if (found_stream == NULL || stream->last_time_data_sent < found_stream->last_time_data_sent) {
-                    /* Select this stream, but need to check if another stream should go before in round robin order */
-                    found_stream = stream;
+            if (picoquic_is_stream_in_queue(cnx, stream, level, &level->ready) &&
+                picoquic_stream_can_send_data(cnx, stream, path_x, is_coalesced)) {
+                if (data_stream == NULL || picoquic_stream_goes_before(stream, data_stream, is_fifo)) {
+                    data_stream = stream;
                 }
+                break;
             }
+            stream = next_stream;
         }
-        else if (((stream->fin_requested && stream->fin_sent) || (stream->reset_requested && stream->reset_sent)) && (!stream->stop_sending_requested || stream->stop_sending_sent)) {
-            /* If stream is exhausted, remove from output list */
-            picoquic_remove_output_stream(cnx, stream);
+    }
 
-            picoquic_delete_stream_if_closed(cnx, stream);
+    if (control_stream != NULL && (!is_fifo || data_stream == NULL || control_stream->stream_id < data_stream->stream_id)) {
+        found_stream = control_stream;
+        scan_limit = control_stream->stream_id;
+    }
+    else if (data_stream != NULL) {
+        found_stream = data_stream;
+        if (is_fifo) {
+            scan_limit = data_stream->stream_id;
         }
-        else {
-            if (stream->is_active ||
-                (stream->send_queue != NULL && stream->send_queue->length > stream->send_queue->offset)) {
-                if (stream->sent_offset >= stream->maxdata_remote) {
-                    cnx->stream_blocked = 1;
-                }
-                else if (cnx->maxdata_remote <= cnx->data_sent) {
-                    cnx->flow_blocked = 1;
-                }
+    }
+
+    /* Signal the blocked streams that the linear scan would have examined before finding a stream */
+    if (stream_blocked_first != NULL && stream_blocked_first->stream_id < scan_limit) {
+        cnx->stream_blocked = 1;
+    }
+    if (flow_blocked_first != NULL && flow_blocked_first->stream_id < scan_limit) {
+        cnx->flow_blocked = 1;
+    }
+    stream = level->blocked.first;
+    while (stream != NULL && stream->stream_id < scan_limit) {
+        if (stream->is_active || (stream->send_queue != NULL && stream->send_queue->length > stream->send_queue->offset)) {
+            cnx->stream_blocked = 1;
+            break;
+        }
+        stream = stream->next_queued_stream;
+    }
+    if (!has_credit) {
+        stream = level->ready.first;
+        while (stream != NULL && (!is_fifo || stream->stream_id < scan_limit)) {
+            if (stream->stream_id < scan_limit && (stream->is_active ||
+                (stream->send_queue != NULL && stream->send_queue->length > stream->send_queue->offset))) {
+                cnx->flow_blocked = 1;
+                break;
             }
+            stream = stream->next_queued_stream;
         }
-        stream = next_stream;
+    }
+
+    return found_stream;
+}
+
+/* Find the next stream to send, at the most urgent priority level for which
+ * a stream is ready. The output streams are queued per priority level, so
+ * that the cost of the search does not depend on the number of idle streams
+ * or of streams blocked by flow control.
+ */
+picoquic_stream_head_t* picoquic_find_ready_stream_path(picoquic_cnx_t* cnx, picoquic_path_t * path_x, int is_coalesced)
+{
+    picoquic_stream_head_t* found_stream = NULL;
+    picoquic_stream_head_t* stream;
+    picoquic_stream_level_t* level;
+
+    /* If stream is exhausted, remove from output list */
+    while ((stream = cnx->exhausted_streams.first) != NULL) {
+        picoquic_update_output_stream(cnx, stream);
+        if (stream->output_queue == &cnx->exhausted_streams) {
+            picoquic_remove_output_stream(cnx, stream);
+            picoquic_delete_stream_if_closed(cnx, stream);
+        }
+    }
+    level = cnx->first_stream_level;
+
+    while (level != NULL && found_stream == NULL) {
+        picoquic_stream_level_t* next_level = level->next_level;
+
+        found_stream = picoquic_find_ready_stream_in_level(cnx, level, path_x, is_coalesced);
+        level = next_level;
     }
 
     return found_stream;
@@ -1949,6 +2186,7 @@ uint8_t * picoquic_format_stream_frame(picoquic_cnx_t* cnx, picoquic_stream_head
                     bytes = bytes0 + stream_data_context.byte_index + stream_data_context.length;
                     stream->sent_offset += stream_data_context.length;
                     stream->last_time_data_sent = picoquic_get_quic_time(cnx->quic);
+                    stream->stream_deficit -= (int64_t)stream_data_context.length;
                     cnx->data_sent += stream_data_context.length;
 
                     if (stream_data_context.length > 0) {
@@ -2009,14 +2247,12 @@ uint8_t * picoquic_format_stream_frame(picoquic_cnx_t* cnx, picoquic_stream_head
 
                     stream->send_queue->offset += length;
                     if (stream->send_queue->offset >= stream->send_queue->length) {
-                        picoquic_stream_queue_node_t* next = stream->send_queue->next_stream_data;
-                        free(stream->send_queue->bytes);
-                        free(stream->send_queue);
-                        stream->send_queue = next;
+                        picoquic_stream_queue_node_sent(stream);
                     }
 
                     stream->sent_offset += length;
                     stream->last_time_data_sent = picoquic_get_quic_time(cnx->quic);
+                    stream->stream_deficit -= (int64_t)length;
                     cnx->data_sent += length;
                 }
 
@@ -2040,6 +2276,8 @@ uint8_t * picoquic_format_stream_frame(picoquic_cnx_t* cnx, picoquic_stream_head
             }
         }
 
+        picoquic_update_output_stream(cnx, stream);
+
         if (*ret == 0) {
             *is_pure_ack &= (bytes == bytes0);
 
@@ -2158,6 +2396,7 @@ void picoquic_queue_data_repeat_delete(void* tree, picosplay_node_t* node)
     picoquic_cnx_t * cnx = (picoquic_cnx_t *)((void *)((char*)tree - offsetof(struct st_picoquic_cnx_t, queue_data_repeat_tree)));
 
     packet->is_queued_for_data_repeat = 0;
+    picoquic_update_packet_memory(cnx, packet);
     if (!packet->is_queued_for_spurious_detection) {
         picoquic_recycle_packet(cnx->quic, packet);
     }
@@ -2241,6 +2480,7 @@ void picoquic_queue_data_repeat_packet(
             packet->data_repeat_frame < packet->length) {
             picosplay_insert(&cnx->queue_data_repeat_tree, packet);
             packet->is_queued_for_data_repeat = 1;
+            picoquic_update_packet_memory(cnx, packet);
         }
     }
 }
@@ -2428,6 +2668,7 @@ uint8_t* picoquic_copy_single_stream_frame_for_retransmit(picoquic_cnx_t* cnx, p
         packet->is_queued_for_spurious_detection = was_queued;
         (void)picosplay_insert(&cnx->queue_data_repeat_tree, packet);
         packet->is_queued_for_data_repeat = 1;
+        picoquic_update_packet_memory(cnx, packet);
         *more_data |= 1;
     }
     else {
@@ -2663,10 +2904,7 @@ uint8_t* picoquic_format_crypto_hs_frame(picoquic_stream_head_t* stream, uint8_t
 
                     stream->send_queue->offset += length;
                     if (stream->send_queue->offset >= stream->send_queue->length) {
-                        picoquic_stream_queue_node_t* next = stream->send_queue->next_stream_data;
-                        free(stream->send_queue->bytes);
-                        free(stream->send_queue);
-                        stream->send_queue = next;
+                        picoquic_stream_queue_node_sent(stream);
                     }
 
                     stream->sent_offset += length;
@@ -3675,6 +3913,10 @@ int picoquic_process_ack_of_stream_frame(picoquic_cnx_t* cnx, uint8_t* bytes,
             (void)picoquic_update_sack_list(&stream->sack_list,
                 offset, offset + data_length - ((fin) ? 0 : 1), 0);
 
+            if (stream->sent_buffers_first != NULL) {
+                picoquic_release_acked_stream_buffers(stream);
+            }
+
             picoquic_delete_stream_if_closed(cnx, stream);
         }
     }
@@ -4069,7 +4311,7 @@ uint8_t* picoquic_format_ack_frame_in_context(picoquic_cnx_t* cnx, uint8_t* byte
     /* Check that there something to acknowledge */
     int not_needed = picoquic_sack_list_is_empty(&ack_ctx->sack_list);
     if (!not_needed && !ack_ctx->act[is_opportunistic].ack_needed &&
-        ack_ctx->sack_list.ack_tree.size == 1) {
+        picoquic_sack_list_size(&ack_ctx->sack_list) == 1) {
         picoquic_sack_item_t* last_sack = picoquic_sack_last_item(&ack_ctx->sack_list);
         not_needed = (last_sack->nb_times_sent[is_opportunistic] >= PICOQUIC_MAX_ACK_RANGE_REPEAT);
     }
@@ -4108,7 +4350,7 @@ uint8_t* picoquic_format_ack_frame_in_context(picoquic_cnx_t* cnx, uint8_t* byte
             /* Implement adaptive tuning of lowest repeat range */
             int nb_sent_max_acked = 0;
             int nb_sent_max_skip = 0;
-            picoquic_sack_item_t* next_sack = picoquic_sack_previous_item(last_sack);
+            picoquic_sack_item_t* next_sack = picoquic_sack_previous_item(&ack_ctx->sack_list, last_sack);
 
             /* Update send count for the top range */
             picoquic_sack_item_record_sent(&ack_ctx->sack_list, last_sack, is_opportunistic);
@@ -4145,7 +4387,7 @@ uint8_t* picoquic_format_ack_frame_in_context(picoquic_cnx_t* cnx, uint8_t* byte
                         }
                     }
                 }
-                next_sack = picoquic_sack_previous_item(next_sack);
+                next_sack = picoquic_sack_previous_item(&ack_ctx->sack_list, next_sack);
             }
             /* When numbers are lower than 64, varint encoding fits on one byte */
             *num_block_byte = (uint8_t)num_block;
@@ -4210,7 +4452,7 @@ uint8_t * picoquic_format_ack_frame(picoquic_cnx_t* cnx, uint8_t* bytes, uint8_t
                 /* Adding test to verify that we do not send too many acks after demotion. */
                 if (cnx->path[path_id]->path_is_demoted &&
                     !ack_ctx->act[is_opportunistic].ack_needed &&
-                    ack_ctx->sack_list.ack_tree.size == 1) {
+                    picoquic_sack_list_size(&ack_ctx->sack_list) == 1) {
                     picoquic_sack_item_t* last_sack = picoquic_sack_last_item(&ack_ctx->sack_list);
                     if (last_sack->nb_times_sent[is_opportunistic] >= PICOQUIC_MIN_ACK_RANGE_REPEAT) {
                         continue;
@@ -4552,6 +4794,7 @@ const uint8_t* picoquic_decode_max_stream_data_frame(picoquic_cnx_t* cnx, const
         if (maxdata > cnx->max_stream_data_remote) {
             cnx->max_stream_data_remote = maxdata;
         }
+        picoquic_update_output_stream(cnx, stream);
     }
 
 
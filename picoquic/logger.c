@@ -2461,6 +2461,21 @@ static void textlog_cc_dump(picoquic_cnx_t* cnx, uint64_t current_time)
     }
 }
 
+static void textlog_packet_departure(picoquic_cnx_t* cnx, picoquic_path_t* path_x,
+    uint64_t sequence_number, uint64_t departure_time, uint64_t current_time)
+{
+#ifdef _WINDOWS
+    UNREFERENCED_PARAMETER(path_x);
+#endif
+    if (cnx->quic->F_log != NULL && picoquic_cnx_is_still_logging(cnx)) {
+        FILE* F = cnx->quic->F_log;
+
+        textlog_prefix_initial_cid64(F, picoquic_val64_connection_id(picoquic_get_logging_cnxid(cnx)));
+        textlog_time(F, cnx, current_time, "T= ", ", ");
+        fprintf(F, "Packet %" PRIu64 " departs at +%" PRIu64 "us\n", sequence_number,
+            (departure_time > current_time) ? departure_time - current_time : 0);
+    }
+}
 
 void picoquic_textlog_close(picoquic_quic_t* quic)
 {
@@ -2490,7 +2505,8 @@ struct st_picoquic_unified_logging_t textlog_functions = {
     textlog_tls_ticket,
     textlog_new_connection,
     textlog_close_connection,
-    textlog_cc_dump
+    textlog_cc_dump,
+    textlog_packet_departure
 };
 
 int picoquic_set_textlog(picoquic_quic_t* quic, char const* textlog_file)
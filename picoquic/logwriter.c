@@ -925,6 +925,29 @@ void binlog_packet_lost(picoquic_cnx_t* cnx, picoquic_path_t* path_x,
     (void)fwrite(bytestream_data(msg), bytestream_length(msg), 1, f);
 }
 
+/* Log the departure time computed for a packet when pacing is offloaded
+ * to the kernel. The event time is the time at which the packet was
+ * prepared, the departure time is logged as an offset from that time.
+ */
+void binlog_packet_departure(picoquic_cnx_t* cnx, picoquic_path_t* path_x,
+    uint64_t sequence_number, uint64_t departure_time, uint64_t current_time)
+{
+    FILE* f = cnx->f_binlog;
+
+    bytestream_buf stream_msg;
+    bytestream* msg = bytestream_buf_init(&stream_msg, BYTESTREAM_MAX_BUFFER_SIZE);
+
+    bytewrite_int32(msg, 0);
+    /* Common chunk header */
+    binlog_compose_event_header(msg, &cnx->initial_cnxid, current_time, binlog_get_path_id(cnx, path_x), picoquic_log_event_packet_departure);
+    /* Event header */
+    bytewrite_vint(msg, sequence_number);
+    bytewrite_vint(msg, (departure_time > current_time) ? departure_time - current_time : 0);
+
+    /* write the frame length at the reserved spot, and save to log file*/
+    picoformat_32(msg->data, (uint32_t)(msg->ptr - 4));
+    (void)fwrite(bytestream_data(msg), bytestream_length(msg), 1, f);
+}
 
 void binlog_negotiated_alpn(picoquic_cnx_t* cnx, int is_local,
     uint8_t const * sni, size_t sni_len, uint8_t const* alpn, size_t alpn_len,
@@ -1351,7 +1374,8 @@ struct st_picoquic_unified_logging_t binlog_functions = {
     binlog_picotls_ticket_ex,
     binlog_new_connection,
     binlog_close_connection,
-    binlog_cc_dump
+    binlog_cc_dump,
+    binlog_packet_departure
 };
 
 int picoquic_set_binlog(picoquic_quic_t* quic, char const* binlog_dir)
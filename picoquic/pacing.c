@@ -34,12 +34,25 @@ void picoquic_pacing_init(picoquic_pacing_t* pacing, uint64_t current_time)
     pacing->packet_time_microsec = 1;
 }
 
+/* Set the pacing offload horizon, in microseconds. If the horizon is
+* not zero, packets are authorized up to that much time before the
+* bucket allows them, and the bucket can become negative by up to
+* the horizon. The departure time of each packet is computed when
+* the packet is sent, and the kernel holds the packet until then.
+*/
+void picoquic_set_pacing_offload_horizon(picoquic_pacing_t* pacing, uint64_t horizon)
+{
+    pacing->offload_horizon_nanosec = horizon * 1000;
+}
+
 /* Update the leaky bucket used for pacing.
 */
 static void picoquic_update_pacing_bucket(picoquic_pacing_t* pacing, uint64_t current_time)
 {
-    if (pacing->bucket_nanosec < -pacing->packet_time_nanosec) {
-        pacing->bucket_nanosec = -pacing->packet_time_nanosec;
+    int64_t bucket_min = -pacing->packet_time_nanosec - (int64_t)pacing->offload_horizon_nanosec;
+
+    if (pacing->bucket_nanosec < bucket_min) {
+        pacing->bucket_nanosec = bucket_min;
     }
 
     if (current_time > pacing->evaluation_time) {
@@ -56,7 +69,7 @@ static void picoquic_update_pacing_bucket(picoquic_pacing_t* pacing, uint64_t cu
  */
 int picoquic_is_pacing_blocked(picoquic_pacing_t* pacing)
 {
-    return (pacing->bucket_nanosec < pacing->packet_time_nanosec);
+    return (pacing->bucket_nanosec + (int64_t)pacing->offload_horizon_nanosec < pacing->packet_time_nanosec);
 }
 
 /*
@@ -70,10 +83,14 @@ int picoquic_is_authorized_by_pacing(picoquic_pacing_t * pacing, uint64_t curren
     unsigned int packet_train_mode, picoquic_quic_t * quic)
 {
     int ret = 1;
+    int64_t bucket_available;
 
     picoquic_update_pacing_bucket(pacing, current_time);
+    /* If pacing is offloaded, packets can be sent up to the horizon
+     * before the bucket allows them. */
+    bucket_available = pacing->bucket_nanosec + (int64_t)pacing->offload_horizon_nanosec;
 
-    if (pacing->bucket_nanosec < pacing->packet_time_nanosec) {
+    if (bucket_available < pacing->packet_time_nanosec) {
         uint64_t next_pacing_time;
         int64_t bucket_required;
 
@@ -84,10 +101,10 @@ int picoquic_is_authorized_by_pacing(picoquic_pacing_t * pacing, uint64_t curren
                 bucket_required = 10 * pacing->packet_time_nanosec;
             }
 
-            bucket_required -= pacing->bucket_nanosec;
+            bucket_required -= bucket_available;
         }
         else {
-            bucket_required = pacing->packet_time_nanosec - pacing->bucket_nanosec;
+            bucket_required = pacing->packet_time_nanosec - bucket_available;
         }
 
         next_pacing_time = current_time + 1 + bucket_required / 1000;
@@ -240,6 +257,16 @@ void picoquic_update_pacing_data_after_send(picoquic_pacing_t * pacing, size_t l
     uint64_t packet_time_nanosec;
 
     picoquic_update_pacing_bucket(pacing, current_time);
+    if (pacing->offload_horizon_nanosec > 0) {
+        /* The packet departs when the bucket would have authorized it */
+        uint64_t departure_time = current_time;
+        if (pacing->bucket_nanosec < pacing->packet_time_nanosec) {
+            departure_time += (uint64_t)(pacing->packet_time_nanosec - pacing->bucket_nanosec + 999) / 1000;
+        }
+        if (departure_time > pacing->departure_time) {
+            pacing->departure_time = departure_time;
+        }
+    }
     packet_time_nanosec = ((pacing->packet_time_nanosec * (uint64_t)length) + (send_mtu - 1)) / send_mtu;
     pacing->bucket_nanosec -= packet_time_nanosec;
 }
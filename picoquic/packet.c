@@ -1088,7 +1088,9 @@ void picoquic_prepare_version_negotiation(
  * stateless reset is PICOQUIC_RESET_PACKET_MIN_SIZE, this code only
  * respond to packets that are strictly larger than the size.
  * 
- * 
+ * The stateless packet buffers have the default packet size, which
+ * may be smaller than the incoming packet if the context accepts
+ * jumbo packets. The pad size is capped so the reset fits in them.
  */
 void picoquic_process_unexpected_cnxid(
     picoquic_quic_t* quic,
@@ -1108,6 +1110,11 @@ void picoquic_process_unexpected_cnxid(
             uint8_t* bytes = sp->bytes;
             size_t byte_index = 0;
 
+            /* Incoming packets may be larger than the stateless packet buffer */
+            if (pad_size > sizeof(sp->bytes) - PICOQUIC_RESET_SECRET_SIZE - 2) {
+                pad_size = sizeof(sp->bytes) - PICOQUIC_RESET_SECRET_SIZE - 2;
+            }
+
             if (pad_size > PICOQUIC_RESET_PACKET_MIN_SIZE - PICOQUIC_RESET_SECRET_SIZE - 1) {
                 pad_size -= (size_t)picoquic_public_uniform_random(pad_size - (PICOQUIC_RESET_PACKET_MIN_SIZE - PICOQUIC_RESET_SECRET_SIZE - 1));
             }
@@ -2329,6 +2336,7 @@ int picoquic_incoming_segment(
             ph.ptype != picoquic_packet_version_negotiation) {
             cnx->nb_packets_received++;
             cnx->latest_receive_time = current_time;
+            picoquic_wake_cnx(cnx, current_time);
             /* Mark the sequence number as received */
             ret = picoquic_record_pn_received(cnx, ph.pc, ph.l_cid, ph.pn64, receive_time);
             /* Perform ECN accounting */
@@ -2403,6 +2411,12 @@ int picoquic_incoming_packet_ex(
     int ret = 0;
     picoquic_connection_id_t previous_destid = picoquic_null_connection_id;
 
+    if (packet_length > quic->max_packet_size) {
+        /* Cannot be decrypted in the packet buffers, ignore. */
+        DBG_PRINTF("Packet length %zu larger than max packet size %zu\n", packet_length, quic->max_packet_size);
+        consumed_index = packet_length;
+    }
+
     while (consumed_index < packet_length) {
         size_t consumed = 0;
 
@@ -423,7 +423,7 @@ void picoquic_sort_available_paths(picoquic_cnx_t* cnx, uint64_t current_time, u
                 }
             }
             if (path_x->bytes_in_transit < path_x->cwin &&
-                path_x->bytes_in_transit < cnx->quic->cwin_max) {
+                path_x->bytes_in_transit < cnx->cwin_max) {
                 if (path_x->last_sent_time < last_sent_cwin) {
                     last_sent_cwin = path_x->last_sent_time;
                     data_path_cwin = path_index;
@@ -0,0 +1,110 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include "picoarena.h"
+
+struct st_picoarena_block_t {
+    picoarena_block_t* next;
+};
+
+#define PICOARENA_OBJECTS_OFFSET ((sizeof(picoarena_block_t) + 15) & ~((size_t)15))
+
+static int picoarena_size_class(size_t size)
+{
+    return (int)((size + PICOARENA_CLASS_SIZE - 1) / PICOARENA_CLASS_SIZE) - 1;
+}
+
+void picoarena_init(picoarena_t* arena)
+{
+    memset(arena, 0, sizeof(picoarena_t));
+}
+
+void picoarena_release(picoarena_t* arena)
+{
+    picoarena_block_t* block;
+
+    while ((block = arena->first_block) != NULL) {
+        arena->first_block = block->next;
+        free(block);
+    }
+    picoarena_init(arena);
+}
+
+void* picoarena_alloc(picoarena_t* arena, size_t size)
+{
+    void* object = NULL;
+
+    arena->stats.nb_allocations++;
+
+    if (arena->is_disabled || size == 0 || size > PICOARENA_OBJECT_MAX) {
+        arena->stats.nb_large++;
+        object = malloc(size);
+    }
+    else {
+        int size_class = picoarena_size_class(size);
+        size_t class_size = ((size_t)size_class + 1) * PICOARENA_CLASS_SIZE;
+
+        if (arena->free_list[size_class] != NULL) {
+            /* The free objects are linked through their first bytes */
+            object = arena->free_list[size_class];
+            arena->free_list[size_class] = *((void**)object);
+            arena->stats.nb_reused++;
+        }
+        else {
+            if (arena->available < class_size) {
+                /* The remainder of the current block is abandoned */
+                picoarena_block_t* block = (picoarena_block_t*)malloc(PICOARENA_BLOCK_SIZE);
+                if (block != NULL) {
+                    block->next = arena->first_block;
+                    arena->first_block = block;
+                    arena->next_object = ((uint8_t*)block) + PICOARENA_OBJECTS_OFFSET;
+                    arena->available = PICOARENA_BLOCK_SIZE - PICOARENA_OBJECTS_OFFSET;
+                    arena->stats.nb_blocks++;
+                }
+            }
+            if (arena->available >= class_size) {
+                object = arena->next_object;
+                arena->next_object += class_size;
+                arena->available -= class_size;
+            }
+        }
+    }
+
+    return object;
+}
+
+void picoarena_free(picoarena_t* arena, void* object, size_t size)
+{
+    if (object != NULL) {
+        if (arena->is_disabled || size == 0 || size > PICOARENA_OBJECT_MAX) {
+            free(object);
+        }
+        else {
+            int size_class = picoarena_size_class(size);
+
+            *((void**)object) = arena->free_list[size_class];
+            arena->free_list[size_class] = object;
+        }
+    }
+}
@@ -0,0 +1,82 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef PICOARENA_H
+#define PICOARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Arena allocator for the small objects owned by a connection.
+ *
+ * Objects are carved sequentially from blocks of PICOARENA_BLOCK_SIZE bytes.
+ * An object that is freed before the end of the arena is kept on the free
+ * list of its size class, and reused by the next allocation of the same
+ * class. The blocks are only returned to the system when the arena is
+ * released, at once, which removes most of the calls to malloc and free
+ * from the creation and deletion of connections.
+ *
+ * Objects larger than PICOARENA_OBJECT_MAX are allocated with malloc, and
+ * so are all objects if the arena is disabled, which provides a baseline
+ * for measuring the effect of the arena.
+ * The size of the object must be passed to picoarena_free, so that the
+ * free list can be found without a header. As for the slab allocator,
+ * objects are not zeroed when allocated.
+ */
+
+#define PICOARENA_BLOCK_SIZE 0x2000
+#define PICOARENA_CLASS_SIZE 64
+#define PICOARENA_OBJECT_MAX 1536
+#define PICOARENA_NB_CLASSES (PICOARENA_OBJECT_MAX / PICOARENA_CLASS_SIZE)
+
+typedef struct st_picoarena_block_t picoarena_block_t;
+
+typedef struct st_picoarena_stats_t {
+    uint64_t nb_allocations; /* Number of objects allocated */
+    uint64_t nb_reused; /* Allocations served from a free list */
+    uint64_t nb_large; /* Allocations passed to malloc, too large or arena disabled */
+    size_t nb_blocks; /* Blocks currently held by the arena */
+} picoarena_stats_t;
+
+typedef struct st_picoarena_t {
+    picoarena_block_t* first_block;
+    uint8_t* next_object;
+    size_t available;
+    void* free_list[PICOARENA_NB_CLASSES];
+    picoarena_stats_t stats;
+    int is_disabled;
+} picoarena_t;
+
+void picoarena_init(picoarena_t* arena);
+/* Return all the blocks to the system. Objects still allocated in the
+ * arena become invalid, large objects must have been freed before. */
+void picoarena_release(picoarena_t* arena);
+void* picoarena_alloc(picoarena_t* arena, size_t size);
+void picoarena_free(picoarena_t* arena, void* object, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* PICOARENA_H */
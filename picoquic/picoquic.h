@@ -111,6 +111,7 @@ extern "C" {
 #define PICOQUIC_ERROR_PATH_NOT_READY (PICOQUIC_ERROR_CLASS + 67)
 #define PICOQUIC_ERROR_PATH_LIMIT_EXCEEDED (PICOQUIC_ERROR_CLASS + 68)
 #define PICOQUIC_ERROR_REDIRECTED (PICOQUIC_ERROR_CLASS + 69) /* Not an error: the packet was captured by a proxy, no further processing needed */
+#define PICOQUIC_ERROR_NETWORK_QUEUE_FULL (PICOQUIC_ERROR_CLASS + 70)
 
 /*
  * Protocol errors defined in the QUIC spec
@@ -141,7 +142,8 @@ extern "C" {
 #define PICOQUIC_TRANSPORT_UNSTABLE_INTERFACE (0x554e5f494e5446)
 #define PICOQUIC_TRANSPORT_NO_CID_AVAILABLE (0x4e4f5f4349445f)
 
-#define PICOQUIC_MAX_PACKET_SIZE 1536
+#define PICOQUIC_MAX_PACKET_SIZE 1536 /* Default size of packet buffers */
+#define PICOQUIC_MAX_PACKET_SIZE_LIMIT 9216 /* Largest value accepted by picoquic_set_max_packet_size */
 #define PICOQUIC_INITIAL_MTU_IPV4 1252
 #define PICOQUIC_INITIAL_MTU_IPV6 1232
 #define PICOQUIC_RESET_SECRET_SIZE 16
@@ -497,6 +499,83 @@ void picoquic_set_random_initial(picoquic_quic_t* quic, int random_initial);
 /* Set the "packet train" mode for pacing */
 void picoquic_set_packet_train_mode(picoquic_quic_t* quic, int train_mode);
 
+/* Offload pacing to the kernel, e.g., SO_TXTIME with the fq qdisc.
+ * If `horizon` is not zero, packets are prepared up to `horizon`
+ * microseconds before their pacing departure time, and the application
+ * is expected to pass that departure time to the socket. The departure
+ * time of the packets prepared by the last call to picoquic_prepare_packet_ex
+ * is returned by picoquic_get_departure_time, or 0 if the packets were
+ * not paced. Setting the horizon to 0 restores pacing in user space.
+ */
+void picoquic_set_pacing_offload(picoquic_quic_t* quic, uint64_t horizon);
+uint64_t picoquic_get_departure_time(picoquic_cnx_t* cnx);
+
+/* Packet pool.
+ * The packets of a QUIC context are allocated from page aligned chunks,
+ * and recycled when they are acknowledged or abandoned. At most
+ * `nb_packets` free packets are kept when the traffic decreases, the
+ * default is 8192 (PICOQUIC_MAX_PACKETS_IN_POOL). Chunks that remain unused are
+ * returned to the system gradually, after about one second.
+ */
+typedef struct st_picoquic_pool_stats_t {
+    uint64_t nb_allocations; /* Number of objects allocated */
+    uint64_t nb_pool_hits; /* Allocations served by recycling a freed object */
+    uint64_t nb_chunks_allocated; /* Chunks obtained from the system */
+    uint64_t nb_chunks_trimmed; /* Chunks returned to the system */
+    size_t nb_in_use; /* Objects currently allocated */
+    size_t nb_in_use_max; /* Max value of nb_in_use */
+    size_t nb_cached; /* Free objects available in the chunks */
+    size_t memory_size; /* Bytes currently held in chunks */
+    size_t chunk_size; /* Size of the chunks obtained from the system */
+    size_t objects_per_chunk; /* Number of objects carved from each chunk */
+    uint64_t nb_chunks_hugetlb; /* Chunks mapped from the reserved huge pages */
+    uint64_t nb_chunks_advised; /* Chunks aligned on huge pages and advised for transparent huge pages */
+} picoquic_pool_stats_t;
+
+void picoquic_set_packet_pool_high_water(picoquic_quic_t* quic, size_t nb_packets);
+void picoquic_get_packet_pool_stats(picoquic_quic_t* quic, picoquic_pool_stats_t* stats);
+
+/* Huge page pools.
+ * Servers holding large retransmit queues spend a lot of time in TLB misses
+ * when walking the packets. If this option is set, the packet and data node
+ * pools are carved from 2MB chunks, mapped from the reserved huge pages if
+ * available (MAP_HUGETLB), or else aligned on 2MB and advised for transparent
+ * huge pages (MADV_HUGEPAGE). The pool statistics report the chunk layout and
+ * how the chunks were obtained. The option can only be changed while no
+ * packet or data node is in use; returns PICOQUIC_ERROR_CANNOT_CHANGE_ACTIVE_CONTEXT
+ * otherwise. On systems without huge page support, only the chunk size changes.
+ */
+int picoquic_set_huge_page_pools(picoquic_quic_t* quic, int use_huge_pages);
+
+/* Stream and ACK range pools.
+ * Stream heads and the items of the ACK range lists are allocated from
+ * pools of the QUIC context in the same way as packets. The high water
+ * marks default to 1024 streams (PICOQUIC_MAX_STREAMS_IN_POOL) and 4096
+ * ACK ranges (PICOQUIC_MAX_SACK_ITEMS_IN_POOL).
+ */
+void picoquic_set_stream_pool_high_water(picoquic_quic_t* quic, size_t nb_streams);
+void picoquic_set_sack_item_pool_high_water(picoquic_quic_t* quic, size_t nb_sack_items);
+
+/* Memory statistics of the QUIC context.
+ * Received stream data held before in order delivery is kept in data nodes
+ * allocated from PICOQUIC_NB_DATA_NODE_CLASSES size classes. The bytes saved
+ * are the difference between the memory used by the nodes of the smaller
+ * classes and the memory the same nodes would use in the full size class.
+ */
+#define PICOQUIC_NB_DATA_NODE_CLASSES 3
+
+typedef struct st_picoquic_memory_stats_t {
+    picoquic_pool_stats_t packets;
+    picoquic_pool_stats_t data_nodes[PICOQUIC_NB_DATA_NODE_CLASSES];
+    size_t data_node_size[PICOQUIC_NB_DATA_NODE_CLASSES]; /* Data capacity of the nodes in each class */
+    uint64_t data_node_bytes_saved; /* Bytes saved by the nodes currently in use */
+    uint64_t data_node_bytes_saved_total; /* Bytes saved, summed over all node allocations */
+    picoquic_pool_stats_t streams;
+    picoquic_pool_stats_t sack_items;
+} picoquic_memory_stats_t;
+
+void picoquic_get_memory_stats(picoquic_quic_t* quic, picoquic_memory_stats_t* stats);
+
 /* set the padding policy.
  * The padding policy is parameterized by two variables:
  * - packets shorter than padding_min_size will be padded to that size.
@@ -709,6 +788,46 @@ void picoquic_set_cwin_max(picoquic_quic_t* quic, uint64_t cwin_max);
 */
 void picoquic_set_max_data_control(picoquic_quic_t* quic, uint64_t max_data);
 
+/* Memory accounting and global memory ceiling.
+ * The memory held by each connection is tracked in four classes:
+ * packets kept for retransmission or loss detection, packets kept to repeat
+ * stream data, data queued by the application for sending, and data
+ * received out of order or not yet delivered to the application.
+ * picoquic_get_memory_held returns the sum of these counters for all
+ * connections in the context.
+ *
+ * If a ceiling is set with picoquic_set_memory_ceiling, the stack applies
+ * back pressure when the memory held exceeds it: the connections that hold
+ * more than their share of the ceiling have their congestion window and
+ * their flow control credit limited to that share. The limits are relaxed
+ * once the memory held falls back below 3/4 of the ceiling. Setting the
+ * ceiling to 0 (default) disables the mechanism.
+ */
+typedef struct st_picoquic_memory_usage_t {
+    uint64_t retransmit_bytes;
+    uint64_t data_repeat_bytes;
+    uint64_t stream_send_bytes;
+    uint64_t stream_receive_bytes;
+    uint64_t total_bytes;
+} picoquic_memory_usage_t;
+
+void picoquic_get_memory_usage(picoquic_cnx_t* cnx, picoquic_memory_usage_t* usage);
+uint64_t picoquic_get_memory_held(picoquic_quic_t* quic);
+uint64_t picoquic_get_memory_held_max(picoquic_quic_t* quic);
+void picoquic_set_memory_ceiling(picoquic_quic_t* quic, uint64_t memory_ceiling);
+
+/* Hibernation of idle connections.
+ * If a hibernation delay is set (in microseconds, 0 = disabled, default),
+ * connections that have been idle for that long, with no packet in transit,
+ * release their congestion control state, the packets kept for detection of
+ * spurious losses and the old keys of the previous key phase. They are
+ * woken up transparently when a packet is received or when the application
+ * queues data; the congestion control restarts from its initial state.
+ */
+void picoquic_set_hibernation_delay(picoquic_quic_t* quic, uint64_t hibernation_delay);
+int picoquic_is_cnx_hibernating(picoquic_cnx_t* cnx);
+size_t picoquic_get_nb_cnx_hibernating(picoquic_quic_t* quic);
+
 /*
 * Idle timeout and handshake timeout
 * 
@@ -783,6 +902,18 @@ uint64_t picoquic_get_default_connection_id_ttl(picoquic_quic_t* quic);
 #define PICOQUIC_MTU_OVERHEAD(p_s_addr) (((p_s_addr)->sa_family==AF_INET6)?48:28)
 void picoquic_set_mtu_max(picoquic_quic_t* quic, uint32_t mtu_max);
 
+/* Setting the size of the packet buffers. The packets sent and received by
+ * the context cannot be larger than that size, which defaults to
+ * PICOQUIC_MAX_PACKET_SIZE. Larger values, up to PICOQUIC_MAX_PACKET_SIZE_LIMIT,
+ * are needed for path MTU discovery on links with jumbo frames, in which
+ * case the "mtu_max" should be set to the MTU of the interface. The size
+ * cannot be changed while packets or stream data buffers are in use, and
+ * cannot be reduced once connections have been created; the call then
+ * returns PICOQUIC_ERROR_CANNOT_CHANGE_ACTIVE_CONTEXT.
+ */
+int picoquic_set_max_packet_size(picoquic_quic_t* quic, size_t max_packet_size);
+size_t picoquic_get_max_packet_size(picoquic_quic_t* quic);
+
 
 /* Set the ALPN function used to verify incoming ALPN */
 void picoquic_set_alpn_select_fn(picoquic_quic_t* quic, picoquic_alpn_select_fn alpn_select_fn);
@@ -1064,6 +1195,20 @@ picoquic_cnx_t* picoquic_get_earliest_cnx_to_wake(picoquic_quic_t* quic, uint64_
 
 uint64_t picoquic_get_next_wake_time(picoquic_quic_t* quic, uint64_t current_time);
 
+/* Wake scheduler.
+ * By default, the connections are kept in a splay tree sorted by wake time.
+ * Servers handling a large number of connections can use a hierarchical
+ * timer wheel instead, in which rescheduling a connection has a constant
+ * cost. The wheel keeps a microsecond resolution for the near term. When
+ * several connections are due, they are served in the order in which they
+ * became due, rather than strictly by wake time. This is best set when the
+ * context is created, but the connections in progress are moved if the
+ * scheduler changes. Returns PICOQUIC_ERROR_MEMORY if the wheel cannot be
+ * allocated.
+ */
+int picoquic_set_wake_wheel(picoquic_quic_t* quic, int use_wheel);
+int picoquic_is_wake_wheel_used(picoquic_quic_t* quic);
+
 picoquic_state_enum picoquic_get_cnx_state(picoquic_cnx_t* cnx);
 
 void picoquic_cnx_set_padding_policy(picoquic_cnx_t * cnx, uint32_t padding_multiple, uint32_t padding_minsize);
@@ -1258,6 +1403,48 @@ typedef int (*picoquic_stream_direct_receive_fn)(picoquic_cnx_t* cnx,
 int picoquic_mark_direct_receive_stream(picoquic_cnx_t* cnx,
     uint64_t stream_id, picoquic_stream_direct_receive_fn direct_receive_fn, void* direct_receive_ctx);
 
+/* Scatter-gather receive.
+ *
+ * With the default API, in order data is delivered through the stream data
+ * callback one chunk at a time, and data received out of order is held
+ * until the gap is filled, then delivered one callback per chunk. An
+ * application can instead mark a stream as `iovec receive`. When new data
+ * becomes available in order, the iovec callback is called once with an
+ * array of segments pointing directly into the data held by the stack, for
+ * example so that the application can write it to disk with `writev`.
+ * Up to PICOQUIC_STREAM_IOVEC_MAX segments are passed per call. The
+ * `offset` argument is the stream offset of the first segment, and `fin`
+ * is set when the last segment ends the stream.
+ *
+ * The segments remain valid until the application releases them by calling
+ * picoquic_release_stream_iovec with the stream offset up to which the data
+ * was processed, or until the connection is deleted. The stream is not
+ * deleted while some segments are held. The release function can be called
+ * from within the callback. Data only counts as consumed once released, so
+ * the flow control credit of the stream opens as segments are released.
+ *
+ * The callback function shall return 0 if the data was processed normally,
+ * or an error code, with the same semantic as for the direct receive
+ * callback. If stream data was queued at the time the
+ * picoquic_mark_iovec_receive_stream function is called, the callback will
+ * be activated immediately.
+ */
+#define PICOQUIC_STREAM_IOVEC_MAX 16
+
+typedef struct st_picoquic_iovec_t {
+    const uint8_t* bytes;
+    size_t length;
+} picoquic_iovec_t;
+
+typedef int (*picoquic_stream_iovec_receive_fn)(picoquic_cnx_t* cnx,
+    uint64_t stream_id, int fin, const picoquic_iovec_t* iov, size_t nb_iov, uint64_t offset,
+    void* iovec_receive_ctx);
+
+int picoquic_mark_iovec_receive_stream(picoquic_cnx_t* cnx,
+    uint64_t stream_id, picoquic_stream_iovec_receive_fn iovec_receive_fn, void* iovec_receive_ctx);
+
+int picoquic_release_stream_iovec(picoquic_cnx_t* cnx, uint64_t stream_id, uint64_t offset);
+
 /* Associate stream with app context */
 int picoquic_set_app_stream_ctx(picoquic_cnx_t* cnx,
     uint64_t stream_id, void* app_stream_ctx);
@@ -1346,6 +1533,25 @@ int picoquic_set_stream_priority(picoquic_cnx_t* cnx, uint64_t stream_id, uint8_
 int picoquic_mark_high_priority_stream(picoquic_cnx_t* cnx,
     uint64_t stream_id, int is_high_priority);
 
+/* Weighted scheduling of round robin levels.
+ *
+ * Plain round robin gives the same share of the bandwidth to all the streams
+ * of a priority level, like the "incremental" streams of RFC 9218. When
+ * weighted scheduling is enabled for a connection, the streams at round robin
+ * levels (even priority) are served by deficit round robin instead: in each
+ * round, a stream may send about 64 bytes per unit of weight, so that the
+ * streams of a level share the bandwidth in proportion of their weights,
+ * e.g., 70/20/10. The deficit is counted in bytes, not in frames, so the
+ * shares do not depend on the size of the frames.
+ *
+ * The weight of new streams is PICOQUIC_DEFAULT_STREAM_WEIGHT. Setting a
+ * weight of zero restores the default. Weights have no effect on FIFO levels,
+ * or if weighted scheduling is not enabled.
+ */
+#define PICOQUIC_DEFAULT_STREAM_WEIGHT 16
+void picoquic_set_weighted_scheduling(picoquic_cnx_t* cnx, int is_weighted);
+int picoquic_set_stream_weight(picoquic_cnx_t* cnx, uint64_t stream_id, uint8_t stream_weight);
+
 /* 
 * Handling of datagram priorities
 * 
@@ -1405,6 +1611,23 @@ void picoquic_reset_stream_ctx(picoquic_cnx_t* cnx, uint64_t stream_id);
  */
 int picoquic_add_to_stream_with_ctx(picoquic_cnx_t * cnx, uint64_t stream_id, const uint8_t * data, size_t length, int set_fin, void * app_stream_ctx);
 
+/* Same as "picoquic_add_to_stream", but the data is not copied in an
+ * intermediate buffer. The transport keeps a reference to the buffer
+ * owned by the application, and only copies the data when formatting
+ * packets. The application must not modify or free the buffer until
+ * the release function is called, which happens once all the bytes in
+ * the buffer have been acknowledged by the peer, or when the stream is
+ * reset or deleted. If the call fails, or if the length is zero, the
+ * release function is not called and the buffer remains owned by the
+ * application. Unlike picoquic_add_to_stream, the call does not modify
+ * the "app_stream_ctx" of the stream.
+ */
+typedef void (*picoquic_stream_buffer_release_fn)(picoquic_cnx_t* cnx, uint64_t stream_id,
+    const uint8_t* bytes, size_t length, void* release_ctx);
+
+int picoquic_add_buffer_to_stream(picoquic_cnx_t* cnx, uint64_t stream_id, const uint8_t* bytes, size_t length,
+    int set_fin, picoquic_stream_buffer_release_fn release_fn, void* release_ctx);
+
 /* Reset a stream, indicating that no more data will be sent on 
  * that stream and that any data currently queued can be abandoned. */
 int picoquic_reset_stream(picoquic_cnx_t* cnx,
@@ -46,6 +46,7 @@ typedef enum {
     picoquic_log_event_packet_lost = 0x0013,
     picoquic_log_event_packet_dropped = 0x0014,
     picoquic_log_event_packet_buffered = 0x0015,
+    picoquic_log_event_packet_departure = 0x0016,
 
     picoquic_log_event_tls_key_update = 0x0020,
     picoquic_log_event_tls_key_retired = 0x0021,
@@ -105,6 +106,10 @@ void binlog_close_connection(picoquic_cnx_t * cnx);
 
 void binlog_cc_dump(picoquic_cnx_t * cnx, uint64_t current_time);
 
+/* Logging of the departure time of packets, if pacing is offloaded */
+void binlog_packet_departure(picoquic_cnx_t* cnx, picoquic_path_t* path_x,
+    uint64_t sequence_number, uint64_t departure_time, uint64_t current_time);
+
 /* Set the binary log folder and start generating per connection traces into it.
  * Set to NULL value to stop binary tracing.
  */
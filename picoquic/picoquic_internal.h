@@ -28,6 +28,10 @@
 
 #include "picohash.h"
 #include "picosplay.h"
+#include "picoslab.h"
+#include "picoarena.h"
+#include "picotable.h"
+#include "picowheel.h"
 #include "picoquic.h"
 #include "picoquic_utils.h"
 
@@ -43,12 +47,15 @@ extern "C" {
 #define PICOQUIC_ENFORCED_INITIAL_CID_LENGTH 8
 #define PICOQUIC_PRACTICAL_MAX_MTU 1440
 #define PICOQUIC_MIN_STREAM_DATA_FRAGMENT 512
+#define PICOQUIC_STREAM_WEIGHT_QUANTUM 64 /* bytes per unit of stream weight in each weighted round robin turn */
 #define PICOQUIC_RETRY_SECRET_SIZE 64
 #define PICOQUIC_RETRY_TOKEN_PAD_SIZE 26
 #define PICOQUIC_DEFAULT_0RTT_WINDOW (10*PICOQUIC_ENFORCED_INITIAL_MTU)
 #define PICOQUIC_NB_PATH_TARGET 8
 #define PICOQUIC_NB_PATH_DEFAULT 2
 #define PICOQUIC_MAX_PACKETS_IN_POOL 0x2000
+#define PICOQUIC_MAX_STREAMS_IN_POOL 0x400
+#define PICOQUIC_MAX_SACK_ITEMS_IN_POOL 0x1000
 #define PICOQUIC_STORED_IP_MAX 16
 
 #define PICOQUIC_INITIAL_RTT 250000ull /* 250 ms */
@@ -89,6 +96,9 @@ extern "C" {
 #define PICOQUIC_CWIN_INITIAL (10 * PICOQUIC_MAX_PACKET_SIZE)
 #define PICOQUIC_CWIN_MINIMUM (2 * PICOQUIC_MAX_PACKET_SIZE)
 
+#define PICOQUIC_MEMORY_CHECK_INTERVAL 10000ull /* Check the memory ceiling every 10 ms */
+#define PICOQUIC_MEMORY_CAP_MINIMUM (4 * PICOQUIC_MAX_PACKET_SIZE) /* Lowest cwin and flow control cap under memory pressure */
+
 #define PICOQUIC_DEFAULT_CRYPTO_EPOCH_LENGTH (1<<22)
 
 #define PICOQUIC_DEFAULT_SIMULTANEOUS_LOGS 32
@@ -362,9 +372,21 @@ typedef struct st_picoquic_stream_data_node_t {
     uint64_t offset;  /* Stream offset of the first octet in "bytes" */
     size_t length;    /* Number of octets in "bytes" */
     const uint8_t* bytes;
-    uint8_t data[PICOQUIC_MAX_PACKET_SIZE];
+    int size_class;   /* Size class of the node, see PICOQUIC_DATA_NODE_CLASS_SIZES */
+    size_t data_size; /* Number of octets allocated for "data", per the size class */
+    uint8_t data[PICOQUIC_MAX_PACKET_SIZE_LIMIT];
 } picoquic_stream_data_node_t;
 
+/* Data nodes are allocated in size classes, so that small chunks held
+ * out of order do not use a full packet buffer. Only the first `data_size`
+ * octets of `data` are allocated. The last class holds a full packet of
+ * the size set for the context, and is used for decrypting incoming packets. Chunks up to
+ * PICOQUIC_DATA_NODE_COPY_MAX octets are copied into a small node rather
+ * than holding a reference into the decrypted packet.
+ */
+#define PICOQUIC_DATA_NODE_CLASS_SIZES { 128, 512, PICOQUIC_MAX_PACKET_SIZE }
+#define PICOQUIC_DATA_NODE_COPY_MAX 512
+
 /* Data structure used to hold chunk of stream data queued by application */
 typedef struct st_picoquic_stream_queue_node_t {
     picoquic_quic_t* quic;
@@ -372,8 +394,25 @@ typedef struct st_picoquic_stream_queue_node_t {
     uint64_t offset;  /* Stream offset of the first octet in "bytes" */
     size_t length;    /* Number of octets in "bytes" */
     uint8_t* bytes;
+    uint64_t stream_offset; /* Offset of bytes[0] in the stream */
+    picoquic_stream_buffer_release_fn release_fn; /* If set, "bytes" is owned by the application */
+    void* release_ctx;
 } picoquic_stream_queue_node_t;
 
+/* Memory accounting. The memory held by each connection is tracked per
+ * class: packets waiting for acknowledgement or loss confirmation, packets
+ * kept only to repeat their stream data, data queued on the send side of
+ * streams, and data nodes held on the receive side of streams.
+ */
+typedef enum {
+    picoquic_memory_class_none = 0,
+    picoquic_memory_class_retransmit,
+    picoquic_memory_class_data_repeat,
+    picoquic_memory_class_stream_send,
+    picoquic_memory_class_stream_receive,
+    picoquic_nb_memory_classes
+} picoquic_memory_class_enum;
+
 /*
  * The simple packet structure is used to store packets that
  * have been sent but are not yet acknowledged.
@@ -422,12 +461,22 @@ typedef struct st_picoquic_packet_t {
     unsigned int is_queued_for_retransmit : 1;
     unsigned int is_queued_for_spurious_detection : 1;
     unsigned int is_queued_for_data_repeat : 1;
+    unsigned int memory_class : 3; /* Memory class to which the packet is charged, see picoquic_update_packet_memory */
 
-    uint8_t bytes[PICOQUIC_MAX_PACKET_SIZE];
+    /* Only the first quic->max_packet_size octets are allocated */
+    uint8_t bytes[PICOQUIC_MAX_PACKET_SIZE_LIMIT];
 } picoquic_packet_t;
 
 picoquic_packet_t* picoquic_create_packet(picoquic_quic_t* quic);
 void picoquic_recycle_packet(picoquic_quic_t* quic, picoquic_packet_t* packet);
+void picoquic_memory_charge(picoquic_cnx_t* cnx, picoquic_memory_class_enum memory_class, size_t length);
+void picoquic_memory_release(picoquic_cnx_t* cnx, picoquic_memory_class_enum memory_class, size_t length);
+void picoquic_update_packet_memory(picoquic_cnx_t* cnx, picoquic_packet_t* packet);
+void picoquic_check_memory_pressure(picoquic_quic_t* quic, uint64_t current_time);
+void picoquic_set_cnx_memory_cap(picoquic_cnx_t* cnx, uint64_t memory_cap);
+void picoquic_open_deferred_flow_control(picoquic_cnx_t* cnx);
+void picoquic_hibernate_cnx_if_idle(picoquic_cnx_t* cnx, uint64_t current_time, uint64_t* next_wake_time);
+void picoquic_wake_cnx(picoquic_cnx_t* cnx, uint64_t current_time);
 size_t picoquic_pad_to_policy(picoquic_cnx_t* cnx, uint8_t* bytes, size_t length, uint32_t max_length);
 
 /* Definition of the token register used to prevent repeated usage of
@@ -627,6 +676,7 @@ typedef struct st_picoquic_quic_t {
     uint8_t default_datagram_priority;
     uint64_t local_cnxid_ttl; /* Max time to live of Connection ID in microsec, init to "forever" */
     uint32_t mtu_max;
+    size_t max_packet_size; /* Size of packet buffers, see picoquic_set_max_packet_size */
     uint32_t padding_multiple_default;
     uint32_t padding_minsize_default;
     uint32_t sequence_hole_pseudo_period; /* Optimistic ack defense */
@@ -646,6 +696,7 @@ typedef struct st_picoquic_quic_t {
     uint64_t stateless_reset_next_time; /* Next time Stateless Reset or VN packet can be sent */
     uint64_t stateless_reset_min_interval; /* Enforced interval between two stateless reset packets */
     uint64_t cwin_max; /* max value of cwin per connection */
+    uint64_t pacing_offload_horizon; /* If > 0, packets may be sent that much ahead of their departure time */
     /* Flags */
     unsigned int check_token : 1;
     unsigned int force_check_token : 1;
@@ -671,6 +722,7 @@ typedef struct st_picoquic_quic_t {
     unsigned int is_port_blocking_disabled : 1; /* Do not check client port on incoming connections */
     unsigned int are_path_callbacks_enabled : 1; /* Enable path specific callbacks by default */
     unsigned int use_predictable_random : 1; /* For logging tests */
+    unsigned int is_cnx_arena_disabled : 1; /* test option, allocate connection objects with malloc */
     picoquic_stateless_packet_t* pending_stateless_packet;
 
     picoquic_congestion_algorithm_t const* default_congestion_alg;
@@ -679,11 +731,12 @@ typedef struct st_picoquic_quic_t {
     struct st_picoquic_cnx_t* cnx_list;
     struct st_picoquic_cnx_t* cnx_last;
     picosplay_tree_t cnx_wake_tree;
+    picowheel_t* cnx_wake_wheel; /* If not NULL, used instead of cnx_wake_tree */
 
     struct st_picoquic_cnx_t* cnx_in_progress;
 
-    picohash_table* table_cnx_by_id;
-    picohash_table* table_cnx_by_net;
+    picotable_t table_cnx_by_id; /* Local CID to picoquic_local_cnxid_t */
+    picotable_t table_cnx_by_net; /* Peer address to picoquic_path_t */
     picohash_table* table_cnx_by_icid;
     picohash_table* table_cnx_by_secret;
 
@@ -692,15 +745,25 @@ typedef struct st_picoquic_quic_t {
     picoquic_issued_ticket_t* table_issued_tickets_last;
     size_t table_issued_tickets_nb;
 
-    picoquic_packet_t * p_first_packet;
-    int nb_packets_in_pool;
-    int nb_packets_allocated;
-    int nb_packets_allocated_max;
-
-    picoquic_stream_data_node_t* p_first_data_node;
-    int nb_data_nodes_in_pool;
-    int nb_data_nodes_allocated;
-    int nb_data_nodes_allocated_max;
+    picoslab_t packet_slab;
+
+    picoslab_t data_node_slab[PICOQUIC_NB_DATA_NODE_CLASSES];
+    size_t nb_data_nodes_in_use;
+    size_t nb_data_nodes_in_use_max;
+    int use_huge_page_pools; /* Packet and data node slabs backed by huge pages */
+    picoslab_t stream_slab;
+    picoslab_t sack_item_slab;
+
+    /* Memory held by all connections, and global memory budget */
+    uint64_t memory_held;
+    uint64_t memory_held_max;
+    uint64_t memory_ceiling; /* If not 0, apply back pressure when memory_held exceeds it */
+    uint64_t memory_check_time;
+    uint64_t nb_memory_pressure_events;
+    /* Hibernation of idle connections */
+    uint64_t hibernation_delay; /* If not 0, connections idle for that long are hibernated */
+    size_t nb_cnx_hibernating;
+    uint64_t nb_hibernations;
 
     picoquic_connection_id_cb_fn cnx_id_callback_fn;
     void* cnx_id_callback_ctx;
@@ -770,11 +833,24 @@ typedef struct st_picoquic_sack_range_count_t {
     int range_counts[PICOQUIC_MAX_ACK_RANGE_REPEAT];
 } picoquic_sack_range_count_t;
 
+/* The sack list usually holds only a few ranges. These are kept in a ring
+ * inside the list, in increasing order, which avoids allocations and tree
+ * rotations when packets are received. If there are more ranges than the
+ * ring can hold, e.g., after many losses, all ranges are moved to the splay
+ * tree, and back to the ring when only a few ranges remain.
+ */
+#define PICOQUIC_SACK_RING_SIZE 4 /* must be a power of 2 */
+
 typedef struct st_picoquic_sack_list_t {
     picosplay_tree_t ack_tree;
+    picoslab_t* item_slab; /* If not NULL, the items are allocated from this slab */
     uint64_t ack_horizon;
     int64_t horizon_delay;
     picoquic_sack_range_count_t rc[2];
+    picoquic_sack_item_t ring[PICOQUIC_SACK_RING_SIZE];
+    int ring_first; /* index of the lowest range in the ring */
+    int ring_count; /* number of ranges in the ring */
+    int is_in_tree; /* ranges are held in the splay tree instead of the ring */
 } picoquic_sack_list_t;
 
 /*
@@ -787,6 +863,8 @@ typedef struct st_picoquic_sack_list_t {
  *
  * - a list of open streams, managed as a "splay"
  * - a subset of "output" streams, managed as a double linked list
+ * - for each priority level of output streams, queues of the streams that
+ *   have something to send or are waiting for flow control credits
  *
  * For each stream, the code maintains a list of received stream segments, managed as
  * a "splay" of "stream data nodes".
@@ -800,18 +878,48 @@ typedef struct st_picoquic_sack_list_t {
  * The stream structure holds a variety of parameters about the state of the stream.
  */
 
+typedef struct st_picoquic_stream_queue_t {
+    struct st_picoquic_stream_head_t* first;
+    struct st_picoquic_stream_head_t* last;
+} picoquic_stream_queue_t;
+
+/* Output streams of the same priority. The sender only examines the queues,
+ * so that idle streams and streams blocked by flow control do not cost
+ * anything when looking for the next stream to send:
+ * - control: streams with a pending STOP_SENDING or RESET_STREAM frame,
+ * - ready: streams with data to send, ordered by stream ID if the
+ *   priority is odd (FIFO), by last time data was sent otherwise (round robin),
+ *   or in rotation order for round robin levels if weighted scheduling is on,
+ * - blocked: streams with data to send but no stream flow control credit.
+ */
+typedef struct st_picoquic_stream_level_t {
+    struct st_picoquic_stream_level_t* next_level;
+    struct st_picoquic_stream_level_t* previous_level;
+    uint64_t nb_streams; /* number of output streams at that priority */
+    uint8_t stream_priority;
+    picoquic_stream_queue_t control;
+    picoquic_stream_queue_t ready;
+    picoquic_stream_queue_t blocked;
+} picoquic_stream_level_t;
+
 typedef struct st_picoquic_stream_head_t {
     picosplay_node_t stream_node; /* splay of streams in connection context */
     struct st_picoquic_stream_head_t * next_output_stream; /* link in the list of output streams */
     struct st_picoquic_stream_head_t * previous_output_stream;
+    struct st_picoquic_stream_head_t* next_queued_stream; /* link in the queue of the priority level */
+    struct st_picoquic_stream_head_t* previous_queued_stream;
+    picoquic_stream_level_t* output_level; /* priority level of the output stream */
+    picoquic_stream_queue_t* output_queue; /* queue in which the stream is listed, or NULL */
     picoquic_cnx_t * cnx;
     uint64_t stream_id;
     struct st_picoquic_path_t * affinity_path; /* Path for which affinity is set, or NULL if none */
     uint64_t consumed_offset; /* amount of data consumed by the application */
+    uint64_t delivered_offset; /* amount of data passed to the scatter-gather receive function */
     uint64_t fin_offset; /* If the fin mark is received, index of the byte after last */
     uint64_t reset_offset; /* Size guaranteed by relaible reset */
     uint64_t maxdata_local; /* flow control limit of how much the peer is authorized to send */
     uint64_t maxdata_local_acked; /* highest value in max stream data frame acked by the peer */
+    uint64_t maxdata_deferred; /* credit requested by the application but held back by the memory cap */
     uint64_t maxdata_remote; /* flow control limit of how much we authorize the peer to send */
     uint64_t local_error;
     uint64_t remote_error;
@@ -822,12 +930,19 @@ typedef struct st_picoquic_stream_head_t {
     uint64_t sent_offset; /* Amount of data sent in the stream */
     uint64_t reliable_size; /* Length guaranteed when sending "reset at" */
     picoquic_stream_queue_node_t* send_queue; /* if the stream is not "active", list of data segments ready to send */
+    picoquic_stream_queue_node_t* sent_buffers_first; /* application buffers sent, waiting for acknowledgement */
+    picoquic_stream_queue_node_t* sent_buffers_last;
     void * app_stream_ctx;
     picoquic_stream_direct_receive_fn direct_receive_fn; /* direct receive function, if not NULL */
     void* direct_receive_ctx; /* direct receive context */
+    picoquic_stream_iovec_receive_fn iovec_receive_fn; /* scatter-gather receive function, if not NULL */
+    void* iovec_receive_ctx; /* scatter-gather receive context */
     picoquic_sack_list_t sack_list; /* Track which parts of the stream were acknowledged by the peer */
     /* Stream priority -- lowest is most urgent */
     uint8_t stream_priority;
+    /* Share of the round robin levels when weighted scheduling is on */
+    uint8_t stream_weight;
+    int64_t stream_deficit; /* bytes that the stream may still send in its turn, see PICOQUIC_STREAM_WEIGHT_QUANTUM */
     /* Flags describing the state of the stream */
     unsigned int is_active : 1; /* The application is actively managing data sending through callbacks */
     unsigned int fin_requested : 1; /* Application has requested Fin of sending stream */
@@ -850,6 +965,7 @@ typedef struct st_picoquic_stream_head_t {
     unsigned int is_discarded : 1; /* There should be no more callback for that stream, the application has discarded it */
     unsigned int use_app_flow_control : 1; /* Do not automatically increment the flow control window, wait for app calls. */
     unsigned int is_not_coalesced : 1; /* do not mix data for this stream with data from other stream in same packet */
+    unsigned int is_iovec_delivering : 1; /* The scatter-gather receive function is being called */
 } picoquic_stream_head_t;
 
 #define IS_CLIENT_STREAM_ID(id) (unsigned int)(((id) & 1) == 0)
@@ -955,7 +1071,6 @@ typedef struct st_picoquic_ack_context_t {
 typedef struct st_picoquic_local_cnxid_t {
     struct st_picoquic_local_cnxid_t* next;
     picoquic_cnx_t* registered_cnx;
-    picohash_item hash_item;
     uint64_t path_id;
     uint64_t sequence;
     uint64_t create_time;
@@ -1006,6 +1121,9 @@ typedef struct st_picoquic_remote_cnxid_stash_t {
 * - evaluation_time: last time the path was evaluated.
 * - bucket_max: maximum value (capacity) of the leaky bucket.
 * - packet_time_microsec: max of (packet_time_nano_sec/1024, 1) microsec.
+* - offload_horizon_nanosec: if pacing is offloaded to the kernel, how far
+*   ahead of their departure time packets may be sent.
+* - departure_time: departure time of the last packet, if pacing is offloaded.
 * Internal variables:
 * - bucket_nanosec: number of nanoseconds of transmission time that are allowed.
 * - packet_time_nanosec: number of nanoseconds required to send a full size packet.
@@ -1018,6 +1136,10 @@ typedef struct st_picoquic_pacing_t {
     uint64_t quantum_max;
     uint64_t rate_max;
     int bandwidth_pause;
+    /* Pacing offload: packets are authorized up to the horizon before
+     * their departure time, which is passed to the kernel. */
+    uint64_t offload_horizon_nanosec;
+    uint64_t departure_time;
     /* High precision variables should only be used inside pacing.c */
     int64_t bucket_nanosec;
     int64_t packet_time_nanosec;
@@ -1090,7 +1212,7 @@ typedef struct st_picoquic_tuple_t {
 */
 typedef struct st_picoquic_path_t {
     struct sockaddr_storage registered_peer_addr;
-    picohash_item net_id_hash_item;
+    int is_net_id_registered;
     struct st_picoquic_cnx_t* cnx;
     uint64_t unique_path_id;
     void* app_path_ctx;
@@ -1263,6 +1385,8 @@ typedef struct st_picoquic_crypto_context_t {
 */
 typedef struct st_picoquic_cnx_t {
     picoquic_quic_t* quic;
+    /* Arena holding the paths, tuples and connection ID lists of the connection */
+    picoarena_t arena;
 
     /* Management of context retrieval tables */
 
@@ -1336,6 +1460,9 @@ typedef struct st_picoquic_cnx_t {
     unsigned int is_subscribed_to_path_allowed : 1; /* application wants to be advised if it is now possible to create a path */
     unsigned int is_notified_that_path_is_allowed : 1; /* application wants to be advised if it is now possible to create a path */
     unsigned int is_reset_stream_at_enabled : 1; /* Reset Stream At is supported */
+    unsigned int is_hibernating : 1; /* The congestion state and old packets were released, see picoquic_hibernate_cnx */
+    unsigned int is_weighted_scheduling : 1; /* Round robin levels are served by deficit round robin, per stream weight */
+    unsigned int is_flow_control_deferred : 1; /* At least one stream has credit deferred by the memory cap */
     
     /* PMTUD policy */
     picoquic_pmtud_policy_enum pmtud_policy;
@@ -1396,6 +1523,7 @@ typedef struct st_picoquic_cnx_t {
     /* Next time sending data is expected */
     uint64_t next_wake_time;
     picosplay_node_t cnx_wake_node;
+    picowheel_node_t cnx_wake_wheel_node;
     /* Wakeup time requested by the application */
     uint64_t app_wake_time;
     /* TLS context, TLS Send Buffer, streams, epochs */
@@ -1422,6 +1550,11 @@ typedef struct st_picoquic_cnx_t {
     picoquic_ack_context_t ack_ctx[picoquic_nb_packet_context];
     /* Sequence number of the next observed address frame */
     uint64_t observed_number;
+    /* Memory accounting, per memory class, and back pressure */
+    uint64_t memory_held[picoquic_nb_memory_classes];
+    uint64_t memory_held_total;
+    uint64_t memory_cap; /* If not 0, cap of cwin and flow control credit set under memory pressure */
+    uint64_t cwin_max; /* Lowest of quic->cwin_max and memory_cap */
     /* Statistics */
     uint64_t nb_bytes_queued;
     uint32_t nb_zero_rtt_sent;
@@ -1461,6 +1594,7 @@ typedef struct st_picoquic_cnx_t {
     uint64_t pacing_increase_threshold;
     uint64_t pacing_decrease_threshold;
     uint64_t pacing_change_threshold;
+    uint64_t departure_time; /* Departure time of the packets prepared by the last call, if pacing is offloaded */
 
     /* Data accounting for limiting amplification attacks */
     uint64_t initial_data_received;
@@ -1491,6 +1625,8 @@ typedef struct st_picoquic_cnx_t {
     picosplay_tree_t stream_tree;
     picoquic_stream_head_t * first_output_stream;
     picoquic_stream_head_t * last_output_stream;
+    picoquic_stream_level_t* first_stream_level; /* output streams per priority, most urgent first */
+    picoquic_stream_queue_t exhausted_streams; /* output streams that have nothing more to send */
     uint64_t high_priority_stream_id;
     uint64_t next_stream_id[4];
     uint64_t priority_limit_for_bypass; /* Bypass CC if dtagram or stream priority lower than this, 0 means never */
@@ -1697,6 +1833,8 @@ picoquic_cnx_t* picoquic_cnx_by_net(picoquic_quic_t* quic, const struct sockaddr
 picoquic_cnx_t* picoquic_cnx_by_icid(picoquic_quic_t* quic, picoquic_connection_id_t* icid,
     const struct sockaddr* addr);
 picoquic_cnx_t* picoquic_cnx_by_secret(picoquic_quic_t* quic, const uint8_t* reset_secret, const struct sockaddr* addr);
+void picoquic_cid_table_key(const picoquic_connection_id_t* cnx_id, picotable_key_t* key);
+void picoquic_net_table_key(const struct sockaddr* addr, picotable_key_t* key);
 
 /* Pacing implementation */
 void picoquic_pacing_init(picoquic_pacing_t* pacing, uint64_t current_time);
@@ -1706,6 +1844,7 @@ void picoquic_update_pacing_parameters(picoquic_pacing_t* pacing, double pacing_
     picoquic_path_t* signalled_path);
 void picoquic_update_pacing_window(picoquic_pacing_t* pacing, int slow_start, uint64_t cwin, size_t send_mtu, uint64_t smoothed_rtt, picoquic_path_t * signalled_path);
 void picoquic_update_pacing_data_after_send(picoquic_pacing_t * pacing, size_t length, size_t send_mtu, uint64_t current_time);
+void picoquic_set_pacing_offload_horizon(picoquic_pacing_t* pacing, uint64_t horizon);
 
 /* Reset the pacing data after CWIN is updated */
 void picoquic_update_pacing_data(picoquic_cnx_t* cnx, picoquic_path_t * path_x, int slow_start);
@@ -1855,8 +1994,8 @@ void picoquic_update_ack_horizon(picoquic_sack_list_t* sack_list, uint64_t curre
 /* Return the first ACK item in the list */
 picoquic_sack_item_t* picoquic_sack_first_item(picoquic_sack_list_t* sack_list);
 picoquic_sack_item_t* picoquic_sack_last_item(picoquic_sack_list_t* sack_list);
-picoquic_sack_item_t* picoquic_sack_next_item(picoquic_sack_item_t * sack);
-picoquic_sack_item_t* picoquic_sack_previous_item(picoquic_sack_item_t* sack);
+picoquic_sack_item_t* picoquic_sack_next_item(picoquic_sack_list_t* sack_list, picoquic_sack_item_t * sack);
+picoquic_sack_item_t* picoquic_sack_previous_item(picoquic_sack_list_t* sack_list, picoquic_sack_item_t* sack);
 int picoquic_sack_insert_item(picoquic_sack_list_t* sack_list, uint64_t range_min, 
     uint64_t range_max, uint64_t current_time);
 
@@ -1873,6 +2012,7 @@ uint64_t picoquic_sack_list_last(picoquic_sack_list_t* first_sack);
 picoquic_sack_item_t* picoquic_sack_list_first_range(picoquic_sack_list_t* first_sack);
 
 void picoquic_sack_list_init(picoquic_sack_list_t* first_sack);
+void picoquic_sack_list_init_ex(picoquic_sack_list_t* sack_list, picoslab_t* item_slab);
 
 int picoquic_sack_list_reset(picoquic_sack_list_t* first_sack, 
     uint64_t range_min, uint64_t range_max, uint64_t current_time);
@@ -1922,6 +2062,7 @@ picoquic_stream_head_t* picoquic_create_stream(picoquic_cnx_t* cnx, uint64_t str
 picoquic_stream_head_t* picoquic_create_missing_streams(picoquic_cnx_t* cnx, uint64_t stream_id, int is_remote);
 int picoquic_is_stream_closed(picoquic_stream_head_t* stream, int client_mode);
 int picoquic_delete_stream_if_closed(picoquic_cnx_t* cnx, picoquic_stream_head_t* stream);
+int picoquic_stream_iovec_callback(picoquic_cnx_t* cnx, picoquic_stream_head_t* stream);
 
 void picoquic_update_stream_initial_remote(picoquic_cnx_t* cnx);
 
@@ -1929,6 +2070,8 @@ picoquic_stream_head_t * picoquic_stream_from_node(picosplay_node_t * node);
 void picoquic_insert_output_stream(picoquic_cnx_t* cnx, picoquic_stream_head_t * stream);
 void picoquic_remove_output_stream(picoquic_cnx_t* cnx, picoquic_stream_head_t * stream);
 void picoquic_reorder_output_stream(picoquic_cnx_t* cnx, picoquic_stream_head_t* stream);
+void picoquic_update_output_stream(picoquic_cnx_t* cnx, picoquic_stream_head_t* stream);
+void picoquic_stream_queue_rotate(picoquic_stream_queue_t* queue);
 picoquic_stream_head_t * picoquic_first_stream(picoquic_cnx_t * cnx);
 picoquic_stream_head_t * picoquic_last_stream(picoquic_cnx_t * cnx);
 picoquic_stream_head_t * picoquic_next_stream(picoquic_stream_head_t * stream);
@@ -2038,7 +2181,14 @@ uint64_t picoquic_cc_increased_window(picoquic_cnx_t* cnx, uint64_t previous_win
 uint8_t* picoquic_format_max_streams_frame_if_needed(picoquic_cnx_t* cnx, uint8_t* bytes, uint8_t* bytes_max, int* more_data, int* is_pure_ack);
 void picoquic_stream_data_node_recycle(picoquic_stream_data_node_t* stream_data);
 picoquic_stream_data_node_t* picoquic_stream_data_node_alloc(picoquic_quic_t* quic);
+picoquic_stream_data_node_t* picoquic_stream_data_node_alloc_ex(picoquic_quic_t* quic, size_t length);
+void picoquic_stream_data_node_charge(picosplay_tree_t* tree, picoquic_stream_data_node_t* stream_data);
+void picoquic_trim_memory_pools(picoquic_quic_t* quic, uint64_t current_time);
 void picoquic_clear_stream(picoquic_stream_head_t* stream);
+void picoquic_stream_queue_node_free(picoquic_stream_head_t* stream, picoquic_stream_queue_node_t* stream_data);
+void picoquic_stream_queue_node_sent(picoquic_stream_head_t* stream);
+void picoquic_release_acked_stream_buffers(picoquic_stream_head_t* stream);
+void picoquic_release_sent_stream_buffers(picoquic_stream_head_t* stream);
 void picoquic_delete_stream(picoquic_cnx_t * cnx, picoquic_stream_head_t * stream);
 picoquic_local_cnxid_list_t* picoquic_find_or_create_local_cnxid_list(picoquic_cnx_t* cnx, uint64_t unique_path_id, int do_create);
 picoquic_local_cnxid_t* picoquic_create_local_cnxid(picoquic_cnx_t* cnx,
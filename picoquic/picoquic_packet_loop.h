@@ -34,6 +34,7 @@ extern "C" {
 #define PICOQUIC_PACKET_LOOP_RECV_MAX 10
 #define PICOQUIC_PACKET_LOOP_SEND_MAX 10
 #define PICOQUIC_PACKET_LOOP_SEND_DELAY_MAX 2500
+#define PICOQUIC_PACKET_LOOP_RECV_BATCH_MAX 64
 
 typedef struct st_picoquic_socket_ctx_t {
     SOCKET_TYPE fd;
@@ -45,6 +46,7 @@ typedef struct st_picoquic_socket_ctx_t {
     unsigned int is_started : 1;
     unsigned int supports_udp_send_coalesced : 1;
     unsigned int supports_udp_recv_coalesced : 1;
+    unsigned int supports_txtime : 1;
     /* Receive data buffer and fields */
     size_t recv_buffer_size;
     uint8_t* recv_buffer;
@@ -75,7 +77,7 @@ typedef struct st_picoquic_socket_ctx_t {
  */
 typedef enum {
     picoquic_packet_loop_ready = 0, /* Argument type: packet loop options */
-    picoquic_packet_loop_after_receive, /* Argument type size_t*: nb packets received */
+    picoquic_packet_loop_after_receive, /* Argument type size_t*: nb packets received in the batch */
     picoquic_packet_loop_after_send, /* Argument type size_t*: nb packets sent */
     picoquic_packet_loop_port_update, /* argument type struct_sockaddr*: new address for wakeup */
     picoquic_packet_loop_time_check, /* argument type packet_loop_time_check_arg_t*. Optional. */
@@ -92,12 +94,23 @@ typedef enum {
 * call. If the application selects the "system call duration"
 * option, it will receive callbacks when the call time varies
 * significantly.
+*
+* If busy polling is enabled, the same callback also reports, at most
+* once per PICOQUIC_PACKET_LOOP_BUSY_POLL_REPORT_INTERVAL, the cumulative
+* time spent spinning on non-blocking receives and waiting in blocking
+* calls.
  */
+#define PICOQUIC_PACKET_LOOP_BUSY_POLL_REPORT_INTERVAL 1000000
+
 typedef struct st_packet_loop_system_call_duration_t {
     uint64_t scd_last;
     uint64_t scd_max;
     uint64_t scd_smoothed;
     uint64_t scd_dev;
+    uint64_t spin_time; /* Microseconds spent spinning on non-blocking receives */
+    uint64_t block_time; /* Microseconds spent in blocking waits */
+    uint64_t nb_spin; /* Number of spin phases */
+    uint64_t nb_spin_fallback; /* Spin phases that exhausted the budget and fell back to a blocking wait */
 } packet_loop_system_call_duration_t;
 
 /* The time check option passes as argument a pointer to a structure specifying
@@ -121,6 +134,16 @@ typedef struct st_picoquic_packet_loop_options_t {
     unsigned int provide_alt_port : 1; /* Used for simulating multipath or migrations. */
 } picoquic_packet_loop_options_t;
 
+/* Optional steering function, called for each incoming packet before it is
+ * submitted to the stack. The function returns 1 if it consumed the
+ * packet, for example by forwarding it to another packet loop, or 0 if the
+ * packet shall be processed by the local stack. The function is called in
+ * the context of the network thread, and the packet bytes are only valid
+ * during the call.
+ */
+typedef int (*picoquic_packet_loop_steer_fn)(void* steer_ctx, uint8_t* bytes, size_t length,
+    struct sockaddr* addr_from, struct sockaddr* addr_to, int if_index_to, unsigned char received_ecn);
+
 /* Version 2 of packet loop, works in progress.
 * Parameters are set in a struct, for future
 * extensibility.
@@ -135,6 +158,19 @@ typedef struct st_picoquic_packet_loop_param_t {
     int prefer_extra_socket;
     int simulate_eio;
     size_t send_length_max;
+    int recv_batch_size; /* If > 1, receive up to that many packets per system call (recvmmsg) */
+    int do_send_batch; /* If set, send the packets prepared in a loop pass with one system call per socket (sendmmsg) */
+    int use_io_uring; /* If set, use the io_uring backend if the kernel supports it, select otherwise */
+    int reuse_port; /* If set, open the sockets bound to local_port with SO_REUSEPORT */
+    int cid_steering_nb_workers; /* If > 0 and reuse_port is set, attach a cBPF program selecting the socket from the CID */
+    int cid_steering_offset; /* Position in the destination CID of the byte encoding the worker rank */
+    int command_queue_size; /* Max number of commands queued for the network thread, 0 for default */
+    uint64_t pacing_offload_horizon; /* If > 0, pace with SO_TXTIME, preparing packets up to that many microseconds ahead */
+    uint64_t busy_poll_threshold; /* If > 0, spin on non-blocking receives when the next wake time is that close, in microseconds */
+    uint64_t busy_poll_budget; /* Max microseconds spent spinning before falling back to a blocking wait, 0 for no limit */
+    int socket_busy_poll; /* If > 0, set SO_BUSY_POLL to that many microseconds on the sockets */
+    picoquic_packet_loop_steer_fn incoming_steer_fn; /* If not NULL, called before submitting each incoming packet */
+    void* incoming_steer_ctx;
 } picoquic_packet_loop_param_t;
 
 int picoquic_packet_loop_v2(picoquic_quic_t* quic,
@@ -177,11 +213,14 @@ typedef struct st_picoquic_network_thread_ctx_t {
 #else
     int wake_up_pipe_fd[2];
 #endif
+    picoquic_mpsc_queue_t* command_queue;
+    volatile int32_t wake_up_pending;
     int is_threaded;
     int wake_up_defined;
     volatile int thread_is_ready;
     volatile int thread_should_close;
     volatile int thread_is_closed;
+    int is_io_uring_used; /* Set by the loop if the io_uring backend is in use */
     int return_code;
 } picoquic_network_thread_ctx_t;
 
@@ -195,6 +234,43 @@ picoquic_network_thread_ctx_t* picoquic_start_network_thread(
 int picoquic_wake_up_network_thread(picoquic_network_thread_ctx_t* thread_ctx);
 void picoquic_delete_network_thread(picoquic_network_thread_ctx_t* thread_ctx);
 
+/* Commands queued for the network thread.
+ *
+ * Instead of managing its own queue and locks, and calling the picoquic
+ * APIs from the wake up callback, the application can post commands to
+ * the network thread. The commands are copied in a lock-free bounded
+ * queue attached to the thread context, and can be posted from any
+ * thread. The network thread is woken up once when the first command is
+ * posted, and then executes all the queued commands in a batch before
+ * calling the `picoquic_packet_loop_wake_up` callback. The data passed
+ * to add to stream or to send as datagram are copied, and the
+ * application can reuse the buffers as soon as the call returns.
+ *
+ * The application must ensure that the connection context remains
+ * valid until the command is executed, for example by only deleting
+ * connections from the network thread after a close command.
+ *
+ * The functions return 0 if the command was queued, or
+ * PICOQUIC_ERROR_NETWORK_QUEUE_FULL if the queue is full, in which
+ * case the application should retry after the network thread has
+ * made progress.
+ */
+typedef int (*picoquic_network_command_fn)(picoquic_quic_t* quic, void* command_ctx);
+
+int picoquic_network_thread_add_to_stream(picoquic_network_thread_ctx_t* thread_ctx, picoquic_cnx_t* cnx,
+    uint64_t stream_id, const uint8_t* data, size_t length, int set_fin);
+int picoquic_network_thread_mark_active_stream(picoquic_network_thread_ctx_t* thread_ctx, picoquic_cnx_t* cnx,
+    uint64_t stream_id, int is_active, void* v_stream_ctx);
+int picoquic_network_thread_queue_datagram(picoquic_network_thread_ctx_t* thread_ctx, picoquic_cnx_t* cnx,
+    const uint8_t* data, size_t length);
+int picoquic_network_thread_close(picoquic_network_thread_ctx_t* thread_ctx, picoquic_cnx_t* cnx,
+    uint64_t application_reason_code);
+/* The command function is called in the network thread. If it returns a non
+ * zero value, the packet loop stops, as if the loop callback had returned
+ * that value. */
+int picoquic_network_thread_call(picoquic_network_thread_ctx_t* thread_ctx,
+    picoquic_network_command_fn command_fn, void* command_ctx);
+
 /* The function picoquic_start_network_thread creates a background thread using
 * the "native" threading APIs, CreateThread in Windows or pthread_create in
 * Unix/Posix systems. This will not work in some environments, if for example
@@ -309,6 +385,7 @@ int picoquic_packet_loop_win(picoquic_quic_t* quic,
 void picoquic_packet_loop_close_socket(picoquic_socket_ctx_t* s_ctx);
 int picoquic_packet_loop_open_sockets(uint16_t local_port, int local_af, int socket_buffer_size, int extra_socket_required,
     int do_not_use_gso, picoquic_socket_ctx_t* s_ctx);
+int picoquic_packet_loop_open_sockets_ex(picoquic_packet_loop_param_t* param, picoquic_socket_ctx_t* s_ctx);
 
 #ifdef __cplusplus
 }
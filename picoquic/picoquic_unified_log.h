@@ -104,6 +104,10 @@ typedef void (*picoquic_log_close_connection_fn)(picoquic_cnx_t* cnx);
 /* log congestion control parameters */
 typedef void (*picoquic_log_cc_dump_fn)(picoquic_cnx_t* cnx, uint64_t current_time);
 
+/* log the departure time of a packet, if pacing is offloaded */
+typedef void (*picoquic_log_packet_departure_fn)(picoquic_cnx_t* cnx, picoquic_path_t* path_x,
+    uint64_t sequence_number, uint64_t departure_time, uint64_t current_time);
+
 /* close resource allocated for logging in QUIC context */
 typedef void (*picoquic_log_quic_close)(picoquic_quic_t* quic);
 
@@ -126,6 +130,7 @@ typedef struct st_picoquic_unified_logging_t {
     picoquic_log_new_connection_fn log_new_connection;
     picoquic_log_close_connection_fn log_close_connection;
     picoquic_log_cc_dump_fn log_cc_dump;
+    picoquic_log_packet_departure_fn log_packet_departure;
 } picoquic_unified_logging_t;
 
 /* Log an event that cannot be attached to a specific connection */
@@ -187,6 +192,10 @@ void picoquic_log_close_connection(picoquic_cnx_t* cnx);
 /* log congestion control parameters */
 void picoquic_log_cc_dump(picoquic_cnx_t* cnx, uint64_t current_time);
 
+/* log the departure time of a packet, if pacing is offloaded */
+void picoquic_log_packet_departure(picoquic_cnx_t* cnx, picoquic_path_t* path_x,
+    uint64_t sequence_number, uint64_t departure_time, uint64_t current_time);
+
 
 #ifdef __cplusplus
 }
@@ -238,6 +238,30 @@ void picoquic_delete_event(picoquic_event_t* event);
 int picoquic_signal_event(picoquic_event_t* event);
 int picoquic_wait_for_event(picoquic_event_t* event, uint64_t microsec_wait);
 
+/* Bounded lock-free queue, with multiple producers and a single consumer.
+ * The number of cells is rounded up to a power of 2. Producers reserve a
+ * cell, fill the data, then publish it using the ticket returned by the
+ * reserve call. The consumer peeks at the next published cell, processes
+ * the data, then releases the cell. Reserve returns NULL if the queue is full,
+ * peek returns NULL if the queue is empty. */
+typedef struct st_picoquic_mpsc_queue_t picoquic_mpsc_queue_t;
+
+picoquic_mpsc_queue_t* picoquic_mpsc_queue_create(size_t nb_cells, size_t data_size);
+void picoquic_mpsc_queue_delete(picoquic_mpsc_queue_t* queue);
+void* picoquic_mpsc_queue_reserve(picoquic_mpsc_queue_t* queue, uint64_t* ticket);
+void picoquic_mpsc_queue_publish(picoquic_mpsc_queue_t* queue, uint64_t ticket);
+void* picoquic_mpsc_queue_peek(picoquic_mpsc_queue_t* queue);
+void picoquic_mpsc_queue_release(picoquic_mpsc_queue_t* queue);
+
+/* Atomic flag. Set returns the previous value of the flag. */
+int picoquic_atomic_flag_set(volatile int32_t* flag);
+void picoquic_atomic_flag_clear(volatile int32_t* flag);
+int picoquic_atomic_flag_is_set(volatile int32_t* flag);
+
+/* Atomic counters, for statistics read by other threads */
+void picoquic_atomic_add(volatile uint64_t* counter, uint64_t delta);
+uint64_t picoquic_atomic_read(volatile uint64_t* counter);
+
 /* Simple portable random number generation
  */
 uint64_t picoquic_uniform_random(uint64_t rnd_max);
@@ -275,7 +299,7 @@ typedef struct st_picoquictest_sim_packet_t {
     struct sockaddr_storage addr_from;
     struct sockaddr_storage addr_to;
     uint8_t ecn_mark;
-    uint8_t bytes[PICOQUIC_MAX_PACKET_SIZE];
+    uint8_t bytes[PICOQUIC_MAX_PACKET_SIZE_LIMIT];
 } picoquictest_sim_packet_t;
 
 
@@ -0,0 +1,131 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef PICOQUIC_WORKERS_H
+#define PICOQUIC_WORKERS_H
+
+#include "picoquic_packet_loop.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Multi-worker server.
+ *
+ * A server can run several network threads, or "workers", each with its
+ * own QUIC context, all listening on the same UDP port. The sockets are
+ * opened with SO_REUSEPORT, and the kernel distributes the incoming packets
+ * between the workers based on a hash of the addresses and ports. That hash
+ * is not stable: a NAT rebinding or a migration will send the packets of a
+ * connection to a different socket. To handle that, each worker encodes its
+ * rank in the connection identifiers that it issues, using the "clear"
+ * layout of the load balancer draft: the first byte of the CID is the
+ * configuration byte, the rank is encoded in the second byte. When a
+ * worker receives a packet whose destination CID points to a different
+ * worker, it copies the packet to the handoff queue of that worker and
+ * wakes it up. The Initial packets sent by clients carry a random CID,
+ * but the same rule is applied so that all packets with the same CID
+ * reach the same worker.
+ *
+ * On Linux, the workers also attach a classic BPF program to their
+ * sockets, so that the kernel selects the socket from the CID of short
+ * header packets, and only uses the hash for long header packets. The
+ * forwarding in user space is then limited to the handshake packets.
+ *
+ * Each worker runs in its own network thread, exactly as if it was started
+ * with picoquic_start_custom_network_thread. The loop callback is called
+ * with the callback context of the specific worker.
+ */
+
+#define PICOQUIC_WORKERS_MAX 64
+#define PICOQUIC_WORKERS_CID_SERVER_ID_OFFSET 1
+#define PICOQUIC_WORKERS_HANDOFF_QUEUE_SIZE 256
+
+typedef struct st_picoquic_workers_t picoquic_workers_t;
+
+typedef struct st_picoquic_workers_stats_t {
+    uint64_t nb_packets_forwarded; /* Packets received by this worker, forwarded to another worker */
+    uint64_t nb_packets_handed_off; /* Packets forwarded to this worker by other workers */
+    uint64_t nb_packets_dropped; /* Packets that could not be forwarded, e.g., handoff queue full */
+} picoquic_workers_stats_t;
+
+/* Packet copied in the handoff queue of a worker */
+typedef struct st_picoquic_handoff_packet_t {
+    struct sockaddr_storage addr_from;
+    struct sockaddr_storage addr_to;
+    int if_index_to;
+    unsigned char received_ecn;
+    size_t length;
+    uint8_t bytes[PICOQUIC_MAX_PACKET_SIZE];
+} picoquic_handoff_packet_t;
+
+/* Find the rank of the worker that shall process a packet, based on the
+ * byte at `server_id_offset` in the destination CID. Short header packets
+ * do not encode the CID length, the value `short_cid_length` configured
+ * for the server is used instead. Returns -1 if the packet is too short
+ * or the CID does not include the server ID byte. */
+int picoquic_workers_packet_rank(const uint8_t* bytes, size_t length,
+    uint8_t short_cid_length, size_t server_id_offset, int nb_workers);
+
+/* Configure the QUIC context of a worker so that the CIDs encode its rank. */
+int picoquic_workers_configure_cid(picoquic_quic_t* quic, int rank);
+
+/* Copy a packet in a handoff queue. Returns 0 if the packet was queued,
+ * -1 if the queue is full or the packet too long. */
+int picoquic_handoff_packet_push(picoquic_mpsc_queue_t* queue, const uint8_t* bytes, size_t length,
+    struct sockaddr* addr_from, struct sockaddr* addr_to, int if_index_to, unsigned char received_ecn);
+
+/* Submit all the packets queued in the handoff queue to the QUIC context. */
+int picoquic_handoff_packet_drain(picoquic_mpsc_queue_t* queue, picoquic_quic_t* quic,
+    uint64_t current_time, size_t* nb_packets);
+
+/* Start `nb_workers` network threads, one per QUIC context in the array `quic`.
+ * The QUIC contexts must have been created by the application, and are
+ * configured by this call for CID steering. Each thread uses a copy of the
+ * parameters `param`, with `reuse_port` set. The arguments `thread_create_fn`,
+ * `thread_delete_fn`, `thread_setname_fn` and `thread_name` have the same
+ * meaning as for picoquic_start_custom_network_thread. The loop callback
+ * context of worker `i` is `loop_callback_ctx[i]`, or NULL if the array
+ * `loop_callback_ctx` is NULL. Returns NULL if the workers could not be
+ * started, in which case `ret` holds the error code. */
+picoquic_workers_t* picoquic_start_workers(int nb_workers, picoquic_quic_t** quic,
+    picoquic_packet_loop_param_t* param,
+    picoquic_custom_thread_create_fn thread_create_fn,
+    picoquic_custom_thread_delete_fn thread_delete_fn,
+    picoquic_custom_thread_setname_fn thread_setname_fn,
+    char const* thread_name,
+    picoquic_packet_loop_cb_fn loop_callback,
+    void** loop_callback_ctx,
+    int* ret);
+
+/* Stop all the worker threads and free the workers context. The CID
+ * configuration of the QUIC contexts is released, but the contexts
+ * themselves remain owned by the application. */
+void picoquic_delete_workers(picoquic_workers_t* workers);
+
+int picoquic_workers_nb_ready(picoquic_workers_t* workers);
+picoquic_network_thread_ctx_t* picoquic_workers_get_thread(picoquic_workers_t* workers, int rank);
+int picoquic_workers_get_stats(picoquic_workers_t* workers, int rank, picoquic_workers_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* PICOQUIC_WORKERS_H */
@@ -0,0 +1,313 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WINDOWS
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+#include "picoslab.h"
+
+/* Each object is preceded by a header pointing to its chunk, so that
+ * the chunk can be found when the object is freed. The header also
+ * links the free objects of the chunk, so that freeing an object
+ * does not modify it. */
+typedef struct st_picoslab_slot_t {
+    picoslab_chunk_t* chunk;
+    struct st_picoslab_slot_t* next_free;
+} picoslab_slot_t;
+
+struct st_picoslab_chunk_t {
+    picoslab_chunk_t* next;
+    picoslab_chunk_t* previous;
+    picoslab_chunk_list_t* list;
+    picoslab_slot_t* first_free;
+    size_t nb_carved;
+    size_t nb_in_use;
+    uint64_t empty_since;
+    int is_mapped; /* Obtained with mmap instead of malloc */
+};
+
+#define PICOSLAB_ALIGN(x) (((x) + 15) & ~((size_t)15))
+#define PICOSLAB_SLOTS_OFFSET PICOSLAB_ALIGN(sizeof(picoslab_chunk_t))
+#define PICOSLAB_NOT_STAMPED UINT64_MAX
+
+static void picoslab_list_remove(picoslab_chunk_t* chunk)
+{
+    picoslab_chunk_list_t* list = chunk->list;
+
+    if (list != NULL) {
+        if (chunk->previous == NULL) {
+            list->first = chunk->next;
+        }
+        else {
+            chunk->previous->next = chunk->next;
+        }
+        if (chunk->next == NULL) {
+            list->last = chunk->previous;
+        }
+        else {
+            chunk->next->previous = chunk->previous;
+        }
+        list->nb_chunks--;
+        chunk->next = NULL;
+        chunk->previous = NULL;
+        chunk->list = NULL;
+    }
+}
+
+static void picoslab_list_append(picoslab_chunk_list_t* list, picoslab_chunk_t* chunk)
+{
+    chunk->previous = list->last;
+    chunk->next = NULL;
+    if (list->last == NULL) {
+        list->first = chunk;
+    }
+    else {
+        list->last->next = chunk;
+    }
+    list->last = chunk;
+    list->nb_chunks++;
+    chunk->list = list;
+}
+
+static void picoslab_list_move(picoslab_chunk_list_t* list, picoslab_chunk_t* chunk)
+{
+    picoslab_list_remove(chunk);
+    picoslab_list_append(list, chunk);
+}
+
+static picoslab_chunk_t* picoslab_chunk_create(picoslab_t* slab)
+{
+    picoslab_chunk_t* chunk = NULL;
+    int is_mapped = 0;
+    size_t alignment = (slab->use_huge_pages) ? PICOSLAB_HUGE_PAGE_SIZE : PICOSLAB_PAGE_SIZE;
+
+#ifdef MAP_HUGETLB
+    if (slab->use_huge_pages) {
+        void* mapped = mmap(NULL, slab->chunk_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mapped != MAP_FAILED) {
+            chunk = (picoslab_chunk_t*)mapped;
+            is_mapped = 1;
+            slab->stats.nb_chunks_hugetlb++;
+        }
+    }
+#endif
+    if (chunk == NULL) {
+#ifdef _WINDOWS
+        chunk = (picoslab_chunk_t*)_aligned_malloc(slab->chunk_size, alignment);
+#else
+        if (posix_memalign((void**)&chunk, alignment, slab->chunk_size) != 0) {
+            chunk = NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        else if (slab->use_huge_pages && madvise(chunk, slab->chunk_size, MADV_HUGEPAGE) == 0) {
+            slab->stats.nb_chunks_advised++;
+        }
+#endif
+#endif
+    }
+    if (chunk != NULL) {
+        memset(chunk, 0, sizeof(picoslab_chunk_t));
+        chunk->empty_since = PICOSLAB_NOT_STAMPED;
+        chunk->is_mapped = is_mapped;
+        slab->stats.nb_chunks_allocated++;
+        slab->stats.memory_size += slab->chunk_size;
+    }
+    return chunk;
+}
+
+static void picoslab_chunk_delete(picoslab_t* slab, picoslab_chunk_t* chunk)
+{
+    picoslab_list_remove(chunk);
+    slab->stats.memory_size -= slab->chunk_size;
+#ifdef _WINDOWS
+    _aligned_free(chunk);
+#else
+    if (chunk->is_mapped) {
+        (void)munmap(chunk, slab->chunk_size);
+    }
+    else {
+        free(chunk);
+    }
+#endif
+}
+
+static void picoslab_set_chunk_size(picoslab_t* slab)
+{
+    size_t page_size = (slab->use_huge_pages) ? PICOSLAB_HUGE_PAGE_SIZE : PICOSLAB_PAGE_SIZE;
+
+    slab->chunk_size = (slab->use_huge_pages) ? PICOSLAB_HUGE_PAGE_SIZE : PICOSLAB_CHUNK_SIZE;
+    if (PICOSLAB_SLOTS_OFFSET + slab->slot_size > slab->chunk_size) {
+        /* Large objects: one per chunk, rounded up to the page size */
+        slab->chunk_size = (PICOSLAB_SLOTS_OFFSET + slab->slot_size + page_size - 1) &
+            ~(page_size - 1);
+    }
+    slab->objects_per_chunk = (slab->chunk_size - PICOSLAB_SLOTS_OFFSET) / slab->slot_size;
+}
+
+void picoslab_init(picoslab_t* slab, size_t object_size, size_t high_water)
+{
+    memset(slab, 0, sizeof(picoslab_t));
+    slab->object_size = object_size;
+    slab->slot_size = PICOSLAB_ALIGN(sizeof(picoslab_slot_t) + object_size);
+    picoslab_set_chunk_size(slab);
+    slab->high_water = high_water;
+}
+
+int picoslab_set_huge_pages(picoslab_t* slab, int use_huge_pages)
+{
+    int ret = 0;
+
+    if ((use_huge_pages != 0) != (slab->use_huge_pages != 0)) {
+        if (slab->partial.first != NULL || slab->full.first != NULL || slab->empty.first != NULL) {
+            ret = -1;
+        }
+        else {
+            slab->use_huge_pages = (use_huge_pages != 0);
+            picoslab_set_chunk_size(slab);
+        }
+    }
+    return ret;
+}
+
+void picoslab_release(picoslab_t* slab)
+{
+    picoslab_chunk_list_t* lists[3] = { &slab->partial, &slab->full, &slab->empty };
+
+    for (int i = 0; i < 3; i++) {
+        while (lists[i]->first != NULL) {
+            picoslab_chunk_delete(slab, lists[i]->first);
+        }
+    }
+    slab->stats.nb_in_use = 0;
+}
+
+void* picoslab_alloc(picoslab_t* slab)
+{
+    picoslab_chunk_t* chunk = slab->partial.first;
+    picoslab_slot_t* slot = NULL;
+
+    if (chunk == NULL) {
+        /* Reuse the most recently emptied chunk, its memory is more likely to be in cache */
+        if ((chunk = slab->empty.last) != NULL) {
+            chunk->empty_since = PICOSLAB_NOT_STAMPED;
+        }
+        else if ((chunk = picoslab_chunk_create(slab)) == NULL) {
+            return NULL;
+        }
+        picoslab_list_move(&slab->partial, chunk);
+    }
+
+    if (chunk->first_free != NULL) {
+        slot = chunk->first_free;
+        chunk->first_free = slot->next_free;
+        slab->stats.nb_pool_hits++;
+    }
+    else {
+        slot = (picoslab_slot_t*)(((uint8_t*)chunk) + PICOSLAB_SLOTS_OFFSET + chunk->nb_carved * slab->slot_size);
+        chunk->nb_carved++;
+        memset(slot + 1, 0, slab->object_size);
+        slot->chunk = chunk;
+    }
+    slot->next_free = NULL;
+    chunk->nb_in_use++;
+    if (chunk->nb_in_use >= slab->objects_per_chunk) {
+        picoslab_list_move(&slab->full, chunk);
+    }
+    slab->stats.nb_allocations++;
+    slab->stats.nb_in_use++;
+    if (slab->stats.nb_in_use > slab->stats.nb_in_use_max) {
+        slab->stats.nb_in_use_max = slab->stats.nb_in_use;
+    }
+
+    return (void*)(slot + 1);
+}
+
+void picoslab_free(picoslab_t* slab, void* object)
+{
+    if (object != NULL) {
+        picoslab_slot_t* slot = ((picoslab_slot_t*)object) - 1;
+        picoslab_chunk_t* chunk = slot->chunk;
+
+        slot->next_free = chunk->first_free;
+        chunk->first_free = slot;
+        chunk->nb_in_use--;
+        slab->stats.nb_in_use--;
+
+        if (chunk->nb_in_use == 0) {
+            chunk->empty_since = PICOSLAB_NOT_STAMPED;
+            picoslab_list_move(&slab->empty, chunk);
+            if (slab->empty.nb_chunks * slab->objects_per_chunk > slab->high_water &&
+                (!slab->use_huge_pages || slab->empty.nb_chunks > 1)) {
+                /* Above the high-water mark, release the oldest empty chunk */
+                picoslab_chunk_delete(slab, slab->empty.first);
+                slab->stats.nb_chunks_trimmed++;
+            }
+        }
+        else if (chunk->list == &slab->full) {
+            picoslab_list_move(&slab->partial, chunk);
+        }
+    }
+}
+
+size_t picoslab_trim(picoslab_t* slab, uint64_t current_time)
+{
+    size_t nb_released = 0;
+
+    if (current_time >= slab->next_trim_time) {
+        picoslab_chunk_t* chunk = slab->empty.first;
+
+        slab->next_trim_time = current_time + PICOSLAB_TRIM_INTERVAL;
+        while (chunk != NULL) {
+            picoslab_chunk_t* next = chunk->next;
+            if (chunk->empty_since == PICOSLAB_NOT_STAMPED) {
+                chunk->empty_since = current_time;
+            }
+            else if (nb_released == 0 && current_time >= chunk->empty_since + PICOSLAB_IDLE_DELAY) {
+                picoslab_chunk_delete(slab, chunk);
+                slab->stats.nb_chunks_trimmed++;
+                nb_released++;
+            }
+            chunk = next;
+        }
+    }
+    return nb_released;
+}
+
+void picoslab_set_high_water(picoslab_t* slab, size_t high_water)
+{
+    slab->high_water = high_water;
+    while (slab->empty.first != NULL && slab->empty.nb_chunks * slab->objects_per_chunk > slab->high_water) {
+        picoslab_chunk_delete(slab, slab->empty.first);
+        slab->stats.nb_chunks_trimmed++;
+    }
+}
+
+size_t picoslab_nb_cached(picoslab_t* slab)
+{
+    size_t nb_chunks = slab->partial.nb_chunks + slab->full.nb_chunks + slab->empty.nb_chunks;
+
+    return nb_chunks * slab->objects_per_chunk - slab->stats.nb_in_use;
+}
@@ -0,0 +1,115 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef PICOSLAB_H
+#define PICOSLAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Slab allocator for fixed size objects.
+ *
+ * Objects are carved from page aligned chunks of PICOSLAB_CHUNK_SIZE bytes.
+ * Freed objects are kept on the free list of their chunk and reused by
+ * later allocations. A chunk in which no object is in use is "empty". Empty
+ * chunks are returned to the system immediately if the number of cached free
+ * objects exceeds the high-water mark, or else gradually by picoslab_trim,
+ * once they have been empty for at least PICOSLAB_IDLE_DELAY microseconds.
+ *
+ * Objects are zeroed when first carved from a chunk, but not when recycled:
+ * callers reset whatever part of the object they need.
+ *
+ * Slabs holding large numbers of objects can be backed by huge pages, see
+ * picoslab_set_huge_pages. The chunks are then PICOSLAB_HUGE_PAGE_SIZE bytes,
+ * mapped with MAP_HUGETLB if the system has huge pages reserved, or else
+ * aligned on the huge page size and marked with MADV_HUGEPAGE so that the
+ * kernel can back them with transparent huge pages. One empty chunk is kept
+ * in the pool when objects are freed, to avoid mapping and unmapping a huge
+ * page each time the number of objects in use crosses a chunk boundary.
+ */
+
+#define PICOSLAB_PAGE_SIZE 4096
+#define PICOSLAB_CHUNK_SIZE 0x10000
+#define PICOSLAB_TRIM_INTERVAL 100000
+#define PICOSLAB_IDLE_DELAY 1000000
+#define PICOSLAB_HUGE_PAGE_SIZE 0x200000
+
+typedef struct st_picoslab_chunk_t picoslab_chunk_t;
+
+typedef struct st_picoslab_chunk_list_t {
+    picoslab_chunk_t* first;
+    picoslab_chunk_t* last;
+    size_t nb_chunks;
+} picoslab_chunk_list_t;
+
+typedef struct st_picoslab_stats_t {
+    uint64_t nb_allocations; /* Number of objects allocated */
+    uint64_t nb_pool_hits; /* Allocations served by recycling a freed object */
+    uint64_t nb_chunks_allocated; /* Chunks obtained from the system */
+    uint64_t nb_chunks_trimmed; /* Chunks returned to the system */
+    size_t nb_in_use; /* Objects currently allocated */
+    size_t nb_in_use_max; /* Max value of nb_in_use */
+    size_t memory_size; /* Bytes currently held in chunks */
+    uint64_t nb_chunks_hugetlb; /* Chunks mapped from the reserved huge pages */
+    uint64_t nb_chunks_advised; /* Chunks aligned on huge pages and advised for transparent huge pages */
+} picoslab_stats_t;
+
+typedef struct st_picoslab_t {
+    size_t object_size;
+    size_t slot_size;
+    size_t chunk_size;
+    size_t objects_per_chunk;
+    size_t high_water;
+    int use_huge_pages;
+    uint64_t next_trim_time;
+    picoslab_chunk_list_t partial; /* Chunks with some objects in use and some available */
+    picoslab_chunk_list_t full; /* Chunks in which all objects are in use */
+    picoslab_chunk_list_t empty; /* Chunks with no object in use, most recently emptied last */
+    picoslab_stats_t stats;
+} picoslab_t;
+
+/* Initialize a slab for objects of `object_size` bytes. At most `high_water`
+ * free objects are cached in empty chunks. */
+void picoslab_init(picoslab_t* slab, size_t object_size, size_t high_water);
+/* Return all the chunks to the system. Objects still in use become invalid. */
+void picoslab_release(picoslab_t* slab);
+void* picoslab_alloc(picoslab_t* slab);
+void picoslab_free(picoslab_t* slab, void* object);
+/* Return at most one idle chunk to the system. The call is cheap if made
+ * less than PICOSLAB_TRIM_INTERVAL after the previous trim. Returns the
+ * number of chunks released. */
+size_t picoslab_trim(picoslab_t* slab, uint64_t current_time);
+void picoslab_set_high_water(picoslab_t* slab, size_t high_water);
+/* Back the chunks of the slab with huge pages, or stop doing so. The chunk
+ * size changes, so this is only possible while the slab holds no chunk.
+ * Returns 0 if successful, -1 otherwise. */
+int picoslab_set_huge_pages(picoslab_t* slab, int use_huge_pages);
+/* Number of free objects cached, including those not yet carved from partial chunks. */
+size_t picoslab_nb_cached(picoslab_t* slab);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* PICOSLAB_H */
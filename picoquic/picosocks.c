@@ -21,6 +21,11 @@
 
 #include "picosocks.h"
 #include "picoquic_utils.h"
+#if defined(__linux__)
+#include <linux/filter.h>
+#include <linux/net_tstamp.h>
+#include <time.h>
+#endif
 
 int picoquic_bind_to_port(SOCKET_TYPE fd, int af, int port)
 {
@@ -241,6 +246,153 @@ int picoquic_socket_set_pmtud_options(SOCKET_TYPE sd, int af)
     return ret;
 }
 
+/* Request UDP receive coalescing (GRO) on Linux. When enabled, the kernel may
+ * deliver several consecutive packets from the same flow in a single buffer,
+ * and documents the segment size in an UDP_GRO control message.
+ * Returns 0 if the option is set, -1 if not supported.
+ */
+int picoquic_socket_set_udp_gro(SOCKET_TYPE sd)
+{
+    int ret = -1;
+#if defined(UDP_GRO)
+    int val = 1;
+    ret = setsockopt(sd, SOL_UDP, UDP_GRO, &val, sizeof(val));
+    if (ret != 0) {
+        DBG_PRINTF("setsockopt UDP_GRO fails, errno: %d\n", errno);
+        ret = -1;
+    }
+#else
+#ifdef UNREFERENCED_PARAMETER
+    UNREFERENCED_PARAMETER(sd);
+#endif
+#endif
+    return ret;
+}
+
+/* Allow several sockets to bind to the same address and port, letting the
+ * kernel distribute incoming packets between them. This must be set
+ * before binding the socket. Returns 0 if the option is set, -1 if not
+ * supported.
+ */
+int picoquic_socket_set_reuse_port(SOCKET_TYPE sd)
+{
+    int ret = -1;
+#if defined(SO_REUSEPORT) && !defined(_WINDOWS)
+    int val = 1;
+    ret = setsockopt(sd, SOL_SOCKET, SO_REUSEPORT, &val, sizeof(val));
+    if (ret != 0) {
+        DBG_PRINTF("setsockopt SO_REUSEPORT fails, errno: %d\n", errno);
+        ret = -1;
+    }
+#else
+#ifdef UNREFERENCED_PARAMETER
+    UNREFERENCED_PARAMETER(sd);
+#endif
+#endif
+    return ret;
+}
+
+/* Steer the packets between the sockets of a SO_REUSEPORT group based on
+ * the destination CID, using a classic BPF program. The kernel runs the
+ * program with the data pointing to the UDP payload, and uses the returned
+ * value as the index of the socket in the group. For short header packets,
+ * the index is the byte at `cid_offset` in the destination CID, modulo
+ * the number of workers. For long header packets, the program returns an
+ * invalid index, and the kernel falls back to selection by hash of the
+ * addresses. The sockets are indexed in the order in which they joined
+ * the group, so the workers must open their sockets in rank order.
+ * Returns 0 if the program is attached, -1 if not supported.
+ */
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+#define PICOQUIC_CID_STEERING_CBPF_LENGTH 6
+
+static void picoquic_cid_steering_cbpf_generate(struct sock_filter* code, size_t cid_offset, int nb_workers)
+{
+    /* A = first byte of the payload */
+    code[0] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 0);
+    /* If the long header bit is set, jump to the fallback */
+    code[1] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x80, 3, 0);
+    /* A = DCID[cid_offset] % nb_workers. A packet that is too short terminates
+     * the program with return code 0, selecting the first socket. */
+    code[2] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_B | BPF_ABS, (uint32_t)(1 + cid_offset));
+    code[3] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t)nb_workers);
+    code[4] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_A, 0);
+    /* Any index larger than the number of sockets selects by hash */
+    code[5] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+}
+#endif
+
+int picoquic_socket_attach_cid_steering(SOCKET_TYPE sd, size_t cid_offset, int nb_workers)
+{
+    int ret = -1;
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+    struct sock_filter code[PICOQUIC_CID_STEERING_CBPF_LENGTH];
+    struct sock_fprog prog;
+
+    if (nb_workers > 0 && cid_offset < PICOQUIC_CONNECTION_ID_MAX_SIZE) {
+        picoquic_cid_steering_cbpf_generate(code, cid_offset, nb_workers);
+        prog.len = PICOQUIC_CID_STEERING_CBPF_LENGTH;
+        prog.filter = code;
+        ret = setsockopt(sd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+        if (ret != 0) {
+            DBG_PRINTF("setsockopt SO_ATTACH_REUSEPORT_CBPF fails, errno: %d\n", errno);
+            ret = -1;
+        }
+    }
+#else
+#ifdef UNREFERENCED_PARAMETER
+    UNREFERENCED_PARAMETER(sd);
+    UNREFERENCED_PARAMETER(cid_offset);
+    UNREFERENCED_PARAMETER(nb_workers);
+#endif
+#endif
+    return ret;
+}
+
+/* Enable per packet departure times on the socket. The departure time
+ * is passed in a SCM_TXTIME control message, in nanoseconds of the
+ * monotonic clock. This requires a qdisc that supports it, such as fq.
+ * Returns 0 if the option is set, -1 if not supported.
+ */
+int picoquic_socket_set_txtime(SOCKET_TYPE sd)
+{
+    int ret = -1;
+#if defined(__linux__) && defined(SO_TXTIME)
+    struct sock_txtime txtime_config;
+
+    memset(&txtime_config, 0, sizeof(txtime_config));
+    txtime_config.clockid = CLOCK_MONOTONIC;
+    ret = setsockopt(sd, SOL_SOCKET, SO_TXTIME, &txtime_config, sizeof(txtime_config));
+    if (ret != 0) {
+        DBG_PRINTF("setsockopt SO_TXTIME fails, errno: %d\n", errno);
+        ret = -1;
+    }
+#else
+#ifdef UNREFERENCED_PARAMETER
+    UNREFERENCED_PARAMETER(sd);
+#endif
+#endif
+    return ret;
+}
+
+int picoquic_socket_set_busy_poll(SOCKET_TYPE sd, int busy_poll_usec)
+{
+    int ret = -1;
+#if defined(__linux__) && defined(SO_BUSY_POLL)
+    ret = setsockopt(sd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll_usec, sizeof(busy_poll_usec));
+    if (ret != 0) {
+        DBG_PRINTF("setsockopt SO_BUSY_POLL (%d) fails, errno: %d\n", busy_poll_usec, errno);
+        ret = -1;
+    }
+#else
+#ifdef UNREFERENCED_PARAMETER
+    UNREFERENCED_PARAMETER(sd);
+    UNREFERENCED_PARAMETER(busy_poll_usec);
+#endif
+#endif
+    return ret;
+}
+
 SOCKET_TYPE picoquic_open_client_socket(int af)
 {
 #ifdef _WINDOWS
@@ -478,6 +630,16 @@ void picoquic_socks_cmsg_parse(
                 }
             }
         }
+#if defined(UDP_GRO)
+        else if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            /* The kernel coalesced several segments of the same size in the buffer */
+            if (cmsg->cmsg_len > 0 && udp_coalesced_size != NULL) {
+                int gso_size = 0;
+                memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(int));
+                *udp_coalesced_size = (size_t)gso_size;
+            }
+        }
+#endif
     }
 #endif
 }
@@ -535,9 +697,23 @@ void picoquic_socks_cmsg_format(
     size_t send_msg_size,
     struct sockaddr* addr_from,
     int dest_if)
+{
+    picoquic_socks_cmsg_format_ex(vmsg, message_length, send_msg_size, addr_from, dest_if, 0);
+}
+
+void picoquic_socks_cmsg_format_ex(
+    void* vmsg,
+    size_t message_length,
+    size_t send_msg_size,
+    struct sockaddr* addr_from,
+    int dest_if,
+    uint64_t txtime)
 {
 #ifdef _WINDOWS
     WSAMSG* msg = (WSAMSG*)vmsg;
+#ifdef UNREFERENCED_PARAMETER
+    UNREFERENCED_PARAMETER(txtime);
+#endif
     int control_length = 0;
     struct cmsghdr* last_cmsg = NULL;
     int is_null = 0;
@@ -711,6 +887,22 @@ void picoquic_socks_cmsg_format(
             is_null = 1;
         }
     }
+#endif
+#if defined(SCM_TXTIME)
+    if (!is_null && txtime != 0) {
+        uint64_t* p_txtime = (uint64_t*)cmsg_format_header_return_data_ptr(msg, &last_cmsg,
+            &control_length, SOL_SOCKET, SCM_TXTIME, sizeof(uint64_t));
+        if (p_txtime != NULL) {
+            *p_txtime = txtime;
+        }
+        else {
+            is_null = 1;
+        }
+    }
+#else
+#ifdef UNREFERENCED_PARAMETER
+    UNREFERENCED_PARAMETER(txtime);
+#endif
 #endif
 
     msg->msg_controllen = control_length;
@@ -799,7 +991,7 @@ picoquic_recvmsg_async_ctx_t * picoquic_create_async_socket(int af, int recv_coa
 #ifdef UDP_RECV_MAX_COALESCED_SIZE
                 if (ret == 0) {
                     DWORD coalesced_size = 0x10000;
-                    ctx->recv_buffer_size = (recv_coalesced)?coalesced_size:PICOQUIC_MAX_PACKET_SIZE;
+                    ctx->recv_buffer_size = (recv_coalesced)?coalesced_size:PICOQUIC_MAX_PACKET_SIZE_LIMIT;
                     ctx->recv_buffer = (uint8_t*)malloc(ctx->recv_buffer_size);
                     ctx->supports_udp_recv_coalesced = recv_coalesced;
                     ctx->supports_udp_send_coalesced = send_coalesced;
@@ -821,7 +1013,7 @@ picoquic_recvmsg_async_ctx_t * picoquic_create_async_socket(int af, int recv_coa
                 }
 #else
                 if (ret == 0) {
-                    ctx->recv_buffer_size = PICOQUIC_MAX_PACKET_SIZE;
+                    ctx->recv_buffer_size = PICOQUIC_MAX_PACKET_SIZE_LIMIT;
                     ctx->recv_buffer = (uint8_t*)malloc(ctx->recv_buffer_size);
                     ctx->supports_udp_recv_coalesced = 0;
                     ctx->supports_udp_send_coalesced = 0;
@@ -944,6 +1136,18 @@ int picoquic_recvmsg(SOCKET_TYPE fd,
     int* dest_if,
     unsigned char* received_ecn,
     uint8_t* buffer, int buffer_max)
+{
+    return picoquic_recvmsg_ex(fd, addr_from, addr_dest, dest_if, received_ecn,
+        buffer, buffer_max, NULL);
+}
+
+int picoquic_recvmsg_ex(SOCKET_TYPE fd,
+    struct sockaddr_storage* addr_from,
+    struct sockaddr_storage* addr_dest,
+    int* dest_if,
+    unsigned char* received_ecn,
+    uint8_t* buffer, int buffer_max,
+    size_t* udp_coalesced_size)
 #ifdef _WINDOWS
 {
     GUID WSARecvMsg_GUID = WSAID_WSARECVMSG;
@@ -965,6 +1169,10 @@ int picoquic_recvmsg(SOCKET_TYPE fd,
         *received_ecn = 0;
     }
 
+    if (udp_coalesced_size != NULL) {
+        *udp_coalesced_size = 0;
+    }
+
     nResult = WSAIoctl(fd, SIO_GET_EXTENSION_FUNCTION_POINTER,
         &WSARecvMsg_GUID, sizeof WSARecvMsg_GUID,
         &WSARecvMsg, sizeof WSARecvMsg,
@@ -996,7 +1204,7 @@ int picoquic_recvmsg(SOCKET_TYPE fd,
             bytes_recv = -1;
         } else {
             bytes_recv = NumberOfBytes;
-            picoquic_socks_cmsg_parse(&msg, addr_dest, dest_if, received_ecn, NULL);
+            picoquic_socks_cmsg_parse(&msg, addr_dest, dest_if, received_ecn, udp_coalesced_size);
         }
     }
 
@@ -1013,6 +1221,10 @@ int picoquic_recvmsg(SOCKET_TYPE fd,
         *dest_if = 0;
     }
 
+    if (udp_coalesced_size != NULL) {
+        *udp_coalesced_size = 0;
+    }
+
     dataBuf.iov_base = (char*)buffer;
     dataBuf.iov_len = buffer_max;
 
@@ -1029,7 +1241,7 @@ int picoquic_recvmsg(SOCKET_TYPE fd,
     if (bytes_recv <= 0) {
         addr_from->ss_family = 0;
     } else {
-        picoquic_socks_cmsg_parse(&msg, addr_dest, dest_if, received_ecn, NULL);
+        picoquic_socks_cmsg_parse(&msg, addr_dest, dest_if, received_ecn, udp_coalesced_size);
     }
 
     return bytes_recv;
@@ -1043,6 +1255,18 @@ int picoquic_sendmsg(SOCKET_TYPE fd,
     const char* bytes, int length,
     int send_msg_size,
     int * sock_err)
+{
+    return picoquic_sendmsg_ex(fd, addr_dest, addr_from, dest_if, bytes, length, send_msg_size, 0, sock_err);
+}
+
+int picoquic_sendmsg_ex(SOCKET_TYPE fd,
+    struct sockaddr* addr_dest,
+    struct sockaddr* addr_from,
+    int dest_if,
+    const char* bytes, int length,
+    int send_msg_size,
+    uint64_t txtime,
+    int * sock_err)
 #ifdef _WINDOWS
 {
     GUID WSASendMsg_GUID = WSAID_WSASENDMSG;
@@ -1080,7 +1304,7 @@ int picoquic_sendmsg(SOCKET_TYPE fd,
         msg.Control.len = sizeof(cmsg_buffer);
 
         /* Format the control message */
-        picoquic_socks_cmsg_format(&msg, length, send_msg_size, addr_from, dest_if);
+        picoquic_socks_cmsg_format_ex(&msg, length, send_msg_size, addr_from, dest_if, txtime);
 
         /* Send the message */
         ret = WSASendMsg(fd, &msg, 0, &dwBytesSent, NULL, NULL);
@@ -1129,7 +1353,7 @@ int picoquic_sendmsg(SOCKET_TYPE fd,
     msg.msg_controllen = sizeof(cmsg_buffer);
 
     /* Format the control message */
-    picoquic_socks_cmsg_format(&msg, length, send_msg_size, addr_from, dest_if);
+    picoquic_socks_cmsg_format_ex(&msg, length, send_msg_size, addr_from, dest_if, txtime);
 
     bytes_sent = sendmsg(fd, &msg, 0);
 
@@ -185,6 +185,11 @@ void picoquic_close_server_sockets(picoquic_server_sockets_t* sockets);
 int picoquic_socket_set_pkt_info(SOCKET_TYPE sd, int af);
 int picoquic_socket_set_ecn_options(SOCKET_TYPE sd, int af, int * recv_set, int * send_set);
 int picoquic_socket_set_pmtud_options(SOCKET_TYPE sd, int af);
+int picoquic_socket_set_udp_gro(SOCKET_TYPE sd);
+int picoquic_socket_set_reuse_port(SOCKET_TYPE sd);
+int picoquic_socket_attach_cid_steering(SOCKET_TYPE sd, size_t cid_offset, int nb_workers);
+int picoquic_socket_set_txtime(SOCKET_TYPE sd);
+int picoquic_socket_set_busy_poll(SOCKET_TYPE sd, int busy_poll_usec);
 
 int picoquic_select(SOCKET_TYPE* sockets, int nb_sockets,
     struct sockaddr_storage* addr_from,
@@ -213,6 +218,17 @@ int picoquic_recvmsg(SOCKET_TYPE fd,
     unsigned char* received_ecn,
     uint8_t* buffer, int buffer_max);
 
+/* Same as picoquic_recvmsg, but also returns the segment size if
+ * the socket delivered several coalesced packets (Linux GRO, Windows URO),
+ * or zero otherwise. */
+int picoquic_recvmsg_ex(SOCKET_TYPE fd,
+    struct sockaddr_storage* addr_from,
+    struct sockaddr_storage* addr_dest,
+    int* dest_if,
+    unsigned char* received_ecn,
+    uint8_t* buffer, int buffer_max,
+    size_t* udp_coalesced_size);
+
 int picoquic_sendmsg(SOCKET_TYPE fd,
     struct sockaddr* addr_dest,
     struct sockaddr* addr_from,
@@ -220,6 +236,16 @@ int picoquic_sendmsg(SOCKET_TYPE fd,
     const char* bytes, int length,
     int send_msg_size, int * sock_err);
 
+/* Same as picoquic_sendmsg, but if `txtime` is not zero, and the socket
+ * was set with picoquic_socket_set_txtime, the kernel holds the packets
+ * until `txtime`, in nanoseconds of the monotonic clock. */
+int picoquic_sendmsg_ex(SOCKET_TYPE fd,
+    struct sockaddr* addr_dest,
+    struct sockaddr* addr_from,
+    int dest_if,
+    const char* bytes, int length,
+    int send_msg_size, uint64_t txtime, int * sock_err);
+
 int picoquic_send_through_socket(
     SOCKET_TYPE fd,
     struct sockaddr* addr_dest,
@@ -265,6 +291,14 @@ void picoquic_socks_cmsg_format(
     struct sockaddr* addr_from,
     int dest_if);
 
+void picoquic_socks_cmsg_format_ex(
+    void* vmsg,
+    size_t message_length,
+    size_t send_msg_size,
+    struct sockaddr* addr_from,
+    int dest_if,
+    uint64_t txtime);
+
 #ifdef __cplusplus
 }
 #endif
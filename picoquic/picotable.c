@@ -0,0 +1,404 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+#include "picotable.h"
+
+/* Control bytes: a slot in use holds the top 7 bits of the hash, the
+ * other values have the most significant bit set. */
+#define PICOTABLE_CTRL_EMPTY 0x80
+#define PICOTABLE_CTRL_DELETED 0xFE
+#define PICOTABLE_LSBS 0x0101010101010101ull
+#define PICOTABLE_MSBS 0x8080808080808080ull
+
+#define PICOTABLE_ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> ((64 - (b)) & 63)))
+#define PICOTABLE_MULTIPLE 0x5851f42d4c957f2dull
+
+/* Load 8 bytes in little endian order, byte i in bits 8i to 8i+7, so that
+ * the hash and the position of the bytes in the group masks do not depend
+ * on the platform. */
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_WINDOWS)
+static uint64_t picotable_load64(const uint8_t* p)
+{
+    uint64_t x;
+
+    memcpy(&x, p, sizeof(uint64_t));
+    return x;
+}
+#else
+static uint64_t picotable_load64(const uint8_t* p)
+{
+    uint64_t x = 0;
+
+    for (int i = 7; i >= 0; i--) {
+        x = (x << 8) | p[i];
+    }
+    return x;
+}
+#endif
+
+/* Full 64x64 bit product, folded by xoring the high and low halves */
+static uint64_t picotable_folded_multiply(uint64_t a, uint64_t b)
+{
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 r = (unsigned __int128)a * b;
+
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    uint64_t high;
+    uint64_t low = _umul128(a, b, &high);
+
+    return low ^ high;
+#else
+    uint64_t a_lo = (uint32_t)a;
+    uint64_t a_hi = a >> 32;
+    uint64_t b_lo = (uint32_t)b;
+    uint64_t b_hi = b >> 32;
+    uint64_t lo_lo = a_lo * b_lo;
+    uint64_t hi_lo = a_hi * b_lo;
+    uint64_t cross = (lo_lo >> 32) + (uint32_t)hi_lo + a_lo * b_hi;
+    uint64_t high = a_hi * b_hi + (hi_lo >> 32) + (cross >> 32);
+    uint64_t low = (cross << 32) | (uint32_t)lo_lo;
+
+    return low ^ high;
+#endif
+}
+
+/* Keyed hash of the key. The trailing zero words are not hashed, so that
+ * a key holding an 8 byte CID and its length costs 2 words, and an IPv4
+ * address 1 word. Each word is mixed with a folded multiply, and the result
+ * depends on the 128 bits of the secret seed: a third party choosing the
+ * CIDs or the addresses cannot predict which keys collide. */
+static uint64_t picotable_hash(const picotable_t* table, const picotable_key_t* key)
+{
+    uint64_t h = picotable_folded_multiply(key->w[0] ^ picotable_load64(table->hash_seed), PICOTABLE_MULTIPLE);
+    int rotate;
+
+    if ((key->w[1] | key->w[2]) != 0) {
+        h = picotable_folded_multiply(h ^ key->w[1], PICOTABLE_MULTIPLE);
+        if (key->w[2] != 0) {
+            h = picotable_folded_multiply(h ^ key->w[2], PICOTABLE_MULTIPLE);
+        }
+    }
+    h = picotable_folded_multiply(h, picotable_load64(table->hash_seed + 8));
+    rotate = (int)(h & 63);
+
+    return PICOTABLE_ROTL(h, rotate);
+}
+
+static int picotable_key_equal(const picotable_key_t* key1, const picotable_key_t* key2)
+{
+    return key1->w[0] == key2->w[0] && key1->w[1] == key2->w[1] && key1->w[2] == key2->w[2];
+}
+
+static uint8_t picotable_tag(uint64_t hash)
+{
+    return (uint8_t)(hash >> 57);
+}
+
+static uint64_t picotable_load_group(const uint8_t* ctrl)
+{
+    return picotable_load64(ctrl);
+}
+
+/* Each of the following returns a mask with the top bit of the matching
+ * bytes set. Matching the tag may produce false positives, which are
+ * eliminated when comparing the keys, but never false negatives. */
+static uint64_t picotable_match_tag(uint64_t group, uint8_t tag)
+{
+    uint64_t x = group ^ (PICOTABLE_LSBS * tag);
+
+    return (x - PICOTABLE_LSBS) & ~x & PICOTABLE_MSBS;
+}
+
+static uint64_t picotable_match_empty(uint64_t group)
+{
+    return group & (~group << 6) & PICOTABLE_MSBS;
+}
+
+static uint64_t picotable_match_available(uint64_t group)
+{
+    return group & ~(group << 7) & PICOTABLE_MSBS;
+}
+
+static size_t picotable_first_match(uint64_t mask)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (size_t)(__builtin_ctzll(mask) >> 3);
+#else
+    size_t index = 0;
+
+    while ((mask & 0x80) == 0) {
+        mask >>= 8;
+        index++;
+    }
+    return index;
+#endif
+}
+
+static int picotable_array_init(picotable_array_t* array, size_t capacity)
+{
+    int ret = 0;
+
+    memset(array, 0, sizeof(picotable_array_t));
+    array->ctrl = (uint8_t*)malloc(capacity);
+    array->slots = (picotable_slot_t*)malloc(capacity * sizeof(picotable_slot_t));
+    if (array->ctrl == NULL || array->slots == NULL) {
+        free(array->ctrl);
+        free(array->slots);
+        memset(array, 0, sizeof(picotable_array_t));
+        ret = -1;
+    }
+    else {
+        memset(array->ctrl, PICOTABLE_CTRL_EMPTY, capacity);
+        array->capacity = capacity;
+    }
+    return ret;
+}
+
+static void picotable_array_release(picotable_array_t* array)
+{
+    free(array->ctrl);
+    free(array->slots);
+    memset(array, 0, sizeof(picotable_array_t));
+}
+
+/* Groups are probed in triangular sequence, which visits all the groups
+ * when their number is a power of 2. */
+static int picotable_array_find(picotable_t* table, picotable_array_t* array, const picotable_key_t* key, uint64_t hash, size_t* index)
+{
+    int found = 0;
+
+    if (array->count > 0) {
+        size_t group_mask = array->capacity / PICOTABLE_GROUP_SIZE - 1;
+        size_t g = (size_t)hash & group_mask;
+        uint8_t tag = picotable_tag(hash);
+
+        for (size_t j = 0; !found && j <= group_mask; j++) {
+            uint64_t group = picotable_load_group(array->ctrl + g * PICOTABLE_GROUP_SIZE);
+            uint64_t match = picotable_match_tag(group, tag);
+
+            table->stats.nb_probes++;
+            while (match != 0) {
+                size_t i = g * PICOTABLE_GROUP_SIZE + picotable_first_match(match);
+
+                if (picotable_key_equal(&array->slots[i].key, key)) {
+                    *index = i;
+                    found = 1;
+                    break;
+                }
+                match &= match - 1;
+            }
+            if (!found && picotable_match_empty(group) != 0) {
+                break;
+            }
+            g = (g + j + 1) & group_mask;
+        }
+    }
+    return found;
+}
+
+/* Insert a key known to be absent. The caller ensures that a slot is available. */
+static void picotable_array_insert(picotable_array_t* array, const picotable_key_t* key, uint64_t hash, void* value)
+{
+    size_t group_mask = array->capacity / PICOTABLE_GROUP_SIZE - 1;
+    size_t g = (size_t)hash & group_mask;
+
+    for (size_t j = 0; j <= group_mask; j++) {
+        uint64_t available = picotable_match_available(picotable_load_group(array->ctrl + g * PICOTABLE_GROUP_SIZE));
+
+        if (available != 0) {
+            size_t i = g * PICOTABLE_GROUP_SIZE + picotable_first_match(available);
+
+            if (array->ctrl[i] == PICOTABLE_CTRL_DELETED) {
+                array->nb_deleted--;
+            }
+            array->ctrl[i] = picotable_tag(hash);
+            array->slots[i].key = *key;
+            array->slots[i].value = value;
+            array->count++;
+            break;
+        }
+        g = (g + j + 1) & group_mask;
+    }
+}
+
+/* A slot can be marked empty if its group has other empty slots: no probe
+ * continues past such a group, so no entry depends on this slot being full. */
+static void picotable_array_erase(picotable_array_t* array, size_t index)
+{
+    size_t g = index / PICOTABLE_GROUP_SIZE;
+
+    if (picotable_match_empty(picotable_load_group(array->ctrl + g * PICOTABLE_GROUP_SIZE)) != 0) {
+        array->ctrl[index] = PICOTABLE_CTRL_EMPTY;
+    }
+    else {
+        array->ctrl[index] = PICOTABLE_CTRL_DELETED;
+        array->nb_deleted++;
+    }
+    array->count--;
+}
+
+/* Move up to nb_slots slots from the previous array to the current one.
+ * The moved slots are marked deleted, so that lookups in the previous
+ * array still find the entries located after them. */
+static void picotable_migrate(picotable_t* table, size_t nb_slots)
+{
+    picotable_array_t* previous = &table->previous;
+
+    while (previous->capacity > 0 && nb_slots > 0) {
+        if (previous->count == 0 || table->migrate_index >= previous->capacity) {
+            picotable_array_release(previous);
+            table->migrate_index = 0;
+        }
+        else {
+            size_t i = table->migrate_index;
+
+            if (previous->ctrl[i] < PICOTABLE_CTRL_EMPTY) {
+                picotable_array_insert(&table->current, &previous->slots[i].key,
+                    picotable_hash(table, &previous->slots[i].key), previous->slots[i].value);
+                previous->ctrl[i] = PICOTABLE_CTRL_DELETED;
+                previous->nb_deleted++;
+                previous->count--;
+            }
+            table->migrate_index++;
+            nb_slots--;
+        }
+    }
+}
+
+/* Start moving the entries to a new array, twice larger unless most of the
+ * unavailable slots are deleted ones, in which case the table is only
+ * cleaned up. */
+static int picotable_grow(picotable_t* table)
+{
+    int ret = 0;
+    picotable_array_t array;
+    size_t capacity = table->current.capacity;
+
+    if (table->previous.capacity > 0) {
+        picotable_migrate(table, SIZE_MAX);
+    }
+    if (table->current.nb_deleted <= table->current.count / 2) {
+        capacity *= 2;
+    }
+    if (capacity < table->current.capacity || picotable_array_init(&array, capacity) != 0) {
+        ret = -1;
+    }
+    else {
+        table->previous = table->current;
+        table->current = array;
+        table->migrate_index = 0;
+        table->stats.nb_resizes++;
+    }
+    return ret;
+}
+
+int picotable_init(picotable_t* table, const uint8_t* hash_seed)
+{
+    memset(table, 0, sizeof(picotable_t));
+    table->hash_seed = hash_seed;
+
+    return picotable_array_init(&table->current, PICOTABLE_MIN_CAPACITY);
+}
+
+void picotable_release(picotable_t* table)
+{
+    picotable_array_release(&table->current);
+    picotable_array_release(&table->previous);
+}
+
+void* picotable_find(picotable_t* table, const picotable_key_t* key)
+{
+    void* value = NULL;
+    uint64_t hash = picotable_hash(table, key);
+    size_t index;
+
+    /* Lookups also move entries, so that a table that is mostly read does
+     * not keep probing the previous array. */
+    if (table->previous.capacity > 0) {
+        picotable_migrate(table, PICOTABLE_MIGRATE_STEP);
+    }
+
+    table->stats.nb_lookups++;
+    if (picotable_array_find(table, &table->current, key, hash, &index)) {
+        value = table->current.slots[index].value;
+    }
+    else if (picotable_array_find(table, &table->previous, key, hash, &index)) {
+        value = table->previous.slots[index].value;
+    }
+    return value;
+}
+
+int picotable_insert(picotable_t* table, const picotable_key_t* key, void* value)
+{
+    int ret = 0;
+    uint64_t hash = picotable_hash(table, key);
+    size_t index;
+
+    picotable_migrate(table, PICOTABLE_MIGRATE_STEP);
+
+    if (picotable_array_find(table, &table->current, key, hash, &index) ||
+        picotable_array_find(table, &table->previous, key, hash, &index)) {
+        ret = -1;
+    }
+    else {
+        /* Keep the load below 7/8. If the table cannot grow, it can still
+         * be filled until no slot is available. */
+        if (8 * (table->current.count + table->current.nb_deleted + 1) > 7 * table->current.capacity &&
+            picotable_grow(table) != 0 &&
+            table->current.count >= table->current.capacity) {
+            ret = -1;
+        }
+        if (ret == 0) {
+            picotable_array_insert(&table->current, key, hash, value);
+        }
+    }
+    return ret;
+}
+
+void* picotable_remove(picotable_t* table, const picotable_key_t* key)
+{
+    void* value = NULL;
+    uint64_t hash = picotable_hash(table, key);
+    size_t index;
+
+    picotable_migrate(table, PICOTABLE_MIGRATE_STEP);
+
+    if (picotable_array_find(table, &table->current, key, hash, &index)) {
+        value = table->current.slots[index].value;
+        picotable_array_erase(&table->current, index);
+    }
+    else if (picotable_array_find(table, &table->previous, key, hash, &index)) {
+        value = table->previous.slots[index].value;
+        picotable_array_erase(&table->previous, index);
+    }
+    return value;
+}
+
+size_t picotable_count(const picotable_t* table)
+{
+    return table->current.count + table->previous.count;
+}
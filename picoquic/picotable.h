@@ -0,0 +1,112 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef PICOTABLE_H
+#define PICOTABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Open addressing hash table with fixed size keys.
+ *
+ * The table maps keys of PICOTABLE_KEY_WORDS 64 bit words to pointers. The
+ * callers build the keys in registers, e.g. from a CID and its length, so
+ * that the table never reads back bytes that were just written one by one.
+ * The keys are copied inline in the slots and compared word by word: there
+ * is no compare callback, and a lookup does not touch the objects referenced
+ * by the table. The trailing zero words of a key are not hashed, so the
+ * callers should place the significant data in the first words.
+ *
+ * CIDs and addresses are chosen by third parties, so the hash is keyed with
+ * the 128 bit seed of the QUIC context. It mixes each word with a folded
+ * 64x64 bit multiply, which costs a few cycles, instead of SipHash.
+ *
+ * The layout follows the "Swiss table" design. Each slot has a control
+ * byte, holding either a 7 bit tag derived from the hash, or a marker for
+ * empty or deleted slots. The control bytes are probed by groups of 8,
+ * and all the tags of a group are compared at once with 64 bit arithmetic,
+ * so that the slots are only read when the tag matches.
+ *
+ * The table grows when its load exceeds 7/8. The new array is allocated at
+ * once, but the entries are moved incrementally: each operation moves a few
+ * slots from the previous array, and lookups check both arrays until the
+ * previous one is empty. This avoids long pauses when a server holding a
+ * very large number of connections needs to resize its tables.
+ */
+
+#define PICOTABLE_KEY_WORDS 3
+#define PICOTABLE_GROUP_SIZE 8
+#define PICOTABLE_MIN_CAPACITY 64
+#define PICOTABLE_MIGRATE_STEP 16
+
+typedef struct st_picotable_key_t {
+    uint64_t w[PICOTABLE_KEY_WORDS];
+} picotable_key_t;
+
+typedef struct st_picotable_slot_t {
+    picotable_key_t key;
+    void* value;
+} picotable_slot_t;
+
+typedef struct st_picotable_array_t {
+    uint8_t* ctrl;
+    picotable_slot_t* slots;
+    size_t capacity; /* Power of 2, multiple of the group size */
+    size_t count; /* Slots in use */
+    size_t nb_deleted; /* Slots marked deleted */
+} picotable_array_t;
+
+typedef struct st_picotable_stats_t {
+    uint64_t nb_lookups;
+    uint64_t nb_probes; /* Groups examined during lookups */
+    uint64_t nb_resizes;
+} picotable_stats_t;
+
+typedef struct st_picotable_t {
+    const uint8_t* hash_seed;
+    picotable_array_t current;
+    picotable_array_t previous; /* Entries not yet moved to the current array */
+    size_t migrate_index; /* Next slot to move in the previous array */
+    picotable_stats_t stats;
+} picotable_t;
+
+/* Initialize the table. The seed is read at each hash computation, it can
+ * be set after the table is initialized, but not once keys are inserted.
+ * Returns 0 if successful, -1 if memory cannot be allocated. */
+int picotable_init(picotable_t* table, const uint8_t* hash_seed);
+void picotable_release(picotable_t* table);
+/* Return the value registered for the key, or NULL. */
+void* picotable_find(picotable_t* table, const picotable_key_t* key);
+/* Register a value for the key. Returns -1 if the key is already present,
+ * or if the table is full and cannot grow. */
+int picotable_insert(picotable_t* table, const picotable_key_t* key, void* value);
+/* Remove the key, returns the value that was registered or NULL. */
+void* picotable_remove(picotable_t* table, const picotable_key_t* key);
+size_t picotable_count(const picotable_t* table);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* PICOTABLE_H */
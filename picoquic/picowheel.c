@@ -0,0 +1,227 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+#include "picowheel.h"
+
+/* Index of the most significant bit set, x must not be zero */
+static int picowheel_msb(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(x);
+#else
+    int n = 0;
+
+    for (int shift = 32; shift > 0; shift >>= 1) {
+        if ((x >> shift) != 0) {
+            x >>= shift;
+            n += shift;
+        }
+    }
+    return n;
+#endif
+}
+
+/* Index of the least significant bit set, x must not be zero */
+static int picowheel_lsb(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    return picowheel_msb(x & (~x + 1));
+#endif
+}
+
+void picowheel_init(picowheel_t* wheel, uint64_t current_time)
+{
+    memset(wheel, 0, sizeof(picowheel_t));
+    wheel->current_time = current_time;
+    wheel->expired_last = &wheel->expired;
+}
+
+static void picowheel_link(picowheel_node_t** pprev, picowheel_node_t* node)
+{
+    node->next = *pprev;
+    if (node->next != NULL) {
+        node->next->pprev = &node->next;
+    }
+    node->pprev = pprev;
+    *pprev = node;
+}
+
+static void picowheel_unlink(picowheel_t* wheel, picowheel_node_t* node)
+{
+    *node->pprev = node->next;
+    if (node->next != NULL) {
+        node->next->pprev = node->pprev;
+    }
+    if (node->bucket == PICOWHEEL_EXPIRED) {
+        if (wheel->expired_last == &node->next) {
+            wheel->expired_last = node->pprev;
+        }
+    }
+    else if (wheel->slots[node->bucket] == NULL) {
+        wheel->occupied[node->bucket / PICOWHEEL_SLOTS] &= ~(1ull << (node->bucket % PICOWHEEL_SLOTS));
+    }
+    node->next = NULL;
+    node->pprev = NULL;
+}
+
+/* Place the node at the level where its wake time first differs from the
+ * current time. Expired nodes are queued at the end of the expired list,
+ * so that they are served in order. */
+static void picowheel_place(picowheel_t* wheel, picowheel_node_t* node)
+{
+    if (node->wake_time <= wheel->current_time) {
+        node->bucket = PICOWHEEL_EXPIRED;
+        picowheel_link(wheel->expired_last, node);
+        wheel->expired_last = &node->next;
+    }
+    else {
+        int level = picowheel_msb(node->wake_time ^ wheel->current_time) / PICOWHEEL_BITS;
+        int slot = (int)((node->wake_time >> (level * PICOWHEEL_BITS)) & (PICOWHEEL_SLOTS - 1));
+
+        node->bucket = level * PICOWHEEL_SLOTS + slot;
+        picowheel_link(&wheel->slots[node->bucket], node);
+        wheel->occupied[level] |= 1ull << slot;
+        if (wheel->earliest != NULL && node->wake_time < wheel->earliest->wake_time) {
+            wheel->earliest = node;
+        }
+    }
+}
+
+void picowheel_remove(picowheel_t* wheel, picowheel_node_t* node)
+{
+    if (node->pprev != NULL) {
+        if (node == wheel->earliest) {
+            wheel->earliest = NULL;
+        }
+        picowheel_unlink(wheel, node);
+        wheel->count--;
+    }
+}
+
+void picowheel_insert(picowheel_t* wheel, picowheel_node_t* node, uint64_t wake_time)
+{
+    picowheel_remove(wheel, node);
+    node->wake_time = wake_time;
+    picowheel_place(wheel, node);
+    wheel->count++;
+}
+
+void picowheel_advance(picowheel_t* wheel, uint64_t current_time)
+{
+    if (current_time > wheel->current_time) {
+        picowheel_node_t* moved = NULL;
+        picowheel_node_t* next;
+
+        /* Collect the nodes in the slots between the old and the new
+         * current time. All slots in use at a level are above the slot
+         * of the old current time at that level. */
+        for (int level = 0; level < PICOWHEEL_LEVELS; level++) {
+            int shift = level * PICOWHEEL_BITS;
+            uint64_t old_index = wheel->current_time >> shift;
+            uint64_t new_index = current_time >> shift;
+            uint64_t mask = wheel->occupied[level];
+
+            if (old_index == new_index) {
+                break;
+            }
+            if (new_index < (old_index | (PICOWHEEL_SLOTS - 1))) {
+                mask &= (2ull << (new_index & (PICOWHEEL_SLOTS - 1))) - 1;
+            }
+            wheel->occupied[level] &= ~mask;
+            while (mask != 0) {
+                int slot = picowheel_lsb(mask);
+                picowheel_node_t** head = &wheel->slots[level * PICOWHEEL_SLOTS + slot];
+
+                mask &= mask - 1;
+                while (*head != NULL) {
+                    next = (*head)->next;
+                    (*head)->next = moved;
+                    moved = *head;
+                    *head = next;
+                }
+            }
+        }
+        wheel->current_time = current_time;
+        if (wheel->earliest != NULL && wheel->earliest->wake_time <= current_time) {
+            wheel->earliest = NULL;
+        }
+        /* The list of moved nodes is reversed, so that the nodes collected
+         * first, i.e., the earliest, are placed first. */
+        next = NULL;
+        while (moved != NULL) {
+            picowheel_node_t* node = moved;
+
+            moved = node->next;
+            node->next = next;
+            next = node;
+        }
+        while (next != NULL) {
+            picowheel_node_t* node = next;
+
+            next = node->next;
+            picowheel_place(wheel, node);
+        }
+    }
+}
+
+picowheel_node_t* picowheel_first(picowheel_t* wheel)
+{
+    picowheel_node_t* node = wheel->expired;
+
+    if (node == NULL) {
+        if (wheel->earliest == NULL) {
+            for (int level = 0; level < PICOWHEEL_LEVELS; level++) {
+                if (wheel->occupied[level] != 0) {
+                    node = wheel->slots[level * PICOWHEEL_SLOTS + picowheel_lsb(wheel->occupied[level])];
+                    wheel->earliest = node;
+                    /* All the nodes in a level 0 slot have the same wake time */
+                    if (level > 0) {
+                        while ((node = node->next) != NULL) {
+                            if (node->wake_time < wheel->earliest->wake_time) {
+                                wheel->earliest = node;
+                            }
+                        }
+                    }
+                    break;
+                }
+            }
+        }
+        node = wheel->earliest;
+    }
+
+    return node;
+}
+
+picowheel_node_t* picowheel_first_due(picowheel_t* wheel, uint64_t max_time)
+{
+    picowheel_node_t* node;
+
+    picowheel_advance(wheel, max_time);
+    node = wheel->expired;
+    while (node != NULL && node->wake_time > max_time) {
+        node = node->next;
+    }
+
+    return node;
+}
@@ -0,0 +1,97 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef PICOWHEEL_H
+#define PICOWHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Hierarchical timer wheel.
+ *
+ * The wheel holds nodes sorted by wake time, with constant cost insertion
+ * and removal. Level 0 has 64 slots of 1 microsecond, level 1 has 64 slots
+ * of 64 microseconds, level 2 of 4 milliseconds, and so on, each level
+ * covering 64 times the span of the previous one. A node is placed at the
+ * lowest level at which its wake time differs from the current time of the
+ * wheel, so timers in the near future keep a microsecond resolution while
+ * timers far in the future sit in coarse slots. When the current time
+ * advances, the slots that it passes are emptied and their nodes are
+ * placed again at a lower level, or in the list of expired nodes. A node
+ * moves at most once per level.
+ *
+ * The slots of each level are tracked in a 64 bit mask, so finding the
+ * earliest node only requires finding the lowest level in use and the
+ * lowest bit of its mask. Above level 0, the earliest slot may hold nodes
+ * with different wake times, and the node with the lowest time is found
+ * by scanning the slot. The result is cached until that node is removed
+ * or an earlier node is inserted.
+ */
+
+#define PICOWHEEL_BITS 6
+#define PICOWHEEL_SLOTS 64
+#define PICOWHEEL_LEVELS 11 /* 6*11 bits cover 64 bit times */
+#define PICOWHEEL_EXPIRED (-1)
+
+typedef struct st_picowheel_node_t {
+    struct st_picowheel_node_t* next;
+    struct st_picowheel_node_t** pprev; /* NULL if not in the wheel */
+    uint64_t wake_time;
+    int bucket; /* level * PICOWHEEL_SLOTS + slot, or PICOWHEEL_EXPIRED */
+} picowheel_node_t;
+
+typedef struct st_picowheel_t {
+    uint64_t current_time;
+    uint64_t occupied[PICOWHEEL_LEVELS];
+    picowheel_node_t* slots[PICOWHEEL_LEVELS * PICOWHEEL_SLOTS];
+    picowheel_node_t* expired; /* Nodes with wake time <= current time */
+    picowheel_node_t** expired_last; /* Next pointer of the last expired node */
+    picowheel_node_t* earliest; /* Cached earliest node in the slots, or NULL */
+    size_t count;
+} picowheel_t;
+
+void picowheel_init(picowheel_t* wheel, uint64_t current_time);
+/* Insert a node, or move it if it is already in the wheel. */
+void picowheel_insert(picowheel_t* wheel, picowheel_node_t* node, uint64_t wake_time);
+void picowheel_remove(picowheel_t* wheel, picowheel_node_t* node);
+/* Move the current time forward. The nodes whose wake time is reached are
+ * moved to the expired list. Times earlier than the current time are
+ * ignored. */
+void picowheel_advance(picowheel_t* wheel, uint64_t current_time);
+/* Return an expired node if there is one, in no particular order, or
+ * else the node with the lowest wake time. Returns NULL if the wheel
+ * is empty. */
+picowheel_node_t* picowheel_first(picowheel_t* wheel);
+/* Return an expired node with wake time lower than or equal to max_time,
+ * after advancing the wheel to that time, or NULL. */
+picowheel_node_t* picowheel_first_due(picowheel_t* wheel, uint64_t max_time);
+
+#define picowheel_is_inserted(node) ((node)->pprev != NULL)
+#define picowheel_count(wheel) ((wheel)->count)
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* PICOWHEEL_H */
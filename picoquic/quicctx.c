@@ -258,50 +258,69 @@ typedef struct st_picoquic_net_secret_key_t {
     picoquic_cnx_t* cnx;
 } picoquic_net_secret_key_t;
 
-/* Hash and compare for CNX hash tables */
-static uint64_t picoquic_local_cnxid_hash(const void* key, const uint8_t * hash_seed)
-{
-    const picoquic_local_cnxid_t* l_cid = (const picoquic_local_cnxid_t*)key;
-    return picoquic_connection_id_hash(&l_cid->cnx_id, hash_seed);
-}
+/* Keys of the CID and address tables. The keys are built in registers
+ * rather than byte by byte, and the unused bytes are zero, so that short
+ * keys only use the first words and are hashed faster. */
+static const uint8_t picoquic_table_key_mask[16] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0, 0, 0, 0, 0, 0, 0, 0 };
 
-static int picoquic_local_cnxid_compare(const void* key1, const void* key2)
+/* Load the 8 bytes at "bytes", keeping only the first "length" ones. */
+static uint64_t picoquic_table_key_word(const uint8_t* bytes, size_t length)
 {
-    const picoquic_local_cnxid_t* l_cid1 = (const picoquic_local_cnxid_t*)key1;
-    const picoquic_local_cnxid_t* l_cid2 = (const picoquic_local_cnxid_t*)key2;
-
-    return picoquic_compare_connection_id(&l_cid1->cnx_id, &l_cid2->cnx_id);
-}
+    uint64_t w;
+    uint64_t mask;
 
-static picohash_item * picoquic_local_cnxid_to_item(const void* key)
-{
-    picoquic_local_cnxid_t* l_cid = (picoquic_local_cnxid_t*)key;
+    if (length > 8) {
+        length = 8;
+    }
+    memcpy(&w, bytes, 8);
+    memcpy(&mask, picoquic_table_key_mask + 8 - length, 8);
 
-    return &l_cid->hash_item;
+    return w & mask;
 }
 
-static uint64_t picoquic_net_id_hash(const void* key, const uint8_t* hash_seed)
+/* The first 8 bytes of the CID are in the first word, the length and the
+ * last 4 bytes in the second, the bytes 8 to 15 in the third. The key of
+ * a CID of up to 8 bytes has only 2 significant words. */
+void picoquic_cid_table_key(const picoquic_connection_id_t* cnx_id, picotable_key_t* key)
 {
-    const picoquic_path_t* path_x = (const picoquic_path_t*)key;
-    
-    /* Using siphash, because secret and IP address are chosen by third parties*/
-    return picoquic_hash_addr((struct sockaddr*) & path_x->registered_peer_addr, hash_seed);
-}
+    size_t length = cnx_id->id_len;
+    uint32_t tail = 0;
 
-static picohash_item * picoquic_local_netid_to_item(const void* key)
-{
-    picoquic_path_t* path_x = (picoquic_path_t*)key;
+    key->w[0] = picoquic_table_key_word(cnx_id->id, length);
+    key->w[2] = (length > 8) ? picoquic_table_key_word(cnx_id->id + 8, length - 8) : 0;
+    if (length > 16) {
+        uint32_t mask;
 
-    return &path_x->net_id_hash_item;
+        memcpy(&tail, cnx_id->id + 16, 4);
+        memcpy(&mask, picoquic_table_key_mask + 8 - (length - 16), 4);
+        tail &= mask;
+    }
+    key->w[1] = (uint64_t)cnx_id->id_len | ((uint64_t)tail << 32);
 }
 
-
-static int picoquic_net_id_compare(const void* key1, const void* key2)
+/* The key of an IPv4 address is a single word holding the address, the
+ * port and the family. For IPv6, the address takes the first 2 words. */
+void picoquic_net_table_key(const struct sockaddr* addr, picotable_key_t* key)
 {
-    const picoquic_path_t* path_x1 = (const picoquic_path_t*)key1;
-    const picoquic_path_t* path_x2 = (const picoquic_path_t*)key2;
+    uint16_t port;
 
-    return picoquic_compare_addr((struct sockaddr*) & path_x1->registered_peer_addr, (struct sockaddr*) & path_x2->registered_peer_addr);
+    memset(key, 0, sizeof(picotable_key_t));
+    if (addr->sa_family == AF_INET) {
+        uint32_t addr32;
+
+        memcpy(&addr32, &((struct sockaddr_in*)addr)->sin_addr, 4);
+        port = ((struct sockaddr_in*)addr)->sin_port;
+        key->w[0] = (uint64_t)addr32 | ((uint64_t)port << 32) | ((uint64_t)AF_INET << 48);
+    }
+    else if (addr->sa_family == AF_INET6) {
+        memcpy(key->w, &((struct sockaddr_in6*)addr)->sin6_addr, 16);
+        port = ((struct sockaddr_in6*)addr)->sin6_port;
+        key->w[2] = (uint64_t)port | ((uint64_t)AF_INET6 << 16);
+    }
+    else {
+        key->w[0] = (uint64_t)addr->sa_family << 48;
+    }
 }
 
 static uint64_t picoquic_net_icid_hash(const void* key, const uint8_t* hash_seed)
@@ -621,6 +640,35 @@ uint32_t picoquic_current_number_connections(picoquic_quic_t * quic)
 static void picoquic_wake_list_init(picoquic_quic_t* quic);
 
 /* QUIC context create and dispose */
+static size_t picoquic_data_node_class_size(picoquic_quic_t* quic, int size_class)
+{
+    const size_t class_size[PICOQUIC_NB_DATA_NODE_CLASSES] = PICOQUIC_DATA_NODE_CLASS_SIZES;
+
+    /* The last class holds a full packet */
+    return (size_class == PICOQUIC_NB_DATA_NODE_CLASSES - 1) ? quic->max_packet_size : class_size[size_class];
+}
+
+static void picoquic_init_packet_slabs(picoquic_quic_t* quic)
+{
+    picoslab_init(&quic->packet_slab,
+        offsetof(struct st_picoquic_packet_t, bytes) + quic->max_packet_size, PICOQUIC_MAX_PACKETS_IN_POOL);
+    (void)picoslab_set_huge_pages(&quic->packet_slab, quic->use_huge_page_pools);
+    for (int i = 0; i < PICOQUIC_NB_DATA_NODE_CLASSES; i++) {
+        picoslab_init(&quic->data_node_slab[i],
+            offsetof(struct st_picoquic_stream_data_node_t, data) + picoquic_data_node_class_size(quic, i),
+            PICOQUIC_MAX_PACKETS_IN_POOL);
+        (void)picoslab_set_huge_pages(&quic->data_node_slab[i], quic->use_huge_page_pools);
+    }
+}
+
+static void picoquic_release_packet_slabs(picoquic_quic_t* quic)
+{
+    picoslab_release(&quic->packet_slab);
+    for (int i = 0; i < PICOQUIC_NB_DATA_NODE_CLASSES; i++) {
+        picoslab_release(&quic->data_node_slab[i]);
+    }
+}
+
 picoquic_quic_t* picoquic_create(uint32_t max_nb_connections,
     char const* cert_file_name,
     char const* key_file_name, 
@@ -666,6 +714,10 @@ picoquic_quic_t* picoquic_create(uint32_t max_nb_connections,
         quic->default_datagram_priority = PICOQUIC_DEFAULT_STREAM_PRIORITY;
         quic->cwin_max = UINT64_MAX;
         quic->sequence_hole_pseudo_period = PICOQUIC_DEFAULT_HOLE_PERIOD;
+        quic->max_packet_size = PICOQUIC_MAX_PACKET_SIZE;
+        picoquic_init_packet_slabs(quic);
+        picoslab_init(&quic->stream_slab, sizeof(picoquic_stream_head_t), PICOQUIC_MAX_STREAMS_IN_POOL);
+        picoslab_init(&quic->sack_item_slab, sizeof(picoquic_sack_item_t), PICOQUIC_MAX_SACK_ITEMS_IN_POOL);
 
         picoquic_init_transport_parameters(&quic->default_tp, 0);
 
@@ -692,10 +744,8 @@ picoquic_quic_t* picoquic_create(uint32_t max_nb_connections,
 
 
             if (max_cnx4 < (size_t)max_nb_connections ||
-                (quic->table_cnx_by_id = picohash_create_ex((size_t)max_nb_connections * 4,
-                picoquic_local_cnxid_hash, picoquic_local_cnxid_compare, picoquic_local_cnxid_to_item, quic->hash_seed)) == NULL ||
-                (quic->table_cnx_by_net = picohash_create_ex((size_t)max_nb_connections * 4,
-                    picoquic_net_id_hash, picoquic_net_id_compare, picoquic_local_netid_to_item, quic->hash_seed)) == NULL ||
+                picotable_init(&quic->table_cnx_by_id, quic->hash_seed) != 0 ||
+                picotable_init(&quic->table_cnx_by_net, quic->hash_seed) != 0 ||
                 (quic->table_cnx_by_icid = picohash_create_ex((size_t)max_nb_connections,
                     picoquic_net_icid_hash, picoquic_net_icid_compare, picoquic_net_icid_to_item, quic->hash_seed)) == NULL ||
                 (quic->table_cnx_by_secret = picohash_create_ex((size_t)max_nb_connections * 4,
@@ -864,7 +914,14 @@ void picoquic_set_default_address_discovery_mode(picoquic_quic_t* quic, int mode
 
 void picoquic_set_cwin_max(picoquic_quic_t* quic, uint64_t cwin_max)
 {
+    picoquic_cnx_t* cnx = quic->cnx_list;
+
     quic->cwin_max = (cwin_max == 0) ? UINT64_MAX : cwin_max;
+
+    while (cnx != NULL) {
+        picoquic_set_cnx_memory_cap(cnx, cnx->memory_cap);
+        cnx = cnx->next_in_table;
+    }
 }
 
 void picoquic_set_max_data_control(picoquic_quic_t* quic, uint64_t max_data)
@@ -887,6 +944,257 @@ void picoquic_set_max_data_control(picoquic_quic_t* quic, uint64_t max_data)
     }
 }
 
+/* Memory accounting.
+ * The counters of the connection and the total for the QUIC context are
+ * updated together, so that the total is always the sum of the memory held
+ * by all connections.
+ */
+void picoquic_memory_charge(picoquic_cnx_t* cnx, picoquic_memory_class_enum memory_class, size_t length)
+{
+    picoquic_quic_t* quic = cnx->quic;
+
+    cnx->memory_held[memory_class] += length;
+    cnx->memory_held_total += length;
+    quic->memory_held += length;
+    if (quic->memory_held > quic->memory_held_max) {
+        quic->memory_held_max = quic->memory_held;
+    }
+}
+
+void picoquic_memory_release(picoquic_cnx_t* cnx, picoquic_memory_class_enum memory_class, size_t length)
+{
+    picoquic_quic_t* quic = cnx->quic;
+
+    if (length > cnx->memory_held[memory_class]) {
+        /* Should never happen, but do not let the counters wrap around */
+        length = (size_t)cnx->memory_held[memory_class];
+    }
+    cnx->memory_held[memory_class] -= length;
+    cnx->memory_held_total -= length;
+    quic->memory_held -= length;
+}
+
+/* A packet is charged once, to the retransmit class while it waits for an
+ * acknowledgement or for the loss confirmation, or to the data repeat class
+ * if it is only kept to repeat its stream data. This function is called
+ * each time a packet enters or leaves one of these queues. */
+void picoquic_update_packet_memory(picoquic_cnx_t* cnx, picoquic_packet_t* packet)
+{
+    picoquic_memory_class_enum memory_class = picoquic_memory_class_none;
+
+    if (packet->is_queued_for_retransmit || packet->is_queued_for_spurious_detection) {
+        memory_class = picoquic_memory_class_retransmit;
+    }
+    else if (packet->is_queued_for_data_repeat) {
+        memory_class = picoquic_memory_class_data_repeat;
+    }
+
+    if (memory_class != (picoquic_memory_class_enum)packet->memory_class) {
+        if (packet->memory_class != picoquic_memory_class_none) {
+            picoquic_memory_release(cnx, (picoquic_memory_class_enum)packet->memory_class, cnx->quic->packet_slab.object_size);
+        }
+        if (memory_class != picoquic_memory_class_none) {
+            picoquic_memory_charge(cnx, memory_class, cnx->quic->packet_slab.object_size);
+        }
+        packet->memory_class = memory_class;
+    }
+}
+
+/* Release whatever is still charged when the connection is deleted */
+static void picoquic_memory_release_all(picoquic_cnx_t* cnx)
+{
+    for (int i = 0; i < picoquic_nb_memory_classes; i++) {
+        picoquic_memory_release(cnx, (picoquic_memory_class_enum)i, (size_t)cnx->memory_held[i]);
+    }
+}
+
+void picoquic_get_memory_usage(picoquic_cnx_t* cnx, picoquic_memory_usage_t* usage)
+{
+    usage->retransmit_bytes = cnx->memory_held[picoquic_memory_class_retransmit];
+    usage->data_repeat_bytes = cnx->memory_held[picoquic_memory_class_data_repeat];
+    usage->stream_send_bytes = cnx->memory_held[picoquic_memory_class_stream_send];
+    usage->stream_receive_bytes = cnx->memory_held[picoquic_memory_class_stream_receive];
+    usage->total_bytes = cnx->memory_held_total;
+}
+
+uint64_t picoquic_get_memory_held(picoquic_quic_t* quic)
+{
+    return quic->memory_held;
+}
+
+uint64_t picoquic_get_memory_held_max(picoquic_quic_t* quic)
+{
+    return quic->memory_held_max;
+}
+
+void picoquic_set_memory_ceiling(picoquic_quic_t* quic, uint64_t memory_ceiling)
+{
+    picoquic_cnx_t* cnx = quic->cnx_list;
+
+    quic->memory_ceiling = memory_ceiling;
+    quic->memory_check_time = 0;
+
+    if (memory_ceiling == 0) {
+        /* Lift the back pressure on all connections */
+        while (cnx != NULL) {
+            picoquic_set_cnx_memory_cap(cnx, 0);
+            cnx = cnx->next_in_table;
+        }
+    }
+}
+
+/* Set the memory cap of a connection, and the resulting cwin limit.
+ * If the cap is raised, the flow control credit that it held back is granted. */
+void picoquic_set_cnx_memory_cap(picoquic_cnx_t* cnx, uint64_t memory_cap)
+{
+    int is_raised = cnx->memory_cap != 0 && (memory_cap == 0 || memory_cap > cnx->memory_cap);
+
+    cnx->memory_cap = memory_cap;
+    cnx->cwin_max = cnx->quic->cwin_max;
+    if (memory_cap != 0 && memory_cap < cnx->cwin_max) {
+        cnx->cwin_max = memory_cap;
+    }
+    if (is_raised) {
+        picoquic_open_deferred_flow_control(cnx);
+    }
+}
+
+/* Back pressure. When the memory held by all connections exceeds the
+ * ceiling, the connections that hold more than their fair share of the
+ * ceiling are capped: their congestion window cannot grow past the fair
+ * share, and they do not grant flow control credit beyond it. Credits
+ * already granted cannot be withdrawn, so the effect on the receive side
+ * comes after these credits are consumed. The caps are lifted progressively,
+ * doubling at each check, once the memory held falls below 3/4 of the ceiling.
+ */
+void picoquic_check_memory_pressure(picoquic_quic_t* quic, uint64_t current_time)
+{
+    if (quic->memory_ceiling != 0 && current_time >= quic->memory_check_time) {
+        picoquic_cnx_t* cnx = quic->cnx_list;
+
+        quic->memory_check_time = current_time + PICOQUIC_MEMORY_CHECK_INTERVAL;
+
+        if (quic->memory_held > quic->memory_ceiling) {
+            uint64_t fair_share = quic->memory_ceiling /
+                ((quic->current_number_connections > 0) ? quic->current_number_connections : 1);
+            uint64_t memory_cap = (fair_share > PICOQUIC_MEMORY_CAP_MINIMUM) ? fair_share : PICOQUIC_MEMORY_CAP_MINIMUM;
+
+            quic->nb_memory_pressure_events++;
+            while (cnx != NULL) {
+                if (cnx->memory_held_total > fair_share &&
+                    (cnx->memory_cap == 0 || cnx->memory_cap > memory_cap)) {
+                    picoquic_set_cnx_memory_cap(cnx, memory_cap);
+                }
+                cnx = cnx->next_in_table;
+            }
+        }
+        else if (quic->memory_held < quic->memory_ceiling - quic->memory_ceiling / 4) {
+            while (cnx != NULL) {
+                if (cnx->memory_cap != 0) {
+                    uint64_t memory_cap = 2 * cnx->memory_cap;
+                    picoquic_set_cnx_memory_cap(cnx, (memory_cap >= quic->memory_ceiling) ? 0 : memory_cap);
+                }
+                cnx = cnx->next_in_table;
+            }
+        }
+    }
+}
+
+/* Hibernation of idle connections.
+ * A server holding a large number of mostly idle connections spends most of
+ * its memory on state that is only useful when data flows: the congestion
+ * control state of each path, the copies of packets kept for detection of
+ * spurious losses, and the old decryption keys kept after a key rotation.
+ * When a connection has been idle for longer than the hibernation delay,
+ * with no packet in transit, that state is released. The connection is
+ * woken up transparently when a packet is received or when the application
+ * prepares a packet, at which point the congestion control state of each
+ * path is reinitialized. This is similar to restarting the congestion window
+ * after an idle period, as recommended in RFC 9002.
+ */
+static int picoquic_is_cnx_quiescent(picoquic_cnx_t* cnx)
+{
+    int is_quiescent = 1;
+
+    for (int pc = 0; is_quiescent && pc < picoquic_nb_packet_context; pc++) {
+        is_quiescent = (cnx->pkt_ctx[pc].pending_first == NULL);
+    }
+    for (int i = 0; is_quiescent && i < cnx->nb_paths; i++) {
+        is_quiescent = (cnx->path[i]->bytes_in_transit == 0 && cnx->path[i]->pkt_ctx.pending_first == NULL);
+    }
+    return is_quiescent;
+}
+
+static void picoquic_release_retransmitted_packets(picoquic_cnx_t* cnx, picoquic_packet_context_t* pkt_ctx)
+{
+    while (pkt_ctx->retransmitted_newest != NULL) {
+        picoquic_dequeue_retransmitted_packet(cnx, pkt_ctx, pkt_ctx->retransmitted_newest);
+    }
+}
+
+void picoquic_hibernate_cnx_if_idle(picoquic_cnx_t* cnx, uint64_t current_time, uint64_t* next_wake_time)
+{
+    uint64_t delay = cnx->quic->hibernation_delay;
+
+    if (delay != 0 && !cnx->is_hibernating && cnx->cnx_state == picoquic_state_ready) {
+        uint64_t idle_since = (cnx->latest_progress_time > cnx->latest_receive_time) ?
+            cnx->latest_progress_time : cnx->latest_receive_time;
+
+        if (idle_since + delay > current_time) {
+            if (idle_since + delay < *next_wake_time) {
+                *next_wake_time = idle_since + delay;
+            }
+        }
+        else if (picoquic_is_cnx_quiescent(cnx)) {
+            for (int pc = 0; pc < picoquic_nb_packet_context; pc++) {
+                picoquic_release_retransmitted_packets(cnx, &cnx->pkt_ctx[pc]);
+            }
+            for (int i = 0; i < cnx->nb_paths; i++) {
+                picoquic_release_retransmitted_packets(cnx, &cnx->path[i]->pkt_ctx);
+                if (cnx->congestion_alg != NULL) {
+                    cnx->congestion_alg->alg_delete(cnx->path[i]);
+                }
+            }
+            if (current_time > cnx->crypto_rotation_time_guard) {
+                picoquic_crypto_context_free(&cnx->crypto_context_old);
+            }
+            cnx->is_hibernating = 1;
+            cnx->quic->nb_cnx_hibernating++;
+            cnx->quic->nb_hibernations++;
+        }
+    }
+}
+
+void picoquic_wake_cnx(picoquic_cnx_t* cnx, uint64_t current_time)
+{
+    if (cnx->is_hibernating) {
+        if (cnx->congestion_alg != NULL) {
+            for (int i = 0; i < cnx->nb_paths; i++) {
+                if (cnx->path[i]->congestion_alg_state == NULL) {
+                    cnx->congestion_alg->alg_init(cnx, cnx->path[i], cnx->congestion_alg_option_string, current_time);
+                }
+            }
+        }
+        cnx->is_hibernating = 0;
+        cnx->quic->nb_cnx_hibernating--;
+    }
+}
+
+void picoquic_set_hibernation_delay(picoquic_quic_t* quic, uint64_t hibernation_delay)
+{
+    quic->hibernation_delay = hibernation_delay;
+}
+
+int picoquic_is_cnx_hibernating(picoquic_cnx_t* cnx)
+{
+    return cnx->is_hibernating;
+}
+
+size_t picoquic_get_nb_cnx_hibernating(picoquic_quic_t* quic)
+{
+    return quic->nb_cnx_hibernating;
+}
+
 void picoquic_set_default_idle_timeout(picoquic_quic_t* quic, uint64_t idle_timeout_ms)
 {
     quic->default_tp.max_idle_timeout = idle_timeout_ms;
@@ -987,23 +1295,10 @@ void picoquic_free(picoquic_quic_t* quic)
         /* Deelete the reused tokens tree */
         picosplay_empty_tree(&quic->token_reuse_tree);
 
-        /* delete packets in pool */
-        while (quic->p_first_packet != NULL) {
-            picoquic_packet_t * p = quic->p_first_packet->packet_previous;
-            free(quic->p_first_packet);
-            quic->p_first_packet = p;
-            quic->nb_packets_allocated--;
-            quic->nb_packets_in_pool--;
-        }
-
-        /* delete data nodes in pool */
-        while (quic->p_first_data_node != NULL) {
-            picoquic_stream_data_node_t* p = quic->p_first_data_node->next_stream_data;
-            free(quic->p_first_data_node);
-            quic->p_first_data_node = p;
-            quic->nb_data_nodes_allocated--;
-            quic->nb_data_nodes_in_pool--;
-        }
+        /* delete packets, data nodes, streams and sack items in pool */
+        picoquic_release_packet_slabs(quic);
+        picoslab_release(&quic->stream_slab);
+        picoslab_release(&quic->sack_item_slab);
 
         /* delete all pending stateless packets */
         while (quic->pending_stateless_packet != NULL) {
@@ -1012,12 +1307,11 @@ void picoquic_free(picoquic_quic_t* quic)
             free(to_delete);
         }
 
-        if (quic->table_cnx_by_id != NULL) {
-            picohash_delete(quic->table_cnx_by_id, 0);
-        }
+        picotable_release(&quic->table_cnx_by_id);
+        picotable_release(&quic->table_cnx_by_net);
 
-        if (quic->table_cnx_by_net != NULL) {
-            picohash_delete(quic->table_cnx_by_net, 0);
+        if (quic->cnx_wake_wheel != NULL) {
+            free(quic->cnx_wake_wheel);
         }
 
         if (quic->table_cnx_by_icid != NULL) {
@@ -1147,14 +1441,12 @@ int picoquic_cnx_is_still_logging(picoquic_cnx_t* cnx)
 int picoquic_register_cnx_id(picoquic_quic_t* quic, picoquic_cnx_t* cnx, picoquic_local_cnxid_t* l_cid)
 {
     int ret = 0;
-    picohash_item* item;
+    picotable_key_t key;
 
-    item = picohash_retrieve(quic->table_cnx_by_id, l_cid);
-    if (item != NULL) {
-        ret = -1;
-    } else {
+    picoquic_cid_table_key(&l_cid->cnx_id, &key);
+    ret = picotable_insert(&quic->table_cnx_by_id, &key, l_cid);
+    if (ret == 0) {
         l_cid->registered_cnx = cnx;
-        ret = picohash_insert(quic->table_cnx_by_id, l_cid);
     }
 
     return ret;
@@ -1162,31 +1454,29 @@ int picoquic_register_cnx_id(picoquic_quic_t* quic, picoquic_cnx_t* cnx, picoqui
 
 void picoquic_unregister_net_id(picoquic_cnx_t* cnx, picoquic_path_t* path_x)
 {
-    if (path_x->net_id_hash_item.key != NULL) {
-        picohash_item* item = picohash_retrieve(cnx->quic->table_cnx_by_net, path_x);
-        if (item != NULL) {
-            picohash_delete_item(cnx->quic->table_cnx_by_net, item, 0);
-        }
+    if (path_x->is_net_id_registered) {
+        picotable_key_t key;
+
+        picoquic_net_table_key((struct sockaddr*)&path_x->registered_peer_addr, &key);
+        (void)picotable_remove(&cnx->quic->table_cnx_by_net, &key);
         memset(&path_x->registered_peer_addr, 0, sizeof(struct sockaddr_storage));
-        memset(&path_x->net_id_hash_item, 0, sizeof(path_x->net_id_hash_item));
+        path_x->is_net_id_registered = 0;
     }
 }
 
 int picoquic_register_net_id(picoquic_quic_t* quic, picoquic_cnx_t* cnx, picoquic_path_t * path_x)
 {
     int ret = 0;
-    picohash_item* item;
+    picotable_key_t key;
 
     /* If registration was present, remove it */
     picoquic_unregister_net_id(cnx, path_x);
     /* Try registering the new address */
     picoquic_store_addr(&path_x->registered_peer_addr, (struct sockaddr *)&path_x->first_tuple->peer_addr);
-    item = picohash_retrieve(quic->table_cnx_by_net, path_x);
-
-    if (item != NULL) {
-        ret = -1;
-    } else {
-        ret = picohash_insert(quic->table_cnx_by_net, path_x);
+    picoquic_net_table_key((struct sockaddr*)&path_x->registered_peer_addr, &key);
+    ret = picotable_insert(&quic->table_cnx_by_net, &key, path_x);
+    if (ret == 0) {
+        path_x->is_net_id_registered = 1;
     }
 
     return ret;
@@ -1383,14 +1673,66 @@ static void picoquic_wake_list_init(picoquic_quic_t * quic)
         picoquic_wake_list_create_node, picoquic_wake_list_delete_node, picoquic_wake_list_node_value);
 }
 
+static picoquic_cnx_t* picoquic_wake_wheel_node_value(picowheel_node_t* cnx_wake_wheel_node)
+{
+    return (cnx_wake_wheel_node == NULL) ? NULL :
+        (picoquic_cnx_t*)((char*)cnx_wake_wheel_node - offsetof(struct st_picoquic_cnx_t, cnx_wake_wheel_node));
+}
+
 static void picoquic_remove_cnx_from_wake_list(picoquic_cnx_t* cnx)
 {
-    picosplay_delete_hint(&cnx->quic->cnx_wake_tree, &cnx->cnx_wake_node);
+    if (cnx->quic->cnx_wake_wheel != NULL) {
+        picowheel_remove(cnx->quic->cnx_wake_wheel, &cnx->cnx_wake_wheel_node);
+    }
+    else {
+        picosplay_delete_hint(&cnx->quic->cnx_wake_tree, &cnx->cnx_wake_node);
+    }
 }
 
 static void picoquic_insert_cnx_by_wake_time(picoquic_quic_t* quic, picoquic_cnx_t* cnx)
 {
-    picosplay_insert(&quic->cnx_wake_tree, cnx);
+    if (quic->cnx_wake_wheel != NULL) {
+        picowheel_insert(quic->cnx_wake_wheel, &cnx->cnx_wake_wheel_node, cnx->next_wake_time);
+    }
+    else {
+        picosplay_insert(&quic->cnx_wake_tree, cnx);
+    }
+}
+
+int picoquic_set_wake_wheel(picoquic_quic_t* quic, int use_wheel)
+{
+    int ret = 0;
+
+    if ((use_wheel != 0) != (quic->cnx_wake_wheel != NULL)) {
+        picowheel_t* wheel = NULL;
+
+        if (use_wheel && (wheel = (picowheel_t*)malloc(sizeof(picowheel_t))) == NULL) {
+            ret = PICOQUIC_ERROR_MEMORY;
+        }
+        else {
+            /* Move the connections from the current scheduler to the new one */
+            for (picoquic_cnx_t* cnx = quic->cnx_list; cnx != NULL; cnx = cnx->next_in_table) {
+                picoquic_remove_cnx_from_wake_list(cnx);
+            }
+            if (quic->cnx_wake_wheel != NULL) {
+                free(quic->cnx_wake_wheel);
+            }
+            quic->cnx_wake_wheel = wheel;
+            if (wheel != NULL) {
+                picowheel_init(wheel, picoquic_get_quic_time(quic));
+            }
+            for (picoquic_cnx_t* cnx = quic->cnx_list; cnx != NULL; cnx = cnx->next_in_table) {
+                picoquic_insert_cnx_by_wake_time(quic, cnx);
+            }
+        }
+    }
+
+    return ret;
+}
+
+int picoquic_is_wake_wheel_used(picoquic_quic_t* quic)
+{
+    return quic->cnx_wake_wheel != NULL;
 }
 
 void picoquic_reinsert_by_wake_time(picoquic_quic_t* quic, picoquic_cnx_t* cnx, uint64_t next_time)
@@ -1402,10 +1744,20 @@ void picoquic_reinsert_by_wake_time(picoquic_quic_t* quic, picoquic_cnx_t* cnx,
 
 picoquic_cnx_t* picoquic_get_earliest_cnx_to_wake(picoquic_quic_t* quic, uint64_t max_wake_time)
 {
-    picoquic_cnx_t* cnx = (picoquic_cnx_t *)picoquic_wake_list_node_value(picosplay_first(&quic->cnx_wake_tree));
-    if (cnx != NULL && max_wake_time != 0 && cnx->next_wake_time > max_wake_time)
-    {
-        cnx = NULL;
+    picoquic_cnx_t* cnx;
+
+    if (quic->cnx_wake_wheel != NULL) {
+        /* The wheel returns a connection that is due, not necessarily
+         * the one with the earliest wake time */
+        cnx = picoquic_wake_wheel_node_value((max_wake_time == 0) ?
+            picowheel_first(quic->cnx_wake_wheel) : picowheel_first_due(quic->cnx_wake_wheel, max_wake_time));
+    }
+    else {
+        cnx = (picoquic_cnx_t*)picoquic_wake_list_node_value(picosplay_first(&quic->cnx_wake_tree));
+        if (cnx != NULL && max_wake_time != 0 && cnx->next_wake_time > max_wake_time)
+        {
+            cnx = NULL;
+        }
     }
 
     return cnx;
@@ -1419,8 +1771,9 @@ uint64_t picoquic_get_next_wake_time(picoquic_quic_t* quic, uint64_t current_tim
         wake_time = current_time;
     }
     else{
-        picoquic_cnx_t* cnx_wake_first = (picoquic_cnx_t*)picoquic_wake_list_node_value(
-            picosplay_first(&quic->cnx_wake_tree));
+        picoquic_cnx_t* cnx_wake_first = (quic->cnx_wake_wheel != NULL) ?
+            picoquic_wake_wheel_node_value(picowheel_first(quic->cnx_wake_wheel)) :
+            (picoquic_cnx_t*)picoquic_wake_list_node_value(picosplay_first(&quic->cnx_wake_tree));
 
         if (cnx_wake_first != NULL) {
             wake_time = cnx_wake_first->next_wake_time;
@@ -1587,7 +1940,7 @@ picoquic_packet_t* picoquic_get_last_packet(picoquic_cnx_t* cnx, picoquic_path_t
  */
 picoquic_tuple_t* picoquic_create_tuple(picoquic_path_t* path_x, const struct sockaddr* local_addr, const struct sockaddr* peer_addr, int if_index)
 {
-    picoquic_tuple_t* tuple = (picoquic_tuple_t*)malloc(sizeof(picoquic_tuple_t));
+    picoquic_tuple_t* tuple = (picoquic_tuple_t*)picoarena_alloc(&path_x->cnx->arena, sizeof(picoquic_tuple_t));
     if (tuple != NULL) {
         memset(tuple, 0, sizeof(picoquic_tuple_t));
         /* Add the tuple to the path */
@@ -1639,7 +1992,7 @@ void picoquic_delete_tuple(picoquic_path_t* path_x, picoquic_tuple_t* tuple, int
     /* Remove from chain to the path */
     picoquic_unchain_tuple(path_x, tuple);
     /* And finally free */
-    free(tuple);
+    picoarena_free(&path_x->cnx->arena, tuple, sizeof(picoquic_tuple_t));
 }
 
 void picoquic_set_first_tuple(picoquic_path_t* path_x, picoquic_tuple_t* tuple)
@@ -1692,7 +2045,7 @@ int picoquic_create_path(picoquic_cnx_t* cnx, uint64_t start_time, const struct
     {
         uint64_t unique_path_id = picoquic_find_avalaible_unique_path_id(cnx, requested_id);
         picoquic_path_t* path_x = (unique_path_id == UINT64_MAX) ? NULL :
-            (picoquic_path_t*)malloc(sizeof(picoquic_path_t));
+            (picoquic_path_t*)picoarena_alloc(&cnx->arena, sizeof(picoquic_path_t));
 
         if (path_x != NULL)
         {
@@ -1716,6 +2069,7 @@ int picoquic_create_path(picoquic_cnx_t* cnx, uint64_t start_time, const struct
 
                 /* Initialize per path pacing state */
                 picoquic_pacing_init(&path_x->pacing, start_time);
+                picoquic_set_pacing_offload_horizon(&path_x->pacing, cnx->quic->pacing_offload_horizon);
 
                 /* Initialize the MTU */
                 path_x->send_mtu = (peer_addr == NULL || peer_addr->sa_family == AF_INET) ? PICOQUIC_INITIAL_MTU_IPV4 : PICOQUIC_INITIAL_MTU_IPV6;
@@ -1773,7 +2127,7 @@ static void picoquic_clear_path_data(picoquic_cnx_t* cnx, picoquic_path_t * path
     }
 
     /* Free the record */
-    free(path_x);
+    picoarena_free(&cnx->arena, path_x, sizeof(picoquic_path_t));
 }
 
 void picoquic_delete_path(picoquic_cnx_t* cnx, int path_index)
@@ -2722,7 +3076,7 @@ void picoquic_reset_path_mtu(picoquic_path_t* path_x)
 /* Manage ACK context and Packet context */
 void picoquic_init_ack_ctx(picoquic_cnx_t* cnx, picoquic_ack_context_t* ack_ctx)
 {
-    picoquic_sack_list_init(&ack_ctx->sack_list);
+    picoquic_sack_list_init_ex(&ack_ctx->sack_list, &cnx->quic->sack_item_slab);
     ack_ctx->time_stamp_largest_received = UINT64_MAX;
     ack_ctx->act[0].highest_ack_sent = 0;
     ack_ctx->act[0].highest_ack_sent_time = cnx->start_time;
@@ -2763,7 +3117,7 @@ picoquic_remote_cnxid_stash_t* picoquic_find_or_create_remote_cnxid_stash(picoqu
     }
 
     if (remote_cnxid_stash == NULL && do_create) {
-        remote_cnxid_stash = (picoquic_remote_cnxid_stash_t*)malloc(sizeof(picoquic_remote_cnxid_stash_t));
+        remote_cnxid_stash = (picoquic_remote_cnxid_stash_t*)picoarena_alloc(&cnx->arena, sizeof(picoquic_remote_cnxid_stash_t));
         if (remote_cnxid_stash != NULL) {
             memset(remote_cnxid_stash, 0, sizeof(picoquic_remote_cnxid_stash_t));
             remote_cnxid_stash->unique_path_id = unique_path_id;
@@ -2782,7 +3136,7 @@ int picoquic_init_cnxid_stash(picoquic_cnx_t* cnx)
         ret = PICOQUIC_TRANSPORT_INTERNAL_ERROR;
     }
     else {
-        remote_cnxid_stash->cnxid_stash_first = (picoquic_remote_cnxid_t*)malloc(sizeof(picoquic_remote_cnxid_t));
+        remote_cnxid_stash->cnxid_stash_first = (picoquic_remote_cnxid_t*)picoarena_alloc(&cnx->arena, sizeof(picoquic_remote_cnxid_t));
         cnx->path[0]->first_tuple->p_remote_cnxid = remote_cnxid_stash->cnxid_stash_first;
         if (remote_cnxid_stash->cnxid_stash_first == NULL) {
             ret = PICOQUIC_TRANSPORT_INTERNAL_ERROR;
@@ -2864,7 +3218,7 @@ uint64_t picoquic_add_remote_cnxid_to_stash(picoquic_cnx_t* cnx, picoquic_remote
             ret = PICOQUIC_TRANSPORT_CONNECTION_ID_LIMIT_ERROR;
         }
         else {
-            stashed = (picoquic_remote_cnxid_t*)malloc(sizeof(picoquic_remote_cnxid_t));
+            stashed = (picoquic_remote_cnxid_t*)picoarena_alloc(&cnx->arena, sizeof(picoquic_remote_cnxid_t));
 
             if (stashed == NULL) {
                 ret = PICOQUIC_TRANSPORT_INTERNAL_ERROR;
@@ -2944,7 +3298,7 @@ picoquic_remote_cnxid_t* picoquic_remove_cnxid_from_stash(picoquic_cnx_t* cnx, p
             else {
                 previous->next = stashed;
             }
-            free(removed);
+            picoarena_free(&cnx->arena, removed, sizeof(picoquic_remote_cnxid_t));
         }
     }
     return stashed;
@@ -3125,7 +3479,7 @@ void picoquic_delete_remote_cnxid_stash(picoquic_cnx_t* cnx, picoquic_remote_cnx
             previous = previous->next_stash;
         }
     }
-    free(cnxid_stash);
+    picoarena_free(&cnx->arena, cnxid_stash, sizeof(picoquic_remote_cnxid_stash_t));
 }
 
 void picoquic_delete_remote_cnxid_stashes(picoquic_cnx_t* cnx)
@@ -3216,15 +3570,10 @@ void* picoquic_stream_data_node_value(picosplay_node_t* node)
 
 void picoquic_stream_data_node_recycle(picoquic_stream_data_node_t* stream_data)
 {
-    if (stream_data->quic->nb_data_nodes_in_pool < PICOQUIC_MAX_PACKETS_IN_POOL) {
-        stream_data->next_stream_data = stream_data->quic->p_first_data_node;
-        stream_data->quic->p_first_data_node = stream_data;
-        stream_data->quic->nb_data_nodes_in_pool++;
-    }
-    else {
-        stream_data->quic->nb_data_nodes_allocated--;
-        free(stream_data);
-    }
+    picoquic_quic_t* quic = stream_data->quic;
+
+    quic->nb_data_nodes_in_use--;
+    picoslab_free(&quic->data_node_slab[stream_data->size_class], stream_data);
 }
 
 void picoquic_stream_data_node_delete(void* tree, picosplay_node_t* node)
@@ -3234,36 +3583,66 @@ void picoquic_stream_data_node_delete(void* tree, picosplay_node_t* node)
     picoquic_stream_data_node_recycle(stream_data);
 }
 
-picoquic_stream_data_node_t* picoquic_stream_data_node_alloc(picoquic_quic_t* quic)
+/* The data nodes held in the receive tree of a stream are charged to the
+ * connection. These trees use a specific delete function, and the stream
+ * is found from the address of the tree inside the stream head. */
+static picoquic_stream_head_t* picoquic_stream_from_data_tree(void* tree)
 {
-    picoquic_stream_data_node_t* stream_data = quic->p_first_data_node;
-    
-    if (stream_data == NULL) {
-        stream_data = (picoquic_stream_data_node_t*)
-            malloc(sizeof(picoquic_stream_data_node_t));
+    return (picoquic_stream_head_t*)((char*)tree - offsetof(struct st_picoquic_stream_head_t, stream_data_tree));
+}
 
-        if (stream_data != NULL) {
-            /* It might be sufficient to zero the metadata, but zeroing everything
-             * appears safer, and does not confuse checkers like valgrind.
-             */
-            memset(stream_data, 0, sizeof(picoquic_stream_data_node_t));
-            stream_data->quic = quic;
-            quic->nb_data_nodes_allocated++;
-            if (quic->nb_data_nodes_allocated > quic->nb_data_nodes_allocated_max) {
-                quic->nb_data_nodes_allocated_max = quic->nb_data_nodes_allocated;
-            }
-        }
+static void picoquic_stream_receive_node_delete(void* tree, picosplay_node_t* node)
+{
+    picoquic_stream_data_node_t* stream_data = (picoquic_stream_data_node_t*)picoquic_stream_data_node_value(node);
+    picoquic_stream_head_t* stream = picoquic_stream_from_data_tree(tree);
+
+    picoquic_memory_release(stream->cnx, picoquic_memory_class_stream_receive,
+        stream_data->quic->data_node_slab[stream_data->size_class].object_size);
+    picoquic_stream_data_node_recycle(stream_data);
+}
+
+void picoquic_stream_data_node_charge(picosplay_tree_t* tree, picoquic_stream_data_node_t* stream_data)
+{
+    if (tree->delete_node == picoquic_stream_receive_node_delete) {
+        picoquic_stream_head_t* stream = picoquic_stream_from_data_tree(tree);
+
+        picoquic_memory_charge(stream->cnx, picoquic_memory_class_stream_receive,
+            stream_data->quic->data_node_slab[stream_data->size_class].object_size);
     }
-    else {
-        quic->p_first_data_node = stream_data->next_stream_data;
-        stream_data->next_stream_data = NULL;
-        stream_data->bytes = NULL;
-        quic->nb_data_nodes_in_pool--;
+}
+
+/* Allocate a node from the smallest size class that can hold `length` octets */
+picoquic_stream_data_node_t* picoquic_stream_data_node_alloc_ex(picoquic_quic_t* quic, size_t length)
+{
+    picoquic_stream_data_node_t* stream_data = NULL;
+    int size_class = 0;
+
+    while (size_class < PICOQUIC_NB_DATA_NODE_CLASSES - 1 && picoquic_data_node_class_size(quic, size_class) < length) {
+        size_class++;
+    }
+
+    stream_data = (picoquic_stream_data_node_t*)picoslab_alloc(&quic->data_node_slab[size_class]);
+    if (stream_data != NULL) {
+        /* Only the metadata is reset, the data is zeroed when the node is
+         * first carved from a slab chunk. */
+        memset(stream_data, 0, offsetof(struct st_picoquic_stream_data_node_t, data));
+        stream_data->quic = quic;
+        stream_data->size_class = size_class;
+        stream_data->data_size = picoquic_data_node_class_size(quic, size_class);
+        quic->nb_data_nodes_in_use++;
+        if (quic->nb_data_nodes_in_use > quic->nb_data_nodes_in_use_max) {
+            quic->nb_data_nodes_in_use_max = quic->nb_data_nodes_in_use;
+        }
     }
 
     return stream_data;
 }
 
+picoquic_stream_data_node_t* picoquic_stream_data_node_alloc(picoquic_quic_t* quic)
+{
+    return picoquic_stream_data_node_alloc_ex(quic, quic->max_packet_size);
+}
+
 
 /* Stream splay management */
 
@@ -3284,6 +3663,78 @@ static void * picoquic_stream_node_value(picosplay_node_t * node)
     return (void*)((char*)node - offsetof(struct st_picoquic_stream_head_t, stream_node));
 }
 
+/* Free a node of the send queue. If the bytes are owned by the
+ * application, they are returned by calling the release function. */
+void picoquic_stream_queue_node_free(picoquic_stream_head_t* stream, picoquic_stream_queue_node_t* stream_data)
+{
+    picoquic_memory_release(stream->cnx, picoquic_memory_class_stream_send, stream_data->length);
+    if (stream_data->release_fn != NULL) {
+        stream_data->release_fn(stream->cnx, stream->stream_id, stream_data->bytes, stream_data->length,
+            stream_data->release_ctx);
+    }
+    else if (stream_data->bytes != NULL) {
+        free(stream_data->bytes);
+    }
+    free(stream_data);
+}
+
+/* Remove the first node of the send queue after all its bytes were sent.
+ * Application buffers are kept until the data is acknowledged. There is
+ * no need to keep them for retransmissions, which are copied from the
+ * packets, but the application expects them to be released only after
+ * the peer has received the data.
+ */
+void picoquic_stream_queue_node_sent(picoquic_stream_head_t* stream)
+{
+    picoquic_stream_queue_node_t* stream_data = stream->send_queue;
+
+    stream->send_queue = stream_data->next_stream_data;
+    if (stream_data->release_fn == NULL) {
+        picoquic_stream_queue_node_free(stream, stream_data);
+    }
+    else {
+        stream_data->next_stream_data = NULL;
+        if (stream->sent_buffers_last == NULL) {
+            stream->sent_buffers_first = stream_data;
+        }
+        else {
+            stream->sent_buffers_last->next_stream_data = stream_data;
+        }
+        stream->sent_buffers_last = stream_data;
+    }
+}
+
+/* Release the application buffers whose content is fully acknowledged.
+ * Buffers are queued in stream order, so the scan stops at the first
+ * buffer that still has missing acknowledgements. */
+void picoquic_release_acked_stream_buffers(picoquic_stream_head_t* stream)
+{
+    picoquic_stream_queue_node_t* stream_data;
+
+    while ((stream_data = stream->sent_buffers_first) != NULL &&
+        picoquic_check_sack_list(&stream->sack_list, stream_data->stream_offset,
+            stream_data->stream_offset + stream_data->length - 1) != 0) {
+        stream->sent_buffers_first = stream_data->next_stream_data;
+        if (stream->sent_buffers_first == NULL) {
+            stream->sent_buffers_last = NULL;
+        }
+        picoquic_stream_queue_node_free(stream, stream_data);
+    }
+}
+
+/* Release all the application buffers waiting for acknowledgement,
+ * e.g., if the stream is reset or deleted. */
+void picoquic_release_sent_stream_buffers(picoquic_stream_head_t* stream)
+{
+    picoquic_stream_queue_node_t* stream_data;
+
+    while ((stream_data = stream->sent_buffers_first) != NULL) {
+        stream->sent_buffers_first = stream_data->next_stream_data;
+        picoquic_stream_queue_node_free(stream, stream_data);
+    }
+    stream->sent_buffers_last = NULL;
+}
+
 void picoquic_clear_stream(picoquic_stream_head_t* stream)
 {
     picoquic_stream_queue_node_t* ready = stream->send_queue;
@@ -3291,12 +3742,10 @@ void picoquic_clear_stream(picoquic_stream_head_t* stream)
 
     while ((next = ready) != NULL) {
         ready = next->next_stream_data;
-        if (next->bytes != NULL) {
-            free(next->bytes);
-        }
-        free(next);
+        picoquic_stream_queue_node_free(stream, next);
     }
     stream->send_queue = NULL;
+    picoquic_release_sent_stream_buffers(stream);
     if (stream->is_output_stream) {
         picoquic_remove_output_stream(stream->cnx, stream);
     }
@@ -3311,7 +3760,7 @@ static void picoquic_stream_node_delete(void * tree, picosplay_node_t * node)
 
     picoquic_clear_stream(stream);
 
-    free(stream);
+    picoslab_free(&stream->cnx->quic->stream_slab, stream);
 }
 
 /* Management of streams */
@@ -3359,6 +3808,291 @@ int picoquic_compare_stream_priority(picoquic_stream_head_t * stream, picoquic_s
     return ret;
 }
 
+/* Management of the per priority queues of output streams.
+ * The queues are updated each time the state of a stream changes in a way
+ * that affects sending: data queued or marked active, FIN requested, flow
+ * control credit received, reset or stop sending requested, frames sent.
+ * The connection level flow control is not tracked in the queues, it is
+ * checked when looking for the next stream to send.
+ */
+static void picoquic_stream_queue_remove(picoquic_stream_head_t* stream)
+{
+    picoquic_stream_queue_t* queue = stream->output_queue;
+
+    if (queue != NULL) {
+        if (stream->previous_queued_stream == NULL) {
+            queue->first = stream->next_queued_stream;
+        }
+        else {
+            stream->previous_queued_stream->next_queued_stream = stream->next_queued_stream;
+        }
+        if (stream->next_queued_stream == NULL) {
+            queue->last = stream->previous_queued_stream;
+        }
+        else {
+            stream->next_queued_stream->previous_queued_stream = stream->previous_queued_stream;
+        }
+        stream->next_queued_stream = NULL;
+        stream->previous_queued_stream = NULL;
+        stream->output_queue = NULL;
+    }
+}
+
+static void picoquic_stream_queue_link(picoquic_stream_queue_t* queue, picoquic_stream_head_t* stream, picoquic_stream_head_t* next)
+{
+    stream->next_queued_stream = next;
+    stream->previous_queued_stream = (next == NULL) ? queue->last : next->previous_queued_stream;
+    if (stream->previous_queued_stream == NULL) {
+        queue->first = stream;
+    }
+    else {
+        stream->previous_queued_stream->next_queued_stream = stream;
+    }
+    if (next == NULL) {
+        queue->last = stream;
+    }
+    else {
+        next->previous_queued_stream = stream;
+    }
+    stream->output_queue = queue;
+}
+
+/* Round robin queues are ordered by last time data was sent, then by
+ * stream ID, which is the order in which the linear scan of the output
+ * list used to pick streams. Other queues are ordered by stream ID. */
+static int picoquic_stream_queue_compare(picoquic_stream_head_t* stream, picoquic_stream_head_t* other, int is_round_robin)
+{
+    int ret = 1;
+
+    if (is_round_robin && stream->last_time_data_sent != other->last_time_data_sent) {
+        ret = (stream->last_time_data_sent < other->last_time_data_sent) ? -1 : 1;
+    }
+    else if (stream->stream_id < other->stream_id) {
+        ret = -1;
+    }
+    else if (stream->stream_id == other->stream_id) {
+        ret = 0;
+    }
+    return ret;
+}
+
+static void picoquic_stream_queue_insert(picoquic_stream_queue_t* queue, picoquic_stream_head_t* stream, int is_round_robin)
+{
+    picoquic_stream_head_t* next = NULL;
+
+    if (queue->last != NULL && picoquic_stream_queue_compare(stream, queue->last, is_round_robin) < 0) {
+        /* Streams just served and streams created last go at the end of the queue.
+         * A round robin stream becoming ready after some idle time usually goes near
+         * the front, so that search starts from the front. */
+        if (picoquic_stream_queue_compare(stream, queue->first, is_round_robin) < 0) {
+            next = queue->first;
+        }
+        else if (is_round_robin) {
+            next = queue->first->next_queued_stream;
+            while (picoquic_stream_queue_compare(stream, next, is_round_robin) > 0) {
+                next = next->next_queued_stream;
+            }
+        }
+        else {
+            next = queue->last;
+            while (picoquic_stream_queue_compare(stream, next->previous_queued_stream, is_round_robin) < 0) {
+                next = next->previous_queued_stream;
+            }
+        }
+    }
+    picoquic_stream_queue_link(queue, stream, next);
+}
+
+/* With weighted scheduling, the ready queues of round robin levels are in
+ * rotation order: new streams join at the end, and the sender moves the
+ * stream at the head of the queue to the end once its turn is over. */
+void picoquic_stream_queue_rotate(picoquic_stream_queue_t* queue)
+{
+    picoquic_stream_head_t* stream = queue->first;
+
+    if (stream != NULL && stream->next_queued_stream != NULL) {
+        picoquic_stream_queue_remove(stream);
+        picoquic_stream_queue_link(queue, stream, NULL);
+    }
+}
+
+static picoquic_stream_level_t* picoquic_get_stream_level(picoquic_cnx_t* cnx, uint8_t stream_priority)
+{
+    picoquic_stream_level_t* previous = NULL;
+    picoquic_stream_level_t* level = cnx->first_stream_level;
+
+    while (level != NULL && level->stream_priority < stream_priority) {
+        previous = level;
+        level = level->next_level;
+    }
+
+    if (level == NULL || level->stream_priority != stream_priority) {
+        picoquic_stream_level_t* next = level;
+
+        level = (picoquic_stream_level_t*)picoarena_alloc(&cnx->arena, sizeof(picoquic_stream_level_t));
+        if (level != NULL) {
+            memset(level, 0, sizeof(picoquic_stream_level_t));
+            level->stream_priority = stream_priority;
+            level->previous_level = previous;
+            level->next_level = next;
+            if (previous == NULL) {
+                cnx->first_stream_level = level;
+            }
+            else {
+                previous->next_level = level;
+            }
+            if (next != NULL) {
+                next->previous_level = level;
+            }
+        }
+    }
+
+    return level;
+}
+
+static void picoquic_stream_level_leave(picoquic_cnx_t* cnx, picoquic_stream_head_t* stream)
+{
+    picoquic_stream_level_t* level = stream->output_level;
+
+    picoquic_stream_queue_remove(stream);
+
+    if (level != NULL) {
+        stream->output_level = NULL;
+        level->nb_streams--;
+        if (level->nb_streams == 0) {
+            if (level->previous_level == NULL) {
+                cnx->first_stream_level = level->next_level;
+            }
+            else {
+                level->previous_level->next_level = level->next_level;
+            }
+            if (level->next_level != NULL) {
+                level->next_level->previous_level = level->previous_level;
+            }
+            picoarena_free(&cnx->arena, level, sizeof(picoquic_stream_level_t));
+        }
+    }
+}
+
+/* Find the queue matching the state of the stream. The tests replicate
+ * those of the formatting of stream frames. */
+static picoquic_stream_queue_t* picoquic_stream_output_queue(picoquic_cnx_t* cnx, picoquic_stream_head_t* stream, picoquic_stream_level_t* level)
+{
+    picoquic_stream_queue_t* queue = NULL;
+
+    if (stream->stop_sending_requested && !stream->stop_sending_sent) {
+        queue = &level->control;
+    }
+    else if (stream->reset_sent) {
+        if (stream->reset_requested || (stream->fin_requested && stream->fin_sent)) {
+            queue = &cnx->exhausted_streams;
+        }
+    }
+    else if (stream->reset_requested) {
+        queue = &level->control;
+    }
+    else {
+        int has_data = (stream->is_active ||
+            (stream->send_queue != NULL && stream->send_queue->length > stream->send_queue->offset) ||
+            (stream->fin_requested && !stream->fin_sent));
+
+        if (has_data && stream->sent_offset < stream->maxdata_remote) {
+            queue = &level->ready;
+        }
+        else if (stream->fin_requested && stream->fin_sent) {
+            queue = &cnx->exhausted_streams;
+        }
+        else if (has_data) {
+            queue = &level->blocked;
+        }
+    }
+
+    return queue;
+}
+
+/* Update the queue of an output stream after a change of state */
+void picoquic_update_output_stream(picoquic_cnx_t* cnx, picoquic_stream_head_t* stream)
+{
+    if (stream->is_output_stream) {
+        picoquic_stream_level_t* level = stream->output_level;
+
+        if (level != NULL && level->stream_priority != stream->stream_priority) {
+            picoquic_stream_level_leave(cnx, stream);
+            level = NULL;
+        }
+        if (level == NULL) {
+            /* If the allocation fails, the stream will be queued at the next update */
+            if ((level = picoquic_get_stream_level(cnx, stream->stream_priority)) != NULL) {
+                stream->output_level = level;
+                level->nb_streams++;
+            }
+        }
+        if (level != NULL) {
+            picoquic_stream_queue_t* queue = picoquic_stream_output_queue(cnx, stream, level);
+            int is_round_robin = (queue == &level->ready && (level->stream_priority & 1) == 0);
+            int is_weighted = is_round_robin && cnx->is_weighted_scheduling;
+
+            if (queue != stream->output_queue && stream->output_queue == &level->ready) {
+                /* As in deficit round robin, streams that leave the ready queue lose their credit */
+                stream->stream_deficit = 0;
+            }
+            if (is_weighted) {
+                if (queue != stream->output_queue) {
+                    picoquic_stream_queue_remove(stream);
+                    picoquic_stream_queue_link(queue, stream, NULL);
+                }
+            }
+            else if (queue != stream->output_queue ||
+                (is_round_robin &&
+                    ((stream->previous_queued_stream != NULL &&
+                        picoquic_stream_queue_compare(stream, stream->previous_queued_stream, 1) < 0) ||
+                    (stream->next_queued_stream != NULL &&
+                        picoquic_stream_queue_compare(stream, stream->next_queued_stream, 1) > 0)))) {
+                picoquic_stream_queue_remove(stream);
+                if (queue != NULL) {
+                    picoquic_stream_queue_insert(queue, stream, is_round_robin);
+                }
+            }
+        }
+    }
+}
+
+/* Switch the ready queues of the round robin levels between the ordering
+ * by last time data was sent and the rotation order of weighted scheduling.
+ */
+void picoquic_set_weighted_scheduling(picoquic_cnx_t* cnx, int is_weighted)
+{
+    if (cnx->is_weighted_scheduling != (is_weighted != 0)) {
+        picoquic_stream_level_t* level = cnx->first_stream_level;
+
+        cnx->is_weighted_scheduling = (is_weighted != 0);
+
+        while (level != NULL) {
+            if ((level->stream_priority & 1) == 0) {
+                picoquic_stream_head_t* stream = level->ready.first;
+
+                level->ready.first = NULL;
+                level->ready.last = NULL;
+                while (stream != NULL) {
+                    picoquic_stream_head_t* next = stream->next_queued_stream;
+
+                    stream->next_queued_stream = NULL;
+                    stream->previous_queued_stream = NULL;
+                    stream->stream_deficit = 0;
+                    if (cnx->is_weighted_scheduling) {
+                        picoquic_stream_queue_link(&level->ready, stream, NULL);
+                    }
+                    else {
+                        picoquic_stream_queue_insert(&level->ready, stream, 1);
+                    }
+                    stream = next;
+                }
+            }
+            level = level->next_level;
+        }
+    }
+}
+
 /* This code assumes that the stream is not currently present in the output stream.
  */
 void picoquic_insert_output_stream(picoquic_cnx_t* cnx, picoquic_stream_head_t* stream)
@@ -3418,6 +4152,7 @@ void picoquic_insert_output_stream(picoquic_cnx_t* cnx, picoquic_stream_head_t*
         }
 
         stream->is_output_stream = 1;
+        picoquic_update_output_stream(cnx, stream);
     }
 }
 
@@ -3425,6 +4160,7 @@ void picoquic_remove_output_stream(picoquic_cnx_t* cnx, picoquic_stream_head_t *
 {
     if (stream->is_output_stream) {
         stream->is_output_stream = 0;
+        picoquic_stream_level_leave(cnx, stream);
 
         if (stream->previous_output_stream == NULL) {
             cnx->first_output_stream = stream->next_output_stream;
@@ -3460,6 +4196,9 @@ void picoquic_reorder_output_stream(picoquic_cnx_t* cnx, picoquic_stream_head_t*
             stream->is_output_stream = 0;
             picoquic_insert_output_stream(cnx, stream);
         }
+        else {
+            picoquic_update_output_stream(cnx, stream);
+        }
     }
 }
 
@@ -3497,10 +4236,10 @@ void picoquic_add_output_streams(picoquic_cnx_t* cnx, uint64_t old_limit, uint64
 
 picoquic_stream_head_t* picoquic_create_stream(picoquic_cnx_t* cnx, uint64_t stream_id)
 {
-    picoquic_stream_head_t* stream = (picoquic_stream_head_t*)malloc(sizeof(picoquic_stream_head_t));
+    picoquic_stream_head_t* stream = (picoquic_stream_head_t*)picoslab_alloc(&cnx->quic->stream_slab);
     if (stream != NULL) {
         memset(stream, 0, sizeof(picoquic_stream_head_t));
-        picoquic_sack_list_init(&stream->sack_list);
+        picoquic_sack_list_init_ex(&stream->sack_list, &cnx->quic->sack_item_slab);
     }
 
     if (stream != NULL){
@@ -3535,8 +4274,9 @@ picoquic_stream_head_t* picoquic_create_stream(picoquic_cnx_t* cnx, uint64_t str
         }
 
         stream->stream_priority = cnx->quic->default_stream_priority;
+        stream->stream_weight = PICOQUIC_DEFAULT_STREAM_WEIGHT;
 
-        picosplay_init_tree(&stream->stream_data_tree, picoquic_stream_data_node_compare, picoquic_stream_data_node_create, picoquic_stream_data_node_delete, picoquic_stream_data_node_value);
+        picosplay_init_tree(&stream->stream_data_tree, picoquic_stream_data_node_compare, picoquic_stream_data_node_create, picoquic_stream_receive_node_delete, picoquic_stream_data_node_value);
 
         picosplay_insert(&cnx->stream_tree, stream);
         if (is_output_stream) {
@@ -3617,6 +4357,72 @@ int picoquic_mark_direct_receive_stream(picoquic_cnx_t* cnx, uint64_t stream_id,
     return ret;
 }
 
+int picoquic_mark_iovec_receive_stream(picoquic_cnx_t* cnx, uint64_t stream_id, picoquic_stream_iovec_receive_fn iovec_receive_fn, void* iovec_receive_ctx)
+{
+    int ret = 0;
+    picoquic_stream_head_t* stream = picoquic_find_stream(cnx, stream_id);
+
+    if (stream == NULL) {
+        ret = PICOQUIC_ERROR_INVALID_STREAM_ID;
+    }
+    else if (!IS_BIDIR_STREAM_ID(stream_id) && IS_LOCAL_STREAM_ID(stream_id, cnx->client_mode)) {
+        ret = PICOQUIC_ERROR_INVALID_STREAM_ID;
+    }
+    else if (iovec_receive_fn == NULL) {
+        ret = PICOQUIC_ERROR_NO_CALLBACK_PROVIDED;
+    }
+    else {
+        stream->iovec_receive_fn = iovec_receive_fn;
+        stream->iovec_receive_ctx = iovec_receive_ctx;
+        if (stream->delivered_offset < stream->consumed_offset) {
+            stream->delivered_offset = stream->consumed_offset;
+        }
+        /* If there is pending data, pass it. */
+        if (picosplay_first(&stream->stream_data_tree) != NULL ||
+            (stream->fin_received && !stream->fin_signalled)) {
+            (void)picoquic_stream_iovec_callback(cnx, stream);
+        }
+    }
+
+    return ret;
+}
+
+int picoquic_release_stream_iovec(picoquic_cnx_t* cnx, uint64_t stream_id, uint64_t offset)
+{
+    int ret = 0;
+    picoquic_stream_head_t* stream = picoquic_find_stream(cnx, stream_id);
+    picoquic_stream_data_node_t* data;
+
+    if (stream == NULL) {
+        ret = PICOQUIC_ERROR_INVALID_STREAM_ID;
+    }
+    else {
+        if (offset > stream->delivered_offset) {
+            offset = stream->delivered_offset;
+        }
+        /* Only the nodes that were entirely delivered and processed are freed */
+        while ((data = (picoquic_stream_data_node_t*)picosplay_first(&stream->stream_data_tree)) != NULL &&
+            data->offset + data->length <= offset) {
+            picosplay_delete_hint(&stream->stream_data_tree, &data->stream_data_node);
+        }
+        /* Released data is consumed, and the peer may get more credit */
+        if (offset > stream->consumed_offset) {
+            stream->consumed_offset = offset;
+            if (stream->fin_received || stream->reset_received) {
+                picoquic_update_max_stream_ID_local(cnx, stream);
+            }
+            else if (!stream->use_app_flow_control && 2 * stream->consumed_offset > stream->maxdata_local) {
+                cnx->max_stream_data_needed = 1;
+            }
+        }
+        if (stream->is_closed) {
+            (void)picoquic_delete_stream_if_closed(cnx, stream);
+        }
+    }
+
+    return ret;
+}
+
 
 /* Management of local CID.
  * Local CID are created and registered on demand.
@@ -3636,7 +4442,7 @@ picoquic_local_cnxid_list_t* picoquic_find_or_create_local_cnxid_list(picoquic_c
     }
 
     if (local_cnxid_list == NULL && do_create) {
-        local_cnxid_list = (picoquic_local_cnxid_list_t*)malloc(sizeof(picoquic_local_cnxid_list_t));
+        local_cnxid_list = (picoquic_local_cnxid_list_t*)picoarena_alloc(&cnx->arena, sizeof(picoquic_local_cnxid_list_t));
         if (local_cnxid_list != NULL) {
             memset(local_cnxid_list, 0, sizeof(picoquic_local_cnxid_list_t));
             local_cnxid_list->unique_path_id = unique_path_id;
@@ -3659,7 +4465,7 @@ picoquic_local_cnxid_t* picoquic_create_local_cnxid(picoquic_cnx_t* cnx,
     int is_unique = 0;
 
     if (local_cnxid_list != NULL) {
-        l_cid = (picoquic_local_cnxid_t*)malloc(sizeof(picoquic_local_cnxid_t));
+        l_cid = (picoquic_local_cnxid_t*)picoarena_alloc(&cnx->arena, sizeof(picoquic_local_cnxid_t));
 
         if (l_cid != NULL) {
             memset(l_cid, 0, sizeof(picoquic_local_cnxid_t));
@@ -3715,7 +4521,7 @@ picoquic_local_cnxid_t* picoquic_create_local_cnxid(picoquic_cnx_t* cnx,
                 }
             }
             else {
-                free(l_cid);
+                picoarena_free(&cnx->arena, l_cid, sizeof(picoquic_local_cnxid_t));
                 l_cid = NULL;
             }
         }
@@ -3745,8 +4551,10 @@ void picoquic_delete_local_cnxid_listed(picoquic_cnx_t* cnx,
     if (l_cid->cnx_id.id_len > 0) {
         /* Remove the registration in hash tables */
         if (l_cid->registered_cnx != NULL) {
-            picohash_item* item = &l_cid->hash_item;
-            picohash_delete_item(cnx->quic->table_cnx_by_id, item, 0);
+            picotable_key_t key;
+
+            picoquic_cid_table_key(&l_cid->cnx_id, &key);
+            (void)picotable_remove(&cnx->quic->table_cnx_by_id, &key);
         }
         l_cid->registered_cnx = NULL;
     }
@@ -3780,7 +4588,7 @@ void picoquic_delete_local_cnxid_listed(picoquic_cnx_t* cnx,
     }
 
     /* Delete and done */
-    free(l_cid);
+    picoarena_free(&cnx->arena, l_cid, sizeof(picoquic_local_cnxid_t));
 }
 
 void picoquic_delete_local_cnxid(picoquic_cnx_t* cnx,  picoquic_local_cnxid_t* l_cid)
@@ -3810,7 +4618,7 @@ void picoquic_delete_local_cnxid_list(picoquic_cnx_t* cnx, picoquic_local_cnxid_
         }
     }
 
-    free(local_cnxid_list);
+    picoarena_free(&cnx->arena, local_cnxid_list, sizeof(picoquic_local_cnxid_list_t));
     cnx->nb_local_cnxid_lists--;
 }
 
@@ -3908,6 +4716,8 @@ picoquic_cnx_t* picoquic_create_cnx_internal(picoquic_quic_t* quic,
         picoquic_local_cnxid_t* cnxid0;
 
         memset(cnx, 0, sizeof(picoquic_cnx_t));
+        picoarena_init(&cnx->arena);
+        cnx->arena.is_disabled = quic->is_cnx_arena_disabled;
         cnx->start_time = start_time;
         cnx->phase_delay = INT64_MAX;
         cnx->client_mode = client_mode;
@@ -3918,6 +4728,7 @@ picoquic_cnx_t* picoquic_create_cnx_internal(picoquic_quic_t* quic,
         }
         cnx->initial_cnxid = initial_cnx_id;
         cnx->quic = quic;
+        cnx->cwin_max = quic->cwin_max;
         cnx->pmtud_policy = quic->default_pmtud_policy;
         /* Create the connection ID number 0 */
         cnxid0 = picoquic_create_local_cnxid(cnx, 0, NULL, start_time);
@@ -4115,9 +4926,10 @@ picoquic_cnx_t* picoquic_create_cnx_internal(picoquic_quic_t* quic,
             cnx->tls_stream[epoch].remote_error = 0;
             cnx->tls_stream[epoch].maxdata_local = UINT64_MAX;
             cnx->tls_stream[epoch].maxdata_remote = UINT64_MAX;
+            cnx->tls_stream[epoch].cnx = cnx;
 
-            picosplay_init_tree(&cnx->tls_stream[epoch].stream_data_tree, picoquic_stream_data_node_compare, picoquic_stream_data_node_create, picoquic_stream_data_node_delete, picoquic_stream_data_node_value);
-            picoquic_sack_list_init(&cnx->tls_stream[epoch].sack_list);
+            picosplay_init_tree(&cnx->tls_stream[epoch].stream_data_tree, picoquic_stream_data_node_compare, picoquic_stream_data_node_create, picoquic_stream_receive_node_delete, picoquic_stream_data_node_value);
+            picoquic_sack_list_init_ex(&cnx->tls_stream[epoch].sack_list, &quic->sack_item_slab);
             /* No need to reset the state flags, as they are not used for the crypto stream */
         }
         
@@ -4501,6 +5313,112 @@ void picoquic_set_packet_train_mode(picoquic_quic_t* quic, int train_mode)
     quic->packet_train_mode = (train_mode > 0) ? 1 : 0;
 }
 
+void picoquic_set_pacing_offload(picoquic_quic_t* quic, uint64_t horizon)
+{
+    picoquic_cnx_t* cnx = quic->cnx_list;
+
+    quic->pacing_offload_horizon = horizon;
+    /* Apply the new horizon to the paths of existing connections */
+    while (cnx != NULL) {
+        for (int i = 0; i < cnx->nb_paths; i++) {
+            picoquic_set_pacing_offload_horizon(&cnx->path[i]->pacing, horizon);
+        }
+        cnx = cnx->next_in_table;
+    }
+}
+
+uint64_t picoquic_get_departure_time(picoquic_cnx_t* cnx)
+{
+    return cnx->departure_time;
+}
+
+void picoquic_set_packet_pool_high_water(picoquic_quic_t* quic, size_t nb_packets)
+{
+    picoslab_set_high_water(&quic->packet_slab, nb_packets);
+}
+
+void picoquic_set_stream_pool_high_water(picoquic_quic_t* quic, size_t nb_streams)
+{
+    picoslab_set_high_water(&quic->stream_slab, nb_streams);
+}
+
+void picoquic_set_sack_item_pool_high_water(picoquic_quic_t* quic, size_t nb_sack_items)
+{
+    picoslab_set_high_water(&quic->sack_item_slab, nb_sack_items);
+}
+
+static void picoquic_get_slab_stats(picoslab_t* slab, picoquic_pool_stats_t* stats)
+{
+    stats->nb_allocations = slab->stats.nb_allocations;
+    stats->nb_pool_hits = slab->stats.nb_pool_hits;
+    stats->nb_chunks_allocated = slab->stats.nb_chunks_allocated;
+    stats->nb_chunks_trimmed = slab->stats.nb_chunks_trimmed;
+    stats->nb_in_use = slab->stats.nb_in_use;
+    stats->nb_in_use_max = slab->stats.nb_in_use_max;
+    stats->nb_cached = picoslab_nb_cached(slab);
+    stats->memory_size = slab->stats.memory_size;
+    stats->chunk_size = slab->chunk_size;
+    stats->objects_per_chunk = slab->objects_per_chunk;
+    stats->nb_chunks_hugetlb = slab->stats.nb_chunks_hugetlb;
+    stats->nb_chunks_advised = slab->stats.nb_chunks_advised;
+}
+
+void picoquic_get_packet_pool_stats(picoquic_quic_t* quic, picoquic_pool_stats_t* stats)
+{
+    picoquic_get_slab_stats(&quic->packet_slab, stats);
+}
+
+void picoquic_get_memory_stats(picoquic_quic_t* quic, picoquic_memory_stats_t* stats)
+{
+    picoslab_t* full_slab = &quic->data_node_slab[PICOQUIC_NB_DATA_NODE_CLASSES - 1];
+
+    memset(stats, 0, sizeof(picoquic_memory_stats_t));
+    picoquic_get_slab_stats(&quic->packet_slab, &stats->packets);
+    for (int i = 0; i < PICOQUIC_NB_DATA_NODE_CLASSES; i++) {
+        picoslab_t* slab = &quic->data_node_slab[i];
+        uint64_t node_saving = full_slab->slot_size - slab->slot_size;
+
+        picoquic_get_slab_stats(slab, &stats->data_nodes[i]);
+        stats->data_node_size[i] = picoquic_data_node_class_size(quic, i);
+        stats->data_node_bytes_saved += node_saving * slab->stats.nb_in_use;
+        stats->data_node_bytes_saved_total += node_saving * slab->stats.nb_allocations;
+    }
+    picoquic_get_slab_stats(&quic->stream_slab, &stats->streams);
+    picoquic_get_slab_stats(&quic->sack_item_slab, &stats->sack_items);
+}
+
+void picoquic_trim_memory_pools(picoquic_quic_t* quic, uint64_t current_time)
+{
+    (void)picoslab_trim(&quic->packet_slab, current_time);
+    for (int i = 0; i < PICOQUIC_NB_DATA_NODE_CLASSES; i++) {
+        (void)picoslab_trim(&quic->data_node_slab[i], current_time);
+    }
+    (void)picoslab_trim(&quic->stream_slab, current_time);
+    (void)picoslab_trim(&quic->sack_item_slab, current_time);
+}
+
+int picoquic_set_huge_page_pools(picoquic_quic_t* quic, int use_huge_pages)
+{
+    int ret = 0;
+
+    if ((use_huge_pages != 0) != (quic->use_huge_page_pools != 0)) {
+        if (quic->packet_slab.stats.nb_in_use > 0 || quic->nb_data_nodes_in_use > 0) {
+            ret = PICOQUIC_ERROR_CANNOT_CHANGE_ACTIVE_CONTEXT;
+        }
+        else {
+            /* The cached chunks have the previous size, and are released */
+            size_t packet_high_water = quic->packet_slab.high_water;
+
+            picoquic_release_packet_slabs(quic);
+            quic->use_huge_page_pools = (use_huge_pages != 0);
+            picoquic_init_packet_slabs(quic);
+            picoslab_set_high_water(&quic->packet_slab, packet_high_water);
+        }
+    }
+
+    return ret;
+}
+
 void picoquic_set_padding_policy(picoquic_quic_t* quic, uint32_t padding_min_size, uint32_t padding_multiple)
 {
     quic->padding_minsize_default = padding_min_size;
@@ -4539,7 +5457,44 @@ uint64_t picoquic_get_default_connection_id_ttl(picoquic_quic_t* quic)
 void picoquic_set_mtu_max(picoquic_quic_t* quic, uint32_t mtu_max)
 {
     quic->mtu_max = mtu_max;
-    quic->default_tp.max_packet_size = mtu_max;
+    /* Do not announce packets larger than the packet buffers */
+    quic->default_tp.max_packet_size = (mtu_max > quic->max_packet_size) ? (uint32_t)quic->max_packet_size : mtu_max;
+}
+
+int picoquic_set_max_packet_size(picoquic_quic_t* quic, size_t max_packet_size)
+{
+    int ret = 0;
+
+    if (max_packet_size != quic->max_packet_size) {
+        if (max_packet_size < PICOQUIC_ENFORCED_INITIAL_MTU || max_packet_size > PICOQUIC_MAX_PACKET_SIZE_LIMIT) {
+            ret = -1;
+        }
+        else if (quic->packet_slab.stats.nb_in_use > 0 || quic->nb_data_nodes_in_use > 0 ||
+            (quic->cnx_list != NULL && max_packet_size < quic->max_packet_size)) {
+            /* Packets in use were allocated with the previous size, and paths
+             * may already use a larger MTU */
+            ret = PICOQUIC_ERROR_CANNOT_CHANGE_ACTIVE_CONTEXT;
+        }
+        else {
+            /* The cached objects have the previous size, and are released */
+            size_t packet_high_water = quic->packet_slab.high_water;
+
+            picoquic_release_packet_slabs(quic);
+            quic->max_packet_size = max_packet_size;
+            picoquic_init_packet_slabs(quic);
+            picoslab_set_high_water(&quic->packet_slab, packet_high_water);
+            if (quic->default_tp.max_packet_size > max_packet_size) {
+                quic->default_tp.max_packet_size = (uint32_t)max_packet_size;
+            }
+        }
+    }
+
+    return ret;
+}
+
+size_t picoquic_get_max_packet_size(picoquic_quic_t* quic)
+{
+    return quic->max_packet_size;
 }
 
 void picoquic_set_alpn_select_fn(picoquic_quic_t* quic, picoquic_alpn_select_fn alpn_select_fn)
@@ -4686,9 +5641,11 @@ void picoquic_clear_ack_ctx(picoquic_ack_context_t* ack_ctx)
 
 void picoquic_reset_ack_context(picoquic_ack_context_t* ack_ctx)
 {
+    picoslab_t* item_slab = ack_ctx->sack_list.item_slab;
+
     picoquic_clear_ack_ctx(ack_ctx);
 
-    picoquic_sack_list_init(&ack_ctx->sack_list);
+    picoquic_sack_list_init_ex(&ack_ctx->sack_list, item_slab);
 
     ack_ctx->ecn_ect0_total_local = 0;
     ack_ctx->ecn_ect1_total_local = 0;
@@ -4955,6 +5912,16 @@ void picoquic_delete_cnx(picoquic_cnx_t* cnx)
         picoquic_unregister_net_icid(cnx);
         picoquic_unregister_net_secret(cnx);
 
+        /* Whatever was not released with the queues and streams must not
+         * remain charged to the QUIC context */
+        picoquic_memory_release_all(cnx);
+
+        if (cnx->is_hibernating) {
+            cnx->quic->nb_cnx_hibernating--;
+        }
+
+        /* All the small objects of the connection go away at once */
+        picoarena_release(&cnx->arena);
         free(cnx);
     }
 }
@@ -5001,22 +5968,17 @@ picoquic_cnx_t* picoquic_cnx_by_id(picoquic_quic_t* quic, picoquic_connection_id
     struct st_picoquic_local_cnxid_t** l_cid)
 {
     picoquic_cnx_t* ret = NULL;
-    picohash_item* item;
-    picoquic_local_cnxid_t key;
+    picoquic_local_cnxid_t* found;
+    picotable_key_t key;
 
-    memset(&key, 0, sizeof(key));
-    key.cnx_id = cnx_id;
+    picoquic_cid_table_key(&cnx_id, &key);
+    found = (picoquic_local_cnxid_t*)picotable_find(&quic->table_cnx_by_id, &key);
 
-    item = picohash_retrieve(quic->table_cnx_by_id, &key);
-
-    if (item != NULL) {
-        ret = ((picoquic_local_cnxid_t*)item->key)->registered_cnx;
-        if (l_cid != NULL) {
-            *l_cid = ((picoquic_local_cnxid_t*)item->key);
-        }
+    if (found != NULL) {
+        ret = found->registered_cnx;
     }
-    else if (l_cid != NULL) {
-        *l_cid = NULL;
+    if (l_cid != NULL) {
+        *l_cid = found;
     }
 
     return ret;
@@ -5025,15 +5987,14 @@ picoquic_cnx_t* picoquic_cnx_by_id(picoquic_quic_t* quic, picoquic_connection_id
 picoquic_cnx_t* picoquic_cnx_by_net(picoquic_quic_t* quic, const struct sockaddr* addr)
 {
     picoquic_cnx_t* ret = NULL;
-    picohash_item* item;
-    picoquic_path_t dummy_path_x = { 0 };
-
-    picoquic_store_addr(&dummy_path_x.registered_peer_addr, addr);
+    picoquic_path_t* path_x;
+    picotable_key_t key;
 
-    item = picohash_retrieve(quic->table_cnx_by_net, &dummy_path_x);
+    picoquic_net_table_key(addr, &key);
+    path_x = (picoquic_path_t*)picotable_find(&quic->table_cnx_by_net, &key);
 
-    if (item != NULL) {
-        ret = ((picoquic_path_t*)item->key)->cnx;
+    if (path_x != NULL) {
+        ret = path_x->cnx;
     }
     return ret;
 }
@@ -59,37 +59,159 @@ static picosplay_node_t* picoquic_sack_node_create(void* value)
 
 static void picoquic_sack_node_delete(void* tree, picosplay_node_t* node)
 {
-#ifdef _WINDOWS
-    UNREFERENCED_PARAMETER(tree);
-#endif
-    free(picoquic_sack_node_value(node));
+    /* The splay tree is the first member of the sack list */
+    picoquic_sack_list_t* sack_list = (picoquic_sack_list_t*)((char*)tree - offsetof(struct st_picoquic_sack_list_t, ack_tree));
+
+    if (sack_list->item_slab != NULL) {
+        picoslab_free(sack_list->item_slab, picoquic_sack_node_value(node));
+    }
+    else {
+        free(picoquic_sack_node_value(node));
+    }
+}
+
+static picoquic_sack_item_t* picoquic_sack_item_alloc(picoquic_sack_list_t* sack_list)
+{
+    return (sack_list->item_slab != NULL) ?
+        (picoquic_sack_item_t*)picoslab_alloc(sack_list->item_slab) :
+        (picoquic_sack_item_t*)malloc(sizeof(picoquic_sack_item_t));
+}
+
+/* Procedures to manage the ring of ranges. The items in the ring are
+ * designated by their rank, from 0 for the lowest range to ring_count - 1
+ * for the highest. Deleting the lowest range does not move the other
+ * items, and deleting or inserting another range only moves the items
+ * above it, so that pointers to lower items remain valid.
+ */
+static picoquic_sack_item_t* picoquic_sack_ring_item(picoquic_sack_list_t* sack_list, int rank)
+{
+    return &sack_list->ring[(sack_list->ring_first + rank) & (PICOQUIC_SACK_RING_SIZE - 1)];
+}
+
+static int picoquic_sack_ring_rank(picoquic_sack_list_t* sack_list, picoquic_sack_item_t* sack)
+{
+    return (int)(((sack - sack_list->ring) + PICOQUIC_SACK_RING_SIZE - sack_list->ring_first) & (PICOQUIC_SACK_RING_SIZE - 1));
+}
+
+/* Move the ranges from the ring to the splay tree, when there is no more
+ * room in the ring. The list is unchanged if allocations fail. */
+static int picoquic_sack_spill_to_tree(picoquic_sack_list_t* sack_list)
+{
+    int ret = 0;
+    picoquic_sack_item_t* items[PICOQUIC_SACK_RING_SIZE];
+    int nb_items = 0;
+
+    while (nb_items < sack_list->ring_count && (items[nb_items] = picoquic_sack_item_alloc(sack_list)) != NULL) {
+        nb_items++;
+    }
+
+    if (nb_items < sack_list->ring_count) {
+        for (int i = 0; i < nb_items; i++) {
+            picoquic_sack_node_delete(&sack_list->ack_tree, &items[i]->node);
+        }
+        ret = -1;
+    }
+    else {
+        for (int i = 0; i < nb_items; i++) {
+            *items[i] = *picoquic_sack_ring_item(sack_list, i);
+            (void)picosplay_insert(&sack_list->ack_tree, items[i]);
+        }
+        sack_list->ring_first = 0;
+        sack_list->ring_count = 0;
+        sack_list->is_in_tree = 1;
+    }
+
+    return ret;
+}
+
+/* Move the ranges back to the ring when only a few ranges remain. This is
+ * only done before updates, when callers do not hold pointers to items. */
+static void picoquic_sack_check_return_to_ring(picoquic_sack_list_t* sack_list)
+{
+    if (sack_list->is_in_tree && sack_list->ack_tree.size <= PICOQUIC_SACK_RING_SIZE / 2) {
+        picosplay_node_t* node = picosplay_first(&sack_list->ack_tree);
+        int rank = 0;
+
+        while (node != NULL) {
+            sack_list->ring[rank] = *picoquic_sack_item_value(node);
+            memset(&sack_list->ring[rank].node, 0, sizeof(picosplay_node_t));
+            rank++;
+            node = picosplay_next(node);
+        }
+        picosplay_empty_tree(&sack_list->ack_tree);
+        sack_list->ring_first = 0;
+        sack_list->ring_count = rank;
+        sack_list->is_in_tree = 0;
+    }
 }
 
 /* Return the first ACK item in the list */
 picoquic_sack_item_t* picoquic_sack_first_item(picoquic_sack_list_t* sack_list)
 {
-    return picoquic_sack_item_value(picosplay_first(&sack_list->ack_tree));
+    if (sack_list->is_in_tree) {
+        return picoquic_sack_item_value(picosplay_first(&sack_list->ack_tree));
+    }
+    return (sack_list->ring_count == 0) ? NULL : picoquic_sack_ring_item(sack_list, 0);
 }
 
 picoquic_sack_item_t* picoquic_sack_last_item(picoquic_sack_list_t* sack_list)
 {
-    return picoquic_sack_item_value(picosplay_last(&sack_list->ack_tree));
+    if (sack_list->is_in_tree) {
+        return picoquic_sack_item_value(picosplay_last(&sack_list->ack_tree));
+    }
+    return (sack_list->ring_count == 0) ? NULL : picoquic_sack_ring_item(sack_list, sack_list->ring_count - 1);
 }
 
-picoquic_sack_item_t* picoquic_sack_next_item(picoquic_sack_item_t* sack)
+picoquic_sack_item_t* picoquic_sack_next_item(picoquic_sack_list_t* sack_list, picoquic_sack_item_t* sack)
 {
-    return picoquic_sack_item_value(picosplay_next(&sack->node));
+    int rank;
+
+    if (sack_list->is_in_tree) {
+        return picoquic_sack_item_value(picosplay_next(&sack->node));
+    }
+    rank = picoquic_sack_ring_rank(sack_list, sack) + 1;
+    return (rank >= sack_list->ring_count) ? NULL : picoquic_sack_ring_item(sack_list, rank);
 }
 
-picoquic_sack_item_t* picoquic_sack_previous_item(picoquic_sack_item_t* sack)
+picoquic_sack_item_t* picoquic_sack_previous_item(picoquic_sack_list_t* sack_list, picoquic_sack_item_t* sack)
 {
-    return picoquic_sack_item_value(picosplay_previous(&sack->node));
+    int rank;
+
+    if (sack_list->is_in_tree) {
+        return picoquic_sack_item_value(picosplay_previous(&sack->node));
+    }
+    rank = picoquic_sack_ring_rank(sack_list, sack);
+    return (rank == 0) ? NULL : picoquic_sack_ring_item(sack_list, rank - 1);
 }
 
 int picoquic_sack_insert_item(picoquic_sack_list_t* sack_list, uint64_t range_min, uint64_t range_max, uint64_t current_time)
 {
     int ret = 0;
-    picoquic_sack_item_t* sack_new = (picoquic_sack_item_t*)malloc(sizeof(picoquic_sack_item_t));
+    picoquic_sack_item_t* sack_new = NULL;
+
+    picoquic_sack_check_return_to_ring(sack_list);
+
+    if (!sack_list->is_in_tree && sack_list->ring_count >= PICOQUIC_SACK_RING_SIZE) {
+        ret = picoquic_sack_spill_to_tree(sack_list);
+    }
+
+    if (ret == 0) {
+        if (sack_list->is_in_tree) {
+            sack_new = picoquic_sack_item_alloc(sack_list);
+        }
+        else {
+            /* New ranges are most often at the top of the ring */
+            int rank = sack_list->ring_count;
+
+            while (rank > 0 && picoquic_sack_ring_item(sack_list, rank - 1)->start_of_sack_range > range_min) {
+                *picoquic_sack_ring_item(sack_list, rank) = *picoquic_sack_ring_item(sack_list, rank - 1);
+                rank--;
+            }
+            sack_new = picoquic_sack_ring_item(sack_list, rank);
+            sack_list->ring_count++;
+        }
+    }
+
     if (sack_new == NULL) {
         ret = -1;
     }
@@ -101,11 +223,14 @@ int picoquic_sack_insert_item(picoquic_sack_list_t* sack_list, uint64_t range_mi
         sack_new->time_created = current_time;
         sack_list->rc[0].range_counts[0] += 1;
         sack_list->rc[1].range_counts[0] += 1;
-        (void)picosplay_insert(&sack_list->ack_tree, sack_new);
+        if (sack_list->is_in_tree) {
+            (void)picosplay_insert(&sack_list->ack_tree, sack_new);
+        }
     }
 
     return ret;
 }
+
 void picoquic_sack_delete_item(picoquic_sack_list_t* sack_list, picoquic_sack_item_t* sack)
 {
     /* Accounting of deleted values */
@@ -114,15 +239,30 @@ void picoquic_sack_delete_item(picoquic_sack_list_t* sack_list, picoquic_sack_it
             sack_list->rc[r].range_counts[sack->nb_times_sent[r]] -= 1;
         }
     }
-    /* Delete the item in the splay */
-    picosplay_delete_hint(&sack_list->ack_tree, &sack->node);
+    if (sack_list->is_in_tree) {
+        /* Delete the item in the splay */
+        picosplay_delete_hint(&sack_list->ack_tree, &sack->node);
+    }
+    else {
+        int rank = picoquic_sack_ring_rank(sack_list, sack);
+
+        if (rank == 0) {
+            sack_list->ring_first = (sack_list->ring_first + 1) & (PICOQUIC_SACK_RING_SIZE - 1);
+        }
+        else {
+            for (int i = rank + 1; i < sack_list->ring_count; i++) {
+                *picoquic_sack_ring_item(sack_list, i - 1) = *picoquic_sack_ring_item(sack_list, i);
+            }
+        }
+        sack_list->ring_count--;
+    }
 }
 
 /* Check whether the sack list is empty
  */
 int picoquic_sack_list_is_empty(picoquic_sack_list_t* sack_list)
 {
-    return (sack_list->ack_tree.size == 0);
+    return (picoquic_sack_list_size(sack_list) == 0);
 }
 
 /* Find the ack context from the context 
@@ -161,10 +301,27 @@ picoquic_sack_item_t* picoquic_sack_find_range_below_number(picoquic_sack_list_t
 #ifdef _WINDOWS
     UNREFERENCED_PARAMETER(previous);
 #endif
-    picoquic_sack_item_t v = { 0 };
-    v.start_of_sack_range = pn64;
-    v.end_of_sack_range = pn64;
-    return(picoquic_sack_item_value(picosplay_find_previous(&sack_list->ack_tree, &v)));
+    picoquic_sack_item_t* sack = NULL;
+
+    if (sack_list->is_in_tree) {
+        picoquic_sack_item_t v = { 0 };
+        v.start_of_sack_range = pn64;
+        v.end_of_sack_range = pn64;
+        sack = picoquic_sack_item_value(picosplay_find_previous(&sack_list->ack_tree, &v));
+    }
+    else {
+        /* Search from the top, where most packets are received */
+        int rank = sack_list->ring_count;
+
+        while (rank > 0) {
+            rank--;
+            if (picoquic_sack_ring_item(sack_list, rank)->start_of_sack_range <= pn64) {
+                sack = picoquic_sack_ring_item(sack_list, rank);
+                break;
+            }
+        }
+    }
+    return sack;
 }
 
 /*
@@ -198,12 +355,15 @@ int picoquic_update_sack_list(picoquic_sack_list_t* sack_list,
     uint64_t pn64_min, uint64_t pn64_max, uint64_t current_time)
 {
     int ret = 1; /* duplicate by default, reset to 0 if update found */
-    picoquic_sack_item_t* previous = picoquic_sack_find_range_below_number(sack_list, NULL, pn64_min);
+    picoquic_sack_item_t* previous;
+
+    picoquic_sack_check_return_to_ring(sack_list);
+    previous = picoquic_sack_find_range_below_number(sack_list, NULL, pn64_min);
 
     if (previous == NULL || previous->end_of_sack_range + 1 < pn64_min) {
         /* No overlap with a range below */
         picoquic_sack_item_t* next = (previous == NULL) ?
-            picoquic_sack_first_item(sack_list) : picoquic_sack_next_item(previous);
+            picoquic_sack_first_item(sack_list) : picoquic_sack_next_item(sack_list, previous);
         if (next == NULL || next->start_of_sack_range - 1 > pn64_max) {
             /* create a new item in the list */
             ret = picoquic_sack_insert_item(sack_list, pn64_min, pn64_max, current_time);
@@ -224,7 +384,7 @@ int picoquic_update_sack_list(picoquic_sack_list_t* sack_list,
     while (previous != NULL && previous->end_of_sack_range < pn64_max) {
         /* we found or created an item that includes the beginning
          * of the acked range. Check the next one */
-        picoquic_sack_item_t* next = picoquic_sack_next_item(previous);
+        picoquic_sack_item_t* next = picoquic_sack_next_item(sack_list, previous);
         if (next == NULL || next->start_of_sack_range - 1 > pn64_max) {
             /* No overlap. Extend the previous item up to the max of the range */
             previous->end_of_sack_range = pn64_max;
@@ -351,7 +511,7 @@ picoquic_sack_item_t* picoquic_process_ack_of_ack_range(picoquic_sack_list_t* sa
     previous = picoquic_sack_find_range_below_number(sack_list, NULL, start_of_range);
 
     if (previous != NULL && previous->start_of_sack_range == start_of_range){
-        picoquic_sack_item_t* next = picoquic_sack_item_value(picosplay_next(&previous->node));
+        picoquic_sack_item_t* next = picoquic_sack_next_item(sack_list, previous);
         if (next == NULL) {
             /* Matching the highest range, which shall not be deleted */
             if (end_of_range < previous->end_of_sack_range) {
@@ -388,7 +548,7 @@ void picoquic_update_ack_horizon(picoquic_sack_list_t* sack_list, uint64_t curre
     while (first_sack != NULL && first_sack->nb_times_sent[0] >= PICOQUIC_MAX_ACK_RANGE_REPEAT) {
         int64_t delay = current_time - first_sack->time_created;
         if (delay > sack_list->horizon_delay) {
-            picoquic_sack_item_t* next_sack = picoquic_sack_next_item(first_sack);
+            picoquic_sack_item_t* next_sack = picoquic_sack_next_item(sack_list, first_sack);
             if (next_sack != NULL) {
                 /* Always keep the last range */
                 sack_list->ack_horizon = first_sack->end_of_sack_range + 1;
@@ -424,16 +584,24 @@ uint64_t picoquic_sack_list_last(picoquic_sack_list_t* sack_list)
 picoquic_sack_item_t * picoquic_sack_list_first_range(picoquic_sack_list_t* sack_list)
 {
     picoquic_sack_item_t* first = picoquic_sack_first_item(sack_list);
-    return(first == NULL) ? NULL : picoquic_sack_item_value(picosplay_next(&first->node));
+    return(first == NULL) ? NULL : picoquic_sack_next_item(sack_list, first);
 }
 
 /* Initialize a sack list
  */
 void picoquic_sack_list_init(picoquic_sack_list_t* sack_list)
+{
+    picoquic_sack_list_init_ex(sack_list, NULL);
+}
+
+/* Initialize a sack list whose items are allocated from the slab of the QUIC context
+ */
+void picoquic_sack_list_init_ex(picoquic_sack_list_t* sack_list, picoslab_t* item_slab)
 {
     memset(sack_list, 0, sizeof(picoquic_sack_list_t));
     picosplay_init_tree(&sack_list->ack_tree, picoquic_sack_item_compare,
         picoquic_sack_node_create, picoquic_sack_node_delete, picoquic_sack_node_value);
+    sack_list->item_slab = item_slab;
 }
 
 /* Reset a SACK list to single range
@@ -451,6 +619,9 @@ int picoquic_sack_list_reset(picoquic_sack_list_t* sack_list, uint64_t range_min
 void picoquic_sack_list_free(picoquic_sack_list_t* sack_list)
 {
     picosplay_empty_tree(&sack_list->ack_tree);
+    sack_list->ring_first = 0;
+    sack_list->ring_count = 0;
+    sack_list->is_in_tree = 0;
     for (int r = 0; r < 2; r++) {
         memset(sack_list->rc[r].range_counts, 0, sizeof(sack_list->rc[r].range_counts));
     }
@@ -497,5 +668,5 @@ void picoquic_sack_item_record_reset(picoquic_sack_list_t* sack_list, picoquic_s
 
 size_t picoquic_sack_list_size(picoquic_sack_list_t* sack_list)
 {
-    return (size_t)sack_list->ack_tree.size;
+    return (sack_list->is_in_tree) ? (size_t)sack_list->ack_tree.size : (size_t)sack_list->ring_count;
 }
\ No newline at end of file
@@ -163,6 +163,7 @@ int picoquic_mark_active_stream(picoquic_cnx_t* cnx,
             stream->is_active = 0;
             stream->app_stream_ctx = app_stream_ctx;
         }
+        picoquic_update_output_stream(cnx, stream);
     }
 
     return ret;
@@ -209,6 +210,18 @@ int picoquic_set_stream_priority(picoquic_cnx_t* cnx, uint64_t stream_id, uint8_
     return ret;
 }
 
+int picoquic_set_stream_weight(picoquic_cnx_t* cnx, uint64_t stream_id, uint8_t stream_weight)
+{
+    int ret = 0;
+    picoquic_stream_head_t* stream = picoquic_find_stream_for_writing(cnx, stream_id, &ret);
+
+    if (ret == 0) {
+        stream->stream_weight = (stream_weight == 0) ? PICOQUIC_DEFAULT_STREAM_WEIGHT : stream_weight;
+    }
+
+    return ret;
+}
+
 int picoquic_mark_high_priority_stream(picoquic_cnx_t * cnx, uint64_t stream_id, int is_high_priority)
 {
     int ret;
@@ -225,8 +238,11 @@ int picoquic_mark_high_priority_stream(picoquic_cnx_t * cnx, uint64_t stream_id,
     return ret;
 }
 
-int picoquic_add_to_stream_with_ctx(picoquic_cnx_t* cnx, uint64_t stream_id,
-    const uint8_t* data, size_t length, int set_fin, void * app_stream_ctx)
+/* Queue data on a stream. If a release function is provided, the data is
+ * owned by the application and is not copied. */
+static int picoquic_queue_stream_data(picoquic_cnx_t* cnx, uint64_t stream_id,
+    const uint8_t* data, size_t length, int set_fin,
+    picoquic_stream_buffer_release_fn release_fn, void* release_ctx, picoquic_stream_head_t** p_stream)
 {
     int ret = 0;
     picoquic_stream_head_t* stream = picoquic_find_stream_for_writing(cnx, stream_id, &ret);
@@ -253,7 +269,12 @@ int picoquic_add_to_stream_with_ctx(picoquic_cnx_t* cnx, uint64_t stream_id,
         if (stream_data == 0) {
             ret = -1;
         } else {
-            stream_data->bytes = (uint8_t*)malloc(length);
+            if (release_fn != NULL) {
+                stream_data->bytes = (uint8_t*)data;
+            }
+            else {
+                stream_data->bytes = (uint8_t*)malloc(length);
+            }
 
             if (stream_data->bytes == NULL) {
                 free(stream_data);
@@ -262,18 +283,26 @@ int picoquic_add_to_stream_with_ctx(picoquic_cnx_t* cnx, uint64_t stream_id,
             } else {
                 picoquic_stream_queue_node_t** pprevious = &stream->send_queue;
                 picoquic_stream_queue_node_t* next = stream->send_queue;
+                uint64_t stream_offset = stream->sent_offset;
 
-                memcpy(stream_data->bytes, data, length);
+                if (release_fn == NULL) {
+                    memcpy(stream_data->bytes, data, length);
+                }
                 stream_data->length = length;
                 stream_data->offset = 0;
                 stream_data->next_stream_data = NULL;
+                stream_data->release_fn = release_fn;
+                stream_data->release_ctx = release_ctx;
 
                 while (next != NULL) {
+                    stream_offset += next->length - next->offset;
                     pprevious = &next->next_stream_data;
                     next = next->next_stream_data;
                 }
 
+                stream_data->stream_offset = stream_offset;
                 *pprevious = stream_data;
+                picoquic_memory_charge(cnx, picoquic_memory_class_stream_send, length);
             }
         }
 
@@ -283,6 +312,24 @@ int picoquic_add_to_stream_with_ctx(picoquic_cnx_t* cnx, uint64_t stream_id,
     if (ret == 0) {
         cnx->nb_bytes_queued += length;
         stream->is_active = 0;
+    }
+
+    if (stream != NULL) {
+        picoquic_update_output_stream(cnx, stream);
+    }
+
+    *p_stream = stream;
+
+    return ret;
+}
+
+int picoquic_add_to_stream_with_ctx(picoquic_cnx_t* cnx, uint64_t stream_id,
+    const uint8_t* data, size_t length, int set_fin, void * app_stream_ctx)
+{
+    picoquic_stream_head_t* stream = NULL;
+    int ret = picoquic_queue_stream_data(cnx, stream_id, data, length, set_fin, NULL, NULL, &stream);
+
+    if (ret == 0) {
         stream->app_stream_ctx = app_stream_ctx;
     }
 
@@ -295,6 +342,19 @@ int picoquic_add_to_stream(picoquic_cnx_t* cnx, uint64_t stream_id,
     return picoquic_add_to_stream_with_ctx(cnx, stream_id, data, length, set_fin, NULL);
 }
 
+int picoquic_add_buffer_to_stream(picoquic_cnx_t* cnx, uint64_t stream_id, const uint8_t* bytes, size_t length,
+    int set_fin, picoquic_stream_buffer_release_fn release_fn, void* release_ctx)
+{
+    int ret = -1;
+    picoquic_stream_head_t* stream = NULL;
+
+    if (release_fn != NULL) {
+        ret = picoquic_queue_stream_data(cnx, stream_id, bytes, length, set_fin, release_fn, release_ctx, &stream);
+    }
+
+    return ret;
+}
+
 int picoquic_set_app_flow_control(picoquic_cnx_t* cnx, uint64_t stream_id, int use_app_flow_control)
 {
     int ret = 0;
@@ -309,12 +369,49 @@ int picoquic_set_app_flow_control(picoquic_cnx_t* cnx, uint64_t stream_id, int u
     return ret;
 }
 
-int picoquic_open_flow_control(picoquic_cnx_t* cnx, uint64_t stream_id, uint64_t expected_data_size)
+/* Open the credit of a stream up to max_required. Under memory pressure,
+ * the credit is only opened up to the memory cap of the connection, and the
+ * rest is kept in maxdata_deferred until the cap is raised. The connection
+ * credit then follows the memory cap, see picoquic_prepare_packet_ready.
+ */
+static int picoquic_open_stream_credit(picoquic_cnx_t* cnx, picoquic_stream_head_t* stream,
+    uint64_t max_required, uint64_t max_data_increase)
 {
     int ret = 0;
     uint8_t buffer[512];
+    uint8_t* bytes_max = buffer + sizeof(buffer);
     size_t length = 0;
-    size_t consumed = 0;
+    int more_data = 0;
+    int is_pure_ack = 1;
+
+    if (cnx->memory_cap != 0) {
+        max_data_increase = 0;
+        if (max_required > stream->consumed_offset + cnx->memory_cap) {
+            if (max_required > stream->maxdata_deferred) {
+                stream->maxdata_deferred = max_required;
+            }
+            cnx->is_flow_control_deferred = 1;
+            max_required = stream->consumed_offset + cnx->memory_cap;
+        }
+    }
+
+    if (max_required > stream->maxdata_local) {
+        uint8_t* bytes_next = picoquic_format_max_stream_data_frame(cnx, stream, buffer, bytes_max, &more_data, &is_pure_ack, max_required);
+        if (max_data_increase > 0) {
+            bytes_next = picoquic_format_max_data_frame(cnx, bytes_next, bytes_max, &more_data, &is_pure_ack, max_data_increase);
+        }
+        if ((length = bytes_next - buffer) > 0) {
+            ret = picoquic_queue_misc_frame(cnx, buffer, length, is_pure_ack,
+                picoquic_packet_context_application);
+        }
+    }
+
+    return ret;
+}
+
+int picoquic_open_flow_control(picoquic_cnx_t* cnx, uint64_t stream_id, uint64_t expected_data_size)
+{
+    int ret = 0;
     picoquic_stream_head_t* stream = picoquic_find_stream(cnx, stream_id);
 
     if (cnx->cnx_state == picoquic_state_ready && cnx->quic->max_data_limit == 0){
@@ -326,25 +423,41 @@ int picoquic_open_flow_control(picoquic_cnx_t* cnx, uint64_t stream_id, uint64_t
             ret = PICOQUIC_ERROR_INVALID_STREAM_ID;
         }
         else {
-            uint64_t max_required = stream->consumed_offset + expected_data_size;
-            uint8_t* bytes_max = buffer + sizeof(buffer);
-            int more_data = 0;
-            int is_pure_ack = 1;
-
-            if (max_required > stream->maxdata_local) {
-                uint8_t* bytes_next = picoquic_format_max_stream_data_frame(cnx, stream, buffer + consumed, bytes_max, &more_data, &is_pure_ack, max_required);
-                bytes_next = picoquic_format_max_data_frame(cnx, bytes_next, bytes_max, &more_data, &is_pure_ack, expected_data_size);
-                if ((length = bytes_next - buffer) > 0) {
-                    ret = picoquic_queue_misc_frame(cnx, buffer, length, is_pure_ack,
-                        picoquic_packet_context_application);
-                }
-            }
+            ret = picoquic_open_stream_credit(cnx, stream, stream->consumed_offset + expected_data_size, expected_data_size);
         }
     }
 
     return ret;
 }
 
+/* Grant the credit held back while the memory cap was lower. Called when
+ * the memory cap of the connection is raised or lifted.
+ */
+void picoquic_open_deferred_flow_control(picoquic_cnx_t* cnx)
+{
+    if (cnx->is_flow_control_deferred && cnx->cnx_state == picoquic_state_ready) {
+        picoquic_stream_head_t* stream = picoquic_first_stream(cnx);
+
+        cnx->is_flow_control_deferred = 0;
+        while (stream != NULL) {
+            if (stream->maxdata_deferred > stream->maxdata_local) {
+                uint64_t max_required = stream->maxdata_deferred;
+
+                stream->maxdata_deferred = 0;
+                if (picoquic_open_stream_credit(cnx, stream, max_required, max_required - stream->maxdata_local) != 0) {
+                    /* Could not queue the frame, retry at the next change of the cap */
+                    stream->maxdata_deferred = max_required;
+                    cnx->is_flow_control_deferred = 1;
+                }
+            }
+            else {
+                stream->maxdata_deferred = 0;
+            }
+            stream = picoquic_next_stream(stream);
+        }
+    }
+}
+
 void picoquic_reset_stream_ctx(picoquic_cnx_t* cnx, uint64_t stream_id)
 {
     picoquic_stream_head_t* stream = picoquic_find_stream(cnx, stream_id);
@@ -374,6 +487,7 @@ int picoquic_reset_stream_at(picoquic_cnx_t* cnx,
             stream->local_error = local_stream_error;
             stream->reset_requested = 1;
             stream->reliable_size = reliable_size;
+            picoquic_update_output_stream(cnx, stream);
         }
     }
 
@@ -422,6 +536,7 @@ int picoquic_stop_sending(picoquic_cnx_t* cnx,
             stream->local_stop_error = local_stream_error;
             stream->stop_sending_requested = 1;
             picoquic_insert_output_stream(cnx, stream);
+            picoquic_update_output_stream(cnx, stream);
         }
     }
 
@@ -504,27 +619,14 @@ size_t picoquic_pad_to_policy(picoquic_cnx_t * cnx, uint8_t * bytes, size_t leng
 
 picoquic_packet_t* picoquic_create_packet(picoquic_quic_t * quic)
 {
-    picoquic_packet_t* packet = quic->p_first_packet;
-    
-    if (packet == NULL) {
-        packet = (picoquic_packet_t*)malloc(sizeof(picoquic_packet_t));
-        if (packet != NULL) {
-            quic->nb_packets_allocated++;
-            if (quic->nb_packets_allocated > quic->nb_packets_allocated_max) {
-                quic->nb_packets_allocated_max = quic->nb_packets_allocated;
-            }
-        }
-    }
-    else {
-        quic->p_first_packet = packet->packet_previous;
-        quic->nb_packets_in_pool--;
-    }
+    picoquic_packet_t* packet = (picoquic_packet_t*)picoslab_alloc(&quic->packet_slab);
 
     if (packet != NULL) {
-        /* It might be sufficient to zero the metadata, but zeroing everything
-         * appears safer, and does not confuse checkers like valgrind.
+        /* Only the metadata is reset. The bytes are zeroed when the packet
+         * is first carved from a slab chunk, which keeps checkers like valgrind
+         * happy, and later overwritten when packets are formatted.
          */
-        memset(packet, 0, sizeof(picoquic_packet_t));
+        memset(packet, 0, offsetof(struct st_picoquic_packet_t, bytes));
     }
 
     return packet;
@@ -532,18 +634,7 @@ picoquic_packet_t* picoquic_create_packet(picoquic_quic_t * quic)
 
 void picoquic_recycle_packet(picoquic_quic_t * quic, picoquic_packet_t* packet)
 {
-    if (packet != NULL) {
-        if (quic->nb_packets_in_pool >= PICOQUIC_MAX_PACKETS_IN_POOL) {
-            free(packet);
-            quic->nb_packets_allocated--;
-        }
-        else {
-            memset(packet, 0, offsetof(struct st_picoquic_packet_t, bytes));
-            packet->packet_previous = quic->p_first_packet;
-            quic->p_first_packet = packet;
-            quic->nb_packets_in_pool++;
-        }
-    }
+    picoslab_free(&quic->packet_slab, packet);
 }
 
 void picoquic_update_payload_length(
@@ -992,6 +1083,7 @@ void picoquic_queue_for_retransmit(picoquic_cnx_t* cnx, picoquic_path_t * path_x
     }
     pkt_ctx->pending_last = packet;
     packet->is_queued_for_retransmit = 1;
+    picoquic_update_packet_memory(cnx, packet);
 
     if (!packet->is_ack_trap) {
         /* Account for bytes in transit, for congestion control */
@@ -999,6 +1091,15 @@ void picoquic_queue_for_retransmit(picoquic_cnx_t* cnx, picoquic_path_t * path_x
         path_x->is_cc_data_updated = 1;
         /* Update the pacing data */
         picoquic_update_pacing_after_send(path_x, length, current_time);
+        if (path_x->pacing.offload_horizon_nanosec > 0) {
+            /* The packets prepared in one call are sent together, at the
+             * departure time of the first paced packet. */
+            if (cnx->departure_time == 0) {
+                cnx->departure_time = path_x->pacing.departure_time;
+            }
+            picoquic_log_packet_departure(cnx, path_x, packet->sequence_number,
+                path_x->pacing.departure_time, current_time);
+        }
     }
 }
 
@@ -1048,6 +1149,7 @@ picoquic_packet_t* picoquic_dequeue_retransmit_packet(picoquic_cnx_t* cnx,
             picoquic_queue_data_repeat_packet(cnx, p);
         }
         else {
+            picoquic_update_packet_memory(cnx, p);
             picoquic_recycle_packet(cnx->quic, p);
             p = NULL;
         }
@@ -1073,6 +1175,10 @@ picoquic_packet_t* picoquic_dequeue_retransmit_packet(picoquic_cnx_t* cnx,
         }
     }
 
+    if (p != NULL) {
+        picoquic_update_packet_memory(cnx, p);
+    }
+
     return p;
 }
 
@@ -1097,6 +1203,7 @@ void picoquic_dequeue_retransmitted_packet(picoquic_cnx_t* cnx, picoquic_packet_
     * for detection of spurious losses, so should only be recycled
     * when removed from both queues */
     p->is_queued_for_spurious_detection = 0;
+    picoquic_update_packet_memory(cnx, p);
     if (!p->is_queued_for_data_repeat) {
         picoquic_recycle_packet(cnx->quic, p);
     }
@@ -1526,9 +1633,6 @@ static size_t picoquic_next_mtu_probe_length(picoquic_cnx_t* cnx, picoquic_path_
                 cnx->quic->mtu_max - PICOQUIC_MTU_OVERHEAD((struct sockaddr*)&path_x->first_tuple->peer_addr)) {
                 probe_length = cnx->quic->mtu_max - PICOQUIC_MTU_OVERHEAD((struct sockaddr*)&path_x->first_tuple->peer_addr);
             }
-            else if (probe_length > PICOQUIC_MAX_PACKET_SIZE) {
-                probe_length = PICOQUIC_MAX_PACKET_SIZE;
-            }
             if (probe_length < path_x->send_mtu) {
                 probe_length = path_x->send_mtu;
             }
@@ -1539,6 +1643,10 @@ static size_t picoquic_next_mtu_probe_length(picoquic_cnx_t* cnx, picoquic_path_
         else {
             probe_length = PICOQUIC_PRACTICAL_MAX_MTU;
         }
+        /* The probe cannot be larger than the packet buffers */
+        if (probe_length > cnx->quic->max_packet_size) {
+            probe_length = cnx->quic->max_packet_size;
+        }
     }
     else {
         if (path_x->send_mtu_max_tried > 1500) {
@@ -2077,7 +2185,7 @@ int picoquic_prepare_packet_client_init(picoquic_cnx_t* cnx, picoquic_path_t * p
                 bytes_next = bytes + length;
                 bytes_max = bytes + send_buffer_max - checksum_overhead;
 
-                if ((tls_ready == 0 || path_x->cwin <= path_x->bytes_in_transit || cnx->quic->cwin_max <= path_x->bytes_in_transit)
+                if ((tls_ready == 0 || path_x->cwin <= path_x->bytes_in_transit || cnx->cwin_max <= path_x->bytes_in_transit)
                     && (cnx->cnx_state == picoquic_state_client_almost_ready
                         || picoquic_is_ack_needed(cnx, current_time, next_wake_time, pc, 0) == 0)
                     && picoquic_find_first_misc_frame(cnx, pc) == NULL && !force_handshake_padding) {
@@ -2099,7 +2207,7 @@ int picoquic_prepare_packet_client_init(picoquic_cnx_t* cnx, picoquic_path_t * p
                         &more_data, &is_pure_ack, pc);
                     length = bytes_next - bytes;
 
-                    if (ret == 0 && path_x->cwin > path_x->bytes_in_transit && cnx->quic->cwin_max > path_x->bytes_in_transit) {
+                    if (ret == 0 && path_x->cwin > path_x->bytes_in_transit && cnx->cwin_max > path_x->bytes_in_transit) {
                         /* Encode the crypto handshake frame */
                         if (tls_ready != 0) {
                             /* Encode the crypto frame */
@@ -2269,7 +2377,7 @@ int picoquic_prepare_packet_server_init(picoquic_cnx_t* cnx, picoquic_path_t * p
         bytes_next = bytes + length;
 
         if (((tls_ready || picoquic_find_first_misc_frame(cnx, pc) != NULL)
-            && path_x->cwin > path_x->bytes_in_transit && cnx->quic->cwin_max > path_x->bytes_in_transit) 
+            && path_x->cwin > path_x->bytes_in_transit && cnx->cwin_max > path_x->bytes_in_transit) 
             || cnx->ack_ctx[pc].act[0].ack_needed) {
             bytes_next = picoquic_format_ack_frame(cnx, bytes_next, bytes_max, &more_data, current_time, pc, 0);
             /* Encode misc frames if present */
@@ -3188,7 +3296,7 @@ int picoquic_prepare_packet_almost_ready(picoquic_cnx_t* cnx, picoquic_path_t* p
                         } /* end of PMTU not required */
 
                         if (ret == 0 && length <= header_length
-                            && path_x->cwin > path_x->bytes_in_transit && cnx->quic->cwin_max > path_x->bytes_in_transit
+                            && path_x->cwin > path_x->bytes_in_transit && cnx->cwin_max > path_x->bytes_in_transit
                             && pmtu_discovery_needed != picoquic_pmtu_discovery_not_needed) {
                             if (send_buffer_max > path_x->send_mtu) {
                                 /* Since there is no data to send, this is an opportunity to send an MTU probe */
@@ -3421,9 +3529,14 @@ int picoquic_prepare_packet_ready(picoquic_cnx_t* cnx, picoquic_path_t* path_x,
 
                 /* If necessary, encode the max data frame */
                 if (ret == 0){
-                    if (cnx->quic->max_data_limit != 0) {
-                        if (cnx->data_received + ((3 * cnx->quic->max_data_limit) / 4) > cnx->maxdata_local) {
-                            uint64_t max_data_increase = cnx->data_received + cnx->quic->max_data_limit - cnx->maxdata_local;
+                    /* Under memory pressure, the credit is limited to the memory cap of the connection */
+                    uint64_t max_data_limit = cnx->quic->max_data_limit;
+                    if (cnx->memory_cap != 0 && (max_data_limit == 0 || cnx->memory_cap < max_data_limit)) {
+                        max_data_limit = cnx->memory_cap;
+                    }
+                    if (max_data_limit != 0) {
+                        if (cnx->data_received + ((3 * max_data_limit) / 4) > cnx->maxdata_local) {
+                            uint64_t max_data_increase = cnx->data_received + max_data_limit - cnx->maxdata_local;
                             bytes_next = picoquic_format_max_data_frame(cnx, bytes_next, bytes_max, &more_data, &is_pure_ack,
                                 max_data_increase);
                         }
@@ -3454,7 +3567,7 @@ int picoquic_prepare_packet_ready(picoquic_cnx_t* cnx, picoquic_path_t* path_x,
                 /* Compute the length before entering the CC block */
                 length = bytes_next - bytes;
 
-                if ((path_x->cwin < path_x->bytes_in_transit || cnx->quic->cwin_max < path_x->bytes_in_transit)
+                if ((path_x->cwin < path_x->bytes_in_transit || cnx->cwin_max < path_x->bytes_in_transit)
                     && !path_x->is_pto_required) {
                     /* Implementation of experimental API, picoquic_set_priority_limit_for_bypass */
                     uint8_t* bytes_next_before_bypass = bytes_next;
@@ -3587,7 +3700,7 @@ int picoquic_prepare_packet_ready(picoquic_cnx_t* cnx, picoquic_path_t* path_x,
                     if (ret == 0 && length <= header_length) {
                         if (send_buffer_max > path_x->send_mtu
                             && path_x->cwin > path_x->bytes_in_transit 
-                            && cnx->quic->cwin_max > path_x->bytes_in_transit
+                            && cnx->cwin_max > path_x->bytes_in_transit
                             && pmtu_discovery_needed != picoquic_pmtu_discovery_not_needed) {
                             /* Since there is no data to send, this is an opportunity to send an MTU probe */
                             length = picoquic_prepare_mtu_probe(cnx, path_x, header_length, checksum_overhead, bytes, send_buffer_max);
@@ -3981,21 +4094,58 @@ void picoquic_handle_send_train_statistics(picoquic_cnx_t* cnx, picoquic_path_t*
     }
 }
 
+/* A hibernating connection is only woken up if there is something to send.
+ * Prepares that are only caused by timers, such as the idle timeout check,
+ * leave it hibernating. */
+static int picoquic_is_wake_needed(picoquic_cnx_t* cnx, uint64_t current_time, uint64_t* next_wake_time)
+{
+    int is_needed = (cnx->cnx_state != picoquic_state_ready || cnx->first_misc_frame != NULL ||
+        cnx->first_datagram != NULL || cnx->is_datagram_ready || cnx->max_stream_data_needed ||
+        cnx->alt_path_challenge_needed);
+
+    for (int i = 0; !is_needed && i < cnx->nb_paths; i++) {
+        is_needed = (cnx->path[i]->first_tuple->challenge_required && !cnx->path[i]->first_tuple->challenge_verified);
+    }
+    for (int pc = 0; !is_needed && pc < picoquic_nb_packet_context; pc++) {
+        is_needed = picoquic_is_ack_needed(cnx, current_time, next_wake_time, pc, 0);
+    }
+    if (!is_needed && cnx->keep_alive_interval != 0) {
+        if (cnx->latest_progress_time + cnx->keep_alive_interval <= current_time) {
+            is_needed = 1;
+        }
+        else if (cnx->latest_progress_time + cnx->keep_alive_interval < *next_wake_time) {
+            *next_wake_time = cnx->latest_progress_time + cnx->keep_alive_interval;
+        }
+    }
+    if (!is_needed) {
+        is_needed = (picoquic_find_ready_stream(cnx) != NULL);
+    }
+    return is_needed;
+}
+
 /* Prepare next packet to send, or nothing.. */
 int picoquic_prepare_packet_ex(picoquic_cnx_t* cnx,
     uint64_t current_time, uint8_t* send_buffer, size_t send_buffer_max, size_t* send_length,
     struct sockaddr_storage * p_addr_to, struct sockaddr_storage * p_addr_from, int* if_index, size_t* send_msg_size)
 {
     uint64_t next_wake_time;
-    int ret = picoquic_handle_send_timers(cnx, current_time, &next_wake_time);
+    int ret;
+
+    picoquic_check_memory_pressure(cnx->quic, current_time);
+    ret = picoquic_handle_send_timers(cnx, current_time, &next_wake_time);
     *send_length = 0;
+    cnx->departure_time = 0;
 
     if (send_buffer_max < PICOQUIC_ENFORCED_INITIAL_MTU) {
         DBG_PRINTF("Invalid buffer size: %zu", send_buffer_max);
         ret = -1;
     }
 
-    if (ret == 0) {
+    if (ret == 0 && cnx->is_hibernating && picoquic_is_wake_needed(cnx, current_time, &next_wake_time)) {
+        picoquic_wake_cnx(cnx, current_time);
+    }
+
+    if (ret == 0 && !cnx->is_hibernating) {
         picoquic_path_t* path_x = NULL;
         picoquic_tuple_t* tuple = NULL;
         uint64_t initial_next_time;
@@ -4175,6 +4325,10 @@ int picoquic_prepare_packet_ex(picoquic_cnx_t* cnx,
         ret = picoquic_program_app_wake_time(cnx, &next_wake_time);
     }
 
+    if (ret == 0 && *send_length == 0) {
+        picoquic_hibernate_cnx_if_idle(cnx, current_time, &next_wake_time);
+    }
+
     picoquic_reinsert_by_wake_time(cnx->quic, cnx, next_wake_time);
 
     return ret;
@@ -4246,6 +4400,9 @@ int picoquic_prepare_next_packet_ex(picoquic_quic_t* quic,
         *p_last_cnx = NULL;
     }
 
+    /* Return idle pool chunks to the system, at most one per trim interval */
+    picoquic_trim_memory_pools(quic, current_time);
+
     if (sp != NULL) {
         if (sp->length > send_buffer_max) {
             *send_length = 0;
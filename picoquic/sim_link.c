@@ -407,7 +407,7 @@ int sim_link_one_test(uint64_t* loss_mask, uint64_t queue_delay_max, uint64_t nb
                     ret = -1;
                 }
                 else {
-                    packet->length = sizeof(packet->bytes);
+                    packet->length = PICOQUIC_MAX_PACKET_SIZE;
                     picoquictest_sim_link_submit(link, packet, departure_time);
                     departure_time += 250;
                     queued++;
@@ -28,7 +28,6 @@
  * loop will terminate if the callback return code is not zero -- except for special processing
  * of the migration testing code.
  * TODO: in Windows, use WSA asynchronous calls instead of sendmsg, allowing for multiple parallel sends.
- * TODO: in Linux, use multiple send per call API
  * TDOO: trim the #define list.
  * TODO: support the QuicDoq scenario, manage extra socket.
  */
@@ -59,6 +58,9 @@
 
 #else /* Linux */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* recvmmsg, struct mmsghdr */
+#endif
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -78,6 +80,9 @@
 #include <netdb.h>
 #include <netinet/in.h>
 #include <sys/select.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
 
 #ifndef __APPLE__
 #ifdef __LINUX__
@@ -108,6 +113,7 @@
 #include "picoquic_internal.h"
 #include "picoquic_packet_loop.h"
 #include "picoquic_unified_log.h"
+#include "sockloop_uring.h"
 
 #if defined(_WINDOWS)
 #ifdef UDP_SEND_MSG_SIZE
@@ -123,6 +129,24 @@ static int udp_gso_available = 0;
 #endif
 #endif
 
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+#define PICOQUIC_PACKET_LOOP_USE_RECVMMSG
+#define PICOQUIC_PACKET_LOOP_USE_SENDMMSG
+#endif
+
+#if defined(PICOQUIC_PACKET_LOOP_USE_IO_URING) && !defined(PICOQUIC_PACKET_LOOP_USE_SENDMMSG)
+/* The io_uring backend reuses the batched send formatting */
+#undef PICOQUIC_PACKET_LOOP_USE_IO_URING
+#endif
+
+#ifndef _WINDOWS
+#if defined(UDP_GRO)
+static int udp_gro_available = 1;
+#else
+static int udp_gro_available = 0;
+#endif
+#endif
+
 #ifdef _WINDOWS
 /* Test support for UDP coalescing */
 void picoquic_sockloop_win_coalescing_test(int * recv_coalesced, int * send_coalesced)
@@ -261,7 +285,8 @@ int picoquic_packet_set_windows_socket(int send_coalesced, int recv_coalesced, p
             s_ctx->recv_buffer_size = 0x10000;
         }
         else {
-            s_ctx->recv_buffer_size = PICOQUIC_MAX_PACKET_SIZE;
+            /* The QUIC context is not known here, use the largest size */
+            s_ctx->recv_buffer_size = PICOQUIC_MAX_PACKET_SIZE_LIMIT;
         }
         s_ctx->recv_buffer = (uint8_t*)malloc(s_ctx->recv_buffer_size);
         if (s_ctx->recv_buffer == NULL) {
@@ -342,8 +367,8 @@ void picoquic_packet_loop_close_socket(picoquic_socket_ctx_t* s_ctx)
 #endif
 }
 
-int picoquic_packet_loop_open_socket(int socket_buffer_size, int do_not_use_gso,
-    picoquic_socket_ctx_t* s_ctx)
+static int picoquic_packet_loop_open_socket_ex(int socket_buffer_size, int do_not_use_gso,
+    int reuse_port, picoquic_socket_ctx_t* s_ctx)
 {
     int ret = 0;
     struct sockaddr_storage local_address;
@@ -371,6 +396,7 @@ int picoquic_packet_loop_open_socket(int socket_buffer_size, int do_not_use_gso,
         /* TODO: set option IPv6 only */
         picoquic_socket_set_ecn_options(s_ctx->fd, s_ctx->af, &recv_set, &send_set) != 0 ||
         picoquic_socket_set_pkt_info(s_ctx->fd, s_ctx->af) != 0 ||
+        (reuse_port && picoquic_socket_set_reuse_port(s_ctx->fd) != 0) ||
         picoquic_bind_to_port(s_ctx->fd,s_ctx->af, s_ctx->port) != 0 ||
         picoquic_get_local_address(s_ctx->fd, &local_address) != 0 ||
         picoquic_socket_set_pmtud_options(s_ctx->fd, s_ctx->af) != 0)
@@ -421,14 +447,25 @@ int picoquic_packet_loop_open_socket(int socket_buffer_size, int do_not_use_gso,
         if (ret == 0) {
             ret = picoquic_packet_set_windows_socket(send_coalesced, recv_coalesced, s_ctx);
         }
+#else
+        if (ret == 0 && udp_gro_available && !do_not_use_gso) {
+            /* Failure to set GRO is not fatal, the socket will receive one packet per call */
+            s_ctx->supports_udp_recv_coalesced = (picoquic_socket_set_udp_gro(s_ctx->fd) == 0);
+        }
 #endif
     }
 
     return ret;
 }
 
-int picoquic_packet_loop_open_sockets(uint16_t local_port, int local_af, int socket_buffer_size, int extra_socket_required,
-    int do_not_use_gso, picoquic_socket_ctx_t* s_ctx)
+int picoquic_packet_loop_open_socket(int socket_buffer_size, int do_not_use_gso,
+    picoquic_socket_ctx_t* s_ctx)
+{
+    return picoquic_packet_loop_open_socket_ex(socket_buffer_size, do_not_use_gso, 0, s_ctx);
+}
+
+static int picoquic_packet_loop_open_sockets_reuse(uint16_t local_port, int local_af, int socket_buffer_size, int extra_socket_required,
+    int do_not_use_gso, int reuse_port, picoquic_socket_ctx_t* s_ctx)
 {
     /* Compute how many sockets are necessary, and set the intial value of AF and port per socket */
     int nb_sockets = 0;
@@ -451,7 +488,10 @@ int picoquic_packet_loop_open_sockets(uint16_t local_port, int local_af, int soc
             s_ctx[nb_sockets].af = af[i_af];
             s_ctx[nb_sockets].port = current_port;
             s_ctx[nb_sockets].n_port = htons(current_port);
-            if ((sock_ret = picoquic_packet_loop_open_socket(socket_buffer_size, do_not_use_gso, &s_ctx[nb_sockets])) == 0) {
+            /* Only the sockets bound to the shared local port are opened with SO_REUSEPORT.
+             * The extra sockets use ephemeral ports, specific to each loop. */
+            if ((sock_ret = picoquic_packet_loop_open_socket_ex(socket_buffer_size, do_not_use_gso,
+                reuse_port && iteration == 0, &s_ctx[nb_sockets])) == 0) {
                 if (current_port == 0) {
                     current_port = s_ctx[nb_sockets].port;
                     s_ctx[nb_sockets].n_port = htons(current_port);
@@ -471,6 +511,49 @@ int picoquic_packet_loop_open_sockets(uint16_t local_port, int local_af, int soc
     return nb_sockets;
 }
 
+int picoquic_packet_loop_open_sockets(uint16_t local_port, int local_af, int socket_buffer_size, int extra_socket_required,
+    int do_not_use_gso, picoquic_socket_ctx_t* s_ctx)
+{
+    return picoquic_packet_loop_open_sockets_reuse(local_port, local_af, socket_buffer_size, extra_socket_required,
+        do_not_use_gso, 0, s_ctx);
+}
+
+/* Open the sockets specified in the loop parameters. If `reuse_port` is set,
+ * the sockets bound to the local port are opened with SO_REUSEPORT, so that
+ * several loops can share the same port. If `cid_steering_nb_workers` is
+ * also set, a cBPF program is attached to these sockets so that the kernel
+ * selects the socket based on the destination CID. Failure to attach the
+ * program is not fatal, the packets will then be selected by hash.
+ */
+int picoquic_packet_loop_open_sockets_ex(picoquic_packet_loop_param_t* param, picoquic_socket_ctx_t* s_ctx)
+{
+    int nb_sockets = picoquic_packet_loop_open_sockets_reuse(param->local_port, param->local_af, param->socket_buffer_size,
+        param->extra_socket_required, param->do_not_use_gso, param->reuse_port, s_ctx);
+
+    if (param->reuse_port && param->cid_steering_nb_workers > 0) {
+        for (int i = 0; i < nb_sockets; i++) {
+            if (s_ctx[i].port == param->local_port &&
+                picoquic_socket_attach_cid_steering(s_ctx[i].fd, (size_t)param->cid_steering_offset,
+                    param->cid_steering_nb_workers) != 0) {
+                DBG_PRINTF("Cannot attach the CID steering program (af=%d, port = %d)\n", s_ctx[i].af, s_ctx[i].port);
+            }
+        }
+    }
+    if (param->pacing_offload_horizon > 0) {
+        for (int i = 0; i < nb_sockets; i++) {
+            s_ctx[i].supports_txtime = (picoquic_socket_set_txtime(s_ctx[i].fd) == 0);
+        }
+    }
+    if (param->socket_busy_poll > 0) {
+        /* Failure is not fatal: raising the value above the system default
+         * requires privileges, the loop still spins in user space. */
+        for (int i = 0; i < nb_sockets; i++) {
+            (void)picoquic_socket_set_busy_poll(s_ctx[i].fd, param->socket_busy_poll);
+        }
+    }
+    return nb_sockets;
+}
+
 /*
 * Windows: use asynchronous receive. Asynchronous receive requires
 * declaring an overlap context and event per socket, as well as a
@@ -573,35 +656,27 @@ int picoquic_packet_loop_wait(picoquic_socket_ctx_t* s_ctx,
     return bytes_recv;
 }
 #else 
-int picoquic_packet_loop_select(picoquic_socket_ctx_t* s_ctx,
+/* Wait until one of the sockets or the wake up pipe is readable, or until the
+ * timer expires. Returns the value of select(), and sets the wake up flag if
+ * data was written on the wake up pipe. */
+static int picoquic_packet_loop_select_fds(picoquic_socket_ctx_t* s_ctx,
     int nb_sockets,
-    struct sockaddr_storage* addr_from,
-    struct sockaddr_storage* addr_dest,
-    int* dest_if,
-    unsigned char * received_ecn,
-    uint8_t* buffer, int buffer_max,
+    fd_set* readfds,
     int64_t delta_t,
-    int * is_wake_up_event,
-    picoquic_network_thread_ctx_t * thread_ctx,
-    int * socket_rank)
+    int* is_wake_up_event,
+    picoquic_network_thread_ctx_t* thread_ctx)
 {
-    fd_set readfds;
     struct timeval tv;
     int ret_select = 0;
-    int bytes_recv = 0;
     int sockmax = 0;
 
-    if (received_ecn != NULL) {
-        *received_ecn = 0;
-    }
-
-    FD_ZERO(&readfds);
+    FD_ZERO(readfds);
 
     for (int i = 0; i < nb_sockets; i++) {
         if (sockmax < (int)s_ctx[i].fd) {
             sockmax = (int)s_ctx[i].fd;
         }
-        FD_SET(s_ctx[i].fd, &readfds);
+        FD_SET(s_ctx[i].fd, readfds);
     }
 
     *is_wake_up_event = 0;
@@ -609,7 +684,7 @@ int picoquic_packet_loop_select(picoquic_socket_ctx_t* s_ctx,
         if (sockmax < (int)thread_ctx->wake_up_pipe_fd[0]) {
             sockmax = (int)thread_ctx->wake_up_pipe_fd[0];
         }
-        FD_SET(thread_ctx->wake_up_pipe_fd[0], &readfds);
+        FD_SET(thread_ctx->wake_up_pipe_fd[0], readfds);
     }
 
     if (delta_t <= 0) {
@@ -625,51 +700,244 @@ int picoquic_packet_loop_select(picoquic_socket_ctx_t* s_ctx,
         }
     }
 
-    ret_select = select(sockmax + 1, &readfds, NULL, NULL, &tv);
+    ret_select = select(sockmax + 1, readfds, NULL, NULL, &tv);
 
     if (ret_select < 0) {
-        bytes_recv = -1;
         DBG_PRINTF("Error: select returns %d\n", ret_select);
     } else if (ret_select > 0) {
-        /* Check if the 'wake up' pipe is full. If it is, read the data on it,
-         * set the is_wake_up_event flag, and ignore the other file descriptors. */
-        if (thread_ctx->wake_up_defined && FD_ISSET(thread_ctx->wake_up_pipe_fd[0], &readfds)) {
+        /* Check if the 'wake up' pipe or eventfd is readable. If it is, read the
+         * data on it, set the is_wake_up_event flag, and ignore the other file
+         * descriptors. A single read resets the eventfd counter, however many
+         * wake up calls were made. */
+        if (thread_ctx->wake_up_defined && FD_ISSET(thread_ctx->wake_up_pipe_fd[0], readfds)) {
             /* Something was written on the "wakeup" pipe. Read it. */
             uint8_t eventbuf[8];
             int pipe_recv;
             if ((pipe_recv = read(thread_ctx->wake_up_pipe_fd[0], eventbuf, sizeof(eventbuf))) <= 0) {
-                bytes_recv = -1;
+                ret_select = -1;
                 DBG_PRINTF("Error: read pipe returns %d\n", (pipe_recv == 0)?EPIPE:errno);
             }
             else {
                 *is_wake_up_event = 1;
             }
         }
-        else
-        {
-            for (int i = 0; i < nb_sockets; i++) {
-                if (FD_ISSET(s_ctx[i].fd, &readfds)) {
-                    *socket_rank = i;
-                    bytes_recv = picoquic_recvmsg(s_ctx[i].fd, addr_from,
-                        addr_dest, dest_if, received_ecn,
-                        buffer, buffer_max);
-
-                    if (bytes_recv <= 0) {
-                        DBG_PRINTF("Could not receive packet on UDP socket[%d]= %d!\n",
-                            i, (int)s_ctx[i].fd);
-                        break;
-                    }
-                    else {
-                        /* Document incoming port */
-                        if (addr_dest->ss_family == AF_INET6) {
-                            ((struct sockaddr_in6*)addr_dest)->sin6_port = s_ctx[i].n_port;
-                        }
-                        else if (addr_dest->ss_family == AF_INET) {
-                            ((struct sockaddr_in*)addr_dest)->sin_port = s_ctx[i].n_port;
-                        }
-                        break;
+    }
+
+    return ret_select;
+}
+
+/* Document the incoming port in the destination address, since the
+ * packet info only provides the IP address. */
+static void picoquic_packet_loop_set_dest_port(struct sockaddr_storage* addr_dest, uint16_t n_port)
+{
+    if (addr_dest->ss_family == AF_INET6) {
+        ((struct sockaddr_in6*)addr_dest)->sin6_port = n_port;
+    }
+    else if (addr_dest->ss_family == AF_INET) {
+        ((struct sockaddr_in*)addr_dest)->sin_port = n_port;
+    }
+}
+
+int picoquic_packet_loop_select(picoquic_socket_ctx_t* s_ctx,
+    int nb_sockets,
+    struct sockaddr_storage* addr_from,
+    struct sockaddr_storage* addr_dest,
+    int* dest_if,
+    unsigned char * received_ecn,
+    uint8_t* buffer, int buffer_max,
+    int64_t delta_t,
+    int * is_wake_up_event,
+    picoquic_network_thread_ctx_t * thread_ctx,
+    int * socket_rank,
+    size_t * udp_coalesced_size)
+{
+    fd_set readfds;
+    int ret_select = 0;
+    int bytes_recv = 0;
+
+    if (received_ecn != NULL) {
+        *received_ecn = 0;
+    }
+    *udp_coalesced_size = 0;
+
+    ret_select = picoquic_packet_loop_select_fds(s_ctx, nb_sockets, &readfds, delta_t,
+        is_wake_up_event, thread_ctx);
+
+    if (ret_select < 0) {
+        bytes_recv = -1;
+    } else if (ret_select > 0 && !*is_wake_up_event) {
+        for (int i = 0; i < nb_sockets; i++) {
+            if (FD_ISSET(s_ctx[i].fd, &readfds)) {
+                *socket_rank = i;
+                bytes_recv = picoquic_recvmsg_ex(s_ctx[i].fd, addr_from,
+                    addr_dest, dest_if, received_ecn,
+                    buffer, buffer_max, udp_coalesced_size);
+
+                if (bytes_recv <= 0) {
+                    DBG_PRINTF("Could not receive packet on UDP socket[%d]= %d!\n",
+                        i, (int)s_ctx[i].fd);
+                    break;
+                }
+                else {
+                    picoquic_packet_loop_set_dest_port(addr_dest, s_ctx[i].n_port);
+                    break;
+                }
+            }
+        }
+    }
+
+    return bytes_recv;
+}
+
+#ifdef PICOQUIC_PACKET_LOOP_USE_RECVMMSG
+/* Batched receive. When the application sets the parameter `recv_batch_size`,
+ * the loop uses recvmmsg to pull up to that many datagrams from a socket in a
+ * single system call. Each message has its own buffer, source address and
+ * control data, so that ECN marks, destination address and interface index
+ * are preserved per packet.
+ */
+typedef struct st_picoquic_recv_batch_msg_t {
+    struct sockaddr_storage addr_from;
+    struct sockaddr_storage addr_dest;
+    int dest_if;
+    unsigned char received_ecn;
+    size_t udp_coalesced_size;
+    size_t length;
+    struct iovec iov;
+    char cmsg_buffer[256];
+} picoquic_recv_batch_msg_t;
+
+typedef struct st_picoquic_recv_batch_t {
+    int nb_msg_max;
+    int nb_msg;
+    size_t buffer_size;
+    struct mmsghdr* mmsg;
+    picoquic_recv_batch_msg_t* msg;
+    uint8_t* buffers;
+} picoquic_recv_batch_t;
+
+static void picoquic_recv_batch_delete(picoquic_recv_batch_t* batch)
+{
+    if (batch->mmsg != NULL) {
+        free(batch->mmsg);
+    }
+    if (batch->msg != NULL) {
+        free(batch->msg);
+    }
+    if (batch->buffers != NULL) {
+        free(batch->buffers);
+    }
+    free(batch);
+}
+
+static picoquic_recv_batch_t* picoquic_recv_batch_create(int nb_msg_max, size_t buffer_size)
+{
+    picoquic_recv_batch_t* batch = (picoquic_recv_batch_t*)malloc(sizeof(picoquic_recv_batch_t));
+
+    if (batch != NULL) {
+        memset(batch, 0, sizeof(picoquic_recv_batch_t));
+        if (nb_msg_max > PICOQUIC_PACKET_LOOP_RECV_BATCH_MAX) {
+            nb_msg_max = PICOQUIC_PACKET_LOOP_RECV_BATCH_MAX;
+        }
+        batch->nb_msg_max = nb_msg_max;
+        batch->buffer_size = buffer_size;
+        batch->mmsg = (struct mmsghdr*)malloc(nb_msg_max * sizeof(struct mmsghdr));
+        batch->msg = (picoquic_recv_batch_msg_t*)malloc(nb_msg_max * sizeof(picoquic_recv_batch_msg_t));
+        batch->buffers = (uint8_t*)malloc(nb_msg_max * buffer_size);
+        if (batch->mmsg == NULL || batch->msg == NULL || batch->buffers == NULL) {
+            picoquic_recv_batch_delete(batch);
+            batch = NULL;
+        }
+        else {
+            memset(batch->mmsg, 0, nb_msg_max * sizeof(struct mmsghdr));
+            memset(batch->msg, 0, nb_msg_max * sizeof(picoquic_recv_batch_msg_t));
+            for (int i = 0; i < nb_msg_max; i++) {
+                batch->msg[i].iov.iov_base = batch->buffers + i * buffer_size;
+                batch->msg[i].iov.iov_len = buffer_size;
+            }
+        }
+    }
+    return batch;
+}
+
+static int picoquic_recv_batch_receive(SOCKET_TYPE fd, uint16_t n_port, picoquic_recv_batch_t* batch)
+{
+    int nb_recv;
+
+    for (int i = 0; i < batch->nb_msg_max; i++) {
+        struct msghdr* hdr = &batch->mmsg[i].msg_hdr;
+
+        hdr->msg_name = (struct sockaddr*)&batch->msg[i].addr_from;
+        hdr->msg_namelen = sizeof(struct sockaddr_storage);
+        hdr->msg_iov = &batch->msg[i].iov;
+        hdr->msg_iovlen = 1;
+        hdr->msg_control = (void*)batch->msg[i].cmsg_buffer;
+        hdr->msg_controllen = sizeof(batch->msg[i].cmsg_buffer);
+        hdr->msg_flags = 0;
+        batch->mmsg[i].msg_len = 0;
+    }
+
+    /* The socket is ready, so the first message is available. MSG_WAITFORONE
+     * makes the call return as soon as the socket queue is empty. */
+    nb_recv = recvmmsg(fd, batch->mmsg, (unsigned int)batch->nb_msg_max, MSG_WAITFORONE, NULL);
+
+    if (nb_recv > 0) {
+        batch->nb_msg = nb_recv;
+        for (int i = 0; i < nb_recv; i++) {
+            picoquic_recv_batch_msg_t* msg = &batch->msg[i];
+            msg->length = batch->mmsg[i].msg_len;
+            msg->addr_dest.ss_family = AF_UNSPEC;
+            msg->dest_if = 0;
+            msg->received_ecn = 0;
+            msg->udp_coalesced_size = 0;
+            picoquic_socks_cmsg_parse(&batch->mmsg[i].msg_hdr, &msg->addr_dest, &msg->dest_if,
+                &msg->received_ecn, &msg->udp_coalesced_size);
+            picoquic_packet_loop_set_dest_port(&msg->addr_dest, n_port);
+        }
+    }
+    else {
+        batch->nb_msg = 0;
+    }
+    return nb_recv;
+}
+
+/* Same logic as picoquic_packet_loop_select, but filling a batch of messages.
+ * Returns the total number of bytes received, 0 on timeout or wake up, -1 on error.
+ */
+static int picoquic_packet_loop_select_batch(picoquic_socket_ctx_t* s_ctx,
+    int nb_sockets,
+    picoquic_recv_batch_t* batch,
+    int64_t delta_t,
+    int* is_wake_up_event,
+    picoquic_network_thread_ctx_t* thread_ctx,
+    int* socket_rank)
+{
+    fd_set readfds;
+    int ret_select = 0;
+    int bytes_recv = 0;
+
+    batch->nb_msg = 0;
+    ret_select = picoquic_packet_loop_select_fds(s_ctx, nb_sockets, &readfds, delta_t,
+        is_wake_up_event, thread_ctx);
+
+    if (ret_select < 0) {
+        bytes_recv = -1;
+    }
+    else if (ret_select > 0 && !*is_wake_up_event) {
+        for (int i = 0; i < nb_sockets; i++) {
+            if (FD_ISSET(s_ctx[i].fd, &readfds)) {
+                *socket_rank = i;
+                if (picoquic_recv_batch_receive(s_ctx[i].fd, s_ctx[i].n_port, batch) <= 0) {
+                    DBG_PRINTF("Could not receive packets on UDP socket[%d]= %d!\n",
+                        i, (int)s_ctx[i].fd);
+                    bytes_recv = -1;
+                }
+                else {
+                    for (int j = 0; j < batch->nb_msg; j++) {
+                        bytes_recv += (int)batch->msg[j].length;
                     }
                 }
+                break;
             }
         }
     }
@@ -677,6 +945,43 @@ int picoquic_packet_loop_select(picoquic_socket_ctx_t* s_ctx,
     return bytes_recv;
 }
 #endif
+#endif
+
+/* Submit a received buffer to the stack. If the socket delivered several
+ * coalesced packets (URO on Windows, GRO on Linux), the buffer is split
+ * in segments of the size indicated by the socket, the last segment
+ * being possibly shorter. If the loop parameters specify a steering
+ * function, each packet is first submitted to that function, and only
+ * passed to the stack if the function did not consume it.
+ */
+static int picoquic_packet_loop_incoming_coalesced(picoquic_quic_t* quic,
+    picoquic_packet_loop_param_t* param, uint8_t* bytes, size_t length, size_t udp_coalesced_size,
+    struct sockaddr* addr_from, struct sockaddr* addr_to, int if_index_to,
+    unsigned char received_ecn, picoquic_cnx_t** last_cnx, uint64_t current_time,
+    size_t* nb_packets_received)
+{
+    int ret = 0;
+    size_t recv_bytes = 0;
+
+    while (recv_bytes < length && ret == 0) {
+        size_t recv_length = length - recv_bytes;
+
+        if (udp_coalesced_size > 0 && recv_length > udp_coalesced_size) {
+            recv_length = udp_coalesced_size;
+        }
+        if (param->incoming_steer_fn == NULL ||
+            param->incoming_steer_fn(param->incoming_steer_ctx, bytes + recv_bytes, recv_length,
+                addr_from, addr_to, if_index_to, received_ecn) == 0) {
+            ret = picoquic_incoming_packet_ex(quic, bytes + recv_bytes,
+                recv_length, addr_from, addr_to, if_index_to,
+                received_ecn, last_cnx, current_time);
+        }
+        recv_bytes += recv_length;
+        *nb_packets_received += 1;
+    }
+
+    return ret;
+}
 
 static int monitor_system_call_duration(packet_loop_system_call_duration_t* sc_duration, uint64_t current_time, uint64_t previous_time)
 {
@@ -707,6 +1012,500 @@ static int monitor_system_call_duration(packet_loop_system_call_duration_t* sc_d
 }
 
 
+/* Find the socket to use for sending a packet. We have multiple sockets, with
+ * support for either IPv6, or IPv4, or both, and binding to a port number.
+ * Find the first socket where:
+ * - the destination AF is supported.
+ * - either the source port is not specified, or it matches the local port.
+ * If no such socket exists, try opening a new one.
+ */
+static SOCKET_TYPE picoquic_packet_loop_find_send_socket(picoquic_packet_loop_param_t* param,
+    picoquic_socket_ctx_t* s_ctx, int* nb_sockets_available, int* nb_sockets,
+    struct sockaddr_storage* peer_addr, struct sockaddr_storage* local_addr, int* supports_txtime)
+{
+    SOCKET_TYPE send_socket = INVALID_SOCKET;
+    uint16_t send_port = (peer_addr->ss_family == AF_INET) ?
+        ((struct sockaddr_in*)local_addr)->sin_port :
+        ((struct sockaddr_in6*)local_addr)->sin6_port;
+
+    *supports_txtime = 0;
+
+    /* TODO: verify htons/ntohs */
+    for (int i = 0; i < *nb_sockets_available; i++) {
+        if (s_ctx[i].af == peer_addr->ss_family) {
+            send_socket = s_ctx[i].fd;
+            *supports_txtime = s_ctx[i].supports_txtime;
+            if (send_port == 0 && !param->prefer_extra_socket) {
+                break;
+            }
+            if (s_ctx[i].n_port == send_port) {
+                break;
+            }
+        }
+    }
+
+    if (send_socket == INVALID_SOCKET) {
+        if (*nb_sockets_available < PICOQUIC_PACKET_LOOP_SOCKETS_MAX) {
+            picoquic_socket_ctx_t* new_ctx = &s_ctx[*nb_sockets_available];
+            memset(new_ctx, 0, sizeof(*new_ctx));
+            new_ctx->af = peer_addr->ss_family;
+            if (peer_addr->ss_family == AF_INET6) {
+                new_ctx->port = ntohs(((struct sockaddr_in6*)peer_addr)->sin6_port);
+            }
+            else {
+                new_ctx->port = ntohs(((struct sockaddr_in*)peer_addr)->sin_port);
+            }
+            new_ctx->n_port = htons(new_ctx->port);
+            if (picoquic_packet_loop_open_socket(param->socket_buffer_size, param->do_not_use_gso, new_ctx) == 0) {
+                if (param->pacing_offload_horizon > 0) {
+                    new_ctx->supports_txtime = (picoquic_socket_set_txtime(new_ctx->fd) == 0);
+                }
+                send_socket = new_ctx->fd;
+                *supports_txtime = new_ctx->supports_txtime;
+                *nb_sockets_available += 1;
+                if (*nb_sockets < *nb_sockets_available) {
+                    *nb_sockets = *nb_sockets_available;
+                }
+            }
+        }
+    }
+
+    return send_socket;
+}
+
+/* Handle a failure to send a packet: log the error, notify the connection
+ * if the destination is unreachable, and if the error indicates that the
+ * interface does not support GSO, resend the packet one segment at a time
+ * and disable GSO for the remainder of the loop.
+ */
+static void picoquic_packet_loop_send_error(picoquic_quic_t* quic, picoquic_cnx_t* cnx,
+    picoquic_connection_id_t* log_cid, SOCKET_TYPE send_socket,
+    struct sockaddr_storage* peer_addr, struct sockaddr_storage* local_addr, int if_index,
+    const uint8_t* send_buffer, size_t send_length, size_t send_msg_size,
+    int sock_ret, int sock_err, uint64_t current_time, size_t** send_msg_ptr)
+{
+    /* TODO: add a test in which the socket fails. */
+    if (cnx == NULL) {
+        picoquic_log_context_free_app_message(quic, log_cid, "Could not send message to AF_to=%d, AF_from=%d, if=%d, ret=%d, err=%d",
+            peer_addr->ss_family, local_addr->ss_family, if_index, sock_ret, sock_err);
+    }
+    else {
+        picoquic_log_app_message(cnx, "Could not send message to AF_to=%d, AF_from=%d, if=%d, ret=%d, err=%d",
+            peer_addr->ss_family, local_addr->ss_family, if_index, sock_ret, sock_err);
+
+        if (picoquic_socket_error_implies_unreachable(sock_err)) {
+            picoquic_notify_destination_unreachable(cnx, current_time,
+                (struct sockaddr*)peer_addr, (struct sockaddr*)local_addr, if_index,
+                sock_err);
+        }
+        else if (sock_err == EIO) {
+            /* TODO: this is an error encountered if the system supports GSO, but
+             * the specific interface driver does not. Main example is Mininet.
+             * Not sure that we can treat that correctly. Try to minimize the
+             * amount of untested code? Rely on config flag? Rely on error
+             * recovery? */
+            size_t packet_index = 0;
+            size_t packet_size = (send_msg_size == 0) ? send_length : send_msg_size;
+
+            while (packet_index < send_length) {
+                if (packet_index + packet_size > send_length) {
+                    packet_size = send_length - packet_index;
+                }
+                sock_ret = picoquic_sendmsg(send_socket,
+                    (struct sockaddr*)peer_addr, (struct sockaddr*)local_addr, if_index,
+                    (const char*)(send_buffer + packet_index), (int)packet_size, 0, &sock_err);
+                if (sock_ret > 0) {
+                    packet_index += packet_size;
+                }
+                else {
+                    picoquic_log_app_message(cnx, "Retry with packet size=%zu fails at index %zu, ret=%d, err=%d.",
+                        packet_size, packet_index, sock_ret, sock_err);
+                    break;
+                }
+            }
+            if (sock_ret > 0) {
+                picoquic_log_app_message(cnx, "Retry of %zu bytes by chunks of %zu bytes succeeds.",
+                    send_length, send_msg_size);
+            }
+            if (*send_msg_ptr != NULL) {
+                /* Make sure that we do not use GSO anymore in this run */
+                *send_msg_ptr = NULL;
+                picoquic_log_app_message(cnx, "%s", "UDP GSO was disabled");
+            }
+        }
+    }
+}
+
+/* Pacing offload. The departure time of the packets is computed by the
+ * stack in the QUIC clock, which is not the monotonic clock expected by
+ * SO_TXTIME. Convert it by adding the delay to the current monotonic time.
+ * Returns 0 if the packets can be sent immediately.
+ */
+static uint64_t picoquic_packet_loop_txtime(picoquic_cnx_t* cnx, uint64_t current_time)
+{
+    uint64_t txtime = 0;
+#if defined(__linux__) && defined(SO_TXTIME)
+    uint64_t departure_time = picoquic_get_departure_time(cnx);
+
+    if (departure_time > current_time) {
+        struct timespec ts;
+        if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+            txtime = ((uint64_t)ts.tv_sec) * 1000000000ull + (uint64_t)ts.tv_nsec +
+                (departure_time - current_time) * 1000ull;
+        }
+    }
+#else
+#ifdef UNREFERENCED_PARAMETER
+    UNREFERENCED_PARAMETER(cnx);
+    UNREFERENCED_PARAMETER(current_time);
+#endif
+#endif
+    return txtime;
+}
+
+#ifdef PICOQUIC_PACKET_LOOP_USE_SENDMMSG
+/* Batched send. When the application sets the parameter `do_send_batch`,
+ * the packets prepared in one pass of the send loop are queued instead of
+ * being sent one at a time, and then submitted with a single sendmmsg call
+ * per socket. Each queued message keeps its own addresses, interface and
+ * GSO segment size, so packets for different connections and paths can
+ * share the same call.
+ */
+typedef struct st_picoquic_send_batch_msg_t {
+    struct sockaddr_storage peer_addr;
+    struct sockaddr_storage local_addr;
+    int if_index;
+    picoquic_connection_id_t log_cid;
+    picoquic_cnx_t* cnx;
+    uint8_t* buffer;
+    size_t length;
+    size_t send_msg_size;
+    uint64_t txtime;
+    struct iovec iov;
+    char cmsg_buffer[1024];
+} picoquic_send_batch_msg_t;
+
+typedef struct st_picoquic_send_batch_t {
+    SOCKET_TYPE fd;
+    int nb_msg;
+    size_t buffer_size;
+#ifdef PICOQUIC_PACKET_LOOP_USE_IO_URING
+    picoquic_uring_t* uring;
+#endif
+    uint8_t* buffers;
+    struct mmsghdr mmsg[PICOQUIC_PACKET_LOOP_SEND_MAX];
+    picoquic_send_batch_msg_t msg[PICOQUIC_PACKET_LOOP_SEND_MAX];
+} picoquic_send_batch_t;
+
+static void picoquic_send_batch_delete(picoquic_send_batch_t* batch)
+{
+    if (batch->buffers != NULL) {
+        free(batch->buffers);
+    }
+    free(batch);
+}
+
+static picoquic_send_batch_t* picoquic_send_batch_create(size_t buffer_size)
+{
+    picoquic_send_batch_t* batch = (picoquic_send_batch_t*)malloc(sizeof(picoquic_send_batch_t));
+
+    if (batch != NULL) {
+        memset(batch, 0, sizeof(picoquic_send_batch_t));
+        batch->fd = INVALID_SOCKET;
+        batch->buffer_size = buffer_size;
+        batch->buffers = (uint8_t*)malloc(PICOQUIC_PACKET_LOOP_SEND_MAX * buffer_size);
+        if (batch->buffers == NULL) {
+            picoquic_send_batch_delete(batch);
+            batch = NULL;
+        }
+        else {
+            for (int i = 0; i < PICOQUIC_PACKET_LOOP_SEND_MAX; i++) {
+                batch->msg[i].buffer = batch->buffers + i * buffer_size;
+            }
+        }
+    }
+    return batch;
+}
+
+/* The connection context recorded when the packet was prepared may have been
+ * deleted by later calls to picoquic_prepare_next_packet_ex, for example after
+ * a server connection is disconnected. Only use it if it is still listed. */
+static picoquic_cnx_t* picoquic_send_batch_check_cnx(picoquic_quic_t* quic, picoquic_cnx_t* cnx)
+{
+    picoquic_cnx_t* next = picoquic_get_first_cnx(quic);
+
+    while (next != NULL && next != cnx) {
+        next = picoquic_get_next_cnx(next);
+    }
+    return next;
+}
+
+/* Submit all queued messages to the socket. If the kernel accepts only part
+ * of the batch, the call is repeated for the remainder. If a message is
+ * refused, the error is processed for that message, which is then skipped.
+ */
+static void picoquic_send_batch_flush(picoquic_quic_t* quic, picoquic_send_batch_t* batch,
+    uint64_t current_time, size_t** send_msg_ptr)
+{
+    int i = 0;
+
+    for (int j = 0; j < batch->nb_msg; j++) {
+        picoquic_send_batch_msg_t* msg = &batch->msg[j];
+        struct msghdr* hdr = &batch->mmsg[j].msg_hdr;
+
+        memset(hdr, 0, sizeof(struct msghdr));
+        msg->iov.iov_base = msg->buffer;
+        msg->iov.iov_len = msg->length;
+        hdr->msg_name = (struct sockaddr*)&msg->peer_addr;
+        hdr->msg_namelen = picoquic_addr_length((struct sockaddr*)&msg->peer_addr);
+        hdr->msg_iov = &msg->iov;
+        hdr->msg_iovlen = 1;
+        hdr->msg_control = (void*)msg->cmsg_buffer;
+        hdr->msg_controllen = sizeof(msg->cmsg_buffer);
+        picoquic_socks_cmsg_format_ex(hdr, msg->length, msg->send_msg_size,
+            (struct sockaddr*)&msg->local_addr, msg->if_index, msg->txtime);
+        batch->mmsg[j].msg_len = 0;
+    }
+
+#ifdef PICOQUIC_PACKET_LOOP_USE_IO_URING
+    if (batch->uring != NULL) {
+        /* Submit the batch through the ring instead of calling sendmmsg */
+        int sock_err[PICOQUIC_PACKET_LOOP_SEND_MAX];
+
+        i = picoquic_uring_send_batch(batch->uring, batch->fd, batch->mmsg, batch->nb_msg, sock_err);
+        for (int j = 0; j < i; j++) {
+            if (sock_err[j] != 0) {
+                picoquic_send_batch_msg_t* msg = &batch->msg[j];
+                picoquic_packet_loop_send_error(quic, picoquic_send_batch_check_cnx(quic, msg->cnx),
+                    &msg->log_cid, batch->fd, &msg->peer_addr, &msg->local_addr, msg->if_index,
+                    msg->buffer, msg->length, msg->send_msg_size, -1, sock_err[j], current_time, send_msg_ptr);
+            }
+        }
+        /* If the ring failed, the messages that it did not take are sent with sendmmsg */
+    }
+#endif
+
+    while (i < batch->nb_msg) {
+        int nb_sent = sendmmsg(batch->fd, &batch->mmsg[i], (unsigned int)(batch->nb_msg - i), 0);
+
+        if (nb_sent > 0) {
+            i += nb_sent;
+        }
+        else {
+            int sock_err = errno;
+            picoquic_send_batch_msg_t* msg = &batch->msg[i];
+
+            DBG_PRINTF("Could not send packet on UDP socket[AF=%d]= %d!\n",
+                msg->peer_addr.ss_family, sock_err);
+            picoquic_packet_loop_send_error(quic, picoquic_send_batch_check_cnx(quic, msg->cnx),
+                &msg->log_cid, batch->fd, &msg->peer_addr, &msg->local_addr, msg->if_index,
+                msg->buffer, msg->length, msg->send_msg_size, -1, sock_err, current_time, send_msg_ptr);
+            i++;
+        }
+    }
+    batch->nb_msg = 0;
+}
+#endif
+
+/* Commands queued for the network thread.
+ * Small payloads are copied in the queue cell, larger ones in a buffer
+ * allocated by the producer and freed by the network thread.
+ */
+#define PICOQUIC_NETWORK_COMMAND_QUEUE_SIZE 256
+#define PICOQUIC_NETWORK_COMMAND_INLINE_MAX 256
+
+typedef enum {
+    picoquic_network_command_add_to_stream = 0,
+    picoquic_network_command_mark_active,
+    picoquic_network_command_send_datagram,
+    picoquic_network_command_close,
+    picoquic_network_command_callback
+} picoquic_network_command_enum;
+
+typedef struct st_picoquic_network_command_t {
+    picoquic_network_command_enum command;
+    picoquic_cnx_t* cnx;
+    uint64_t stream_id;
+    uint64_t error_code;
+    int flag; /* set_fin for add to stream, is_active for mark active */
+    void* ctx; /* stream context or command context */
+    picoquic_network_command_fn command_fn;
+    size_t length;
+    uint8_t* allocated_data;
+    uint8_t inline_data[PICOQUIC_NETWORK_COMMAND_INLINE_MAX];
+} picoquic_network_command_t;
+
+static picoquic_network_command_t* picoquic_network_command_reserve(picoquic_network_thread_ctx_t* thread_ctx,
+    uint64_t* ticket)
+{
+    picoquic_network_command_t* command = NULL;
+
+    if (thread_ctx->command_queue != NULL &&
+        (command = (picoquic_network_command_t*)picoquic_mpsc_queue_reserve(thread_ctx->command_queue, ticket)) != NULL) {
+        command->cnx = NULL;
+        command->stream_id = 0;
+        command->error_code = 0;
+        command->flag = 0;
+        command->ctx = NULL;
+        command->command_fn = NULL;
+        command->length = 0;
+        command->allocated_data = NULL;
+    }
+    return command;
+}
+
+static int picoquic_network_command_copy_data(picoquic_network_command_t* command, const uint8_t* data, size_t length)
+{
+    int ret = 0;
+
+    if (length > PICOQUIC_NETWORK_COMMAND_INLINE_MAX) {
+        if ((command->allocated_data = (uint8_t*)malloc(length)) == NULL) {
+            ret = PICOQUIC_ERROR_MEMORY;
+        }
+        else {
+            memcpy(command->allocated_data, data, length);
+        }
+    }
+    else if (length > 0) {
+        memcpy(command->inline_data, data, length);
+    }
+    command->length = (ret == 0) ? length : 0;
+    return ret;
+}
+
+/* Publish the command, and wake up the network thread. The wake up
+ * call does nothing if a wake up is already pending. */
+static int picoquic_network_command_publish(picoquic_network_thread_ctx_t* thread_ctx, uint64_t ticket)
+{
+    picoquic_mpsc_queue_publish(thread_ctx->command_queue, ticket);
+    return picoquic_wake_up_network_thread(thread_ctx);
+}
+
+static int picoquic_network_command_post(picoquic_network_thread_ctx_t* thread_ctx,
+    picoquic_network_command_enum command_type, picoquic_cnx_t* cnx, uint64_t stream_id, uint64_t error_code,
+    int flag, void* ctx, picoquic_network_command_fn command_fn, const uint8_t* data, size_t length)
+{
+    int ret = 0;
+    uint64_t ticket = 0;
+    picoquic_network_command_t* command = picoquic_network_command_reserve(thread_ctx, &ticket);
+
+    if (command == NULL) {
+        ret = PICOQUIC_ERROR_NETWORK_QUEUE_FULL;
+    }
+    else {
+        command->command = command_type;
+        command->cnx = cnx;
+        command->stream_id = stream_id;
+        command->error_code = error_code;
+        command->flag = flag;
+        command->ctx = ctx;
+        command->command_fn = command_fn;
+        if (picoquic_network_command_copy_data(command, data, length) != 0) {
+            /* The cell was already claimed. Turn the command into a no-op callback. */
+            command->command = picoquic_network_command_callback;
+            command->command_fn = NULL;
+            ret = PICOQUIC_ERROR_MEMORY;
+        }
+        if (picoquic_network_command_publish(thread_ctx, ticket) != 0 && ret == 0) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+int picoquic_network_thread_add_to_stream(picoquic_network_thread_ctx_t* thread_ctx, picoquic_cnx_t* cnx,
+    uint64_t stream_id, const uint8_t* data, size_t length, int set_fin)
+{
+    return picoquic_network_command_post(thread_ctx, picoquic_network_command_add_to_stream, cnx, stream_id, 0,
+        set_fin, NULL, NULL, data, length);
+}
+
+int picoquic_network_thread_mark_active_stream(picoquic_network_thread_ctx_t* thread_ctx, picoquic_cnx_t* cnx,
+    uint64_t stream_id, int is_active, void* v_stream_ctx)
+{
+    return picoquic_network_command_post(thread_ctx, picoquic_network_command_mark_active, cnx, stream_id, 0,
+        is_active, v_stream_ctx, NULL, NULL, 0);
+}
+
+int picoquic_network_thread_queue_datagram(picoquic_network_thread_ctx_t* thread_ctx, picoquic_cnx_t* cnx,
+    const uint8_t* data, size_t length)
+{
+    return picoquic_network_command_post(thread_ctx, picoquic_network_command_send_datagram, cnx, 0, 0,
+        0, NULL, NULL, data, length);
+}
+
+int picoquic_network_thread_close(picoquic_network_thread_ctx_t* thread_ctx, picoquic_cnx_t* cnx,
+    uint64_t application_reason_code)
+{
+    return picoquic_network_command_post(thread_ctx, picoquic_network_command_close, cnx, 0, application_reason_code,
+        0, NULL, NULL, NULL, 0);
+}
+
+int picoquic_network_thread_call(picoquic_network_thread_ctx_t* thread_ctx,
+    picoquic_network_command_fn command_fn, void* command_ctx)
+{
+    return picoquic_network_command_post(thread_ctx, picoquic_network_command_callback, NULL, 0, 0,
+        0, command_ctx, command_fn, NULL, 0);
+}
+
+static int picoquic_network_command_execute(picoquic_quic_t* quic, picoquic_network_command_t* command)
+{
+    int ret = 0;
+    int cmd_ret = 0;
+    uint8_t* data = (command->allocated_data != NULL) ? command->allocated_data : command->inline_data;
+
+    switch (command->command) {
+    case picoquic_network_command_add_to_stream:
+        cmd_ret = picoquic_add_to_stream(command->cnx, command->stream_id, data, command->length, command->flag);
+        break;
+    case picoquic_network_command_mark_active:
+        cmd_ret = picoquic_mark_active_stream(command->cnx, command->stream_id, command->flag, command->ctx);
+        break;
+    case picoquic_network_command_send_datagram:
+        cmd_ret = picoquic_queue_datagram_frame(command->cnx, command->length, data);
+        break;
+    case picoquic_network_command_close:
+        cmd_ret = picoquic_close(command->cnx, command->error_code);
+        break;
+    case picoquic_network_command_callback:
+        if (command->command_fn != NULL) {
+            ret = command->command_fn(quic, command->ctx);
+        }
+        break;
+    default:
+        break;
+    }
+    if (cmd_ret != 0) {
+        /* Errors on a specific connection do not stop the loop */
+        DBG_PRINTF("Network command %d fails, ret = 0x%x", command->command, cmd_ret);
+    }
+    return ret;
+}
+
+/* Execute all the commands in the queue. The loop clears the wake up
+ * pending flag before calling this function, so that a command posted
+ * after the last read will trigger a new wake up. If `quic` is NULL,
+ * the commands are discarded. */
+static int picoquic_network_command_drain(picoquic_network_thread_ctx_t* thread_ctx, picoquic_quic_t* quic)
+{
+    int ret = 0;
+    picoquic_network_command_t* command;
+
+    if (thread_ctx->command_queue != NULL) {
+        while ((command = (picoquic_network_command_t*)picoquic_mpsc_queue_peek(thread_ctx->command_queue)) != NULL) {
+            if (ret == 0 && quic != NULL) {
+                ret = picoquic_network_command_execute(quic, command);
+            }
+            if (command->allocated_data != NULL) {
+                free(command->allocated_data);
+                command->allocated_data = NULL;
+            }
+            picoquic_mpsc_queue_release(thread_ctx->command_queue);
+        }
+    }
+    return ret;
+}
+
 #ifdef _WINDOWS
     DWORD WINAPI picoquic_packet_loop_v3(LPVOID v_ctx)
 #else
@@ -725,7 +1524,9 @@ void* picoquic_packet_loop_v3(void* v_ctx)
     struct sockaddr_storage addr_to;
     int if_index_to;
 #ifndef _WINDOWS
-    uint8_t buffer[1536];
+    uint8_t* buffer = NULL;
+    size_t buffer_size = picoquic_get_max_packet_size(quic);
+    size_t udp_coalesced_size = 0;
 #endif
     uint8_t* send_buffer = NULL;
     size_t send_length = 0;
@@ -740,8 +1541,22 @@ void* picoquic_packet_loop_v3(void* v_ctx)
     picoquic_cnx_t* last_cnx = NULL;
     int loop_immediate = 0;
     unsigned int nb_loop_immediate = 0;
+    int is_pacing_offloaded = 0;
     picoquic_packet_loop_options_t options = { 0 };
     packet_loop_system_call_duration_t sc_duration = { 0 };
+    int is_spinning = 0;
+    uint64_t last_busy_poll_report = 0;
+#ifdef PICOQUIC_PACKET_LOOP_USE_RECVMMSG
+    picoquic_recv_batch_t* recv_batch = NULL;
+#endif
+#ifdef PICOQUIC_PACKET_LOOP_USE_SENDMMSG
+    picoquic_send_batch_t* send_batch = NULL;
+#endif
+#ifdef PICOQUIC_PACKET_LOOP_USE_IO_URING
+    picoquic_uring_t* uring = NULL;
+    picoquic_uring_msg_t* uring_msg = NULL;
+    int nb_uring_msg = 0;
+#endif
 
     int is_wake_up_event;
 #ifdef _WINDOWS
@@ -758,9 +1573,7 @@ void* picoquic_packet_loop_v3(void* v_ctx)
     }
 
     memset(s_ctx, 0, sizeof(s_ctx));
-    if ((nb_sockets = picoquic_packet_loop_open_sockets(param->local_port,
-        param->local_af, param->socket_buffer_size,
-        param->extra_socket_required, param->do_not_use_gso, s_ctx)) <= 0) {
+    if ((nb_sockets = picoquic_packet_loop_open_sockets_ex(param, s_ctx)) <= 0) {
         ret = PICOQUIC_ERROR_UNEXPECTED_ERROR;
     }
     else if (loop_callback != NULL) {
@@ -780,6 +1593,22 @@ void* picoquic_packet_loop_v3(void* v_ctx)
     if (ret == 0) {
         nb_sockets_available = nb_sockets;
 
+        if (param->pacing_offload_horizon > 0) {
+            /* Only offload pacing if all the sockets support it, otherwise
+             * the packets sent ahead of time would be sent in bursts. */
+            is_pacing_offloaded = 1;
+            for (int i = 0; i < nb_sockets; i++) {
+                if (!s_ctx[i].supports_txtime) {
+                    is_pacing_offloaded = 0;
+                    DBG_PRINTF("%s", "Cannot set SO_TXTIME, pacing is not offloaded.");
+                    break;
+                }
+            }
+            if (is_pacing_offloaded) {
+                picoquic_set_pacing_offload(quic, param->pacing_offload_horizon);
+            }
+        }
+
         if (udp_gso_available && !param->do_not_use_gso) {
             send_buffer_size = 0xFFFF;
             send_msg_ptr = &send_msg_size;
@@ -788,10 +1617,66 @@ void* picoquic_packet_loop_v3(void* v_ctx)
         if (send_buffer == NULL) {
             ret = -1;
         }
+#ifndef _WINDOWS
+        if (udp_gro_available && !param->do_not_use_gso) {
+            /* Coalesced receive requires buffers large enough for a full GRO batch */
+            buffer_size = 0x10000;
+        }
+#ifdef PICOQUIC_PACKET_LOOP_USE_IO_URING
+        if (ret == 0 && param->use_io_uring && picoquic_uring_is_available()) {
+            /* Use the io_uring backend if it can be set up, or else fall back to select */
+            if ((uring = picoquic_uring_create(buffer_size,
+                (thread_ctx->wake_up_defined) ? thread_ctx->wake_up_pipe_fd[0] : -1)) != NULL) {
+                for (int i = 0; uring != NULL && i < nb_sockets; i++) {
+                    if (picoquic_uring_add_socket(uring, &s_ctx[i], i) != 0) {
+                        picoquic_uring_delete(uring);
+                        uring = NULL;
+                    }
+                }
+            }
+            if (uring == NULL) {
+                DBG_PRINTF("%s", "Cannot use io_uring, falling back to select.");
+            }
+        }
+        if (uring != NULL) {
+            /* Received packets are held in the ring's provided buffers. */
+            thread_ctx->is_io_uring_used = 1;
+        }
+        else
+#endif
+#ifdef PICOQUIC_PACKET_LOOP_USE_RECVMMSG
+        if (ret == 0 && param->recv_batch_size > 1) {
+            if ((recv_batch = picoquic_recv_batch_create(param->recv_batch_size, buffer_size)) == NULL) {
+                ret = -1;
+            }
+        }
+        else
+#endif
+        if (ret == 0 && (buffer = (uint8_t*)malloc(buffer_size)) == NULL) {
+            ret = -1;
+        }
+#endif
+#ifdef PICOQUIC_PACKET_LOOP_USE_SENDMMSG
+        if (ret == 0 && (param->do_send_batch
+#ifdef PICOQUIC_PACKET_LOOP_USE_IO_URING
+            || uring != NULL
+#endif
+            )) {
+            if ((send_batch = picoquic_send_batch_create(send_buffer_size)) == NULL) {
+                ret = -1;
+            }
+#ifdef PICOQUIC_PACKET_LOOP_USE_IO_URING
+            else {
+                send_batch->uring = uring;
+            }
+#endif
+        }
+#endif
     }
 
     if (ret == 0) {
         thread_ctx->thread_is_ready = 1;
+        last_busy_poll_report = picoquic_current_time();
     }
     else {
         DBG_PRINTF("%s", "Thread cannot run");
@@ -841,25 +1726,82 @@ void* picoquic_packet_loop_v3(void* v_ctx)
         loop_immediate = 0;
         /* Remember the time before the select call, so it duration be monitored */
         previous_time = current_time;
-        /* Initialize the dest addr family to UNSPEC yo handle systems that cannot set it. */
-        addr_to.ss_family = AF_UNSPEC;
+        /* If the next wake up is close, spin on non-blocking receives
+         * instead of blocking, so that the thread is not descheduled
+         * just before it has work to do. */
+        is_spinning = (param->busy_poll_threshold > 0 && delta_t > 0 &&
+            (uint64_t)delta_t <= param->busy_poll_threshold);
+        do {
+            int64_t wait_t = (is_spinning) ? 0 : delta_t;
+            uint64_t wait_start = current_time;
+            /* Initialize the dest addr family to UNSPEC yo handle systems that cannot set it. */
+            addr_to.ss_family = AF_UNSPEC;
 #ifdef _WINDOWS
-        bytes_recv = picoquic_packet_loop_wait(s_ctx, nb_sockets_available,
-            &addr_from, &addr_to, &if_index_to, &received_ecn, &received_buffer,
-            delta_t, &is_wake_up_event, thread_ctx, &socket_rank);
+            bytes_recv = picoquic_packet_loop_wait(s_ctx, nb_sockets_available,
+                &addr_from, &addr_to, &if_index_to, &received_ecn, &received_buffer,
+                wait_t, &is_wake_up_event, thread_ctx, &socket_rank);
 #else
-        bytes_recv = picoquic_packet_loop_select(s_ctx, nb_sockets_available,
-            &addr_from,
-            &addr_to, &if_index_to, &received_ecn,
-            buffer, sizeof(buffer),
-            delta_t, &is_wake_up_event, thread_ctx, &socket_rank);
-        received_buffer = buffer;
+#ifdef PICOQUIC_PACKET_LOOP_USE_IO_URING
+            if (uring != NULL) {
+                bytes_recv = picoquic_uring_wait(uring, nb_sockets_available, wait_t,
+                    &is_wake_up_event, &uring_msg, &nb_uring_msg);
+            }
+            else
 #endif
-        current_time = picoquic_current_time();
-        if (options.do_system_call_duration && delta_t == 0 &&
-            monitor_system_call_duration(&sc_duration, current_time, previous_time)) {
-            ret = loop_callback(quic, picoquic_packet_loop_system_call_duration,
-                loop_callback_ctx, &sc_duration);
+#ifdef PICOQUIC_PACKET_LOOP_USE_RECVMMSG
+            if (recv_batch != NULL) {
+                bytes_recv = picoquic_packet_loop_select_batch(s_ctx, nb_sockets_available,
+                    recv_batch, wait_t, &is_wake_up_event, thread_ctx, &socket_rank);
+            }
+            else
+#endif
+            bytes_recv = picoquic_packet_loop_select(s_ctx, nb_sockets_available,
+                &addr_from,
+                &addr_to, &if_index_to, &received_ecn,
+                buffer, (int)buffer_size,
+                wait_t, &is_wake_up_event, thread_ctx, &socket_rank, &udp_coalesced_size);
+            received_buffer = buffer;
+#endif
+            current_time = picoquic_current_time();
+            if (is_spinning) {
+                if (bytes_recv != 0 || is_wake_up_event ||
+                    current_time >= previous_time + delta_t) {
+                    /* Data arrived or the timer expired */
+                    sc_duration.spin_time += current_time - previous_time;
+                    sc_duration.nb_spin++;
+                    is_spinning = 0;
+                    break;
+                }
+                else if (param->busy_poll_budget > 0 &&
+                    current_time >= previous_time + param->busy_poll_budget) {
+                    /* Budget exhausted, block until the wake time */
+                    sc_duration.spin_time += current_time - previous_time;
+                    sc_duration.nb_spin++;
+                    sc_duration.nb_spin_fallback++;
+                    delta_t -= (int64_t)(current_time - previous_time);
+                    is_spinning = 0;
+                }
+            }
+            else {
+                if (wait_t > 0) {
+                    sc_duration.block_time += current_time - wait_start;
+                }
+                break;
+            }
+        } while (1);
+
+        if (options.do_system_call_duration) {
+            if (delta_t == 0 &&
+                monitor_system_call_duration(&sc_duration, current_time, previous_time)) {
+                ret = loop_callback(quic, picoquic_packet_loop_system_call_duration,
+                    loop_callback_ctx, &sc_duration);
+            }
+            else if (param->busy_poll_threshold > 0 &&
+                current_time >= last_busy_poll_report + PICOQUIC_PACKET_LOOP_BUSY_POLL_REPORT_INTERVAL) {
+                last_busy_poll_report = current_time;
+                ret = loop_callback(quic, picoquic_packet_loop_system_call_duration,
+                    loop_callback_ctx, &sc_duration);
+            }
         }
 
         if (bytes_recv < 0) {
@@ -867,7 +1809,14 @@ void* picoquic_packet_loop_v3(void* v_ctx)
             ret = (thread_ctx->thread_should_close) ? PICOQUIC_NO_ERROR_TERMINATE_PACKET_LOOP : -1;
         }
         else if (bytes_recv == 0 && is_wake_up_event) {
-            ret = loop_callback(quic, picoquic_packet_loop_wake_up, loop_callback_ctx, NULL);
+            /* The wake up event was consumed by the receive call. Clear the
+             * pending flag before looking at the commands or calling the
+             * application, so that any later request triggers a new wake up. */
+            picoquic_atomic_flag_clear(&thread_ctx->wake_up_pending);
+            ret = picoquic_network_command_drain(thread_ctx, quic);
+            if (ret == 0) {
+                ret = loop_callback(quic, picoquic_packet_loop_wake_up, loop_callback_ctx, NULL);
+            }
         }
         else {
             uint64_t loop_time = current_time;
@@ -875,38 +1824,57 @@ void* picoquic_packet_loop_v3(void* v_ctx)
             size_t nb_packets_sent = 0;
 
             if (bytes_recv > 0) {
+                size_t nb_packets_received = 0;
 #ifdef _WINDOWS
-                size_t recv_bytes = 0;
-                while (recv_bytes < (size_t)bytes_recv && ret == 0) {
-                    size_t recv_length = (size_t)(bytes_recv - recv_bytes);
-
-                    if (s_ctx[socket_rank].udp_coalesced_size > 0 &&
-                        recv_length > s_ctx[socket_rank].udp_coalesced_size) {
-                        recv_length = s_ctx[socket_rank].udp_coalesced_size;
-                    }
-                    /* Submit the packet to the client */
-                    ret = picoquic_incoming_packet_ex(quic, s_ctx[socket_rank].recv_buffer + recv_bytes,
-                        recv_length, (struct sockaddr*)&addr_from,
-                        (struct sockaddr*)&addr_to,
-                        s_ctx[socket_rank].dest_if,
-                        s_ctx[socket_rank].received_ecn, &last_cnx, current_time);
-                    recv_bytes += recv_length;
-                }
+                /* Submit the packet or coalesced packets to the stack */
+                ret = picoquic_packet_loop_incoming_coalesced(quic, param, s_ctx[socket_rank].recv_buffer,
+                    (size_t)bytes_recv, s_ctx[socket_rank].udp_coalesced_size,
+                    (struct sockaddr*)&addr_from, (struct sockaddr*)&addr_to,
+                    s_ctx[socket_rank].dest_if, s_ctx[socket_rank].received_ecn,
+                    &last_cnx, current_time, &nb_packets_received);
                 if (ret == 0) {
                     ret = picoquic_win_recvmsg_async_start(&s_ctx[socket_rank]);
                 }
 #else
-                /* Submit the packet to the server */
-                ret = picoquic_incoming_packet_ex(quic, received_buffer,
-                    (size_t)bytes_recv, (struct sockaddr*)&addr_from,
-                    (struct sockaddr*)&addr_to, if_index_to, received_ecn,
-                    &last_cnx, current_time);
+#ifdef PICOQUIC_PACKET_LOOP_USE_IO_URING
+                if (uring != NULL) {
+                    for (int i = 0; ret == 0 && i < nb_uring_msg; i++) {
+                        picoquic_uring_msg_t* msg = &uring_msg[i];
+                        ret = picoquic_packet_loop_incoming_coalesced(quic, param, msg->bytes,
+                            msg->length, msg->udp_coalesced_size,
+                            (struct sockaddr*)&msg->addr_from, (struct sockaddr*)&msg->addr_dest,
+                            msg->dest_if, msg->received_ecn, &last_cnx, current_time,
+                            &nb_packets_received);
+                    }
+                }
+                else
+#endif
+#ifdef PICOQUIC_PACKET_LOOP_USE_RECVMMSG
+                if (recv_batch != NULL) {
+                    /* Submit the whole batch before giving control back to the application */
+                    for (int i = 0; ret == 0 && i < recv_batch->nb_msg; i++) {
+                        picoquic_recv_batch_msg_t* msg = &recv_batch->msg[i];
+                        ret = picoquic_packet_loop_incoming_coalesced(quic, param, (uint8_t*)msg->iov.iov_base,
+                            msg->length, msg->udp_coalesced_size,
+                            (struct sockaddr*)&msg->addr_from, (struct sockaddr*)&msg->addr_dest,
+                            msg->dest_if, msg->received_ecn, &last_cnx, current_time,
+                            &nb_packets_received);
+                    }
+                }
+                else
+#endif
+                {
+                    /* Submit the packet or coalesced packets to the stack */
+                    ret = picoquic_packet_loop_incoming_coalesced(quic, param, received_buffer,
+                        (size_t)bytes_recv, udp_coalesced_size,
+                        (struct sockaddr*)&addr_from, (struct sockaddr*)&addr_to,
+                        if_index_to, received_ecn, &last_cnx, current_time,
+                        &nb_packets_received);
+                }
 #endif
-
 
                 if (loop_callback != NULL) {
-                    size_t b_recvd = (size_t)bytes_recv;
-                    ret = loop_callback(quic, picoquic_packet_loop_after_receive, loop_callback_ctx, &b_recvd);
+                    ret = loop_callback(quic, picoquic_packet_loop_after_receive, loop_callback_ctx, &nb_packets_received);
                 }
 
                 /* If the number of packets received in immediate mode has not
@@ -946,13 +1914,25 @@ void* picoquic_packet_loop_v3(void* v_ctx)
                 int if_index = param->dest_if;
                 int sock_ret = 0;
                 int sock_err = 0;
+                uint8_t* packet_buffer = send_buffer;
+#ifdef PICOQUIC_PACKET_LOOP_USE_SENDMMSG
+                if (send_batch != NULL) {
+                    packet_buffer = send_batch->msg[send_batch->nb_msg].buffer;
+                }
+#endif
 
                 ret = picoquic_prepare_next_packet_ex(quic, loop_time,
-                    send_buffer, send_buffer_size, &send_length,
+                    packet_buffer, send_buffer_size, &send_length,
                     &peer_addr, &local_addr, &if_index, &log_cid, &last_cnx,
                     send_msg_ptr);
 
                 if (ret == 0 && send_length > 0) {
+                    SOCKET_TYPE send_socket;
+                    int supports_txtime = 0;
+                    uint64_t txtime = 0;
+#ifdef PICOQUIC_PACKET_LOOP_USE_IO_URING
+                    int nb_sockets_before = nb_sockets_available;
+#endif
                     /* If send_msg_size is defined, sendmsg may send more than one packet.
                      * We compute that to update the number of packets sent in the loop.
                      */
@@ -961,131 +1941,74 @@ void* picoquic_packet_loop_v3(void* v_ctx)
                     if (send_length > param->send_length_max) {
                         param->send_length_max = send_length;
                     }
-                    /* We have multiple sockets, with support for
-                    * either IPv6, or IPv4, or both, and binding to a port number.
-                    * Find the first socket where:
-                    * - the destination AF is supported.
-                    * - either the source port is not specified, or it matches the local port.
-                    */
-                    SOCKET_TYPE send_socket = INVALID_SOCKET;
-                    uint16_t send_port = (peer_addr.ss_family == AF_INET) ?
-                        ((struct sockaddr_in*)&local_addr)->sin_port :
-                        ((struct sockaddr_in6*)&local_addr)->sin6_port;
-
                     bytes_sent += send_length;
 
-                    /* TODO: verify htons/ntohs */
-                    for (int i = 0; i < nb_sockets_available; i++) {
-                        if (s_ctx[i].af == peer_addr.ss_family) {
-                            send_socket = s_ctx[i].fd;
-                            if (send_port == 0 && !param->prefer_extra_socket) {
-                                break;
-                            }
-                            if (s_ctx[i].n_port == send_port) {
-                                break;
-                            }
-                        }
+                    send_socket = picoquic_packet_loop_find_send_socket(param, s_ctx,
+                        &nb_sockets_available, &nb_sockets, &peer_addr, &local_addr, &supports_txtime);
+                    if (is_pacing_offloaded && supports_txtime && last_cnx != NULL) {
+                        txtime = picoquic_packet_loop_txtime(last_cnx, loop_time);
                     }
-
-                    if (send_socket == INVALID_SOCKET) {
-                        if (nb_sockets_available < PICOQUIC_PACKET_LOOP_SOCKETS_MAX) {
-                            picoquic_socket_ctx_t* new_ctx = &s_ctx[nb_sockets_available];
-                            memset(new_ctx, 0, sizeof(*new_ctx));
-                            new_ctx->af = peer_addr.ss_family;
-                            if (peer_addr.ss_family == AF_INET6) {
-                                new_ctx->port = ntohs(((struct sockaddr_in6*)&peer_addr)->sin6_port);
-                            }
-                            else {
-                                new_ctx->port = ntohs(((struct sockaddr_in*)&peer_addr)->sin_port);
-                            }
-                            new_ctx->n_port = htons(new_ctx->port);
-                            if (picoquic_packet_loop_open_socket(param->socket_buffer_size, param->do_not_use_gso, new_ctx) == 0) {
-                                send_socket = new_ctx->fd;
-                                send_port = new_ctx->n_port;
-                                nb_sockets_available++;
-                                if (nb_sockets < nb_sockets_available) {
-                                    nb_sockets = nb_sockets_available;
-                                }
-                            }
-                        }
+#ifdef PICOQUIC_PACKET_LOOP_USE_IO_URING
+                    if (uring != NULL && nb_sockets_available > nb_sockets_before) {
+                        /* A new socket was opened, post a receive for it */
+                        (void)picoquic_uring_add_socket(uring, &s_ctx[nb_sockets_before], nb_sockets_before);
                     }
+#endif
 
                     if (send_socket == INVALID_SOCKET) {
                         sock_ret = -1;
                         sock_err = -1;
                     }
-                    else
-                    {
-
-                        if (param->simulate_eio && send_length > PICOQUIC_MAX_PACKET_SIZE) {
-                            /* Test hook, simulating a driver that does not support GSO */
-                            sock_ret = -1;
-                            sock_err = EIO;
-                            param->simulate_eio = 0;
-                        }
-                        else {
-                            sock_ret = picoquic_sendmsg(send_socket,
-                                (struct sockaddr*)&peer_addr, (struct sockaddr*)&local_addr, if_index,
-                                (const char*)send_buffer, (int)send_length, (int)send_msg_size, &sock_err);
+                    else if (param->simulate_eio && send_length > PICOQUIC_MAX_PACKET_SIZE) {
+                        /* Test hook, simulating a driver that does not support GSO */
+                        sock_ret = -1;
+                        sock_err = EIO;
+                        param->simulate_eio = 0;
+                    }
+#ifdef PICOQUIC_PACKET_LOOP_USE_SENDMMSG
+                    else if (send_batch != NULL) {
+                        picoquic_send_batch_msg_t* msg;
+
+                        if (send_batch->nb_msg > 0 && send_batch->fd != send_socket) {
+                            /* sendmmsg works on a single socket. Flush, then start a new batch. */
+                            picoquic_send_batch_flush(quic, send_batch, current_time, &send_msg_ptr);
+                            memcpy(send_batch->msg[0].buffer, packet_buffer, send_length);
                         }
+                        send_batch->fd = send_socket;
+                        msg = &send_batch->msg[send_batch->nb_msg];
+                        msg->peer_addr = peer_addr;
+                        msg->local_addr = local_addr;
+                        msg->if_index = if_index;
+                        msg->log_cid = log_cid;
+                        msg->cnx = last_cnx;
+                        msg->length = send_length;
+                        msg->send_msg_size = (send_msg_ptr == NULL) ? 0 : send_msg_size;
+                        msg->txtime = txtime;
+                        send_batch->nb_msg++;
+                        sock_ret = (int)send_length;
                     }
+#endif
+                    else {
+                        sock_ret = picoquic_sendmsg_ex(send_socket,
+                            (struct sockaddr*)&peer_addr, (struct sockaddr*)&local_addr, if_index,
+                            (const char*)packet_buffer, (int)send_length, (int)send_msg_size, txtime, &sock_err);
+                    }
+
                     if (sock_ret <= 0) {
-                        /* TODO: add a test in which the socket fails. */
-                        if (last_cnx == NULL) {
-                            picoquic_log_context_free_app_message(quic, &log_cid, "Could not send message to AF_to=%d, AF_from=%d, if=%d, ret=%d, err=%d",
-                                peer_addr.ss_family, local_addr.ss_family, if_index, sock_ret, sock_err);
-                        }
-                        else {
-                            picoquic_log_app_message(last_cnx, "Could not send message to AF_to=%d, AF_from=%d, if=%d, ret=%d, err=%d",
-                                peer_addr.ss_family, local_addr.ss_family, if_index, sock_ret, sock_err);
-
-                            if (picoquic_socket_error_implies_unreachable(sock_err)) {
-                                picoquic_notify_destination_unreachable(last_cnx, current_time,
-                                    (struct sockaddr*)&peer_addr, (struct sockaddr*)&local_addr, if_index,
-                                    sock_err);
-                            }
-                            else if (sock_err == EIO) {
-                                /* TODO: this is an error encountered if the system supports GSO, but
-                                 * the specific interface driver does not. Main example is Mininet.
-                                 * Not sure that we can treat that correctly. Try to minimize the
-                                 * amount of untested code? Rely on config flag? Rely on error
-                                 * recovery? */
-                                size_t packet_index = 0;
-                                size_t packet_size = send_msg_size;
-
-                                while (packet_index < send_length) {
-                                    if (packet_index + packet_size > send_length) {
-                                        packet_size = send_length - packet_index;
-                                    }
-                                    sock_ret = picoquic_sendmsg(send_socket,
-                                        (struct sockaddr*)&peer_addr, (struct sockaddr*)&local_addr, if_index,
-                                        (const char*)(send_buffer + packet_index), (int)packet_size, 0, &sock_err);
-                                    if (sock_ret > 0) {
-                                        packet_index += packet_size;
-                                    }
-                                    else {
-                                        picoquic_log_app_message(last_cnx, "Retry with packet size=%zu fails at index %zu, ret=%d, err=%d.",
-                                            packet_size, packet_index, sock_ret, sock_err);
-                                        break;
-                                    }
-                                }
-                                if (sock_ret > 0) {
-                                    picoquic_log_app_message(last_cnx, "Retry of %zu bytes by chunks of %zu bytes succeeds.",
-                                        send_length, send_msg_size);
-                                }
-                                if (send_msg_ptr != NULL) {
-                                    /* Make sure that we do not use GSO anymore in this run */
-                                    send_msg_ptr = NULL;
-                                    picoquic_log_app_message(last_cnx, "%s", "UDP GSO was disabled");
-                                }
-                            }
-                        }
+                        picoquic_packet_loop_send_error(quic, last_cnx, &log_cid, send_socket,
+                            &peer_addr, &local_addr, if_index, packet_buffer, send_length, send_msg_size,
+                            sock_ret, sock_err, current_time, &send_msg_ptr);
                     }
                 }
                 else {
                     break;
                 }
             }
+#ifdef PICOQUIC_PACKET_LOOP_USE_SENDMMSG
+            if (send_batch != NULL && send_batch->nb_msg > 0) {
+                picoquic_send_batch_flush(quic, send_batch, current_time, &send_msg_ptr);
+            }
+#endif
 
             if (ret == 0 && loop_callback != NULL) {
                 ret = loop_callback(quic, picoquic_packet_loop_after_send, loop_callback_ctx, &bytes_sent);
@@ -1095,6 +2018,17 @@ void* picoquic_packet_loop_v3(void* v_ctx)
 
     thread_ctx->thread_is_ready = 0;
 
+    if (is_pacing_offloaded) {
+        /* Restore pacing in user space, in case the context is reused */
+        picoquic_set_pacing_offload(quic, 0);
+    }
+
+    if (options.do_system_call_duration && param->busy_poll_threshold > 0) {
+        /* Final report of the busy poll statistics */
+        (void)loop_callback(quic, picoquic_packet_loop_system_call_duration,
+            loop_callback_ctx, &sc_duration);
+    }
+
     if (ret == PICOQUIC_NO_ERROR_TERMINATE_PACKET_LOOP) {
         /* Normal termination requested by the application, returns no error */
         ret = 0;
@@ -1108,6 +2042,26 @@ void* picoquic_packet_loop_v3(void* v_ctx)
     if (send_buffer != NULL) {
         free(send_buffer);
     }
+#ifndef _WINDOWS
+    if (buffer != NULL) {
+        free(buffer);
+    }
+#endif
+#ifdef PICOQUIC_PACKET_LOOP_USE_RECVMMSG
+    if (recv_batch != NULL) {
+        picoquic_recv_batch_delete(recv_batch);
+    }
+#endif
+#ifdef PICOQUIC_PACKET_LOOP_USE_SENDMMSG
+    if (send_batch != NULL) {
+        picoquic_send_batch_delete(send_batch);
+    }
+#endif
+#ifdef PICOQUIC_PACKET_LOOP_USE_IO_URING
+    if (uring != NULL) {
+        picoquic_uring_delete(uring);
+    }
+#endif
     thread_ctx->return_code = ret;
 #ifdef _WINDOWS
     return (DWORD)ret;
@@ -1165,8 +2119,9 @@ static void picoquic_close_network_wake_up(picoquic_network_thread_ctx_t* thread
 #ifdef _WINDOWS
         CloseHandle(thread_ctx->wake_up_event);
 #else
-        for (int i = 0; i < 2; i++) {
-            (void)close(thread_ctx->wake_up_pipe_fd[i]);
+        (void)close(thread_ctx->wake_up_pipe_fd[0]);
+        if (thread_ctx->wake_up_pipe_fd[1] != thread_ctx->wake_up_pipe_fd[0]) {
+            (void)close(thread_ctx->wake_up_pipe_fd[1]);
         }
 #endif
         thread_ctx->wake_up_defined = 0;
@@ -1184,6 +2139,19 @@ static void picoquic_open_network_wake_up(picoquic_network_thread_ctx_t* thread_
     else {
         thread_ctx->wake_up_defined = 1;
     }
+#elif defined(__linux__)
+    /* On Linux, use an eventfd instead of a pipe. The same descriptor is
+     * used for reading and writing, and successive writes only increment
+     * a counter, which a single read resets. */
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+        *ret = errno;
+    }
+    else {
+        thread_ctx->wake_up_pipe_fd[0] = fd;
+        thread_ctx->wake_up_pipe_fd[1] = fd;
+        thread_ctx->wake_up_defined = 1;
+    }
 #else
     if (pipe(thread_ctx->wake_up_pipe_fd) != 0) {
         *ret = errno;
@@ -1252,8 +2220,15 @@ picoquic_network_thread_ctx_t* picoquic_start_custom_network_thread(picoquic_qui
         thread_ctx->param = param;
         thread_ctx->loop_callback = loop_callback;
         thread_ctx->loop_callback_ctx = loop_callback_ctx;
-        /* Open the wake up pipe or event */
+        /* Open the wake up pipe or event, and create the command queue */
         picoquic_open_network_wake_up(thread_ctx, ret);
+        if (thread_ctx->wake_up_defined &&
+            (thread_ctx->command_queue = picoquic_mpsc_queue_create(
+                (param->command_queue_size > 0) ? (size_t)param->command_queue_size : PICOQUIC_NETWORK_COMMAND_QUEUE_SIZE,
+                sizeof(picoquic_network_command_t))) == NULL) {
+            *ret = PICOQUIC_ERROR_MEMORY;
+            picoquic_close_network_wake_up(thread_ctx);
+        }
         /* Start thread at specified entry point */
         if (thread_ctx->wake_up_defined){
             thread_ctx->is_threaded = 1;
@@ -1284,29 +2259,48 @@ picoquic_network_thread_ctx_t* picoquic_start_network_thread(picoquic_quic_t* qu
     return picoquic_start_custom_network_thread(quic, param, NULL, NULL, NULL, NULL, loop_callback, loop_callback_ctx, ret);
 }
 
-int picoquic_wake_up_network_thread(picoquic_network_thread_ctx_t* thread_ctx)
+static int picoquic_signal_network_wake_up(picoquic_network_thread_ctx_t* thread_ctx)
 {
     int ret = 0;
-
-    if (thread_ctx->wake_up_defined) {
 #ifdef _WINDOWS
-        if (SetEvent(thread_ctx->wake_up_event) == 0) {
-            DWORD err = WSAGetLastError();
-            DBG_PRINTF("Set network event fails, error 0x%x", err);
-            ret = (int)err;
-        }
+    if (SetEvent(thread_ctx->wake_up_event) == 0) {
+        DWORD err = WSAGetLastError();
+        DBG_PRINTF("Set network event fails, error 0x%x", err);
+        ret = (int)err;
+    }
 #else
-        /* TODO: write to network pipe */
-        ssize_t written = 0;
-        if ((written = write(thread_ctx->wake_up_pipe_fd[1], &ret, 1)) != 1) {
-            if (written == 0) {
-                ret = EPIPE;
-            }
-            else {
-                ret = errno;
-            }
+#ifdef __linux__
+    uint64_t one = 1;
+    size_t signal_length = sizeof(one);
+#else
+    uint8_t one = 1;
+    size_t signal_length = 1;
+#endif
+    ssize_t written = 0;
+    if ((written = write(thread_ctx->wake_up_pipe_fd[1], &one, signal_length)) != (ssize_t)signal_length) {
+        if (written >= 0) {
+            ret = EPIPE;
         }
+        else {
+            ret = errno;
+        }
+    }
 #endif
+    return ret;
+}
+
+int picoquic_wake_up_network_thread(picoquic_network_thread_ctx_t* thread_ctx)
+{
+    int ret = 0;
+
+    if (thread_ctx->wake_up_defined) {
+        /* If a wake up is already pending, the network thread has not yet
+         * processed it, and will see the new request when it does. Skip the
+         * system call in that case. */
+        if (!picoquic_atomic_flag_set(&thread_ctx->wake_up_pending) &&
+            (ret = picoquic_signal_network_wake_up(thread_ctx)) != 0) {
+            picoquic_atomic_flag_clear(&thread_ctx->wake_up_pending);
+        }
     }
     else {
         DBG_PRINTF("%s", "Wake up event not defined.");
@@ -1319,15 +2313,25 @@ void picoquic_delete_network_thread(picoquic_network_thread_ctx_t* thread_ctx)
 {
     /* set the should_close flag, so the thread knows the loop should stop */
     thread_ctx->thread_should_close = 1;
-    /* Delete the wake up event. This ought to create a fault 
-     * in the wait for event call, causing the thread to wake up,
-     * notice the flag, and exit.
-     */
-    picoquic_close_network_wake_up(thread_ctx);
+    /* Signal the wake up event, bypassing the pending flag, so the
+     * thread wakes up, notices the flag, and exits. Closing the event
+     * is not sufficient: closing an eventfd does not interrupt a
+     * pending select. */
+    if (thread_ctx->wake_up_defined) {
+        (void)picoquic_signal_network_wake_up(thread_ctx);
+    }
     /* delete the thread */
     if (thread_ctx->is_threaded) {
         thread_ctx->thread_delete_fn((void**)&thread_ctx->pthread);
     }
+    /* Delete the wake up event once the thread is gone */
+    picoquic_close_network_wake_up(thread_ctx);
+    /* Discard the commands that were not executed */
+    if (thread_ctx->command_queue != NULL) {
+        (void)picoquic_network_command_drain(thread_ctx, NULL);
+        picoquic_mpsc_queue_delete(thread_ctx->command_queue);
+        thread_ctx->command_queue = NULL;
+    }
     /* Free the context */
     free(thread_ctx);
 }
@@ -0,0 +1,714 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* io_uring backend for the packet loop, see sockloop_uring.h.
+ *
+ * The ring carries three types of requests, identified by the top byte of
+ * the user data:
+ * - one multishot RECVMSG per socket, using the provided buffer group,
+ * - one multishot POLL_ADD on the wake up pipe,
+ * - SENDMSG requests, submitted in batches by picoquic_uring_send_batch.
+ * Completion entries are processed as they are found. Received packets are
+ * queued until the next call to picoquic_uring_wait, and the wake up event
+ * is remembered until it can be reported, so that waiting for the send
+ * completions never loses a receive or a wake up.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "picoquic_utils.h"
+#include "sockloop_uring.h"
+
+#ifdef PICOQUIC_PACKET_LOOP_USE_IO_URING
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#define PICOQUIC_URING_SQ_ENTRIES 64
+#define PICOQUIC_URING_CQ_ENTRIES 1024
+#define PICOQUIC_URING_BGID 0
+#define PICOQUIC_URING_CMSG_SIZE 256
+
+#define PICOQUIC_URING_TAG_RECV 1ull
+#define PICOQUIC_URING_TAG_POLL 2ull
+#define PICOQUIC_URING_TAG_SEND 3ull
+#define PICOQUIC_URING_USER_DATA(tag, index) (((tag) << 56) | (uint64_t)(index))
+#define PICOQUIC_URING_TAG(user_data) ((user_data) >> 56)
+#define PICOQUIC_URING_INDEX(user_data) ((int)((user_data) & 0xFF))
+#define PICOQUIC_URING_FD(user_data) ((int)(((user_data) >> 8) & 0xFFFFFFFF))
+
+/* Received packet waiting to be delivered to the loop */
+typedef struct st_picoquic_uring_pending_t {
+    int socket_rank;
+    uint16_t bid;
+    uint32_t length;
+} picoquic_uring_pending_t;
+
+typedef struct st_picoquic_uring_socket_t {
+    SOCKET_TYPE fd;
+    uint16_t n_port;
+    int is_armed;
+    struct msghdr recv_hdr;
+} picoquic_uring_socket_t;
+
+struct st_picoquic_uring_t {
+    int ring_fd;
+    /* Submission queue */
+    void* sq_ring;
+    size_t sq_ring_size;
+    unsigned int* sq_head;
+    unsigned int* sq_tail;
+    unsigned int sq_mask;
+    unsigned int sq_entries;
+    unsigned int* sq_array;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned int nb_to_submit;
+    /* Completion queue */
+    void* cq_ring;
+    size_t cq_ring_size;
+    unsigned int* cq_head;
+    unsigned int* cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe* cqes;
+    /* Provided buffers */
+    struct io_uring_buf_ring* buf_ring;
+    size_t buf_ring_size;
+    uint8_t* buffers;
+    size_t buffer_size;
+    uint16_t buf_tail;
+    /* Sockets and wake up pipe */
+    picoquic_uring_socket_t sockets[PICOQUIC_PACKET_LOOP_SOCKETS_MAX];
+    int wake_up_fd;
+    int wake_up_armed;
+    int wake_up_pending;
+    /* Received packets, not yet delivered */
+    picoquic_uring_pending_t pending[PICOQUIC_URING_NB_BUFFERS];
+    int pending_first;
+    int nb_pending;
+    /* Packets delivered by the last call to wait */
+    picoquic_uring_msg_t msg[PICOQUIC_PACKET_LOOP_RECV_BATCH_MAX];
+    int nb_msg;
+    /* Send completions */
+    int* send_err;
+    int nb_send_outstanding;
+};
+
+static int picoquic_uring_setup(unsigned int entries, struct io_uring_params* p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int picoquic_uring_enter(int ring_fd, unsigned int to_submit, unsigned int min_complete,
+    unsigned int flags, void* arg, size_t arg_size)
+{
+    return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+static int picoquic_uring_register(int ring_fd, unsigned int opcode, void* arg, unsigned int nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+/* Multishot receive with provided buffer rings appeared in Linux 6.0, in the same
+ * release as IORING_OP_SEND_ZC. There is no feature flag for it, so we use the
+ * presence of that opcode in the probe as a proxy. */
+static int picoquic_uring_probe(void)
+{
+    int is_available = 0;
+    struct io_uring_params p;
+    int ring_fd;
+
+    memset(&p, 0, sizeof(p));
+    if ((ring_fd = picoquic_uring_setup(4, &p)) >= 0) {
+        size_t probe_size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+        struct io_uring_probe* probe = (struct io_uring_probe*)malloc(probe_size);
+
+        if (probe != NULL) {
+            memset(probe, 0, probe_size);
+            if ((p.features & IORING_FEAT_EXT_ARG) != 0 &&
+                picoquic_uring_register(ring_fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+                probe->ops_len > IORING_OP_SEND_ZC &&
+                (probe->ops[IORING_OP_RECVMSG].flags & IO_URING_OP_SUPPORTED) != 0 &&
+                (probe->ops[IORING_OP_SENDMSG].flags & IO_URING_OP_SUPPORTED) != 0 &&
+                (probe->ops[IORING_OP_POLL_ADD].flags & IO_URING_OP_SUPPORTED) != 0 &&
+                (probe->ops[IORING_OP_SEND_ZC].flags & IO_URING_OP_SUPPORTED) != 0) {
+                is_available = 1;
+            }
+            free(probe);
+        }
+        close(ring_fd);
+    }
+    return is_available;
+}
+
+int picoquic_uring_is_available(void)
+{
+    static int uring_available = -1;
+
+    if (uring_available < 0) {
+        uring_available = picoquic_uring_probe();
+    }
+    return uring_available;
+}
+
+void picoquic_uring_delete(picoquic_uring_t* uring)
+{
+    if (uring->ring_fd >= 0) {
+        close(uring->ring_fd);
+    }
+    if (uring->sqes != NULL && uring->sqes != MAP_FAILED) {
+        munmap(uring->sqes, uring->sqes_size);
+    }
+    if (uring->cq_ring != NULL && uring->cq_ring != MAP_FAILED && uring->cq_ring != uring->sq_ring) {
+        munmap(uring->cq_ring, uring->cq_ring_size);
+    }
+    if (uring->sq_ring != NULL && uring->sq_ring != MAP_FAILED) {
+        munmap(uring->sq_ring, uring->sq_ring_size);
+    }
+    if (uring->buf_ring != NULL && uring->buf_ring != MAP_FAILED) {
+        munmap(uring->buf_ring, uring->buf_ring_size);
+    }
+    if (uring->buffers != NULL) {
+        free(uring->buffers);
+    }
+    if (uring->send_err != NULL) {
+        free(uring->send_err);
+    }
+    free(uring);
+}
+
+static int picoquic_uring_map_rings(picoquic_uring_t* uring, struct io_uring_params* p)
+{
+    int ret = 0;
+
+    uring->sq_ring_size = p->sq_off.array + p->sq_entries * sizeof(unsigned int);
+    uring->cq_ring_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    if ((p->features & IORING_FEAT_SINGLE_MMAP) != 0) {
+        if (uring->cq_ring_size > uring->sq_ring_size) {
+            uring->sq_ring_size = uring->cq_ring_size;
+        }
+        uring->cq_ring_size = uring->sq_ring_size;
+    }
+    uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_SQ_RING);
+    if (uring->sq_ring == MAP_FAILED) {
+        ret = -1;
+    }
+    else {
+        if ((p->features & IORING_FEAT_SINGLE_MMAP) != 0) {
+            uring->cq_ring = uring->sq_ring;
+        }
+        else {
+            uring->cq_ring = mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_CQ_RING);
+        }
+        uring->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+        uring->sqes = (struct io_uring_sqe*)mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_SQES);
+        if (uring->cq_ring == MAP_FAILED || uring->sqes == MAP_FAILED) {
+            ret = -1;
+        }
+        else {
+            uint8_t* sq = (uint8_t*)uring->sq_ring;
+            uint8_t* cq = (uint8_t*)uring->cq_ring;
+
+            uring->sq_head = (unsigned int*)(sq + p->sq_off.head);
+            uring->sq_tail = (unsigned int*)(sq + p->sq_off.tail);
+            uring->sq_mask = *(unsigned int*)(sq + p->sq_off.ring_mask);
+            uring->sq_entries = *(unsigned int*)(sq + p->sq_off.ring_entries);
+            uring->sq_array = (unsigned int*)(sq + p->sq_off.array);
+            uring->cq_head = (unsigned int*)(cq + p->cq_off.head);
+            uring->cq_tail = (unsigned int*)(cq + p->cq_off.tail);
+            uring->cq_mask = *(unsigned int*)(cq + p->cq_off.ring_mask);
+            uring->cqes = (struct io_uring_cqe*)(cq + p->cq_off.cqes);
+        }
+    }
+    return ret;
+}
+
+/* Size of a provided buffer: the recvmsg header, the source address,
+ * the control data, and the payload. */
+static size_t picoquic_uring_slot_size(size_t buffer_size)
+{
+    return sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_storage) +
+        PICOQUIC_URING_CMSG_SIZE + buffer_size;
+}
+
+static void picoquic_uring_buffer_return(picoquic_uring_t* uring, uint16_t bid)
+{
+    struct io_uring_buf* buf = &uring->buf_ring->bufs[uring->buf_tail & (PICOQUIC_URING_NB_BUFFERS - 1)];
+    size_t slot_size = picoquic_uring_slot_size(uring->buffer_size);
+
+    buf->addr = (uint64_t)(uintptr_t)(uring->buffers + bid * slot_size);
+    buf->len = (uint32_t)slot_size;
+    buf->bid = bid;
+    uring->buf_tail++;
+    __atomic_store_n(&uring->buf_ring->tail, uring->buf_tail, __ATOMIC_RELEASE);
+}
+
+static int picoquic_uring_setup_buffers(picoquic_uring_t* uring)
+{
+    int ret = 0;
+    struct io_uring_buf_reg reg;
+
+    uring->buf_ring_size = PICOQUIC_URING_NB_BUFFERS * sizeof(struct io_uring_buf);
+    uring->buf_ring = (struct io_uring_buf_ring*)mmap(NULL, uring->buf_ring_size,
+        PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    uring->buffers = (uint8_t*)malloc(PICOQUIC_URING_NB_BUFFERS * picoquic_uring_slot_size(uring->buffer_size));
+
+    if (uring->buf_ring == MAP_FAILED || uring->buffers == NULL) {
+        ret = -1;
+    }
+    else {
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = (uint64_t)(uintptr_t)uring->buf_ring;
+        reg.ring_entries = PICOQUIC_URING_NB_BUFFERS;
+        reg.bgid = PICOQUIC_URING_BGID;
+        if (picoquic_uring_register(uring->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+            DBG_PRINTF("Cannot register the io_uring buffer ring, err=%d", errno);
+            ret = -1;
+        }
+        else {
+            uring->buf_tail = 0;
+            for (uint16_t bid = 0; bid < PICOQUIC_URING_NB_BUFFERS; bid++) {
+                picoquic_uring_buffer_return(uring, bid);
+            }
+        }
+    }
+    return ret;
+}
+
+picoquic_uring_t* picoquic_uring_create(size_t buffer_size, int wake_up_fd)
+{
+    picoquic_uring_t* uring = (picoquic_uring_t*)malloc(sizeof(picoquic_uring_t));
+
+    if (uring != NULL) {
+        struct io_uring_params p;
+        int ret = 0;
+
+        memset(uring, 0, sizeof(picoquic_uring_t));
+        memset(&p, 0, sizeof(p));
+        uring->buffer_size = buffer_size;
+        uring->wake_up_fd = wake_up_fd;
+        for (int i = 0; i < PICOQUIC_PACKET_LOOP_SOCKETS_MAX; i++) {
+            uring->sockets[i].fd = INVALID_SOCKET;
+        }
+        p.flags = IORING_SETUP_CQSIZE;
+        p.cq_entries = PICOQUIC_URING_CQ_ENTRIES;
+        if ((uring->ring_fd = picoquic_uring_setup(PICOQUIC_URING_SQ_ENTRIES, &p)) < 0) {
+            DBG_PRINTF("Cannot create io_uring, err=%d", errno);
+            ret = -1;
+        }
+        else if ((uring->send_err = (int*)malloc(p.sq_entries * sizeof(int))) == NULL ||
+            picoquic_uring_map_rings(uring, &p) != 0 ||
+            picoquic_uring_setup_buffers(uring) != 0) {
+            ret = -1;
+        }
+
+        if (ret != 0) {
+            picoquic_uring_delete(uring);
+            uring = NULL;
+        }
+    }
+    return uring;
+}
+
+/* Submit the queued entries. If `wait_nb` is not zero, also wait for that
+ * many completions, or for the timeout if `ts` is not NULL. */
+static int picoquic_uring_submit(picoquic_uring_t* uring, unsigned int wait_nb, struct __kernel_timespec* ts)
+{
+    int ret = 0;
+    unsigned int flags = 0;
+    struct io_uring_getevents_arg arg;
+
+    if (wait_nb > 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+        if (ts != NULL) {
+            memset(&arg, 0, sizeof(arg));
+            arg.ts = (uint64_t)(uintptr_t)ts;
+            flags |= IORING_ENTER_EXT_ARG;
+        }
+    }
+
+    if (uring->nb_to_submit > 0 || wait_nb > 0) {
+        int nb_submitted = picoquic_uring_enter(uring->ring_fd, uring->nb_to_submit, wait_nb, flags,
+            (ts != NULL) ? &arg : NULL, (ts != NULL) ? sizeof(arg) : 0);
+
+        if (nb_submitted >= 0) {
+            uring->nb_to_submit -= (unsigned int)nb_submitted;
+        }
+        else if (errno != ETIME && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+            DBG_PRINTF("io_uring_enter fails, err=%d", errno);
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+static struct io_uring_sqe* picoquic_uring_get_sqe(picoquic_uring_t* uring)
+{
+    struct io_uring_sqe* sqe = NULL;
+    unsigned int tail = *uring->sq_tail;
+
+    if (tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) >= uring->sq_entries) {
+        /* The queue is full. Push the pending entries to the kernel. */
+        (void)picoquic_uring_submit(uring, 0, NULL);
+    }
+    if (tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) < uring->sq_entries) {
+        unsigned int index = tail & uring->sq_mask;
+
+        sqe = &uring->sqes[index];
+        memset(sqe, 0, sizeof(struct io_uring_sqe));
+        uring->sq_array[index] = index;
+    }
+    return sqe;
+}
+
+static void picoquic_uring_commit_sqe(picoquic_uring_t* uring)
+{
+    __atomic_store_n(uring->sq_tail, *uring->sq_tail + 1, __ATOMIC_RELEASE);
+    uring->nb_to_submit++;
+}
+
+static int picoquic_uring_arm_recv(picoquic_uring_t* uring, int socket_rank)
+{
+    int ret = 0;
+    picoquic_uring_socket_t* sock = &uring->sockets[socket_rank];
+    struct io_uring_sqe* sqe = picoquic_uring_get_sqe(uring);
+
+    if (sqe == NULL) {
+        ret = -1;
+    }
+    else {
+        /* For multishot receive, the name and control lengths set the space
+         * reserved for these fields at the beginning of each buffer. */
+        memset(&sock->recv_hdr, 0, sizeof(struct msghdr));
+        sock->recv_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        sock->recv_hdr.msg_controllen = PICOQUIC_URING_CMSG_SIZE;
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = sock->fd;
+        sqe->addr = (uint64_t)(uintptr_t)&sock->recv_hdr;
+        sqe->len = 1;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = PICOQUIC_URING_BGID;
+        /* Document the socket in the user data, so that completions of a request
+         * posted for a socket that was since replaced can be recognized. */
+        sqe->user_data = PICOQUIC_URING_USER_DATA(PICOQUIC_URING_TAG_RECV,
+            ((uint64_t)(uint32_t)sock->fd << 8) | (uint64_t)socket_rank);
+        picoquic_uring_commit_sqe(uring);
+        sock->is_armed = 1;
+    }
+    return ret;
+}
+
+static int picoquic_uring_arm_wake_up(picoquic_uring_t* uring)
+{
+    int ret = 0;
+    struct io_uring_sqe* sqe = picoquic_uring_get_sqe(uring);
+
+    if (sqe == NULL) {
+        ret = -1;
+    }
+    else {
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = uring->wake_up_fd;
+        sqe->len = IORING_POLL_ADD_MULTI;
+        sqe->poll32_events = POLLIN;
+        sqe->user_data = PICOQUIC_URING_USER_DATA(PICOQUIC_URING_TAG_POLL, 0);
+        picoquic_uring_commit_sqe(uring);
+        uring->wake_up_armed = 1;
+    }
+    return ret;
+}
+
+int picoquic_uring_add_socket(picoquic_uring_t* uring, picoquic_socket_ctx_t* s_ctx, int socket_rank)
+{
+    int ret = -1;
+
+    if (socket_rank >= 0 && socket_rank < PICOQUIC_PACKET_LOOP_SOCKETS_MAX) {
+        if (uring->sockets[socket_rank].fd == s_ctx->fd && uring->sockets[socket_rank].is_armed) {
+            return 0;
+        }
+        uring->sockets[socket_rank].fd = s_ctx->fd;
+        uring->sockets[socket_rank].n_port = s_ctx->n_port;
+        ret = picoquic_uring_arm_recv(uring, socket_rank);
+    }
+    return ret;
+}
+
+static void picoquic_uring_process_cqe(picoquic_uring_t* uring, struct io_uring_cqe* cqe)
+{
+    uint64_t tag = PICOQUIC_URING_TAG(cqe->user_data);
+    int index = PICOQUIC_URING_INDEX(cqe->user_data);
+
+    if (tag == PICOQUIC_URING_TAG_RECV) {
+        int is_stale = (PICOQUIC_URING_FD(cqe->user_data) != (int)uring->sockets[index].fd);
+
+        if (is_stale) {
+            /* Completion for a socket that is not used at this rank anymore */
+            if ((cqe->flags & IORING_CQE_F_BUFFER) != 0) {
+                picoquic_uring_buffer_return(uring, (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT));
+            }
+        }
+        else if ((cqe->flags & IORING_CQE_F_MORE) == 0) {
+            /* The multishot request ended, e.g., because no buffer was available.
+             * It will be posted again before the next wait. */
+            uring->sockets[index].is_armed = 0;
+        }
+        if (is_stale) {
+            /* Buffer already returned */
+        }
+        else if ((cqe->flags & IORING_CQE_F_BUFFER) != 0) {
+            uint16_t bid = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+
+            if (cqe->res > 0 && uring->nb_pending < PICOQUIC_URING_NB_BUFFERS) {
+                picoquic_uring_pending_t* pending = &uring->pending[
+                    (uring->pending_first + uring->nb_pending) % PICOQUIC_URING_NB_BUFFERS];
+                pending->socket_rank = index;
+                pending->bid = bid;
+                pending->length = (uint32_t)cqe->res;
+                uring->nb_pending++;
+            }
+            else {
+                picoquic_uring_buffer_return(uring, bid);
+            }
+        }
+        else if (cqe->res < 0 && cqe->res != -ENOBUFS) {
+            DBG_PRINTF("io_uring receive on socket[%d] fails, err=%d", index, -cqe->res);
+        }
+    }
+    else if (tag == PICOQUIC_URING_TAG_POLL) {
+        if ((cqe->flags & IORING_CQE_F_MORE) == 0) {
+            uring->wake_up_armed = 0;
+        }
+        if (cqe->res > 0) {
+            uring->wake_up_pending = 1;
+        }
+    }
+    else if (tag == PICOQUIC_URING_TAG_SEND) {
+        uring->send_err[index] = (cqe->res < 0) ? -cqe->res : 0;
+        uring->nb_send_outstanding--;
+    }
+}
+
+static void picoquic_uring_reap(picoquic_uring_t* uring)
+{
+    unsigned int head = *uring->cq_head;
+    unsigned int tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        picoquic_uring_process_cqe(uring, &uring->cqes[head & uring->cq_mask]);
+        head++;
+    }
+    __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* Parse a provided buffer filled by a multishot recvmsg into a message description */
+static int picoquic_uring_parse_recv(picoquic_uring_t* uring, picoquic_uring_pending_t* pending,
+    picoquic_uring_msg_t* msg)
+{
+    int ret = 0;
+    uint8_t* slot = uring->buffers + pending->bid * picoquic_uring_slot_size(uring->buffer_size);
+    struct io_uring_recvmsg_out* out = (struct io_uring_recvmsg_out*)slot;
+    uint8_t* name = slot + sizeof(struct io_uring_recvmsg_out);
+    uint8_t* control = name + sizeof(struct sockaddr_storage);
+    uint8_t* payload = control + PICOQUIC_URING_CMSG_SIZE;
+    struct msghdr hdr;
+
+    memset(msg, 0, sizeof(picoquic_uring_msg_t));
+    msg->socket_rank = pending->socket_rank;
+    msg->bid = pending->bid;
+
+    if ((out->flags & MSG_TRUNC) != 0 || out->namelen > sizeof(struct sockaddr_storage) ||
+        pending->length < (uint32_t)(payload - slot)) {
+        ret = -1;
+    }
+    else {
+        memcpy(&msg->addr_from, name, out->namelen);
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.msg_control = control;
+        hdr.msg_controllen = out->controllen;
+        msg->addr_dest.ss_family = AF_UNSPEC;
+        picoquic_socks_cmsg_parse(&hdr, &msg->addr_dest, &msg->dest_if,
+            &msg->received_ecn, &msg->udp_coalesced_size);
+        if (msg->addr_dest.ss_family == AF_INET6) {
+            ((struct sockaddr_in6*)&msg->addr_dest)->sin6_port = uring->sockets[pending->socket_rank].n_port;
+        }
+        else if (msg->addr_dest.ss_family == AF_INET) {
+            ((struct sockaddr_in*)&msg->addr_dest)->sin_port = uring->sockets[pending->socket_rank].n_port;
+        }
+        msg->bytes = payload;
+        msg->length = out->payloadlen;
+    }
+    return ret;
+}
+
+int picoquic_uring_wait(picoquic_uring_t* uring, int nb_sockets, int64_t delta_t,
+    int* is_wake_up_event, picoquic_uring_msg_t** msg, int* nb_msg)
+{
+    int ret = 0;
+    int bytes_recv = 0;
+
+    *is_wake_up_event = 0;
+    *msg = uring->msg;
+    *nb_msg = 0;
+
+    /* The packets delivered in the previous call have been processed. */
+    for (int i = 0; i < uring->nb_msg; i++) {
+        picoquic_uring_buffer_return(uring, uring->msg[i].bid);
+    }
+    uring->nb_msg = 0;
+
+    /* Post again the multishot requests that were terminated */
+    for (int i = 0; ret == 0 && i < PICOQUIC_PACKET_LOOP_SOCKETS_MAX; i++) {
+        if (uring->sockets[i].fd != INVALID_SOCKET && !uring->sockets[i].is_armed) {
+            ret = picoquic_uring_arm_recv(uring, i);
+        }
+    }
+    if (ret == 0 && uring->wake_up_fd >= 0 && !uring->wake_up_armed) {
+        ret = picoquic_uring_arm_wake_up(uring);
+    }
+
+    if (ret == 0) {
+        picoquic_uring_reap(uring);
+        if (uring->nb_pending == 0 && !uring->wake_up_pending && delta_t > 0) {
+            struct __kernel_timespec ts;
+
+            if (delta_t > 10000000) {
+                delta_t = 10000000;
+            }
+            ts.tv_sec = delta_t / 1000000;
+            ts.tv_nsec = (delta_t % 1000000) * 1000;
+            ret = picoquic_uring_submit(uring, 1, &ts);
+        }
+        else {
+            ret = picoquic_uring_submit(uring, 0, NULL);
+        }
+        picoquic_uring_reap(uring);
+    }
+
+    if (ret != 0) {
+        bytes_recv = -1;
+    }
+    else if (uring->wake_up_pending) {
+        /* Something was written on the "wakeup" pipe. Read it. Packets
+         * already received will be delivered at the next call. */
+        uint8_t eventbuf[8];
+        int pipe_recv;
+
+        uring->wake_up_pending = 0;
+        if ((pipe_recv = (int)read(uring->wake_up_fd, eventbuf, sizeof(eventbuf))) <= 0 && errno != EAGAIN) {
+            DBG_PRINTF("Error: read pipe returns %d\n", (pipe_recv == 0) ? EPIPE : errno);
+            bytes_recv = -1;
+        }
+        else {
+            *is_wake_up_event = 1;
+        }
+    }
+    else {
+        while (uring->nb_pending > 0 && uring->nb_msg < PICOQUIC_PACKET_LOOP_RECV_BATCH_MAX) {
+            picoquic_uring_pending_t* pending = &uring->pending[uring->pending_first];
+            picoquic_uring_msg_t* next_msg = &uring->msg[uring->nb_msg];
+
+            uring->pending_first = (uring->pending_first + 1) % PICOQUIC_URING_NB_BUFFERS;
+            uring->nb_pending--;
+            if (pending->socket_rank >= nb_sockets || picoquic_uring_parse_recv(uring, pending, next_msg) != 0) {
+                /* Socket not in use anymore, or malformed message: drop it. */
+                picoquic_uring_buffer_return(uring, pending->bid);
+            }
+            else {
+                bytes_recv += (int)next_msg->length;
+                uring->nb_msg++;
+            }
+        }
+        *nb_msg = uring->nb_msg;
+    }
+
+    return bytes_recv;
+}
+
+int picoquic_uring_send_batch(picoquic_uring_t* uring, SOCKET_TYPE fd,
+    struct mmsghdr* mmsg, int nb_msg, int* sock_err)
+{
+    int ret = 0;
+    int nb_queued = 0;
+
+    if (nb_msg > (int)uring->sq_entries) {
+        nb_msg = (int)uring->sq_entries;
+    }
+    uring->nb_send_outstanding = 0;
+    while (nb_queued < nb_msg) {
+        struct io_uring_sqe* sqe = picoquic_uring_get_sqe(uring);
+
+        if (sqe == NULL) {
+            /* The remaining messages will be sent by the caller */
+            break;
+        }
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)(uintptr_t)&mmsg[nb_queued].msg_hdr;
+        sqe->len = 1;
+        sqe->user_data = PICOQUIC_URING_USER_DATA(PICOQUIC_URING_TAG_SEND, nb_queued);
+        picoquic_uring_commit_sqe(uring);
+        uring->send_err[nb_queued] = 0;
+        uring->nb_send_outstanding++;
+        nb_queued++;
+    }
+
+    /* The messages and their buffers belong to the caller, and will be reused
+     * after the call. Wait until the kernel has processed all of them. UDP
+     * sends normally complete inline, so this is typically one system call. */
+    ret = picoquic_uring_submit(uring, 0, NULL);
+    picoquic_uring_reap(uring);
+    while (ret == 0 && uring->nb_send_outstanding > 0) {
+        ret = picoquic_uring_submit(uring, 1, NULL);
+        picoquic_uring_reap(uring);
+    }
+
+    if (ret != 0) {
+        /* The last entries in the submission queue were never seen by the
+         * kernel. Withdraw them, so they are not submitted later with stale
+         * buffers, and let the caller send these messages. */
+        unsigned int nb_withdrawn = (uring->nb_to_submit < (unsigned int)nb_queued) ?
+            uring->nb_to_submit : (unsigned int)nb_queued;
+
+        __atomic_store_n(uring->sq_tail, *uring->sq_tail - nb_withdrawn, __ATOMIC_RELEASE);
+        uring->nb_to_submit -= nb_withdrawn;
+        nb_queued -= (int)nb_withdrawn;
+    }
+
+    for (int i = 0; i < nb_queued; i++) {
+        sock_err[i] = uring->send_err[i];
+    }
+
+    return nb_queued;
+}
+#endif
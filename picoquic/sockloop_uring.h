@@ -0,0 +1,103 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SOCKLOOP_URING_H
+#define SOCKLOOP_URING_H
+
+/* io_uring backend for the packet loop.
+ *
+ * This is used by the socket loop on Linux when the parameter `use_io_uring`
+ * is set and the kernel supports the required features. The backend keeps one
+ * multishot receive posted per socket, with the packets landing in a ring of
+ * provided buffers, polls the wake up pipe through the ring, and waits for
+ * completions with a timeout set to the next wake time of the QUIC context.
+ * Sends are queued as submission entries and submitted with a single system
+ * call per batch. The code uses the kernel interface directly, so that there
+ * is no dependency on liburing.
+ */
+
+#include "picoquic_packet_loop.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_ENTER_EXT_ARG) && defined(IORING_POLL_ADD_MULTI)
+#define PICOQUIC_PACKET_LOOP_USE_IO_URING
+#endif
+#endif
+#endif
+
+#ifdef PICOQUIC_PACKET_LOOP_USE_IO_URING
+#include <sys/socket.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PICOQUIC_URING_NB_BUFFERS 128
+
+struct mmsghdr; /* Only defined if _GNU_SOURCE is set */
+
+typedef struct st_picoquic_uring_t picoquic_uring_t;
+
+/* Description of a packet received through the ring. The bytes point into
+ * a provided buffer, which remains valid until the next call to
+ * picoquic_uring_wait. */
+typedef struct st_picoquic_uring_msg_t {
+    struct sockaddr_storage addr_from;
+    struct sockaddr_storage addr_dest;
+    int dest_if;
+    unsigned char received_ecn;
+    size_t udp_coalesced_size;
+    uint8_t* bytes;
+    size_t length;
+    int socket_rank;
+    uint16_t bid;
+} picoquic_uring_msg_t;
+
+/* Check once whether the kernel supports the io_uring features used by the loop */
+int picoquic_uring_is_available(void);
+
+picoquic_uring_t* picoquic_uring_create(size_t buffer_size, int wake_up_fd);
+void picoquic_uring_delete(picoquic_uring_t* uring);
+
+/* Post a multishot receive for the socket at rank `socket_rank` */
+int picoquic_uring_add_socket(picoquic_uring_t* uring, picoquic_socket_ctx_t* s_ctx, int socket_rank);
+
+/* Wait until packets are received, the wake up pipe is signalled, or the
+ * delay expires. Packets received on sockets of rank larger than or equal
+ * to `nb_sockets` are dropped. Returns the number of bytes received, 0 on
+ * timeout or wake up, -1 on error. */
+int picoquic_uring_wait(picoquic_uring_t* uring, int nb_sockets, int64_t delta_t,
+    int* is_wake_up_event, picoquic_uring_msg_t** msg, int* nb_msg);
+
+/* Submit the formatted messages on the socket, and wait for the send
+ * completions. Returns the number of messages handed to the kernel, which
+ * is less than nb_msg if the ring itself failed or is too small. On return,
+ * sock_err[i] is zero if message i was sent, or the error code otherwise. */
+int picoquic_uring_send_batch(picoquic_uring_t* uring, SOCKET_TYPE fd,
+    struct mmsghdr* mmsg, int nb_msg, int* sock_err);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* PICOQUIC_PACKET_LOOP_USE_IO_URING */
+#endif /* SOCKLOOP_URING_H */
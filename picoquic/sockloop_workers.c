@@ -0,0 +1,358 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Multi-worker server, see picoquic_workers.h.
+ *
+ * Each worker runs a regular packet loop, with two additions: the sockets
+ * are opened with SO_REUSEPORT, and the loop parameters specify a steering
+ * function that is called for each incoming packet. If the packet belongs
+ * to a different worker, the steering function copies it in the handoff
+ * queue of that worker and wakes it up. The loop callback of each worker
+ * is wrapped, so that the handoff queue is drained when the worker wakes
+ * up, before calling the application callback.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "picoquic_utils.h"
+#include "picoquic_lb.h"
+#include "picoquic_workers.h"
+
+#ifdef _WINDOWS
+#define PICOQUIC_WORKERS_SLEEP_MS(x) Sleep(x)
+#else
+#include <unistd.h>
+#define PICOQUIC_WORKERS_SLEEP_MS(x) usleep((x)*1000)
+#endif
+
+typedef struct st_picoquic_worker_t {
+    struct st_picoquic_workers_t* workers;
+    int rank;
+    picoquic_quic_t* quic;
+    picoquic_packet_loop_param_t param;
+    picoquic_network_thread_ctx_t* thread_ctx;
+    picoquic_mpsc_queue_t* handoff_queue;
+    picoquic_packet_loop_cb_fn loop_callback;
+    void* loop_callback_ctx;
+    volatile int32_t is_accepting; /* Set while other workers may forward packets to this one */
+    picoquic_workers_stats_t stats; /* Updated with atomic operations, read by other threads */
+} picoquic_worker_t;
+
+struct st_picoquic_workers_t {
+    int nb_workers;
+    picoquic_worker_t worker[PICOQUIC_WORKERS_MAX];
+};
+
+int picoquic_workers_packet_rank(const uint8_t* bytes, size_t length,
+    uint8_t short_cid_length, size_t server_id_offset, int nb_workers)
+{
+    int rank = -1;
+
+    if (length > 0 && nb_workers > 0) {
+        if ((bytes[0] & 0x80) == 0) {
+            /* Short header: the CID starts at byte 1, with the configured length */
+            if (server_id_offset < short_cid_length && 1 + server_id_offset < length) {
+                rank = bytes[1 + server_id_offset] % nb_workers;
+            }
+        }
+        else if (length > 6) {
+            /* Long header: the CID length is encoded in byte 5, the CID follows */
+            size_t dcid_length = bytes[5];
+
+            if (server_id_offset < dcid_length && 6 + server_id_offset < length) {
+                rank = bytes[6 + server_id_offset] % nb_workers;
+            }
+        }
+    }
+
+    return rank;
+}
+
+int picoquic_workers_configure_cid(picoquic_quic_t* quic, int rank)
+{
+    picoquic_load_balancer_config_t lb_config;
+    uint8_t cid_length = picoquic_get_local_cid_length(quic);
+
+    memset(&lb_config, 0, sizeof(lb_config));
+    lb_config.method = picoquic_load_balancer_cid_clear;
+    lb_config.server_id_length = 1;
+    lb_config.connection_id_length = (cid_length > PICOQUIC_WORKERS_CID_SERVER_ID_OFFSET + 1) ? cid_length : 8;
+    lb_config.server_id64 = (uint64_t)rank;
+
+    return picoquic_lb_compat_cid_config(quic, &lb_config);
+}
+
+int picoquic_handoff_packet_push(picoquic_mpsc_queue_t* queue, const uint8_t* bytes, size_t length,
+    struct sockaddr* addr_from, struct sockaddr* addr_to, int if_index_to, unsigned char received_ecn)
+{
+    int ret = -1;
+    uint64_t ticket;
+    picoquic_handoff_packet_t* packet;
+
+    if (length <= PICOQUIC_MAX_PACKET_SIZE &&
+        (packet = (picoquic_handoff_packet_t*)picoquic_mpsc_queue_reserve(queue, &ticket)) != NULL) {
+        picoquic_store_addr(&packet->addr_from, addr_from);
+        picoquic_store_addr(&packet->addr_to, addr_to);
+        packet->if_index_to = if_index_to;
+        packet->received_ecn = received_ecn;
+        packet->length = length;
+        memcpy(packet->bytes, bytes, length);
+        picoquic_mpsc_queue_publish(queue, ticket);
+        ret = 0;
+    }
+
+    return ret;
+}
+
+int picoquic_handoff_packet_drain(picoquic_mpsc_queue_t* queue, picoquic_quic_t* quic,
+    uint64_t current_time, size_t* nb_packets)
+{
+    int ret = 0;
+    picoquic_handoff_packet_t* packet;
+    picoquic_cnx_t* last_cnx = NULL;
+
+    while (ret == 0 && (packet = (picoquic_handoff_packet_t*)picoquic_mpsc_queue_peek(queue)) != NULL) {
+        ret = picoquic_incoming_packet_ex(quic, packet->bytes, packet->length,
+            (struct sockaddr*)&packet->addr_from, (struct sockaddr*)&packet->addr_to,
+            packet->if_index_to, packet->received_ecn, &last_cnx, current_time);
+        picoquic_mpsc_queue_release(queue);
+        *nb_packets += 1;
+    }
+
+    return ret;
+}
+
+/* Steering function, called by the packet loop of a worker for each
+ * incoming packet. Returns 1 if the packet was forwarded or dropped,
+ * 0 if the packet shall be processed locally.
+ */
+static int picoquic_worker_steer(void* steer_ctx, uint8_t* bytes, size_t length,
+    struct sockaddr* addr_from, struct sockaddr* addr_to, int if_index_to, unsigned char received_ecn)
+{
+    int consumed = 0;
+    picoquic_worker_t* worker = (picoquic_worker_t*)steer_ctx;
+    picoquic_workers_t* workers = worker->workers;
+    int rank = picoquic_workers_packet_rank(bytes, length, picoquic_get_local_cid_length(worker->quic),
+        PICOQUIC_WORKERS_CID_SERVER_ID_OFFSET, workers->nb_workers);
+
+    if (rank >= 0 && rank != worker->rank) {
+        picoquic_worker_t* target = &workers->worker[rank];
+
+        consumed = 1;
+        /* If the target is not ready, drop the packet. Processing it locally
+         * would create connection state on the wrong worker. */
+        if (!picoquic_atomic_flag_is_set(&target->is_accepting) ||
+            picoquic_handoff_packet_push(target->handoff_queue, bytes, length, addr_from, addr_to,
+                if_index_to, received_ecn) != 0) {
+            picoquic_atomic_add(&worker->stats.nb_packets_dropped, 1);
+        }
+        else {
+            picoquic_atomic_add(&worker->stats.nb_packets_forwarded, 1);
+            (void)picoquic_wake_up_network_thread(target->thread_ctx);
+        }
+    }
+
+    return consumed;
+}
+
+/* Loop callback of a worker. Drain the handoff queue when the thread is
+ * woken up, then pass the event to the application callback.
+ */
+static int picoquic_worker_loop_cb(picoquic_quic_t* quic, picoquic_packet_loop_cb_enum cb_mode,
+    void* callback_ctx, void* callback_arg)
+{
+    int ret = 0;
+    picoquic_worker_t* worker = (picoquic_worker_t*)callback_ctx;
+
+    if (cb_mode == picoquic_packet_loop_wake_up) {
+        size_t nb_packets = 0;
+        ret = picoquic_handoff_packet_drain(worker->handoff_queue, quic, picoquic_get_quic_time(quic), &nb_packets);
+        picoquic_atomic_add(&worker->stats.nb_packets_handed_off, nb_packets);
+    }
+    if (ret == 0 && worker->loop_callback != NULL) {
+        ret = worker->loop_callback(quic, cb_mode, worker->loop_callback_ctx, callback_arg);
+    }
+
+    return ret;
+}
+
+static void picoquic_workers_stop_threads(picoquic_workers_t* workers)
+{
+    /* Stop steering packets to other workers, then ask all threads to close
+     * and join all of them before deleting any thread context, so that no
+     * thread can attempt to wake up a thread whose context was deleted. */
+    for (int i = 0; i < workers->nb_workers; i++) {
+        picoquic_atomic_flag_clear(&workers->worker[i].is_accepting);
+    }
+    for (int i = 0; i < workers->nb_workers; i++) {
+        if (workers->worker[i].thread_ctx != NULL) {
+            workers->worker[i].thread_ctx->thread_should_close = 1;
+            (void)picoquic_wake_up_network_thread(workers->worker[i].thread_ctx);
+        }
+    }
+    for (int i = 0; i < workers->nb_workers; i++) {
+        picoquic_network_thread_ctx_t* thread_ctx = workers->worker[i].thread_ctx;
+
+        if (thread_ctx != NULL && thread_ctx->is_threaded) {
+            thread_ctx->thread_delete_fn((void**)&thread_ctx->pthread);
+            /* The thread is joined, picoquic_delete_network_thread shall not join it again */
+            thread_ctx->is_threaded = 0;
+        }
+    }
+}
+
+void picoquic_delete_workers(picoquic_workers_t* workers)
+{
+    picoquic_workers_stop_threads(workers);
+
+    for (int i = 0; i < workers->nb_workers; i++) {
+        picoquic_worker_t* worker = &workers->worker[i];
+
+        if (worker->thread_ctx != NULL) {
+            picoquic_delete_network_thread(worker->thread_ctx);
+            worker->thread_ctx = NULL;
+        }
+        if (worker->handoff_queue != NULL) {
+            picoquic_mpsc_queue_delete(worker->handoff_queue);
+            worker->handoff_queue = NULL;
+        }
+        if (worker->quic != NULL) {
+            picoquic_lb_compat_cid_config_free(worker->quic);
+        }
+    }
+    free(workers);
+}
+
+picoquic_workers_t* picoquic_start_workers(int nb_workers, picoquic_quic_t** quic,
+    picoquic_packet_loop_param_t* param,
+    picoquic_custom_thread_create_fn thread_create_fn,
+    picoquic_custom_thread_delete_fn thread_delete_fn,
+    picoquic_custom_thread_setname_fn thread_setname_fn,
+    char const* thread_name,
+    picoquic_packet_loop_cb_fn loop_callback,
+    void** loop_callback_ctx,
+    int* ret)
+{
+    picoquic_workers_t* workers = NULL;
+
+    *ret = 0;
+    if (nb_workers <= 0 || nb_workers > PICOQUIC_WORKERS_MAX || param->local_port == 0) {
+        /* The workers must share a well known port */
+        *ret = PICOQUIC_ERROR_UNEXPECTED_ERROR;
+    }
+    else if ((workers = (picoquic_workers_t*)malloc(sizeof(picoquic_workers_t))) == NULL) {
+        *ret = PICOQUIC_ERROR_MEMORY;
+    }
+    else {
+        memset(workers, 0, sizeof(picoquic_workers_t));
+        workers->nb_workers = nb_workers;
+
+        /* Configure all the workers before starting any thread, so that the
+         * steering function can find the handoff queue of each worker. */
+        for (int i = 0; *ret == 0 && i < nb_workers; i++) {
+            picoquic_worker_t* worker = &workers->worker[i];
+
+            worker->workers = workers;
+            worker->rank = i;
+            worker->quic = quic[i];
+            worker->loop_callback = loop_callback;
+            worker->loop_callback_ctx = (loop_callback_ctx == NULL) ? NULL : loop_callback_ctx[i];
+            worker->param = *param;
+            worker->param.reuse_port = 1;
+            worker->param.cid_steering_nb_workers = nb_workers;
+            worker->param.cid_steering_offset = PICOQUIC_WORKERS_CID_SERVER_ID_OFFSET;
+            worker->param.incoming_steer_fn = picoquic_worker_steer;
+            worker->param.incoming_steer_ctx = worker;
+            if ((worker->handoff_queue = picoquic_mpsc_queue_create(PICOQUIC_WORKERS_HANDOFF_QUEUE_SIZE,
+                sizeof(picoquic_handoff_packet_t))) == NULL) {
+                *ret = PICOQUIC_ERROR_MEMORY;
+            }
+            else if (picoquic_workers_configure_cid(quic[i], i) != 0) {
+                *ret = PICOQUIC_ERROR_UNEXPECTED_ERROR;
+            }
+        }
+        for (int i = 0; *ret == 0 && i < nb_workers; i++) {
+            picoquic_worker_t* worker = &workers->worker[i];
+
+            worker->thread_ctx = picoquic_start_custom_network_thread(worker->quic, &worker->param,
+                thread_create_fn, thread_delete_fn, thread_setname_fn, thread_name,
+                picoquic_worker_loop_cb, worker, ret);
+            if (worker->thread_ctx == NULL) {
+                if (*ret == 0) {
+                    *ret = PICOQUIC_ERROR_UNEXPECTED_ERROR;
+                }
+            }
+            else {
+                /* The kernel indexes the sockets of a reuseport group in the order in which
+                 * they are bound. Wait until the sockets of this worker are open before
+                 * starting the next one, so that the index matches the rank. */
+                for (int t = 0; t < 2000 && !worker->thread_ctx->thread_is_ready; t++) {
+                    PICOQUIC_WORKERS_SLEEP_MS(1);
+                }
+                if (!worker->thread_ctx->thread_is_ready) {
+                    *ret = PICOQUIC_ERROR_UNEXPECTED_ERROR;
+                }
+                else {
+                    (void)picoquic_atomic_flag_set(&worker->is_accepting);
+                }
+            }
+        }
+        if (*ret != 0) {
+            picoquic_delete_workers(workers);
+            workers = NULL;
+        }
+    }
+
+    return workers;
+}
+
+int picoquic_workers_nb_ready(picoquic_workers_t* workers)
+{
+    int nb_ready = 0;
+
+    for (int i = 0; i < workers->nb_workers; i++) {
+        if (workers->worker[i].thread_ctx != NULL && workers->worker[i].thread_ctx->thread_is_ready) {
+            nb_ready++;
+        }
+    }
+    return nb_ready;
+}
+
+picoquic_network_thread_ctx_t* picoquic_workers_get_thread(picoquic_workers_t* workers, int rank)
+{
+    return (rank >= 0 && rank < workers->nb_workers) ? workers->worker[rank].thread_ctx : NULL;
+}
+
+int picoquic_workers_get_stats(picoquic_workers_t* workers, int rank, picoquic_workers_stats_t* stats)
+{
+    int ret = -1;
+
+    if (rank >= 0 && rank < workers->nb_workers) {
+        picoquic_workers_stats_t* worker_stats = &workers->worker[rank].stats;
+
+        stats->nb_packets_forwarded = picoquic_atomic_read(&worker_stats->nb_packets_forwarded);
+        stats->nb_packets_handed_off = picoquic_atomic_read(&worker_stats->nb_packets_handed_off);
+        stats->nb_packets_dropped = picoquic_atomic_read(&worker_stats->nb_packets_dropped);
+        ret = 0;
+    }
+    return ret;
+}
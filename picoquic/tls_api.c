@@ -2151,6 +2151,7 @@ static int picoquic_add_to_tls_stream(picoquic_cnx_t* cnx, const uint8_t* data,
                 stream_data->length = length;
                 stream_data->offset = 0;
                 stream_data->next_stream_data = NULL;
+                stream_data->release_fn = NULL;
 
                 while (next != NULL) {
                     pprevious = &next->next_stream_data;
@@ -2158,6 +2159,7 @@ static int picoquic_add_to_tls_stream(picoquic_cnx_t* cnx, const uint8_t* data,
                 }
 
                 *pprevious = stream_data;
+                picoquic_memory_charge(cnx, picoquic_memory_class_stream_send, length);
             }
         }
     }
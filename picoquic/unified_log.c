@@ -263,4 +263,18 @@ void picoquic_log_cc_dump(picoquic_cnx_t* cnx, uint64_t current_time)
             cnx->quic->bin_log_fns->log_cc_dump(cnx, current_time);
         }
     }
-}
\ No newline at end of file
+}
+
+/* log the departure time of a packet, if pacing is offloaded */
+void picoquic_log_packet_departure(picoquic_cnx_t* cnx, picoquic_path_t* path_x,
+    uint64_t sequence_number, uint64_t departure_time, uint64_t current_time)
+{
+    if (picoquic_cnx_is_still_logging(cnx)) {
+        if (cnx->quic->F_log != NULL) {
+            cnx->quic->text_log_fns->log_packet_departure(cnx, path_x, sequence_number, departure_time, current_time);
+        }
+        if (cnx->f_binlog != NULL) {
+            cnx->quic->bin_log_fns->log_packet_departure(cnx, path_x, sequence_number, departure_time, current_time);
+        }
+    }
+}
@@ -1257,6 +1257,182 @@ int picoquic_wait_for_event(picoquic_event_t* event, uint64_t microsec_wait)
     return ret;
 }
 
+/* Bounded lock-free queue, multiple producers and single consumer.
+ * The queue is an array of cells, each with a sequence number, following
+ * the design by Dmitry Vyukov. A producer claims the next position by
+ * compare-and-swap on the enqueue position, writes the cell content, then
+ * sets the cell sequence to signal that the cell is full. The consumer
+ * checks the sequence of the next cell, reads the content, and sets the
+ * sequence to mark the cell as available for the next round.
+ */
+#ifdef _WINDOWS
+#define picoquic_atomic_load(p) ((uint64_t)InterlockedCompareExchange64((volatile LONG64*)(p), 0, 0))
+#define picoquic_atomic_store(p, v) ((void)InterlockedExchange64((volatile LONG64*)(p), (LONG64)(v)))
+#define picoquic_atomic_cas(p, expected, desired) \
+    (InterlockedCompareExchange64((volatile LONG64*)(p), (LONG64)(desired), (LONG64)(expected)) == (LONG64)(expected))
+#else
+#define picoquic_atomic_load(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define picoquic_atomic_store(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define picoquic_atomic_cas(p, expected, desired) \
+    __atomic_compare_exchange_n((p), &(expected), (desired), 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)
+#endif
+
+typedef struct st_picoquic_mpsc_cell_t {
+    volatile uint64_t sequence;
+} picoquic_mpsc_cell_t;
+
+struct st_picoquic_mpsc_queue_t {
+    volatile uint64_t enqueue_pos;
+    uint8_t padding[56]; /* keep producer and consumer positions on different cache lines */
+    uint64_t dequeue_pos;
+    size_t nb_cells;
+    size_t cell_size;
+    uint8_t* cells;
+};
+
+static picoquic_mpsc_cell_t* picoquic_mpsc_queue_cell(picoquic_mpsc_queue_t* queue, uint64_t pos)
+{
+    return (picoquic_mpsc_cell_t*)(queue->cells + (size_t)(pos & (queue->nb_cells - 1)) * queue->cell_size);
+}
+
+picoquic_mpsc_queue_t* picoquic_mpsc_queue_create(size_t nb_cells, size_t data_size)
+{
+    picoquic_mpsc_queue_t* queue = NULL;
+    size_t actual_cells = 1;
+
+    /* Round the number of cells to a power of 2 */
+    while (actual_cells < nb_cells) {
+        actual_cells <<= 1;
+    }
+    queue = (picoquic_mpsc_queue_t*)malloc(sizeof(picoquic_mpsc_queue_t));
+    if (queue != NULL) {
+        memset(queue, 0, sizeof(picoquic_mpsc_queue_t));
+        queue->nb_cells = actual_cells;
+        /* Cell header followed by data, aligned on 8 bytes */
+        queue->cell_size = (sizeof(picoquic_mpsc_cell_t) + data_size + 7) & ~((size_t)7);
+        queue->cells = (uint8_t*)malloc(queue->nb_cells * queue->cell_size);
+        if (queue->cells == NULL) {
+            free(queue);
+            queue = NULL;
+        }
+        else {
+            for (uint64_t i = 0; i < queue->nb_cells; i++) {
+                picoquic_mpsc_queue_cell(queue, i)->sequence = i;
+            }
+        }
+    }
+    return queue;
+}
+
+void picoquic_mpsc_queue_delete(picoquic_mpsc_queue_t* queue)
+{
+    if (queue != NULL) {
+        if (queue->cells != NULL) {
+            free(queue->cells);
+        }
+        free(queue);
+    }
+}
+
+void* picoquic_mpsc_queue_reserve(picoquic_mpsc_queue_t* queue, uint64_t* ticket)
+{
+    void* data = NULL;
+    uint64_t pos = picoquic_atomic_load(&queue->enqueue_pos);
+
+    while (data == NULL) {
+        picoquic_mpsc_cell_t* cell = picoquic_mpsc_queue_cell(queue, pos);
+        int64_t dif = (int64_t)(picoquic_atomic_load(&cell->sequence) - pos);
+
+        if (dif == 0) {
+            if (picoquic_atomic_cas(&queue->enqueue_pos, pos, pos + 1)) {
+                data = (void*)(cell + 1);
+                *ticket = pos;
+            }
+            else {
+                /* Another producer claimed that position */
+                pos = picoquic_atomic_load(&queue->enqueue_pos);
+            }
+        }
+        else if (dif < 0) {
+            /* The queue is full */
+            break;
+        }
+        else {
+            pos = picoquic_atomic_load(&queue->enqueue_pos);
+        }
+    }
+    return data;
+}
+
+void picoquic_mpsc_queue_publish(picoquic_mpsc_queue_t* queue, uint64_t ticket)
+{
+    picoquic_atomic_store(&picoquic_mpsc_queue_cell(queue, ticket)->sequence, ticket + 1);
+}
+
+void* picoquic_mpsc_queue_peek(picoquic_mpsc_queue_t* queue)
+{
+    void* data = NULL;
+    picoquic_mpsc_cell_t* cell = picoquic_mpsc_queue_cell(queue, queue->dequeue_pos);
+
+    if (picoquic_atomic_load(&cell->sequence) == queue->dequeue_pos + 1) {
+        data = (void*)(cell + 1);
+    }
+    return data;
+}
+
+void picoquic_mpsc_queue_release(picoquic_mpsc_queue_t* queue)
+{
+    picoquic_mpsc_cell_t* cell = picoquic_mpsc_queue_cell(queue, queue->dequeue_pos);
+
+    picoquic_atomic_store(&cell->sequence, queue->dequeue_pos + queue->nb_cells);
+    queue->dequeue_pos++;
+}
+
+/* Atomic flag, used for example to avoid sending redundant wake up signals.
+ * Setting the flag returns its previous value. */
+int picoquic_atomic_flag_set(volatile int32_t* flag)
+{
+#ifdef _WINDOWS
+    return (int)InterlockedExchange((volatile LONG*)flag, 1);
+#else
+    return (int)__atomic_exchange_n(flag, 1, __ATOMIC_ACQ_REL);
+#endif
+}
+
+void picoquic_atomic_flag_clear(volatile int32_t* flag)
+{
+#ifdef _WINDOWS
+    (void)InterlockedExchange((volatile LONG*)flag, 0);
+#else
+    __atomic_store_n(flag, 0, __ATOMIC_SEQ_CST);
+    /* Reads that follow the clear shall not be performed before it */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+int picoquic_atomic_flag_is_set(volatile int32_t* flag)
+{
+#ifdef _WINDOWS
+    return (int)InterlockedCompareExchange((volatile LONG*)flag, 0, 0);
+#else
+    return (int)__atomic_load_n(flag, __ATOMIC_ACQUIRE);
+#endif
+}
+
+void picoquic_atomic_add(volatile uint64_t* counter, uint64_t delta)
+{
+#ifdef _WINDOWS
+    (void)InterlockedExchangeAdd64((volatile LONG64*)counter, (LONG64)delta);
+#else
+    (void)__atomic_add_fetch(counter, delta, __ATOMIC_RELAXED);
+#endif
+}
+
+uint64_t picoquic_atomic_read(volatile uint64_t* counter)
+{
+    return picoquic_atomic_load(counter);
+}
+
 
 /* Pseudo random generation suitable for tests. Guaranties that the
 * same seed will produce the same sequence, allows for specific
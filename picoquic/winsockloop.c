@@ -441,7 +441,7 @@ int picoquic_packet_loop_win(picoquic_quic_t* quic,
 
     /* Create a list of contexts for sending packets */
     if (ret == 0) {
-        size_t send_buffer_size = PICOQUIC_MAX_PACKET_SIZE;
+        size_t send_buffer_size = picoquic_get_max_packet_size(quic);
         if (sock_ctx[0]->supports_udp_send_coalesced) {
             send_buffer_size *= 10;
         }
@@ -503,6 +503,7 @@ int picoquic_packet_loop_win(picoquic_quic_t* quic,
                 else
                 {
                     size_t recv_bytes = 0;
+                    size_t nb_packets_received = 0;
                     if (sock_ctx[socket_rank]->bytes_recv > 0) {
                         /* Document incoming port. By default, there is just one port in use.
                          * But we also have special code for supporting migration tests, which requires
@@ -541,8 +542,9 @@ int picoquic_packet_loop_win(picoquic_quic_t* quic,
                                     recv_length, (struct sockaddr*)&sock_ctx[socket_rank]->addr_from,
                                     (struct sockaddr*)&sock_ctx[socket_rank]->addr_dest, sock_ctx[socket_rank]->dest_if,
                                     sock_ctx[socket_rank]->received_ecn, &last_cnx, current_time);
-                                recv_bytes += recv_length;
+                                nb_packets_received++;
                             }
+                            recv_bytes += recv_length;
                         }
                     }
 
@@ -558,7 +560,7 @@ int picoquic_packet_loop_win(picoquic_quic_t* quic,
                     }
 
                     if (ret == 0 && loop_callback != NULL) {
-                        ret = loop_callback(quic, picoquic_packet_loop_after_receive, loop_callback_ctx, &recv_bytes);
+                        ret = loop_callback(quic, picoquic_packet_loop_after_receive, loop_callback_ctx, &nb_packets_received);
                     }
 
 
@@ -54,6 +54,8 @@ static const picoquic_test_def_t test_table[] = {
     { "picohash_embedded", picohash_embedded_test },
     { "picohash_bytes", picohash_bytes_test },
     { "siphash", siphash_test },
+    { "picotable", picotable_test },
+    { "cnx_table_bench", cnx_table_bench_test },
     { "picolog_basic", picolog_basic_test },
     { "bytestream", bytestream_test },
     { "sockloop_basic", sockloop_basic_test },
@@ -64,7 +66,29 @@ static const picoquic_test_def_t test_table[] = {
     { "sockloop_nat", sockloop_nat_test },
     { "sockloop_thread", sockloop_thread_test },
     { "sockloop_thread_name", sockloop_thread_name_test },
+    { "sockloop_recvmmsg", sockloop_recvmmsg_test },
+    { "sockloop_gro", sockloop_gro_test },
+    { "sockloop_cid_steering", sockloop_cid_steering_test },
+    { "sockloop_workers", sockloop_workers_test },
+    { "sockloop_commands", sockloop_commands_test },
+    { "sockloop_wake_up", sockloop_wake_up_test },
+    { "sockloop_command_add_to_stream", sockloop_command_add_to_stream_test },
+    { "sockloop_command_mark_active", sockloop_command_mark_active_test },
+    { "sockloop_command_datagram", sockloop_command_datagram_test },
+    { "sockloop_command_close", sockloop_command_close_test },
+    { "sockloop_sendmmsg", sockloop_sendmmsg_test },
+    { "sockloop_txtime", sockloop_txtime_test },
+    { "sockloop_busy_poll", sockloop_busy_poll_test },
+    { "sockloop_uring", sockloop_uring_test },
     { "splay", splay_test },
+    { "picowheel", picowheel_test },
+    { "wake_wheel_bench", wake_wheel_bench_test },
+    { "slab", slab_test },
+    { "arena", arena_test },
+    { "stream_churn", stream_churn_test },
+    { "huge_page_pool", huge_page_pool_test },
+    { "packet_pool", packet_pool_test },
+    { "data_node_reorder", data_node_reorder_test },
     { "create_cnx", create_cnx_test },
     { "create_quic", create_quic_test },
     { "parseheader", parseheadertest },
@@ -87,15 +111,19 @@ static const picoquic_test_def_t test_table[] = {
     { "StreamZeroFrame", StreamZeroFrameTest },
     { "stream_splay", stream_splay_test },
     { "stream_output", stream_output_test },
+    { "stream_ready_queue", stream_ready_queue_test },
+    { "stream_weighted", stream_weighted_test },
     { "stream_retransmit_copy", test_copy_for_retransmit },
     { "dataqueue_copy", dataqueue_copy_test },
     { "dataqueue_packet", dataqueue_packet_test },
     { "stateless_blowback", test_stateless_blowback },
+    { "stateless_reset_jumbo", stateless_reset_jumbo_test },
     { "ack_send", sendacktest },
     { "ack_loop", sendack_loop_test },
     { "ack_range", ackrange_test },
     { "ack_disorder", ack_disorder_test },
     { "ack_horizon", ack_horizon_test },
+    { "sack_ring_bench", sack_ring_bench_test },
     { "ack_of_ack", ack_of_ack_test },
     { "ackfrq_basic", ackfrq_basic_test },
     { "ackfrq_short", ackfrq_short_test },
@@ -117,6 +145,7 @@ static const picoquic_test_def_t test_table[] = {
     { "new_cnxid", new_cnxid_test },
     { "pacing", pacing_test },
     { "pacing_repeat", pacing_repeat_test },
+    { "pacing_offload", pacing_offload_test },
 #if 0
     /* The TLS API connect test is only useful when debugging issues step by step */
     { "tls_api_connect", tls_api_connect_test },
@@ -208,6 +237,7 @@ static const picoquic_test_def_t test_table[] = {
     { "mtu_delayed", mtu_delayed_test },
     { "mtu_required", mtu_required_test },
     { "mtu_max", mtu_max_test },
+    { "mtu_jumbo", mtu_jumbo_test },
     { "mtu_drop_bbr", mtu_drop_bbr_test },
     { "mtu_drop_cubic", mtu_drop_cubic_test },
     { "mtu_drop_dcubic", mtu_drop_dcubic_test },
@@ -344,6 +374,7 @@ static const picoquic_test_def_t test_table[] = {
     { "fastcc", fastcc_test },
     { "fastcc_jitter", fastcc_jitter_test },
     { "flow_control", flow_control_test },
+    { "flow_control_memory_cap", flow_control_memory_cap_test },
     { "bbr", bbr_test },
     { "bbr_jitter", bbr_jitter_test },
     { "bbr_long", bbr_long_test },
@@ -410,6 +441,8 @@ static const picoquic_test_def_t test_table[] = {
     { "limited_safe", limited_safe_test },
     { "send_stream_blocked", send_stream_blocked_test },
     { "stream_ack", stream_ack_test },
+    { "stream_buffer", stream_buffer_test },
+    { "iovec_receive", iovec_receive_test },
     { "queue_network_input", queue_network_input_test },
     { "pacing_update", pacing_update_test },
     { "quality_update", quality_update_test },
@@ -425,6 +458,11 @@ static const picoquic_test_def_t test_table[] = {
     { "initial_race", initial_race_test },
     { "chacha20", chacha20_test },
     { "cnx_limit", cnx_limit_test },
+    { "cnx_memory_budget", cnx_memory_budget_test },
+    { "cnx_hibernate", cnx_hibernate_test },
+    { "cnx_stress_workers", cnx_stress_workers_test },
+    { "cnx_stress_wheel", cnx_stress_wheel_test },
+    { "cnx_handshake_rate", cnx_handshake_rate_test },
     { "cert_verify_bad_cert", cert_verify_bad_cert_test },
     { "cert_verify_bad_sni", cert_verify_bad_sni_test },
     { "cert_verify_null", cert_verify_null_test },
@@ -520,10 +520,10 @@ static int app_limited_test_one(app_limited_test_config_t * config)
         }
     }
 
-    if (ret == 0 && test_ctx->qclient->nb_data_nodes_allocated > test_ctx->qclient->nb_data_nodes_in_pool) {
+    if (ret == 0 && test_ctx->qclient->nb_data_nodes_in_use > 0) {
         ret = -1;
     }
-    else if (ret == 0 && test_ctx->qserver->nb_data_nodes_allocated > test_ctx->qserver->nb_data_nodes_in_pool) {
+    else if (ret == 0 && test_ctx->qserver->nb_data_nodes_in_use > 0) {
         ret = -1;
     }
 
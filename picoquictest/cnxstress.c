@@ -28,12 +28,20 @@
 #else
 #include <signal.h>
 #endif
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#include <malloc.h>
+#define CNX_HIBERNATE_HEAP_MEASURED
+#endif
 #include <picotls.h>
 #include "picoquic_utils.h"
 #include "picoquic_internal.h"
+#include "picoquic_lb.h"
+#include "picoquic_workers.h"
 #include "tls_api.h"
 #include "picoquictest_internal.h"
 #define CNX_STRESS_ALPN "cnxstress"
+#define CNX_STRESS_WORKERS_MAX 8
+#define CNX_STRESS_NAT_EPOCH 5000000
 
 typedef struct st_cnx_stress_stream_ctx_t {
     /* For receive streams, just look at the first 16 bytes,
@@ -75,16 +83,25 @@ typedef struct st_cnx_stress_ctx_t {
     uint64_t random_ctx;
     picoquic_quic_t* qserver;
     picoquic_quic_t* qclient;
+    /* When simulating a multi-worker server, qworker[0] is the same as qserver */
+    int nb_workers;
+    int next_worker;
+    picoquic_quic_t* qworker[CNX_STRESS_WORKERS_MAX];
+    picoquic_mpsc_queue_t* handoff_queue[CNX_STRESS_WORKERS_MAX];
+    uint64_t nb_packets_forwarded;
     struct sockaddr_in server_addr;
     struct sockaddr_in client_addr;
     picoquictest_sim_link_t* link_to_clients;
     picoquictest_sim_link_t* link_to_server;
+    uint64_t loss_mask_to_clients;
+    uint64_t loss_mask_to_server;
     int is_limit_test;
     int limit_test_got_server_busy;
     int nb_clients;
     int nb_servers;
     int nb_client_target;
     int nb_clients_deleted;
+    int nb_clients_ready;
     uint64_t client_creation_interval;
     uint64_t next_client_creation_time;
     uint64_t client_deletion_interval;
@@ -418,7 +435,11 @@ int cnx_stress_callback(picoquic_cnx_t* cnx,
         ret = cnx_stress_callback_prepare_to_send(cnx_ctx, stream_ctx, stream_id, (void*)bytes, length);
         break;
     case picoquic_callback_almost_ready:
+        break;
     case picoquic_callback_ready:
+        if (cnx_ctx->mode == 0) {
+            cnx_ctx->stress_ctx->nb_clients_ready++;
+        }
         break;
     case picoquic_callback_datagram:/* No datagram support */
         break;
@@ -569,6 +590,52 @@ int cnx_stress_link_arrival(picoquic_quic_t * quic, picoquictest_sim_link_t * li
     return ret;
 }
 
+/* Simulation of a multi-worker server. The kernel selects the socket, and
+ * thus the worker, based on a hash of the addresses. All the simulated
+ * clients share the same address, so the hash is replaced by a value that
+ * changes at each "NAT epoch", as if the NAT rebinding changed the port
+ * number of all the clients. The worker then checks the destination CID,
+ * and forwards the packet through the handoff queue if it belongs to
+ * another worker. In the simulation, the target worker drains its queue
+ * immediately, as if it woke up at once.
+ */
+int cnx_stress_worker_arrival(cnx_stress_ctx_t* stress_ctx, uint64_t current_time)
+{
+    int ret = 0;
+    picoquictest_sim_packet_t* packet =
+        picoquictest_sim_link_dequeue(stress_ctx->link_to_server, current_time);
+
+    if (packet != NULL) {
+        int kernel_rank = (int)((current_time / CNX_STRESS_NAT_EPOCH) % stress_ctx->nb_workers);
+        picoquic_quic_t* quic = stress_ctx->qworker[kernel_rank];
+        int rank = picoquic_workers_packet_rank(packet->bytes, packet->length,
+            picoquic_get_local_cid_length(quic), PICOQUIC_WORKERS_CID_SERVER_ID_OFFSET,
+            stress_ctx->nb_workers);
+
+        if (rank >= 0 && rank != kernel_rank) {
+            size_t nb_packets = 0;
+
+            if (picoquic_handoff_packet_push(stress_ctx->handoff_queue[rank], packet->bytes, packet->length,
+                (struct sockaddr*)&packet->addr_from, (struct sockaddr*)&packet->addr_to, 0, 0) != 0) {
+                ret = -1;
+            }
+            else {
+                stress_ctx->nb_packets_forwarded++;
+                ret = picoquic_handoff_packet_drain(stress_ctx->handoff_queue[rank], stress_ctx->qworker[rank],
+                    current_time, &nb_packets);
+            }
+        }
+        else {
+            ret = picoquic_incoming_packet(quic, packet->bytes,
+                (uint32_t)packet->length,
+                (struct sockaddr*)&packet->addr_from,
+                (struct sockaddr*)&packet->addr_to, 0, 0, current_time);
+        }
+        free(packet);
+    }
+    return ret;
+}
+
 int cnx_stress_prepare(picoquic_quic_t* quic, picoquictest_sim_link_t* link,
     struct sockaddr * default_source, uint64_t current_time)
 {
@@ -639,9 +706,13 @@ int cnx_stress_loop_step(cnx_stress_ctx_t * stress_ctx)
         next_time = stress_ctx->link_to_server->first_packet->arrival_time;
     }
     /* Is it time for server message preparation? */
-    if (picoquic_get_next_wake_time(stress_ctx->qserver, stress_ctx->simulated_time) < next_time) {
-        next_event = cnx_stress_event_server_prepare;
-        next_time = picoquic_get_next_wake_time(stress_ctx->qserver, stress_ctx->simulated_time);
+    for (int i = 0; i < stress_ctx->nb_workers; i++) {
+        uint64_t worker_time = picoquic_get_next_wake_time(stress_ctx->qworker[i], stress_ctx->simulated_time);
+        if (worker_time < next_time) {
+            next_event = cnx_stress_event_server_prepare;
+            next_time = worker_time;
+            stress_ctx->next_worker = i;
+        }
     }
     /* Update the simulation time based on next time */
     if (next_time > stress_ctx->simulated_time) {
@@ -689,12 +760,17 @@ int cnx_stress_loop_step(cnx_stress_ctx_t * stress_ctx)
         break;
     case cnx_stress_event_server_arrival:
         /* If there is something to receive on the client , do it now */
-        ret = cnx_stress_link_arrival(stress_ctx->qserver,
-            stress_ctx->link_to_server, stress_ctx->simulated_time);
+        if (stress_ctx->nb_workers > 1) {
+            ret = cnx_stress_worker_arrival(stress_ctx, stress_ctx->simulated_time);
+        }
+        else {
+            ret = cnx_stress_link_arrival(stress_ctx->qserver,
+                stress_ctx->link_to_server, stress_ctx->simulated_time);
+        }
         break;
     case cnx_stress_event_server_prepare:
         /* If a client packet is ready to send, send it. */
-        ret = cnx_stress_prepare(stress_ctx->qserver, stress_ctx->link_to_clients,
+        ret = cnx_stress_prepare(stress_ctx->qworker[stress_ctx->next_worker], stress_ctx->link_to_clients,
             (struct sockaddr*) & stress_ctx->server_addr, stress_ctx->simulated_time);
         break;
     default:
@@ -764,9 +840,26 @@ void cnx_stress_delete_ctx(cnx_stress_ctx_t* stress_ctx)
         stress_ctx->link_to_server = NULL;
     }
 
+    for (int i = 1; i < stress_ctx->nb_workers; i++) {
+        if (stress_ctx->qworker[i] != NULL) {
+            picoquic_lb_compat_cid_config_free(stress_ctx->qworker[i]);
+            picoquic_free(stress_ctx->qworker[i]);
+            stress_ctx->qworker[i] = NULL;
+        }
+    }
+
+    for (int i = 0; i < stress_ctx->nb_workers; i++) {
+        if (stress_ctx->handoff_queue[i] != NULL) {
+            picoquic_mpsc_queue_delete(stress_ctx->handoff_queue[i]);
+            stress_ctx->handoff_queue[i] = NULL;
+        }
+    }
+
     if (stress_ctx->qserver != NULL) {
+        picoquic_lb_compat_cid_config_free(stress_ctx->qserver);
         picoquic_free(stress_ctx->qserver);
         stress_ctx->qserver = NULL;
+        stress_ctx->qworker[0] = NULL;
     }
 
     if (stress_ctx->qclient != NULL) {
@@ -802,7 +895,7 @@ void cnx_stress_delete_ctx(cnx_stress_ctx_t* stress_ctx)
     free(stress_ctx);
 }
 
-cnx_stress_ctx_t* cnx_stress_create_ctx(uint64_t duration, int nb_clients, int limit_test) 
+cnx_stress_ctx_t* cnx_stress_create_ctx(uint64_t duration, int nb_clients, int nb_workers, int limit_test) 
 {
     cnx_stress_ctx_t* stress_ctx = (cnx_stress_ctx_t*)malloc(sizeof(cnx_stress_ctx_t));
 
@@ -822,11 +915,15 @@ cnx_stress_ctx_t* cnx_stress_create_ctx(uint64_t duration, int nb_clients, int l
         picoquic_set_test_address(&stress_ctx->server_addr, 0x01010101, 4433);
 
         /* Set and verify the simulation intervals */
+        stress_ctx->nb_workers = nb_workers;
         stress_ctx->nb_client_target = nb_clients;
         stress_ctx->client_creation_interval = 2000;
         stress_ctx->next_client_creation_time = 0;
         stress_ctx->client_deletion_interval = 100;
-        if ((stress_ctx->client_creation_interval + stress_ctx->client_deletion_interval) * nb_clients
+        if (nb_workers < 1 || nb_workers > CNX_STRESS_WORKERS_MAX) {
+            ret = -1;
+        }
+        else if ((stress_ctx->client_creation_interval + stress_ctx->client_deletion_interval) * nb_clients
             > duration) {
             ret = -1;
         }
@@ -885,15 +982,35 @@ cnx_stress_ctx_t* cnx_stress_create_ctx(uint64_t duration, int nb_clients, int l
                             ret = -1;
                         }
                         else {
-                            ret = picoquic_set_low_memory_mode(stress_ctx->qclient, 1);
+                            stress_ctx->qworker[0] = stress_ctx->qserver;
+                            for (int i = 1; i < nb_workers; i++) {
+                                stress_ctx->qworker[i] = picoquic_create(nb_clients, test_server_cert_file, test_server_key_file,
+                                    NULL, CNX_STRESS_ALPN, cnx_stress_callback, stress_ctx->default_ctx, NULL, NULL,
+                                    NULL, stress_ctx->simulated_time, &stress_ctx->simulated_time,
+                                    NULL, NULL, 0);
+                                if (stress_ctx->qworker[i] == NULL) {
+                                    ret = -1;
+                                }
+                            }
                             if (ret == 0) {
-                                ret = picoquic_set_low_memory_mode(stress_ctx->qserver, 1);
+                                ret = picoquic_set_low_memory_mode(stress_ctx->qclient, 1);
                             }
                             if (ret == 0) {
                                 ret = cnx_stress_set_default_tp(stress_ctx->qclient);
                             }
-                            if (ret == 0) {
-                                ret = cnx_stress_set_default_tp(stress_ctx->qserver);
+                            for (int i = 0; ret == 0 && i < nb_workers; i++) {
+                                ret = picoquic_set_low_memory_mode(stress_ctx->qworker[i], 1);
+                                if (ret == 0) {
+                                    ret = cnx_stress_set_default_tp(stress_ctx->qworker[i]);
+                                }
+                                if (ret == 0 && nb_workers > 1) {
+                                    /* Encode the worker rank in the server CIDs, and create the handoff queue */
+                                    ret = picoquic_workers_configure_cid(stress_ctx->qworker[i], i);
+                                    if (ret == 0 && (stress_ctx->handoff_queue[i] = picoquic_mpsc_queue_create(
+                                        PICOQUIC_WORKERS_HANDOFF_QUEUE_SIZE, sizeof(picoquic_handoff_packet_t))) == NULL) {
+                                        ret = -1;
+                                    }
+                                }
                             }
                         }
                     }
@@ -909,10 +1026,20 @@ cnx_stress_ctx_t* cnx_stress_create_ctx(uint64_t duration, int nb_clients, int l
     return stress_ctx;
 }
 
-int cnx_stress_do_test(uint64_t duration, int nb_clients, int do_report)
+static int cnx_stress_do_test_ex(uint64_t duration, int nb_clients, int nb_workers, int use_wheel, int do_report)
 {
     int ret = 0;
-    cnx_stress_ctx_t* stress_ctx = cnx_stress_create_ctx(duration, nb_clients, 0);
+    cnx_stress_ctx_t* stress_ctx = cnx_stress_create_ctx(duration, nb_clients, nb_workers, 0);
+
+    if (stress_ctx == NULL) {
+        ret = -1;
+    }
+    else if (use_wheel) {
+        ret = picoquic_set_wake_wheel(stress_ctx->qclient, 1);
+        if (ret == 0) {
+            ret = picoquic_set_wake_wheel(stress_ctx->qserver, 1);
+        }
+    }
 
     if (stress_ctx != NULL) {
         uint64_t wall_time_start = picoquic_current_time();
@@ -943,6 +1070,10 @@ int cnx_stress_do_test(uint64_t duration, int nb_clients, int do_report)
                     stress_ctx->nb_messages_sent, stress_ctx->nb_messages_received);
                 ret = -1;
             }
+            else if (nb_workers > 1 && stress_ctx->nb_packets_forwarded == 0) {
+                DBG_PRINTF("No packet forwarded between %d workers", nb_workers);
+                ret = -1;
+            }
             else if (do_report) {
                 double msg_avg_delay = (stress_ctx->nb_messages_target > 0) ?
                     (double)stress_ctx->sum_message_delays / (double)stress_ctx->nb_messages_target : 0;
@@ -955,11 +1086,97 @@ int cnx_stress_do_test(uint64_t duration, int nb_clients, int do_report)
                 fprintf(stdout, "Processed %d messages, delays min/avg/max= %fs, %fs, %fs.\n",
                     stress_ctx->nb_messages_target, ((double)stress_ctx->message_delay_min)/ 1000000.0,
                     msg_avg_delay, ((double)stress_ctx->message_delay_max)/ 1000000.0);
+                if (nb_workers > 1) {
+                    fprintf(stdout, "Processed with %d workers, %" PRIu64 " packets forwarded.\n",
+                        nb_workers, stress_ctx->nb_packets_forwarded);
+                }
+            }
+        }
+
+        cnx_stress_delete_ctx(stress_ctx);
+    }
+    return ret;
+}
+
+/* Handshake rate:
+ * Create the client connections as in the cnx stress test, without queuing
+ * messages, and measure the wall time needed to complete all the handshakes.
+ * The connection objects are allocated from the connection arenas, or with
+ * malloc if the arenas are disabled, so the two rates can be compared.
+ */
+static int cnx_stress_handshake_rate(int nb_clients, int use_arena, double* handshake_rate)
+{
+    int ret = 0;
+    uint64_t duration = (uint64_t)nb_clients * 3000 + 10000000;
+    cnx_stress_ctx_t* stress_ctx = cnx_stress_create_ctx(duration, nb_clients, 1, 0);
+
+    *handshake_rate = 0;
+
+    if (stress_ctx == NULL) {
+        ret = -1;
+    }
+    else {
+        uint64_t wall_time_start;
+        uint64_t wall_time_elapsed;
+        picoquic_cnx_t* cnx;
+
+        stress_ctx->qclient->is_cnx_arena_disabled = !use_arena;
+        stress_ctx->qserver->is_cnx_arena_disabled = !use_arena;
+        stress_ctx->next_message_creation_time = UINT64_MAX;
+        stress_ctx->next_client_deletion_time = UINT64_MAX;
+
+        wall_time_start = picoquic_current_time();
+        while (ret == 0 && stress_ctx->nb_clients_ready < nb_clients &&
+            stress_ctx->simulated_time < duration) {
+            ret = cnx_stress_loop_step(stress_ctx);
+        }
+        wall_time_elapsed = picoquic_current_time() - wall_time_start;
+
+        if (ret == 0) {
+            if (stress_ctx->nb_clients_ready != nb_clients || stress_ctx->nb_servers != nb_clients) {
+                DBG_PRINTF("Expected %d handshakes, got %d (client) and %d (server)",
+                    nb_clients, stress_ctx->nb_clients_ready, stress_ctx->nb_servers);
+                ret = -1;
+            }
+            else if ((cnx = picoquic_get_first_cnx(stress_ctx->qserver)) == NULL ||
+                (cnx->arena.stats.nb_blocks > 0) != (use_arena != 0)) {
+                DBG_PRINTF("Arena %s used when %s", (use_arena) ? "not" : "still", (use_arena) ? "enabled" : "disabled");
+                ret = -1;
+            }
+            else if (wall_time_elapsed > 0) {
+                *handshake_rate = ((double)nb_clients * 1000000.0) / (double)wall_time_elapsed;
             }
         }
 
         cnx_stress_delete_ctx(stress_ctx);
     }
+
+    return ret;
+}
+
+static int cnx_stress_handshake_rates(int nb_clients, double* arena_rate, double* malloc_rate)
+{
+    int ret = cnx_stress_handshake_rate(nb_clients, 1, arena_rate);
+
+    if (ret == 0) {
+        ret = cnx_stress_handshake_rate(nb_clients, 0, malloc_rate);
+    }
+
+    return ret;
+}
+
+int cnx_stress_do_test(uint64_t duration, int nb_clients, int do_report)
+{
+    int ret = cnx_stress_do_test_ex(duration, nb_clients, 1, 0, do_report);
+
+    if (ret == 0 && do_report) {
+        double handshake_rate[2];
+
+        if ((ret = cnx_stress_handshake_rates(nb_clients, &handshake_rate[0], &handshake_rate[1])) == 0) {
+            fprintf(stdout, "Handshake rate: %f/s with connection arenas, %f/s with malloc.\n",
+                handshake_rate[0], handshake_rate[1]);
+        }
+    }
     return ret;
 }
 
@@ -971,6 +1188,38 @@ int cnx_stress_unit_test()
     return cnx_stress_do_test(120000000, 100, 0);
 }
 
+/* Multi-worker variant of the cnx stress test. The server is split in
+ * 4 workers, and the simulated NAT rebinding causes packets to reach the
+ * wrong worker. The test verifies that all connections succeed and all
+ * messages are delivered, thanks to the CID based forwarding. */
+int cnx_stress_workers_test()
+{
+    return cnx_stress_do_test_ex(120000000, 100, 4, 0, 0);
+}
+
+/* Verify that the handshakes complete with and without the connection
+ * arenas, and document the handshake rate in both cases. The rates depend
+ * on the machine and its load, so they are reported but not compared. */
+int cnx_handshake_rate_test()
+{
+    double handshake_rate[2];
+    int ret = cnx_stress_handshake_rates(1000, &handshake_rate[0], &handshake_rate[1]);
+
+    if (ret == 0) {
+        DBG_PRINTF("Handshake rate: %f/s with connection arenas, %f/s with malloc",
+            handshake_rate[0], handshake_rate[1]);
+    }
+
+    return ret;
+}
+
+/* Variant of the cnx stress test in which client and server schedule the
+ * connections with the timer wheel instead of the splay tree. */
+int cnx_stress_wheel_test()
+{
+    return cnx_stress_do_test_ex(120000000, 100, 1, 1, 0);
+}
+
 /*Connection limit
  * Test that if one attempts to create more than the set limit of
  * connections, it fails. This is complementary to the cnx_stress
@@ -982,7 +1231,7 @@ int cnx_limit_test()
     int ret = 0;
     int nb_clients = 4;
     uint64_t duration = 120000000;
-    cnx_stress_ctx_t* stress_ctx = cnx_stress_create_ctx(duration, nb_clients, 1);
+    cnx_stress_ctx_t* stress_ctx = cnx_stress_create_ctx(duration, nb_clients, 1, 1);
 
     if (stress_ctx == NULL) {
         ret = -1;
@@ -1032,4 +1281,232 @@ int cnx_limit_test()
     }
 
     return ret;
-}
\ No newline at end of file
+}
+
+/* Memory budget test.
+ * Run a few hundred connections that all start sending large messages at
+ * about the same time, on lossy links, with a memory ceiling set on the
+ * client and server contexts. Verify that the ceiling is actually hit and
+ * the back pressure engaged, that all messages are still delivered, and
+ * that the memory charged to the context always matches the sum of the
+ * memory charged to its connections.
+ */
+static int cnx_memory_budget_check(picoquic_quic_t* quic)
+{
+    int ret = 0;
+    uint64_t total = 0;
+    picoquic_cnx_t* cnx = picoquic_get_first_cnx(quic);
+
+    while (cnx != NULL) {
+        picoquic_memory_usage_t usage;
+
+        picoquic_get_memory_usage(cnx, &usage);
+        if (usage.total_bytes != usage.retransmit_bytes + usage.data_repeat_bytes +
+            usage.stream_send_bytes + usage.stream_receive_bytes) {
+            ret = -1;
+        }
+        total += usage.total_bytes;
+        cnx = picoquic_get_next_cnx(cnx);
+    }
+
+    if (total != picoquic_get_memory_held(quic)) {
+        DBG_PRINTF("Memory held %" PRIu64 ", sum of connections %" PRIu64,
+            picoquic_get_memory_held(quic), total);
+        ret = -1;
+    }
+
+    return ret;
+}
+
+int cnx_memory_budget_test()
+{
+    int ret = 0;
+    int nb_clients = 300;
+    uint64_t duration = 120000000;
+    uint64_t memory_ceiling = 0x100000;
+    cnx_stress_ctx_t* stress_ctx = cnx_stress_create_ctx(duration, nb_clients, 1, 0);
+
+    if (stress_ctx == NULL) {
+        ret = -1;
+    }
+    else {
+        int nb_steps = 0;
+
+        /* Large messages, all created within a few milliseconds */
+        stress_ctx->message_size = 0x8000;
+        stress_ctx->message_creation_interval = 10;
+        /* Lose about one packet in 32 in each direction */
+        stress_ctx->loss_mask_to_clients = 0x0000000100000001ull;
+        stress_ctx->loss_mask_to_server = 0x0000010000000100ull;
+        stress_ctx->link_to_clients->loss_mask = &stress_ctx->loss_mask_to_clients;
+        stress_ctx->link_to_server->loss_mask = &stress_ctx->loss_mask_to_server;
+        picoquic_set_memory_ceiling(stress_ctx->qclient, memory_ceiling);
+        picoquic_set_memory_ceiling(stress_ctx->qserver, memory_ceiling);
+
+        while (ret == 0 && stress_ctx->simulated_time < duration) {
+            ret = cnx_stress_loop_step(stress_ctx);
+            nb_steps++;
+            if (ret == 0 && (nb_steps % 1024) == 0) {
+                ret = cnx_memory_budget_check(stress_ctx->qclient);
+                if (ret == 0) {
+                    ret = cnx_memory_budget_check(stress_ctx->qserver);
+                }
+            }
+        }
+
+        if (ret == 0) {
+            if (stress_ctx->nb_messages_received != stress_ctx->nb_messages_target) {
+                DBG_PRINTF("Expected %d messages, sent %d, received %d",
+                    stress_ctx->nb_messages_target,
+                    stress_ctx->nb_messages_sent, stress_ctx->nb_messages_received);
+                ret = -1;
+            }
+            else if (stress_ctx->qclient->nb_memory_pressure_events == 0 &&
+                stress_ctx->qserver->nb_memory_pressure_events == 0) {
+                DBG_PRINTF("Memory ceiling never reached, max held %" PRIu64 " and %" PRIu64,
+                    picoquic_get_memory_held_max(stress_ctx->qclient),
+                    picoquic_get_memory_held_max(stress_ctx->qserver));
+                ret = -1;
+            }
+            else {
+                ret = cnx_memory_budget_check(stress_ctx->qclient);
+                if (ret == 0) {
+                    ret = cnx_memory_budget_check(stress_ctx->qserver);
+                }
+            }
+        }
+
+        cnx_stress_delete_ctx(stress_ctx);
+    }
+
+    return ret;
+}
+
+/* Hibernation test.
+ * Create a large number of connections that stay idle until the first message
+ * is created, with a hibernation delay set on client and server. Verify that all
+ * connections hibernate, release their congestion control state and hold no
+ * packet or stream memory, that the messages are then delivered, and that the
+ * connections hibernate again once the messages are delivered. The test runs
+ * twice, with and without hibernation. When the C library can report the heap
+ * bytes in use, the test also verifies that a hibernated connection uses less
+ * memory than an idle connection that is not hibernated.
+ */
+static uint64_t cnx_hibernate_heap_in_use()
+{
+    uint64_t in_use = 0;
+#ifdef CNX_HIBERNATE_HEAP_MEASURED
+    struct mallinfo2 mi = mallinfo2();
+
+    in_use = (uint64_t)mi.uordblks + (uint64_t)mi.hblkhd;
+#endif
+    return in_use;
+}
+
+static int cnx_hibernate_check(picoquic_quic_t* quic, int nb_cnx)
+{
+    int ret = 0;
+    picoquic_cnx_t* cnx = picoquic_get_first_cnx(quic);
+
+    if (picoquic_get_nb_cnx_hibernating(quic) != (size_t)nb_cnx) {
+        DBG_PRINTF("Expected %d connections hibernating, got %zu", nb_cnx,
+            picoquic_get_nb_cnx_hibernating(quic));
+        ret = -1;
+    }
+
+    while (ret == 0 && cnx != NULL) {
+        if (!picoquic_is_cnx_hibernating(cnx) ||
+            cnx->path[0]->congestion_alg_state != NULL ||
+            cnx->pkt_ctx[picoquic_packet_context_application].retransmitted_newest != NULL ||
+            cnx->memory_held_total != 0) {
+            DBG_PRINTF("Connection not compacted, %" PRIu64 " bytes held", cnx->memory_held_total);
+            ret = -1;
+        }
+        cnx = picoquic_get_next_cnx(cnx);
+    }
+
+    return ret;
+}
+
+static int cnx_hibernate_run(int nb_clients, uint64_t hibernation_delay, uint64_t* heap_per_cnx)
+{
+    int ret = 0;
+    uint64_t duration = 60000000;
+    uint64_t heap_start = cnx_hibernate_heap_in_use();
+    cnx_stress_ctx_t* stress_ctx = cnx_stress_create_ctx(duration, nb_clients, 1, 0);
+
+    *heap_per_cnx = 0;
+
+    if (stress_ctx == NULL) {
+        ret = -1;
+    }
+    else {
+        int is_idle_checked = 0;
+
+        picoquic_set_hibernation_delay(stress_ctx->qclient, hibernation_delay);
+        picoquic_set_hibernation_delay(stress_ctx->qserver, hibernation_delay);
+
+        while (ret == 0 && stress_ctx->simulated_time < duration) {
+            ret = cnx_stress_loop_step(stress_ctx);
+            /* The first message is queued but not sent yet. All the
+             * connections have been idle since the end of the handshakes. */
+            if (ret == 0 && !is_idle_checked && stress_ctx->nb_messages_sent > 0) {
+                uint64_t heap_idle = cnx_hibernate_heap_in_use();
+
+                is_idle_checked = 1;
+                if (heap_idle > heap_start) {
+                    /* Memory used by a client connection and its server peer */
+                    *heap_per_cnx = (heap_idle - heap_start) / (uint64_t)nb_clients;
+                }
+                if (hibernation_delay > 0) {
+                    ret = cnx_hibernate_check(stress_ctx->qclient, stress_ctx->nb_clients);
+                    if (ret == 0) {
+                        ret = cnx_hibernate_check(stress_ctx->qserver, stress_ctx->nb_servers);
+                    }
+                }
+            }
+        }
+
+        if (ret == 0) {
+            if (!is_idle_checked || stress_ctx->nb_clients != nb_clients ||
+                stress_ctx->nb_messages_received != stress_ctx->nb_messages_target) {
+                DBG_PRINTF("Expected %d messages, sent %d, received %d",
+                    stress_ctx->nb_messages_target,
+                    stress_ctx->nb_messages_sent, stress_ctx->nb_messages_received);
+                ret = -1;
+            }
+            else if (hibernation_delay > 0 &&
+                (stress_ctx->qclient->nb_hibernations <= (uint64_t)nb_clients ||
+                    stress_ctx->qserver->nb_hibernations <= (uint64_t)nb_clients)) {
+                DBG_PRINTF("Connections did not hibernate after the messages, %" PRIu64 " and %" PRIu64,
+                    stress_ctx->qclient->nb_hibernations, stress_ctx->qserver->nb_hibernations);
+                ret = -1;
+            }
+        }
+
+        cnx_stress_delete_ctx(stress_ctx);
+    }
+
+    return ret;
+}
+
+int cnx_hibernate_test()
+{
+    int nb_clients = 1000;
+    uint64_t heap_per_cnx[2] = { 0, 0 };
+    int ret = cnx_hibernate_run(nb_clients, 0, &heap_per_cnx[0]);
+
+    if (ret == 0) {
+        ret = cnx_hibernate_run(nb_clients, 2000000, &heap_per_cnx[1]);
+    }
+
+    if (ret == 0 && heap_per_cnx[0] > 0) {
+        DBG_PRINTF("Heap per idle connection pair: %" PRIu64 " bytes without hibernation, %" PRIu64 " with hibernation",
+            heap_per_cnx[0], heap_per_cnx[1]);
+        if (heap_per_cnx[1] >= heap_per_cnx[0]) {
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
@@ -50,6 +50,8 @@ typedef struct st_fctest_spec_t {
 	uint64_t initial_credit;
 	uint64_t bytes_buffered_max;
 	uint64_t completion_target;
+	uint64_t memory_cap;
+	uint64_t memory_cap_release_time;
 } fctest_spec_t;
 
 typedef struct st_fctest_ctx_t {
@@ -300,7 +302,26 @@ int fctest_one(fctest_spec_t* spec)
 		ret = tls_api_connection_loop(test_ctx, &fctest_ctx.loss_mask, 0, &fctest_ctx.simulated_time);
 	}
 
+	if (ret == 0 && spec->memory_cap != 0) {
+		/* Cap the receiver as if the memory ceiling had been hit */
+		picoquic_set_cnx_memory_cap(test_ctx->cnx_client, spec->memory_cap);
+	}
+
 	while (ret == 0 && picoquic_get_cnx_state(test_ctx->cnx_client) != picoquic_state_disconnected) {
+		if (test_ctx->cnx_client->memory_cap != 0 && fctest_ctx.simulated_time >= spec->memory_cap_release_time) {
+			/* The credit requested under the cap must have been deferred, and granted once the cap is lifted */
+			if (!test_ctx->cnx_client->is_flow_control_deferred) {
+				DBG_PRINTF("No credit deferred by the memory cap at T=%" PRIu64, fctest_ctx.simulated_time);
+				ret = -1;
+				break;
+			}
+			picoquic_set_cnx_memory_cap(test_ctx->cnx_client, 0);
+			if (test_ctx->cnx_client->is_flow_control_deferred) {
+				DBG_PRINTF("Deferred credit not granted at T=%" PRIu64, fctest_ctx.simulated_time);
+				ret = -1;
+				break;
+			}
+		}
 		/* May need to set a timeout per flow control. */
 		if (fctest_ctx.bytes_buffered > 0 &&
 			fctest_ctx.simulated_time >= fctest_ctx.buffered_time + timeout) {
@@ -371,4 +392,24 @@ int flow_control_test()
 	spec.ccalgo = picoquic_bbr_algorithm;
 
 	return fctest_one(&spec);
-}
\ No newline at end of file
+}
+
+/* Flow control under memory pressure. The receiver is capped for the first
+ * part of the transfer, so the credit it opens is limited to the cap and
+ * the rest is deferred. The transfer must complete once the cap is lifted.
+ */
+int flow_control_memory_cap_test()
+{
+	fctest_spec_t spec = { 0 };
+	spec.test_id = 2;
+	spec.transfer_size = 1000000;
+	spec.microsecs_per_byte = 10;
+	spec.credit_quantum = 0x4000;
+	spec.initial_credit = 0x10000;
+	spec.bytes_buffered_max = 0x4000;
+	spec.memory_cap = PICOQUIC_MEMORY_CAP_MINIMUM;
+	spec.memory_cap_release_time = 3000000;
+	spec.ccalgo = picoquic_bbr_algorithm;
+
+	return fctest_one(&spec);
+}
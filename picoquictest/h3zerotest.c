@@ -1935,10 +1935,10 @@ static int demo_server_test(char const * alpn, picoquic_stream_data_cb_fn server
         }
     }
 
-    if (ret == 0 && test_ctx->qclient->nb_data_nodes_allocated > test_ctx->qclient->nb_data_nodes_in_pool) {
+    if (ret == 0 && test_ctx->qclient->nb_data_nodes_in_use > 0) {
         ret = -1;
     }
-    else if (ret == 0 && test_ctx->qserver->nb_data_nodes_allocated > test_ctx->qserver->nb_data_nodes_in_pool) {
+    else if (ret == 0 && test_ctx->qserver->nb_data_nodes_in_use > 0) {
         ret = -1;
     }
 
@@ -3757,10 +3757,10 @@ static int h3_grease_test_one(int server_test)
         }
     }
 
-    if (ret == 0 && test_ctx->qclient->nb_data_nodes_allocated > test_ctx->qclient->nb_data_nodes_in_pool) {
+    if (ret == 0 && test_ctx->qclient->nb_data_nodes_in_use > 0) {
         ret = -1;
     }
-    else if (ret == 0 && test_ctx->qserver->nb_data_nodes_allocated > test_ctx->qserver->nb_data_nodes_in_pool) {
+    else if (ret == 0 && test_ctx->qserver->nb_data_nodes_in_use > 0) {
         ret = -1;
     }
 
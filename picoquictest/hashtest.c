@@ -333,3 +333,333 @@ int siphash_test()
 #endif /* COMPARING TIMES */
     return ret;
 }
+
+/* Test of the open addressing table.
+ * Insert enough keys to cause several resizes, verifying that all the keys
+ * can be retrieved while the entries are moved between arrays, then remove
+ * and insert keys again to exercise the deleted slots.
+ */
+#define PICOTABLE_TEST_NB_KEYS 5000
+
+/* One key in three uses all the words. */
+static void picotable_test_key(uint64_t x, picotable_key_t* key)
+{
+    key->w[0] = x;
+    key->w[1] = 8;
+    key->w[2] = ((x % 3) == 0) ? ~x : 0;
+}
+
+static int picotable_test_key_equal(const picotable_key_t* key1, const picotable_key_t* key2)
+{
+    return memcmp(key1, key2, sizeof(picotable_key_t)) == 0;
+}
+
+/* Check that the keys of the connection tables only depend on the bytes
+ * in use, and differ when the length or the address differ. */
+static int picotable_test_cnx_keys()
+{
+    int ret = 0;
+    picoquic_connection_id_t cid1;
+    picoquic_connection_id_t cid2;
+    picotable_key_t key1;
+    picotable_key_t key2;
+    struct sockaddr_in a4;
+    struct sockaddr_in6 a6;
+
+    for (uint8_t len = 0; ret == 0 && len <= PICOQUIC_CONNECTION_ID_MAX_SIZE; len++) {
+        memset(&cid1, 0, sizeof(cid1));
+        memset(&cid2, 0xff, sizeof(cid2));
+        for (uint8_t i = 0; i < len; i++) {
+            cid1.id[i] = (uint8_t)(i + 1);
+            cid2.id[i] = (uint8_t)(i + 1);
+        }
+        cid1.id_len = len;
+        cid2.id_len = len;
+        picoquic_cid_table_key(&cid1, &key1);
+        picoquic_cid_table_key(&cid2, &key2);
+        if (!picotable_test_key_equal(&key1, &key2)) {
+            DBG_PRINTF("CID key of length %d depends on unused bytes", len);
+            ret = -1;
+        }
+        else if (len > 0) {
+            cid2.id[len - 1] ^= 0x80;
+            picoquic_cid_table_key(&cid2, &key2);
+            if (picotable_test_key_equal(&key1, &key2)) {
+                DBG_PRINTF("CID key of length %d ignores the last byte", len);
+                ret = -1;
+            }
+            else {
+                cid2.id[len - 1] = 0;
+                cid2.id_len = len - 1;
+                cid1.id[len - 1] = 0;
+                picoquic_cid_table_key(&cid1, &key1);
+                picoquic_cid_table_key(&cid2, &key2);
+                if (picotable_test_key_equal(&key1, &key2)) {
+                    DBG_PRINTF("CID key of length %d ignores the length", len);
+                    ret = -1;
+                }
+            }
+        }
+    }
+
+    if (ret == 0) {
+        memset(&a4, 0, sizeof(a4));
+        memset(&a6, 0, sizeof(a6));
+        a4.sin_family = AF_INET;
+        a4.sin_port = htons(4433);
+        a6.sin6_family = AF_INET6;
+        a6.sin6_port = htons(4433);
+        picoquic_net_table_key((struct sockaddr*)&a4, &key1);
+        picoquic_net_table_key((struct sockaddr*)&a6, &key2);
+        if (picotable_test_key_equal(&key1, &key2)) {
+            ret = -1;
+        }
+        else {
+            a4.sin_port = htons(4434);
+            picoquic_net_table_key((struct sockaddr*)&a4, &key2);
+            if (picotable_test_key_equal(&key1, &key2)) {
+                ret = -1;
+            }
+        }
+        if (ret != 0) {
+            DBG_PRINTF("%s", "Address keys do not differ");
+        }
+    }
+
+    return ret;
+}
+
+static int picotable_test_check(picotable_t* table, uint64_t nb_keys, uint64_t step, uint64_t offset)
+{
+    int ret = 0;
+    picotable_key_t key;
+
+    for (uint64_t i = 0; ret == 0 && i < nb_keys; i++) {
+        void* expected = ((i % step) == 0) ? (void*)(uintptr_t)(i + offset) : NULL;
+
+        picotable_test_key(i, &key);
+        if (picotable_find(table, &key) != expected) {
+            DBG_PRINTF("Key %" PRIu64 " not found as expected", i);
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+int picotable_test()
+{
+    int ret = 0;
+    picotable_t table;
+    picotable_key_t key;
+    uint8_t hash_seed[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+
+    if (picotable_init(&table, hash_seed) != 0) {
+        ret = -1;
+    }
+
+    for (uint64_t i = 0; ret == 0 && i < PICOTABLE_TEST_NB_KEYS; i++) {
+        picotable_test_key(i, &key);
+        if (picotable_insert(&table, &key, (void*)(uintptr_t)(i + 1)) != 0) {
+            DBG_PRINTF("Cannot insert key %" PRIu64, i);
+            ret = -1;
+        }
+        else if (picotable_insert(&table, &key, NULL) == 0) {
+            DBG_PRINTF("Duplicate key %" PRIu64 " inserted", i);
+            ret = -1;
+        }
+        else if ((i % 97) == 0) {
+            ret = picotable_test_check(&table, i + 1, 1, 1);
+        }
+    }
+
+    if (ret == 0 && (picotable_count(&table) != PICOTABLE_TEST_NB_KEYS || table.stats.nb_resizes == 0)) {
+        ret = -1;
+    }
+
+    /* Remove the odd keys, then insert them again with a different value */
+    for (uint64_t i = 1; ret == 0 && i < PICOTABLE_TEST_NB_KEYS; i += 2) {
+        picotable_test_key(i, &key);
+        if (picotable_remove(&table, &key) != (void*)(uintptr_t)(i + 1) ||
+            picotable_remove(&table, &key) != NULL) {
+            ret = -1;
+        }
+    }
+    if (ret == 0) {
+        ret = picotable_test_check(&table, PICOTABLE_TEST_NB_KEYS, 2, 1);
+    }
+    for (uint64_t i = 1; ret == 0 && i < PICOTABLE_TEST_NB_KEYS; i += 2) {
+        picotable_test_key(i, &key);
+        if (picotable_insert(&table, &key, (void*)(uintptr_t)(i + 2)) != 0) {
+            ret = -1;
+        }
+    }
+    for (uint64_t i = 0; ret == 0 && i < PICOTABLE_TEST_NB_KEYS; i++) {
+        picotable_test_key(i, &key);
+        if (picotable_find(&table, &key) != (void*)(uintptr_t)(i + 1 + (i & 1))) {
+            ret = -1;
+        }
+    }
+
+    /* Remove everything */
+    for (uint64_t i = 0; ret == 0 && i < PICOTABLE_TEST_NB_KEYS; i++) {
+        picotable_test_key(i, &key);
+        if (picotable_remove(&table, &key) == NULL) {
+            ret = -1;
+        }
+    }
+    if (ret == 0 && picotable_count(&table) != 0) {
+        ret = -1;
+    }
+
+    picotable_release(&table);
+
+    if (ret == 0) {
+        ret = picotable_test_cnx_keys();
+    }
+
+    return ret;
+}
+
+/* Connection table benchmark.
+ * Register 10K, 100K and 1M connection IDs, then look them up in random
+ * order, in the chained hash table used previously and in the open
+ * addressing table. As when packets arrive, the CIDs looked up are copies,
+ * not the registered objects, and the open addressing keys are built by
+ * the same function as in the connection table. Each table is timed
+ * several times and the best time is kept. The test fails if a lookup
+ * fails, or if the open addressing table is slower than the chained one.
+ */
+#define CNX_TABLE_BENCH_LOOKUPS 1000000
+#define CNX_TABLE_BENCH_PASSES 8
+
+typedef struct st_cnx_table_bench_key_t {
+    picoquic_connection_id_t cnx_id;
+    picohash_item item;
+} cnx_table_bench_key_t;
+
+static uint64_t cnx_table_bench_hash(const void* key, const uint8_t* hash_seed)
+{
+    return picoquic_connection_id_hash(&((const cnx_table_bench_key_t*)key)->cnx_id, hash_seed);
+}
+
+static int cnx_table_bench_compare(const void* key1, const void* key2)
+{
+    return picoquic_compare_connection_id(&((const cnx_table_bench_key_t*)key1)->cnx_id,
+        &((const cnx_table_bench_key_t*)key2)->cnx_id);
+}
+
+static picohash_item* cnx_table_bench_to_item(const void* key)
+{
+    return &((cnx_table_bench_key_t*)key)->item;
+}
+
+static int cnx_table_bench_one(size_t nb_cnx, uint8_t* hash_seed, uint64_t* random_ctx)
+{
+    int ret = 0;
+    cnx_table_bench_key_t* keys = (cnx_table_bench_key_t*)malloc(nb_cnx * sizeof(cnx_table_bench_key_t));
+    size_t* order = (size_t*)malloc(nb_cnx * sizeof(size_t));
+    picoquic_connection_id_t* probes = (picoquic_connection_id_t*)malloc(nb_cnx * sizeof(picoquic_connection_id_t));
+    picohash_table* chained = picohash_create_ex(4 * nb_cnx, cnx_table_bench_hash, cnx_table_bench_compare,
+        cnx_table_bench_to_item, hash_seed);
+    picotable_t table;
+    uint64_t elapsed[2] = { UINT64_MAX, UINT64_MAX };
+    size_t nb_lookups = (nb_cnx < CNX_TABLE_BENCH_LOOKUPS) ? CNX_TABLE_BENCH_LOOKUPS : nb_cnx;
+
+    if (picotable_init(&table, hash_seed) != 0) {
+        ret = -1;
+    }
+    else if (keys == NULL || order == NULL || probes == NULL || chained == NULL) {
+        ret = -1;
+    }
+    else {
+        picotable_key_t key;
+
+        memset(keys, 0, nb_cnx * sizeof(cnx_table_bench_key_t));
+        for (size_t i = 0; ret == 0 && i < nb_cnx; i++) {
+            keys[i].cnx_id.id_len = 8;
+            picoquic_test_random_bytes(random_ctx, keys[i].cnx_id.id, 8);
+            picoquic_cid_table_key(&keys[i].cnx_id, &key);
+            if (picotable_insert(&table, &key, &keys[i]) != 0 ||
+                picohash_insert(chained, &keys[i]) != 0) {
+                ret = -1;
+            }
+            order[i] = i;
+        }
+        for (size_t i = nb_cnx - 1; i > 0; i--) {
+            size_t j = (size_t)(picoquic_test_random(random_ctx) % (i + 1));
+            size_t x = order[i];
+            order[i] = order[j];
+            order[j] = x;
+        }
+        for (size_t i = 0; i < nb_cnx; i++) {
+            probes[i] = keys[order[i]].cnx_id;
+        }
+        /* The first two passes warm up the caches, the next ones are timed */
+        for (int pass = 0; ret == 0 && pass < CNX_TABLE_BENCH_PASSES; pass++) {
+            uint64_t start_time = picoquic_current_time();
+            uint64_t pass_time;
+
+            for (size_t n = 0; ret == 0 && n < nb_lookups; n++) {
+                size_t i = n % nb_cnx;
+                cnx_table_bench_key_t* k = &keys[order[i]];
+
+                if ((pass & 1) == 0) {
+                    cnx_table_bench_key_t probe;
+                    picohash_item* item;
+
+                    probe.cnx_id = probes[i];
+                    item = picohash_retrieve(chained, &probe);
+                    if (item == NULL || item->key != k) {
+                        ret = -1;
+                    }
+                }
+                else {
+                    picoquic_cid_table_key(&probes[i], &key);
+                    if (picotable_find(&table, &key) != k) {
+                        ret = -1;
+                    }
+                }
+            }
+            pass_time = picoquic_current_time() - start_time;
+            if (pass >= 2 && pass_time < elapsed[pass & 1]) {
+                elapsed[pass & 1] = (pass_time > 0) ? pass_time : 1;
+            }
+        }
+        if (ret == 0) {
+            DBG_PRINTF("%zu connections, lookups per second: chained %.0f, open addressing %.0f",
+                nb_cnx, (double)nb_lookups * 1000000.0 / (double)elapsed[0],
+                (double)nb_lookups * 1000000.0 / (double)elapsed[1]);
+            if (elapsed[1] > elapsed[0]) {
+                DBG_PRINTF("Open addressing slower than chained with %zu connections", nb_cnx);
+                ret = -1;
+            }
+        }
+        else {
+            DBG_PRINTF("Lookup failed with %zu connections", nb_cnx);
+        }
+    }
+
+    picotable_release(&table);
+    if (chained != NULL) {
+        picohash_delete(chained, 0);
+    }
+    free(probes);
+    free(order);
+    free(keys);
+
+    return ret;
+}
+
+int cnx_table_bench_test()
+{
+    int ret = 0;
+    uint64_t random_ctx = 0x7461626c65626e63ull;
+    uint8_t hash_seed[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+    size_t nb_cnx[3] = { 10000, 100000, 1000000 };
+
+    for (int i = 0; ret == 0 && i < 3; i++) {
+        ret = cnx_table_bench_one(nb_cnx[i], hash_seed, &random_ctx);
+    }
+
+    return ret;
+}
@@ -345,4 +345,79 @@ int pacing_repeat_test()
         }
     }
     return ret;
-}
\ No newline at end of file
+}
+
+/* Verify that when pacing is offloaded, packets are authorized up to
+ * the horizon before the bucket would allow them, and that the
+ * departure times are spaced at the pacing rate.
+ */
+int pacing_offload_test()
+{
+    int ret = 0;
+    picoquic_pacing_t pacing = { 0 };
+    uint64_t current_time = 1000;
+    const uint64_t horizon = 1000;
+    const uint64_t packet_time = 100;
+    uint64_t last_departure = 0;
+    int nb_sent = 0;
+
+    picoquic_pacing_init(&pacing, current_time);
+    /* 1536 bytes every 100us, bucket of 2 packets */
+    picoquic_update_pacing_parameters(&pacing, 15360000.0, 3072, 1536, 10000, NULL);
+    picoquic_set_pacing_offload_horizon(&pacing, horizon);
+
+    for (int round = 0; ret == 0 && round < 2; round++) {
+        nb_sent = 0;
+        while (ret == 0 && nb_sent < 100) {
+            uint64_t next_time = UINT64_MAX;
+
+            if (!picoquic_is_authorized_by_pacing(&pacing, current_time, &next_time, 0, NULL)) {
+                if (next_time > current_time + packet_time + 1) {
+                    DBG_PRINTF("Round %d, next time %" PRIu64 " too late", round, next_time);
+                    ret = -1;
+                }
+                break;
+            }
+            picoquic_update_pacing_data_after_send(&pacing, 1536, 1536, current_time);
+            if (pacing.departure_time > current_time + horizon) {
+                DBG_PRINTF("Round %d, departure %" PRIu64 " beyond horizon", round, pacing.departure_time);
+                ret = -1;
+            }
+            else if (last_departure != 0 && pacing.departure_time > current_time &&
+                pacing.departure_time != last_departure + packet_time) {
+                DBG_PRINTF("Round %d, departure %" PRIu64 " after %" PRIu64, round,
+                    pacing.departure_time, last_departure);
+                ret = -1;
+            }
+            last_departure = pacing.departure_time;
+            nb_sent++;
+        }
+        /* The horizon holds 10 packets, the bucket 2 more */
+        if (ret == 0 && (nb_sent < 10 || nb_sent > 12)) {
+            DBG_PRINTF("Round %d, %d packets sent instead of 10 to 12", round, nb_sent);
+            ret = -1;
+        }
+        current_time += 2 * horizon;
+    }
+
+    if (ret == 0) {
+        /* Without offload, the bucket limits the burst */
+        picoquic_set_pacing_offload_horizon(&pacing, 0);
+        nb_sent = 0;
+        while (nb_sent < 100) {
+            uint64_t next_time = UINT64_MAX;
+
+            if (!picoquic_is_authorized_by_pacing(&pacing, current_time, &next_time, 0, NULL)) {
+                break;
+            }
+            picoquic_update_pacing_data_after_send(&pacing, 1536, 1536, current_time);
+            nb_sent++;
+        }
+        if (nb_sent > 3) {
+            DBG_PRINTF("%d packets sent without offload", nb_sent);
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
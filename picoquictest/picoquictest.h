@@ -45,6 +45,8 @@ int util_threading_test();
 int picohash_test();
 int picohash_bytes_test();
 int siphash_test();
+int picotable_test();
+int cnx_table_bench_test();
 int picohash_embedded_test();
 int picolog_basic_test();
 int bytestream_test();
@@ -103,6 +105,7 @@ int ackrange_test();
 int ack_of_ack_test();
 int ack_disorder_test();
 int ack_horizon_test();
+int sack_ring_bench_test();
 int tls_api_two_connections_test();
 int cleartext_aead_test();
 int tls_api_multiple_versions_test();
@@ -117,6 +120,7 @@ int binlog_test();
 int app_message_overflow_test();
 int socket_test();
 int test_stateless_blowback();
+int stateless_reset_jumbo_test();
 int ticket_store_test();
 int ticket_seed_test();
 int ticket_seed_from_bdp_frame_test();
@@ -133,6 +137,7 @@ int mtu_blocked_test();
 int mtu_delayed_test();
 int mtu_required_test();
 int mtu_max_test();
+int mtu_jumbo_test();
 int mtu_drop_bbr_test();
 int mtu_drop_cubic_test();
 int mtu_drop_dcubic_test();
@@ -191,7 +196,29 @@ int sockloop_migration_test();
 int sockloop_nat_test();
 int sockloop_thread_test();
 int sockloop_thread_name_test();
+int sockloop_recvmmsg_test();
+int sockloop_gro_test();
+int sockloop_cid_steering_test();
+int sockloop_workers_test();
+int sockloop_commands_test();
+int sockloop_wake_up_test();
+int sockloop_command_add_to_stream_test();
+int sockloop_command_mark_active_test();
+int sockloop_command_datagram_test();
+int sockloop_command_close_test();
+int sockloop_sendmmsg_test();
+int sockloop_txtime_test();
+int sockloop_busy_poll_test();
+int sockloop_uring_test();
 int splay_test();
+int picowheel_test();
+int wake_wheel_bench_test();
+int slab_test();
+int arena_test();
+int stream_churn_test();
+int huge_page_pool_test();
+int packet_pool_test();
+int data_node_reorder_test();
 int TlsStreamFrameTest();
 int draft17_vector_test();
 int dtn_basic_test();
@@ -374,15 +401,20 @@ int bad_coalesce_test();
 int bad_cnxid_test();
 int stream_splay_test();
 int stream_output_test();
+int stream_ready_queue_test();
+int stream_weighted_test();
 int stream_rank_test();
 int provide_stream_buffer_test();
 int not_before_cnxid_test();
 int send_stream_blocked_test();
 int stream_ack_test();
+int stream_buffer_test();
+int iovec_receive_test();
 int queue_network_input_test();
 int fastcc_test();
 int fastcc_jitter_test();
 int flow_control_test();
+int flow_control_memory_cap_test();
 int bbr_test();
 int bbr_jitter_test();
 int bbr_long_test();
@@ -440,8 +472,14 @@ int cwin_max_test();
 int initial_race_test();
 int pacing_test();
 int pacing_repeat_test();
+int pacing_offload_test();
 int chacha20_test();
 int cnx_limit_test();
+int cnx_memory_budget_test();
+int cnx_hibernate_test();
+int cnx_stress_workers_test();
+int cnx_stress_wheel_test();
+int cnx_handshake_rate_test();
 int cert_verify_bad_cert_test();
 int cert_verify_bad_sni_test();
 int cert_verify_null_test();
@@ -613,6 +651,7 @@ int quicperf_datagram_test();
 int quicperf_media_test();
 int quicperf_multi_test();
 int quicperf_overflow_test();
+int quicperf_weighted_test();
 int cplusplustest();
 
 #ifdef __cplusplus
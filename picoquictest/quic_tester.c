@@ -126,7 +126,7 @@ picoquic_packet_t* tester_init_packet(picoquic_cnx_t* cnx, picoquic_packet_type_
 
 void tester_add_frame(picoquic_packet_t* packet, uint8_t* frame, size_t frame_length)
 {
-    if (packet->length + frame_length < sizeof(packet->bytes)) {
+    if (packet->length + frame_length < PICOQUIC_MAX_PACKET_SIZE) {
         memcpy(&packet->bytes[packet->length], frame, frame_length);
         packet->length += frame_length;
     }
@@ -40,6 +40,7 @@
 #define qpstr_video2 "=v2:s30:p4:C:n300:12345;"
 #define qpstr_video3 "=v3 : s30: p4:S: n1800:12345:G150:I11111;"
 #define qpstr_video4 "=v4 : s30:p4:S:  n1800:12345:G150:I11111:D1000;"
+#define qpstr_video5 "=v5 : s30:p4:w70:S:  n1800:12345:G150:I11111;"
 #define qpstr_audio "=a0:d50:p2:C:n500:40;"
 #define qpstr_combo "=a1:d50:p2:S:n3000:80; \
 = vlow:*3 : s30 :p4:S:n1800 : 3750 : G150 : I37500; \
@@ -200,6 +201,27 @@ const quicperf_stream_desc_t qpsc_video4[] = {
     }
 };
 
+const quicperf_stream_desc_t qpsc_video5[] = {
+    {
+        { 'v', '5', 0 }, /* id */
+        { 0, 0 }, /* previous id */
+        1, /* repeat_count */
+        quicperf_media_stream, /* media_type */
+        30, /* frequency */
+        0, /* post_size */
+        0, /* response_size */
+        1800, /* nb_frames */
+        12345, /* frame_size */
+        150, /* group_size */
+        11111, /* first_frame_size */
+        0, /* reset_delay */
+        4, /* priority */
+        0, /* is_infinite */
+        0, /*  is_client_media */
+        70, /* weight */
+    }
+};
+
 const quicperf_stream_desc_t qpsc_audio[1] = {
     {
         { 'a', '0', 0 }, /* id */
@@ -305,6 +327,7 @@ const quicperf_test_line_t test_lines[] = {
     { qpsc_video2, 1, qpstr_video2 },
     { qpsc_video3, 1, qpstr_video3 },
     { qpsc_video4, 1, qpstr_video4 },
+    { qpsc_video5, 1, qpstr_video5 },
     { qpsc_audio, 1, qpstr_audio },
     { qpsc_combo, 4, qpstr_combo }
 };
@@ -364,6 +387,9 @@ int quicperf_compare_stream_desc(const quicperf_stream_desc_t* sc1, const quicpe
     else if (sc1->is_client_media != sc2->is_client_media) {
         diff = "is_client_media";
     }
+    else if (sc1->weight != sc2->weight) {
+        diff = "weight";
+    }
     if (diff != NULL) {
         DBG_PRINTF("Values of %s do not match.\n", diff);
         ret = -1;
@@ -429,6 +455,7 @@ int quicperf_e2e_test(uint8_t test_id, char const *scenario, uint64_t completion
     uint64_t time_out;
     int nb_trials = 0;
     int was_active = 0;
+    int is_weighted = 0;
     picoquic_test_tls_api_ctx_t* test_ctx = NULL;
     quicperf_ctx_t  *quicperf_ctx;
     int ret = 0;
@@ -447,6 +474,14 @@ int quicperf_e2e_test(uint8_t test_id, char const *scenario, uint64_t completion
         return -1;
     }
 
+    /* Weighted media streams are requested with the weighted header */
+    for (size_t i = 0; i < quicperf_ctx->nb_scenarios; i++) {
+        if (quicperf_ctx->scenarios[i].media_type == quicperf_media_stream &&
+            quicperf_ctx->scenarios[i].weight != 0) {
+            is_weighted = 1;
+        }
+    }
+
     if (ret == 0) {
         ret = tls_api_init_ctx_ex(&test_ctx,
             PICOQUIC_INTERNAL_TEST_VERSION_1,
@@ -515,10 +550,17 @@ int quicperf_e2e_test(uint8_t test_id, char const *scenario, uint64_t completion
         }
     }
 
-    if (ret == 0 && test_ctx->qclient->nb_data_nodes_allocated > test_ctx->qclient->nb_data_nodes_in_pool) {
+    if (ret == 0 && test_ctx->qclient->nb_data_nodes_in_use > 0) {
+        ret = -1;
+    }
+    else if (ret == 0 && test_ctx->qserver->nb_data_nodes_in_use > 0) {
         ret = -1;
     }
-    else if (ret == 0 && test_ctx->qserver->nb_data_nodes_allocated > test_ctx->qserver->nb_data_nodes_in_pool) {
+
+    /* The server enables weighted scheduling only after parsing a weighted header */
+    if (ret == 0 && (test_ctx->cnx_server == NULL ||
+        test_ctx->cnx_server->is_weighted_scheduling != (unsigned int)is_weighted)) {
+        DBG_PRINTF("Expected weighted scheduling %d on the server", is_weighted);
         ret = -1;
     }
 
@@ -702,3 +744,41 @@ int quicperf_overflow_test()
 
     return quicperf_e2e_test(0xf1, overflow_scenario, 6000000, 4, overflow_target);
 }
+
+/* Same media streams as the multi test, but sharing the same round robin
+ * priority with weights 10 and 70. The requests carry the weighted header,
+ * and all frames shall be delivered. */
+int quicperf_weighted_test()
+{
+    char const* weighted_scenario = "=a1:d50:p2:S:n250:80; \
+     = vlow: s30 :p4:w10:S:n150 : 3750 : G30 : I37500; \
+     = vmid: s30 :p4:w70:S:n150 : 6250 : G30 : I62500;";
+    quicperf_test_target_t weighted_target[] = {
+        {
+        250, /* nb_frames_received_min */
+        250, /* nb_frames_received_max */
+        20000, /* average_delay_min */
+        26000, /* average_delay_max */
+        100000, /* max_delay */
+        20000, /* min_delay */
+        },
+        {
+        150, /* nb_frames_received_min */
+        150, /* nb_frames_received_max */
+        20000, /* average_delay_min */
+        0, /* average_delay_max */
+        0, /* max_delay */
+        20000, /* min_delay */
+        },
+        {
+        150, /* nb_frames_received_min */
+        150, /* nb_frames_received_max */
+        20000, /* average_delay_min */
+        0, /* average_delay_max */
+        0, /* max_delay */
+        20000, /* min_delay */
+        }
+    };
+
+    return quicperf_e2e_test(0x3e, weighted_scenario, 6000000, 3, weighted_target);
+}
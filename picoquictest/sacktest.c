@@ -131,7 +131,7 @@ int check_ack_ranges(picoquic_sack_list_t* sack_list)
             else if (sack->nb_times_sent[r] < PICOQUIC_MAX_ACK_RANGE_REPEAT) {
                 range_sum[sack->nb_times_sent[r]] += 1;
             }
-            sack = picoquic_sack_next_item(sack);
+            sack = picoquic_sack_next_item(sack_list, sack);
         }
 
         for (int i = 0; ret == 0 && i < PICOQUIC_MAX_ACK_RANGE_REPEAT; i++) {
@@ -792,3 +792,121 @@ int ack_horizon_test()
     int ret = ack_disorder_test_one(ACK_HORIZON_LOG, 1000000, 196.0);
     return ret;
 }
+
+/* Benchmark of the sack list. Packets are received with a given loss
+ * rate. Every few packets, an ACK frame carries the highest ranges, and
+ * the acknowledgement of that ACK arrives about one RTT later. With little
+ * or no loss, the ranges fit in the ring of the sack list. With more
+ * losses, they spill to the splay tree.
+ */
+#define SACK_BENCH_NB_PACKETS 1000000
+#define SACK_BENCH_ACK_INTERVAL 16
+#define SACK_BENCH_ACK_DELAY 4 /* in ACK intervals, i.e., one RTT */
+#define SACK_BENCH_MAX_RANGES 32
+
+typedef struct st_sack_bench_ack_t {
+    int nb_ranges;
+    uint64_t range_min[SACK_BENCH_MAX_RANGES];
+    uint64_t range_max[SACK_BENCH_MAX_RANGES];
+} sack_bench_ack_t;
+
+static int sack_bench_check_list(picoquic_sack_list_t* sack_list)
+{
+    int ret = check_ack_ranges(sack_list);
+    picoquic_sack_item_t* sack = picoquic_sack_first_item(sack_list);
+    size_t nb_items = 0;
+
+    while (ret == 0 && sack != NULL) {
+        picoquic_sack_item_t* next = picoquic_sack_next_item(sack_list, sack);
+
+        nb_items++;
+        if (sack->end_of_sack_range < sack->start_of_sack_range ||
+            (next != NULL && next->start_of_sack_range <= sack->end_of_sack_range + 1)) {
+            ret = -1;
+        }
+        sack = next;
+    }
+    if (ret == 0 && nb_items != picoquic_sack_list_size(sack_list)) {
+        ret = -1;
+    }
+    return ret;
+}
+
+static int sack_bench_one(uint64_t loss_per_thousand, double* ns_per_packet, size_t * max_ranges)
+{
+    int ret = 0;
+    picoquic_sack_list_t sack_list;
+    sack_bench_ack_t acks[SACK_BENCH_ACK_DELAY];
+    uint64_t random_ctx = 0x5ac4be4c4;
+    uint64_t start_time;
+    uint64_t current_time = 0;
+
+    picoquic_sack_list_init(&sack_list);
+    memset(acks, 0, sizeof(acks));
+    *max_ranges = 0;
+
+    start_time = picoquic_current_time();
+    for (uint64_t pn = 0; ret == 0 && pn < SACK_BENCH_NB_PACKETS; pn++) {
+        current_time += 100;
+        if (picoquic_test_random(&random_ctx) % 1000 >= loss_per_thousand &&
+            picoquic_update_sack_list(&sack_list, pn, pn, current_time) != 0) {
+            ret = -1;
+        }
+        else if ((pn % SACK_BENCH_ACK_INTERVAL) == 0) {
+            sack_bench_ack_t* ack = &acks[(pn / SACK_BENCH_ACK_INTERVAL) % SACK_BENCH_ACK_DELAY];
+            picoquic_sack_item_t* sack;
+            int nb_sent_max = 0;
+            int nb_sent_max_skip = 0;
+
+            /* The ACK sent one RTT ago is acknowledged */
+            for (int i = 0; i < ack->nb_ranges; i++) {
+                (void)picoquic_process_ack_of_ack_range(&sack_list, NULL, ack->range_min[i], ack->range_max[i]);
+            }
+            /* Send a new ACK, with the highest ranges */
+            sack = picoquic_sack_last_item(&sack_list);
+            picoquic_sack_select_ack_ranges(&sack_list, sack, SACK_BENCH_MAX_RANGES, 0, &nb_sent_max, &nb_sent_max_skip);
+            ack->nb_ranges = 0;
+            while (sack != NULL && ack->nb_ranges < SACK_BENCH_MAX_RANGES) {
+                ack->range_min[ack->nb_ranges] = sack->start_of_sack_range;
+                ack->range_max[ack->nb_ranges] = sack->end_of_sack_range;
+                ack->nb_ranges++;
+                picoquic_sack_item_record_sent(&sack_list, sack, 0);
+                sack = picoquic_sack_previous_item(&sack_list, sack);
+            }
+            if (picoquic_sack_list_size(&sack_list) > *max_ranges) {
+                *max_ranges = picoquic_sack_list_size(&sack_list);
+            }
+        }
+    }
+    *ns_per_packet = (double)(picoquic_current_time() - start_time) * 1000.0 / (double)SACK_BENCH_NB_PACKETS;
+
+    if (ret == 0) {
+        ret = sack_bench_check_list(&sack_list);
+    }
+
+    picoquic_sack_list_free(&sack_list);
+
+    return ret;
+}
+
+int sack_ring_bench_test()
+{
+    int ret = 0;
+    uint64_t loss_per_thousand[3] = { 0, 10, 100 };
+    double ns_per_packet[3] = { 0, 0, 0 };
+    size_t max_ranges[3] = { 0, 0, 0 };
+
+    for (int i = 0; ret == 0 && i < 3; i++) {
+        ret = sack_bench_one(loss_per_thousand[i], &ns_per_packet[i], &max_ranges[i]);
+        if (ret != 0) {
+            DBG_PRINTF("Sack list is inconsistent after test with loss %d/1000", (int)loss_per_thousand[i]);
+        }
+    }
+
+    if (ret == 0) {
+        DBG_PRINTF("ns per packet: %.1f (0%% loss, %zu ranges), %.1f (1%%, %zu ranges), %.1f (10%%, %zu ranges)",
+            ns_per_packet[0], max_ranges[0], ns_per_packet[1], max_ranges[1], ns_per_packet[2], max_ranges[2]);
+    }
+
+    return ret;
+}
@@ -2929,10 +2929,10 @@ static size_t dataqueue_prepare_packet(
     uint64_t stream_id, uint64_t offset, size_t frame_data_length)
 {
     uint8_t* bytes = packet->bytes;
-    uint8_t* bytes_max = bytes + sizeof(packet->bytes);
+    uint8_t* bytes_max = bytes + PICOQUIC_MAX_PACKET_SIZE;
     size_t copied_index;
 
-    memset(packet, 0, sizeof(picoquic_packet_t));
+    memset(packet, 0, offsetof(picoquic_packet_t, bytes) + PICOQUIC_MAX_PACKET_SIZE);
     packet->offset = 12;
     packet->data_repeat_frame = 17;
     packet->data_repeat_index = 17;
@@ -3818,3 +3818,437 @@ int stream_ack_test()
 
     return ret;
 }
+
+/* Test that application owned buffers queued with picoquic_add_buffer_to_stream
+ * are sent without copy, and released only after all their bytes are
+ * acknowledged, or when the stream is reset or deleted.
+ */
+#define STREAM_BUFFER_TEST_NB_FRAMES 16
+
+typedef struct st_stream_buffer_test_ctx_t {
+    int nb_released;
+    size_t bytes_released;
+    const uint8_t* last_released;
+} stream_buffer_test_ctx_t;
+
+static void stream_buffer_test_release(picoquic_cnx_t* cnx, uint64_t stream_id,
+    const uint8_t* bytes, size_t length, void* release_ctx)
+{
+    stream_buffer_test_ctx_t* ctx = (stream_buffer_test_ctx_t*)release_ctx;
+    ctx->nb_released++;
+    ctx->bytes_released += length;
+    ctx->last_released = bytes;
+}
+
+static int stream_buffer_test_send(picoquic_cnx_t* cnx, uint64_t stream_id,
+    uint8_t frames[STREAM_BUFFER_TEST_NB_FRAMES][PICOQUIC_MAX_PACKET_SIZE], size_t* frame_length,
+    size_t frame_size, size_t nb_frames_max, size_t* nb_frames)
+{
+    int ret = 0;
+    picoquic_stream_head_t* stream = picoquic_find_stream(cnx, stream_id);
+
+    *nb_frames = 0;
+    if (stream == NULL) {
+        ret = -1;
+    }
+    while (ret == 0 && *nb_frames < nb_frames_max && (stream->send_queue != NULL ||
+        (stream->fin_requested && !stream->fin_sent))) {
+        int more_data = 0;
+        int is_pure_ack = 1;
+        int is_still_active = 0;
+        uint8_t* bytes = picoquic_format_stream_frame(cnx, stream, frames[*nb_frames],
+            frames[*nb_frames] + frame_size, &more_data, &is_pure_ack, &is_still_active, &ret);
+
+        if (ret == 0) {
+            if (bytes == NULL || bytes == frames[*nb_frames]) {
+                DBG_PRINTF("Cannot format frame %zu", *nb_frames);
+                ret = -1;
+            }
+            else {
+                frame_length[*nb_frames] = bytes - frames[*nb_frames];
+                *nb_frames += 1;
+            }
+        }
+    }
+    return ret;
+}
+
+int stream_buffer_test()
+{
+    int ret = 0;
+    uint64_t simulated_time = 0;
+    picoquic_cnx_t* cnx = NULL;
+    picoquic_stream_head_t* stream = NULL;
+    struct sockaddr_storage addr;
+    stream_buffer_test_ctx_t ctx = { 0 };
+    static uint8_t buffers[3][2000];
+    const size_t buffer_length[3] = { 1000, 2000, 500 };
+    uint8_t frames[STREAM_BUFFER_TEST_NB_FRAMES][PICOQUIC_MAX_PACKET_SIZE];
+    size_t frame_length[STREAM_BUFFER_TEST_NB_FRAMES];
+    size_t nb_frames = 0;
+    size_t total_length = 0;
+    picoquic_quic_t* quic = picoquic_create(8, NULL, NULL, NULL, NULL, NULL,
+        NULL, NULL, NULL, NULL, simulated_time,
+        &simulated_time, NULL, NULL, 0);
+
+    for (int i = 0; i < 3; i++) {
+        for (size_t j = 0; j < buffer_length[i]; j++) {
+            buffers[i][j] = (uint8_t)(i * 101 + j);
+        }
+        total_length += buffer_length[i];
+    }
+
+    if (quic == NULL) {
+        ret = -1;
+    }
+    else {
+        ret = picoquic_store_text_addr(&addr, "10.0.0.1", 1234);
+        if (ret == 0) {
+            cnx = picoquic_create_cnx(quic, picoquic_null_connection_id,
+                picoquic_null_connection_id, (struct sockaddr*) & addr,
+                simulated_time, 0, "test-sni", "test-alpn", 1);
+            if (cnx == NULL) {
+                ret = -1;
+            }
+            else {
+                cnx->max_stream_id_bidir_remote = 64;
+                cnx->maxdata_remote = 0x100000;
+            }
+        }
+    }
+
+    /* Queue three buffers on stream 4, without copy */
+    for (int i = 0; ret == 0 && i < 3; i++) {
+        ret = picoquic_add_buffer_to_stream(cnx, 4, buffers[i], buffer_length[i], i == 2,
+            stream_buffer_test_release, &ctx);
+    }
+    if (ret == 0 && picoquic_add_buffer_to_stream(cnx, 4, buffers[0], 10, 0, NULL, NULL) == 0) {
+        DBG_PRINTF("%s", "Buffer without release function accepted");
+        ret = -1;
+    }
+    if (ret == 0) {
+        if ((stream = picoquic_find_stream(cnx, 4)) == NULL) {
+            ret = -1;
+        }
+        else {
+            stream->maxdata_remote = 0x100000;
+            ret = stream_buffer_test_send(cnx, 4, frames, frame_length, 1200,
+                STREAM_BUFFER_TEST_NB_FRAMES, &nb_frames);
+        }
+    }
+
+    if (ret == 0 && (ctx.nb_released != 0 || stream->sent_buffers_first == NULL || nb_frames < 3)) {
+        DBG_PRINTF("After send, %d released, %zu frames", ctx.nb_released, nb_frames);
+        ret = -1;
+    }
+
+    /* Verify that the frames carry the application data */
+    for (size_t i = 0; ret == 0 && i < nb_frames; i++) {
+        uint64_t stream_id = 0;
+        uint64_t offset = 0;
+        size_t data_length = 0;
+        int fin = 0;
+        size_t consumed = 0;
+
+        if (picoquic_parse_stream_header(frames[i], frame_length[i], &stream_id, &offset,
+            &data_length, &fin, &consumed) != 0 || stream_id != 4 ||
+            offset + data_length > total_length || consumed + data_length != frame_length[i]) {
+            DBG_PRINTF("Cannot parse frame %zu", i);
+            ret = -1;
+        }
+        for (size_t j = 0; ret == 0 && j < data_length; j++) {
+            uint64_t x = offset + j;
+            int k = 0;
+            while (x >= buffer_length[k]) {
+                x -= buffer_length[k];
+                k++;
+            }
+            if (frames[i][consumed + j] != buffers[k][x]) {
+                DBG_PRINTF("Frame %zu, data mismatch at offset %" PRIu64, i, offset + j);
+                ret = -1;
+            }
+        }
+    }
+
+    /* Acknowledge all frames but the first, in reverse order. Buffers are
+     * released in sequence, so nothing can be released yet */
+    for (size_t i = nb_frames - 1; ret == 0 && i > 0; i--) {
+        size_t consumed = 0;
+        ret = picoquic_process_ack_of_stream_frame(cnx, frames[i], frame_length[i], &consumed);
+    }
+    if (ret == 0 && ctx.nb_released != 0) {
+        DBG_PRINTF("Released %d buffers before first ack", ctx.nb_released);
+        ret = -1;
+    }
+    if (ret == 0) {
+        size_t consumed = 0;
+        ret = picoquic_process_ack_of_stream_frame(cnx, frames[0], frame_length[0], &consumed);
+        if (ret == 0 && (ctx.nb_released != 3 || ctx.bytes_released != total_length ||
+            ctx.last_released != buffers[2])) {
+            DBG_PRINTF("After acks, released %d buffers, %zu bytes", ctx.nb_released, ctx.bytes_released);
+            ret = -1;
+        }
+    }
+
+    /* Send part of the data on stream 8, then reset it */
+    if (ret == 0) {
+        ret = picoquic_add_buffer_to_stream(cnx, 8, buffers[2], buffer_length[2], 0,
+            stream_buffer_test_release, &ctx);
+        if (ret == 0) {
+            ret = picoquic_add_buffer_to_stream(cnx, 8, buffers[1], buffer_length[1], 0,
+                stream_buffer_test_release, &ctx);
+        }
+        if (ret == 0) {
+            if ((stream = picoquic_find_stream(cnx, 8)) == NULL) {
+                ret = -1;
+            }
+            else {
+                stream->maxdata_remote = 0x100000;
+                ret = stream_buffer_test_send(cnx, 8, frames, frame_length, 1200, 1, &nb_frames);
+            }
+        }
+        if (ret == 0 && ctx.nb_released != 3) {
+            DBG_PRINTF("Released %d buffers before reset", ctx.nb_released);
+            ret = -1;
+        }
+        if (ret == 0) {
+            int more_data = 0;
+            int is_pure_ack = 1;
+
+            if (picoquic_reset_stream(cnx, 8, 0) != 0 ||
+                picoquic_format_reset_stream_frame(cnx, stream, frames[1], frames[1] + 1200,
+                    &more_data, &is_pure_ack) == NULL) {
+                ret = -1;
+            }
+            else if (ctx.nb_released != 5 || stream->send_queue != NULL || stream->sent_buffers_first != NULL) {
+                DBG_PRINTF("After reset, released %d buffers", ctx.nb_released);
+                ret = -1;
+            }
+        }
+    }
+
+    /* Buffers not yet sent are released when the context is deleted */
+    if (ret == 0) {
+        ret = picoquic_add_buffer_to_stream(cnx, 12, buffers[0], buffer_length[0], 1,
+            stream_buffer_test_release, &ctx);
+    }
+
+    if (quic != NULL) {
+        picoquic_free(quic);
+    }
+
+    if (ret == 0 && ctx.nb_released != 6) {
+        DBG_PRINTF("After free, released %d buffers", ctx.nb_released);
+        ret = -1;
+    }
+
+    return ret;
+}
+
+/* Test the scatter-gather receive API. Chunks received out of order are
+ * delivered in a single callback once the gap is filled, and the data
+ * nodes are held until the application releases them. The data is only
+ * consumed, and the flow control credit opened, when released.
+ */
+#define IOVEC_RECEIVE_TEST_CHUNK 300
+#define IOVEC_RECEIVE_TEST_NB_CHUNKS 5
+
+typedef struct st_iovec_receive_test_ctx_t {
+    int nb_calls;
+    size_t nb_iov;
+    uint64_t offset;
+    int fin;
+    int release_in_callback;
+    uint8_t received[IOVEC_RECEIVE_TEST_CHUNK * IOVEC_RECEIVE_TEST_NB_CHUNKS];
+} iovec_receive_test_ctx_t;
+
+static int iovec_receive_test_callback(picoquic_cnx_t* cnx,
+    uint64_t stream_id, int fin, const picoquic_iovec_t* iov, size_t nb_iov, uint64_t offset,
+    void* iovec_receive_ctx)
+{
+    int ret = 0;
+    iovec_receive_test_ctx_t* ctx = (iovec_receive_test_ctx_t*)iovec_receive_ctx;
+    uint64_t next_offset = offset;
+
+    ctx->nb_calls++;
+    ctx->nb_iov = nb_iov;
+    ctx->offset = offset;
+    ctx->fin |= fin;
+    for (size_t i = 0; ret == 0 && i < nb_iov; i++) {
+        if (next_offset + iov[i].length > sizeof(ctx->received)) {
+            ret = -1;
+        }
+        else {
+            memcpy(ctx->received + next_offset, iov[i].bytes, iov[i].length);
+            next_offset += iov[i].length;
+        }
+    }
+    if (ret == 0 && ctx->release_in_callback) {
+        ret = picoquic_release_stream_iovec(cnx, stream_id, next_offset);
+    }
+    return ret;
+}
+
+static int iovec_receive_test_chunk(picoquic_cnx_t* cnx, uint64_t stream_id, const uint8_t* data, int rank)
+{
+    int ret = 0;
+    uint8_t frame[IOVEC_RECEIVE_TEST_CHUNK + 32];
+    uint64_t offset = (uint64_t)rank * IOVEC_RECEIVE_TEST_CHUNK;
+    uint8_t* bytes = picoquic_format_stream_frame_header(frame, frame + sizeof(frame), stream_id, offset);
+
+    if (bytes == NULL) {
+        ret = -1;
+    }
+    else {
+        if (rank == IOVEC_RECEIVE_TEST_NB_CHUNKS - 1) {
+            frame[0] |= 1;
+        }
+        memcpy(bytes, data + offset, IOVEC_RECEIVE_TEST_CHUNK);
+        bytes += IOVEC_RECEIVE_TEST_CHUNK;
+        if (picoquic_decode_stream_frame(cnx, frame, bytes, NULL, 0) == NULL) {
+            DBG_PRINTF("Cannot decode chunk %d on stream %" PRIu64, rank, stream_id);
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+int iovec_receive_test()
+{
+    int ret = 0;
+    uint64_t simulated_time = 0;
+    picoquic_cnx_t* cnx = NULL;
+    struct sockaddr_storage addr;
+    iovec_receive_test_ctx_t ctx[4];
+    picoquic_stream_head_t* stream;
+    uint8_t data[IOVEC_RECEIVE_TEST_CHUNK * IOVEC_RECEIVE_TEST_NB_CHUNKS];
+    const int order[IOVEC_RECEIVE_TEST_NB_CHUNKS] = { 2, 4, 1, 3, 0 };
+    size_t nb_nodes_initial = 0;
+    picoquic_quic_t* quic = picoquic_create(8, NULL, NULL, NULL, NULL, NULL,
+        NULL, NULL, NULL, NULL, simulated_time,
+        &simulated_time, NULL, NULL, 0);
+
+    memset(ctx, 0, sizeof(ctx));
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 7 + 3);
+    }
+
+    if (quic == NULL) {
+        ret = -1;
+    }
+    else {
+        ret = picoquic_store_text_addr(&addr, "10.0.0.1", 1234);
+        if (ret == 0) {
+            cnx = picoquic_create_cnx(quic, picoquic_null_connection_id,
+                picoquic_null_connection_id, (struct sockaddr*) & addr,
+                simulated_time, 0, "test-sni", "test-alpn", 1);
+            if (cnx == NULL) {
+                ret = -1;
+            }
+            else {
+                nb_nodes_initial = quic->nb_data_nodes_in_use;
+            }
+        }
+    }
+
+    /* Stream 1: out of order chunks, delivered in one call when the gap fills */
+    if (ret == 0 && (picoquic_create_stream(cnx, 1) == NULL ||
+        picoquic_mark_iovec_receive_stream(cnx, 1, iovec_receive_test_callback, &ctx[0]) != 0)) {
+        ret = -1;
+    }
+    for (int i = 0; ret == 0 && i < IOVEC_RECEIVE_TEST_NB_CHUNKS; i++) {
+        if (ctx[0].nb_calls != 0) {
+            DBG_PRINTF("Unexpected call before chunk %d", order[i]);
+            ret = -1;
+        }
+        else {
+            ret = iovec_receive_test_chunk(cnx, 1, data, order[i]);
+        }
+    }
+    if (ret == 0 && (ctx[0].nb_calls != 1 || ctx[0].nb_iov != IOVEC_RECEIVE_TEST_NB_CHUNKS ||
+        ctx[0].offset != 0 || !ctx[0].fin || memcmp(ctx[0].received, data, sizeof(data)) != 0)) {
+        DBG_PRINTF("Stream 1: %d calls, %zu segments, fin %d", ctx[0].nb_calls, ctx[0].nb_iov, ctx[0].fin);
+        ret = -1;
+    }
+    /* The segments are held, and not consumed, until released */
+    if (ret == 0 && ((stream = picoquic_find_stream(cnx, 1)) == NULL || stream->consumed_offset != 0 ||
+        quic->nb_data_nodes_in_use != nb_nodes_initial + IOVEC_RECEIVE_TEST_NB_CHUNKS)) {
+        DBG_PRINTF("Expected %d nodes held, got %zu", IOVEC_RECEIVE_TEST_NB_CHUNKS,
+            quic->nb_data_nodes_in_use - nb_nodes_initial);
+        ret = -1;
+    }
+    if (ret == 0 && (picoquic_release_stream_iovec(cnx, 1, 2 * IOVEC_RECEIVE_TEST_CHUNK + 1) != 0 ||
+        stream->consumed_offset != 2 * IOVEC_RECEIVE_TEST_CHUNK + 1 ||
+        quic->nb_data_nodes_in_use != nb_nodes_initial + 3)) {
+        DBG_PRINTF("After partial release, %zu nodes held", quic->nb_data_nodes_in_use - nb_nodes_initial);
+        ret = -1;
+    }
+    if (ret == 0 && (picoquic_release_stream_iovec(cnx, 1, sizeof(data)) != 0 ||
+        stream->consumed_offset != sizeof(data) ||
+        quic->nb_data_nodes_in_use != nb_nodes_initial)) {
+        DBG_PRINTF("After release, %zu nodes held", quic->nb_data_nodes_in_use - nb_nodes_initial);
+        ret = -1;
+    }
+
+    /* Stream 5: in order chunks, released from the callback */
+    if (ret == 0) {
+        ctx[1].release_in_callback = 1;
+        if (picoquic_create_stream(cnx, 5) == NULL ||
+            picoquic_mark_iovec_receive_stream(cnx, 5, iovec_receive_test_callback, &ctx[1]) != 0) {
+            ret = -1;
+        }
+    }
+    for (int i = 0; ret == 0 && i < IOVEC_RECEIVE_TEST_NB_CHUNKS; i++) {
+        ret = iovec_receive_test_chunk(cnx, 5, data, i);
+        if (ret == 0 && (ctx[1].nb_calls != i + 1 || ctx[1].nb_iov != 1 ||
+            ctx[1].offset != (uint64_t)i * IOVEC_RECEIVE_TEST_CHUNK ||
+            quic->nb_data_nodes_in_use != nb_nodes_initial)) {
+            DBG_PRINTF("Stream 5, chunk %d: %d calls, %zu segments", i, ctx[1].nb_calls, ctx[1].nb_iov);
+            ret = -1;
+        }
+    }
+    if (ret == 0 && (!ctx[1].fin || memcmp(ctx[1].received, data, sizeof(data)) != 0)) {
+        ret = -1;
+    }
+
+    /* Stream 9: data queued before the stream is marked is delivered immediately */
+    for (int i = 0; ret == 0 && i < IOVEC_RECEIVE_TEST_NB_CHUNKS; i++) {
+        ret = iovec_receive_test_chunk(cnx, 9, data, order[i]);
+    }
+    if (ret == 0 && (picoquic_mark_iovec_receive_stream(cnx, 9, NULL, NULL) == 0 ||
+        picoquic_mark_iovec_receive_stream(cnx, 9, iovec_receive_test_callback, &ctx[2]) != 0 ||
+        ctx[2].nb_calls != 1 || ctx[2].nb_iov != IOVEC_RECEIVE_TEST_NB_CHUNKS || !ctx[2].fin ||
+        memcmp(ctx[2].received, data, sizeof(data)) != 0)) {
+        DBG_PRINTF("Stream 9: %d calls, %zu segments", ctx[2].nb_calls, ctx[2].nb_iov);
+        ret = -1;
+    }
+
+    /* Stream 13: a stream already finished on the sending side is deleted
+     * when the application releases the last segments from the callback */
+    if (ret == 0) {
+        if ((stream = picoquic_create_stream(cnx, 13)) == NULL) {
+            ret = -1;
+        }
+        else {
+            stream->fin_requested = 1;
+            stream->fin_sent = 1;
+            (void)picoquic_update_sack_list(&stream->sack_list, 0, 0, 0);
+            ctx[3].release_in_callback = 1;
+        }
+    }
+    for (int i = 0; ret == 0 && i < IOVEC_RECEIVE_TEST_NB_CHUNKS; i++) {
+        ret = iovec_receive_test_chunk(cnx, 13, data, order[i]);
+    }
+    if (ret == 0 && (picoquic_mark_iovec_receive_stream(cnx, 13, iovec_receive_test_callback, &ctx[3]) != 0 ||
+        !ctx[3].fin || picoquic_find_stream(cnx, 13) != NULL)) {
+        DBG_PRINTF("Stream 13: %d calls, fin %d, not deleted", ctx[3].nb_calls, ctx[3].fin);
+        ret = -1;
+    }
+
+    if (quic != NULL) {
+        /* Held segments are released with the connection */
+        picoquic_free(quic);
+    }
+
+    return ret;
+}
@@ -0,0 +1,728 @@
+/*
+* Author: Christian Huitema
+* Copyright (c) 2026, Private Octopus, Inc.
+* All rights reserved.
+*
+* Permission to use, copy, modify, and distribute this software for any
+* purpose with or without fee is hereby granted, provided that the above
+* copyright notice and this permission notice appear in all copies.
+*
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL Private Octopus, Inc. BE LIABLE FOR ANY
+* DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+* LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+* ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+* SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "picoquic_internal.h"
+#include "picoquic_utils.h"
+#include "picoslab.h"
+#include "picoarena.h"
+
+#define SLAB_TEST_OBJECT_SIZE 100
+#define SLAB_TEST_NB_OBJECTS 2000
+#define SLAB_TEST_HIGH_WATER 1000
+
+static int slab_test_check_zero(uint8_t* object, size_t length)
+{
+    int ret = 0;
+
+    for (size_t i = 0; ret == 0 && i < length; i++) {
+        if (object[i] != 0) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+/* Verify the slab allocator: objects are zeroed when carved, freed objects
+ * are reused, empty chunks above the high-water mark are released at once,
+ * and the others are released gradually by the trim function.
+ */
+int slab_test()
+{
+    int ret = 0;
+    picoslab_t slab;
+    uint8_t** objects = (uint8_t**)malloc(sizeof(uint8_t*) * SLAB_TEST_NB_OBJECTS);
+    size_t nb_chunks = 0;
+    size_t nb_kept = 0;
+
+    picoslab_init(&slab, SLAB_TEST_OBJECT_SIZE, SLAB_TEST_HIGH_WATER);
+
+    if (objects == NULL) {
+        ret = -1;
+    }
+
+    for (int i = 0; ret == 0 && i < SLAB_TEST_NB_OBJECTS; i++) {
+        if ((objects[i] = (uint8_t*)picoslab_alloc(&slab)) == NULL) {
+            DBG_PRINTF("Cannot allocate object %d", i);
+            ret = -1;
+        }
+        else if (slab_test_check_zero(objects[i], SLAB_TEST_OBJECT_SIZE) != 0) {
+            DBG_PRINTF("Object %d is not zeroed", i);
+            ret = -1;
+        }
+        else if (i > 0 && objects[i] < objects[i - 1] + SLAB_TEST_OBJECT_SIZE &&
+            objects[i] + SLAB_TEST_OBJECT_SIZE > objects[i - 1]) {
+            DBG_PRINTF("Object %d overlaps the previous one", i);
+            ret = -1;
+        }
+        else {
+            memset(objects[i], (uint8_t)(i + 1), SLAB_TEST_OBJECT_SIZE);
+        }
+    }
+
+    if (ret == 0) {
+        nb_chunks = (SLAB_TEST_NB_OBJECTS + slab.objects_per_chunk - 1) / slab.objects_per_chunk;
+        if (slab.stats.nb_allocations != SLAB_TEST_NB_OBJECTS || slab.stats.nb_pool_hits != 0 ||
+            slab.stats.nb_in_use != SLAB_TEST_NB_OBJECTS || slab.stats.nb_chunks_allocated != nb_chunks ||
+            slab.stats.memory_size != nb_chunks * slab.chunk_size) {
+            DBG_PRINTF("Unexpected stats after allocation, %" PRIu64 " chunks", slab.stats.nb_chunks_allocated);
+            ret = -1;
+        }
+    }
+
+    /* Free all objects. Only the empty chunks under the high-water mark are kept. */
+    if (ret == 0) {
+        nb_kept = SLAB_TEST_HIGH_WATER / slab.objects_per_chunk;
+        for (int i = 0; i < SLAB_TEST_NB_OBJECTS; i++) {
+            picoslab_free(&slab, objects[i]);
+        }
+        if (slab.stats.nb_in_use != 0 || slab.empty.nb_chunks != nb_kept ||
+            slab.stats.nb_chunks_trimmed != nb_chunks - nb_kept ||
+            picoslab_nb_cached(&slab) != nb_kept * slab.objects_per_chunk) {
+            DBG_PRINTF("Unexpected stats after free, %zu empty chunks", slab.empty.nb_chunks);
+            ret = -1;
+        }
+    }
+
+    /* Freed objects are reused without being zeroed */
+    if (ret == 0) {
+        uint8_t* object = (uint8_t*)picoslab_alloc(&slab);
+
+        if (object == NULL || slab.stats.nb_pool_hits != 1) {
+            DBG_PRINTF("%s", "Freed object not reused");
+            ret = -1;
+        }
+        else if (slab_test_check_zero(object, SLAB_TEST_OBJECT_SIZE) == 0) {
+            DBG_PRINTF("%s", "Recycled object was zeroed");
+            ret = -1;
+        }
+        picoslab_free(&slab, object);
+    }
+
+    /* Idle chunks are released one by one after the idle delay */
+    if (ret == 0) {
+        uint64_t current_time = 0;
+        uint64_t nb_trimmed = slab.stats.nb_chunks_trimmed;
+
+        (void)picoslab_trim(&slab, current_time);
+        current_time += PICOSLAB_IDLE_DELAY / 2;
+        if (picoslab_trim(&slab, current_time) != 0) {
+            DBG_PRINTF("%s", "Chunk released before the idle delay");
+            ret = -1;
+        }
+        while (ret == 0 && slab.empty.nb_chunks > 0) {
+            current_time += PICOSLAB_TRIM_INTERVAL;
+            if (current_time > 10 * PICOSLAB_IDLE_DELAY) {
+                DBG_PRINTF("%s", "Idle chunks are not released");
+                ret = -1;
+            }
+            else {
+                (void)picoslab_trim(&slab, current_time);
+            }
+        }
+        if (ret == 0 && (slab.stats.memory_size != 0 ||
+            slab.stats.nb_chunks_trimmed != nb_trimmed + nb_kept)) {
+            DBG_PRINTF("%s", "Unexpected stats after trim");
+            ret = -1;
+        }
+    }
+
+    picoslab_release(&slab);
+    if (objects != NULL) {
+        free(objects);
+    }
+
+    return ret;
+}
+
+/* Verify that packets are allocated from the packet pool of the QUIC context,
+ * that recycled packets have their metadata reset, and that the high-water
+ * mark can be tuned.
+ */
+#define PACKET_POOL_TEST_NB_PACKETS 100
+
+int packet_pool_test()
+{
+    int ret = 0;
+    picoquic_packet_t* packets[PACKET_POOL_TEST_NB_PACKETS];
+    picoquic_pool_stats_t stats;
+    uint64_t nb_chunks_first_round = 0;
+    picoquic_quic_t* quic = picoquic_create(8, NULL, NULL, NULL, NULL, NULL, NULL,
+        NULL, NULL, NULL, 0, NULL, NULL, NULL, 0);
+
+    memset(packets, 0, sizeof(packets));
+    if (quic == NULL) {
+        ret = -1;
+    }
+
+    for (int round = 0; ret == 0 && round < 2; round++) {
+        for (int i = 0; ret == 0 && i < PACKET_POOL_TEST_NB_PACKETS; i++) {
+            if ((packets[i] = picoquic_create_packet(quic)) == NULL) {
+                ret = -1;
+            }
+            else if (packets[i]->length != 0 || packets[i]->sequence_number != 0 ||
+                packets[i]->packet_next != NULL || packets[i]->is_queued_to_path) {
+                DBG_PRINTF("Packet %d metadata not reset, round %d", i, round);
+                ret = -1;
+            }
+            else {
+                packets[i]->length = PICOQUIC_MAX_PACKET_SIZE;
+                packets[i]->sequence_number = (uint64_t)i + 1;
+                packets[i]->packet_next = packets[i];
+                packets[i]->is_queued_to_path = 1;
+            }
+        }
+        for (int i = 0; i < PACKET_POOL_TEST_NB_PACKETS; i++) {
+            picoquic_recycle_packet(quic, packets[i]);
+            packets[i] = NULL;
+        }
+        if (round == 0) {
+            picoquic_get_packet_pool_stats(quic, &stats);
+            nb_chunks_first_round = stats.nb_chunks_allocated;
+        }
+    }
+
+    if (ret == 0) {
+        picoquic_get_packet_pool_stats(quic, &stats);
+        /* The second round reuses the chunks of the first one */
+        if (stats.nb_allocations != 2 * PACKET_POOL_TEST_NB_PACKETS ||
+            stats.nb_pool_hits == 0 || stats.nb_pool_hits > PACKET_POOL_TEST_NB_PACKETS ||
+            stats.nb_chunks_allocated != nb_chunks_first_round ||
+            stats.nb_in_use != 0 || stats.nb_in_use_max != PACKET_POOL_TEST_NB_PACKETS ||
+            stats.nb_cached < PACKET_POOL_TEST_NB_PACKETS || stats.memory_size == 0) {
+            DBG_PRINTF("Unexpected pool stats, %" PRIu64 " allocations, %" PRIu64 " hits",
+                stats.nb_allocations, stats.nb_pool_hits);
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        /* With a high-water mark of 0, the empty chunks are returned to the system */
+        picoquic_set_packet_pool_high_water(quic, 0);
+        picoquic_get_packet_pool_stats(quic, &stats);
+        if (stats.memory_size != 0 || stats.nb_cached != 0 ||
+            stats.nb_chunks_trimmed != stats.nb_chunks_allocated) {
+            DBG_PRINTF("%s", "Empty chunks kept above the high-water mark");
+            ret = -1;
+        }
+    }
+
+    if (quic != NULL) {
+        picoquic_free(quic);
+    }
+
+    return ret;
+}
+
+/* Verify that small chunks of stream data received out of order are held in
+ * small data nodes. The test simulates a high reordering, with packets of
+ * a single stream arriving in reverse order, and processes them as the stack
+ * does: each packet is decrypted in a full size node, then its last frame is
+ * queued with picoquic_queue_network_input. One chunk in four is large, and
+ * is held by reference to the received packet; the others are small.
+ */
+#define DATA_NODE_REORDER_NB_CHUNKS 1024
+#define DATA_NODE_REORDER_SMALL 40
+#define DATA_NODE_REORDER_LARGE 1200
+#define DATA_NODE_REORDER_HEADER 20
+
+int picoquic_queue_network_input(picoquic_quic_t* quic, picosplay_tree_t* tree, uint64_t consumed_offset,
+    uint64_t stream_ofs, const uint8_t* bytes, size_t length, int is_last_frame, picoquic_stream_data_node_t* received_data, int* new_data_available);
+int64_t picoquic_stream_data_node_compare(void* l, void* r);
+picosplay_node_t* picoquic_stream_data_node_create(void* value);
+void picoquic_stream_data_node_delete(void* tree, picosplay_node_t* node);
+void* picoquic_stream_data_node_value(picosplay_node_t* node);
+
+static size_t data_node_reorder_length(int i)
+{
+    return ((i % 4) == 0) ? DATA_NODE_REORDER_LARGE : DATA_NODE_REORDER_SMALL;
+}
+
+static uint8_t data_node_reorder_byte(uint64_t offset)
+{
+    return (uint8_t)(offset * 7 + (offset >> 8));
+}
+
+static int data_node_reorder_receive(picoquic_quic_t* quic, picosplay_tree_t* tree, uint64_t offset, size_t length)
+{
+    int ret = 0;
+    int new_data_available = 0;
+    picoquic_stream_data_node_t* received_data = picoquic_stream_data_node_alloc(quic);
+
+    if (received_data == NULL) {
+        ret = -1;
+    }
+    else {
+        for (size_t j = 0; j < length; j++) {
+            received_data->data[DATA_NODE_REORDER_HEADER + j] = data_node_reorder_byte(offset + j);
+        }
+        ret = picoquic_queue_network_input(quic, tree, 0, offset, received_data->data + DATA_NODE_REORDER_HEADER,
+            length, 1, received_data, &new_data_available);
+        if (received_data->bytes == NULL) {
+            picoquic_stream_data_node_recycle(received_data);
+        }
+    }
+    return ret;
+}
+
+int data_node_reorder_test()
+{
+    int ret = 0;
+    uint64_t simulated_time = 0;
+    uint64_t offsets[DATA_NODE_REORDER_NB_CHUNKS + 1];
+    size_t nb_small = 0;
+    size_t nb_large = 0;
+    picoquic_memory_stats_t stats;
+    picoquic_quic_t* quic = picoquic_create(8, NULL, NULL, NULL, NULL, NULL,
+        NULL, NULL, NULL, NULL, simulated_time, &simulated_time, NULL, NULL, 0);
+    picosplay_tree_t* tree = picosplay_new_tree(picoquic_stream_data_node_compare,
+        picoquic_stream_data_node_create, picoquic_stream_data_node_delete, picoquic_stream_data_node_value);
+
+    if (quic == NULL || tree == NULL) {
+        ret = -1;
+    }
+
+    offsets[0] = 0;
+    for (int i = 0; i < DATA_NODE_REORDER_NB_CHUNKS; i++) {
+        offsets[i + 1] = offsets[i] + data_node_reorder_length(i);
+    }
+
+    /* All chunks but the first one arrive, in reverse order */
+    for (int i = DATA_NODE_REORDER_NB_CHUNKS - 1; ret == 0 && i > 0; i--) {
+        ret = data_node_reorder_receive(quic, tree, offsets[i], data_node_reorder_length(i));
+        if (data_node_reorder_length(i) == DATA_NODE_REORDER_SMALL) {
+            nb_small++;
+        }
+        else {
+            nb_large++;
+        }
+    }
+
+    if (ret == 0) {
+        size_t memory_size = 0;
+        uint64_t full_node_size;
+
+        picoquic_get_memory_stats(quic, &stats);
+        full_node_size = stats.data_nodes[PICOQUIC_NB_DATA_NODE_CLASSES - 1].memory_size /
+            (stats.data_nodes[PICOQUIC_NB_DATA_NODE_CLASSES - 1].nb_in_use + stats.data_nodes[PICOQUIC_NB_DATA_NODE_CLASSES - 1].nb_cached);
+        for (int i = 0; i < PICOQUIC_NB_DATA_NODE_CLASSES; i++) {
+            memory_size += stats.data_nodes[i].memory_size;
+        }
+        if (stats.data_nodes[0].nb_in_use != nb_small ||
+            stats.data_nodes[PICOQUIC_NB_DATA_NODE_CLASSES - 1].nb_in_use != nb_large) {
+            DBG_PRINTF("Unexpected node classes: %zu small, %zu full", stats.data_nodes[0].nb_in_use,
+                stats.data_nodes[PICOQUIC_NB_DATA_NODE_CLASSES - 1].nb_in_use);
+            ret = -1;
+        }
+        else if (stats.data_node_bytes_saved < nb_small * (PICOQUIC_MAX_PACKET_SIZE - stats.data_node_size[0]) ||
+            stats.data_node_bytes_saved_total < stats.data_node_bytes_saved) {
+            DBG_PRINTF("Bytes saved: %" PRIu64 ", total %" PRIu64, stats.data_node_bytes_saved,
+                stats.data_node_bytes_saved_total);
+            ret = -1;
+        }
+        else if (memory_size >= (nb_small + nb_large) * full_node_size) {
+            DBG_PRINTF("Data nodes use %zu bytes, more than full size nodes", memory_size);
+            ret = -1;
+        }
+    }
+
+    /* The first chunk arrives, all the data can be delivered in order */
+    if (ret == 0) {
+        ret = data_node_reorder_receive(quic, tree, offsets[0], data_node_reorder_length(0));
+    }
+
+    if (ret == 0) {
+        uint64_t expected_offset = 0;
+        picoquic_stream_data_node_t* next = (picoquic_stream_data_node_t*)picosplay_first(tree);
+
+        while (ret == 0 && next != NULL) {
+            if (next->offset != expected_offset) {
+                DBG_PRINTF("Gap at offset %" PRIu64, expected_offset);
+                ret = -1;
+            }
+            for (size_t j = 0; ret == 0 && j < next->length; j++) {
+                if (next->bytes[j] != data_node_reorder_byte(next->offset + j)) {
+                    DBG_PRINTF("Wrong data at offset %" PRIu64, next->offset + j);
+                    ret = -1;
+                }
+            }
+            expected_offset = next->offset + next->length;
+            next = (picoquic_stream_data_node_t*)picosplay_next(&next->stream_data_node);
+        }
+        if (ret == 0 && expected_offset != offsets[DATA_NODE_REORDER_NB_CHUNKS]) {
+            DBG_PRINTF("Received %" PRIu64 " bytes instead of %" PRIu64, expected_offset,
+                offsets[DATA_NODE_REORDER_NB_CHUNKS]);
+            ret = -1;
+        }
+    }
+
+    if (tree != NULL) {
+        picosplay_empty_tree(tree);
+        free(tree);
+    }
+
+    if (ret == 0 && quic->nb_data_nodes_in_use != 0) {
+        DBG_PRINTF("%zu data nodes not recycled", quic->nb_data_nodes_in_use);
+        ret = -1;
+    }
+
+    if (quic != NULL) {
+        picoquic_free(quic);
+    }
+
+    return ret;
+}
+
+/* Verify the connection arena: objects of different sizes are carved from
+ * the same block without overlapping, freed objects are reused for the next
+ * allocation of the same size class, large objects fall back to malloc, and
+ * all blocks are returned when the arena is released. Then check that the
+ * creation of a connection fits in a single arena block, and that it does
+ * not use the arena at all if the arena is disabled.
+ */
+#define ARENA_TEST_NB_OBJECTS 64
+
+int arena_test()
+{
+    int ret = 0;
+    picoarena_t arena;
+    uint8_t* objects[ARENA_TEST_NB_OBJECTS];
+    size_t sizes[ARENA_TEST_NB_OBJECTS];
+    uint8_t* large = NULL;
+
+    picoarena_init(&arena);
+
+    for (int i = 0; ret == 0 && i < ARENA_TEST_NB_OBJECTS; i++) {
+        sizes[i] = 8 + ((size_t)i * 97) % PICOARENA_OBJECT_MAX;
+        if ((objects[i] = (uint8_t*)picoarena_alloc(&arena, sizes[i])) == NULL) {
+            DBG_PRINTF("Cannot allocate object %d", i);
+            ret = -1;
+        }
+        else {
+            memset(objects[i], (uint8_t)(i + 1), sizes[i]);
+        }
+    }
+
+    /* Each object still holds its own pattern, so no two objects overlap */
+    for (int i = 0; ret == 0 && i < ARENA_TEST_NB_OBJECTS; i++) {
+        for (size_t j = 0; j < sizes[i]; j++) {
+            if (objects[i][j] != (uint8_t)(i + 1)) {
+                DBG_PRINTF("Object %d overwritten at %zu", i, j);
+                ret = -1;
+                break;
+            }
+        }
+    }
+
+    if (ret == 0 && (arena.stats.nb_allocations != ARENA_TEST_NB_OBJECTS ||
+        arena.stats.nb_reused != 0 || arena.stats.nb_large != 0 || arena.stats.nb_blocks < 2)) {
+        DBG_PRINTF("Unexpected stats after allocation, %zu blocks", arena.stats.nb_blocks);
+        ret = -1;
+    }
+
+    /* A freed object is reused by an allocation of the same class */
+    if (ret == 0) {
+        size_t nb_blocks = arena.stats.nb_blocks;
+        uint8_t* object;
+
+        picoarena_free(&arena, objects[5], sizes[5]);
+        object = (uint8_t*)picoarena_alloc(&arena, sizes[5]);
+        if (object != objects[5] || arena.stats.nb_reused != 1 || arena.stats.nb_blocks != nb_blocks) {
+            DBG_PRINTF("%s", "Freed object not reused");
+            ret = -1;
+        }
+    }
+
+    /* Large objects are not taken from the arena */
+    if (ret == 0) {
+        large = (uint8_t*)picoarena_alloc(&arena, PICOARENA_OBJECT_MAX + 1);
+        if (large == NULL || arena.stats.nb_large != 1) {
+            DBG_PRINTF("%s", "Large object not allocated");
+            ret = -1;
+        }
+        picoarena_free(&arena, large, PICOARENA_OBJECT_MAX + 1);
+    }
+
+    picoarena_release(&arena);
+    if (ret == 0 && (arena.stats.nb_blocks != 0 || arena.first_block != NULL)) {
+        DBG_PRINTF("%s", "Blocks not released");
+        ret = -1;
+    }
+
+    if (ret == 0) {
+        struct sockaddr_in addr;
+        picoquic_cnx_t* cnx = NULL;
+        picoquic_quic_t* quic = picoquic_create(8, NULL, NULL, NULL, NULL, NULL, NULL,
+            NULL, NULL, NULL, 0, NULL, NULL, NULL, 0);
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(4433);
+
+        if (quic == NULL ||
+            (cnx = picoquic_create_cnx(quic, picoquic_null_connection_id, picoquic_null_connection_id,
+                (struct sockaddr*)&addr, 0, 0, NULL, NULL, 1)) == NULL) {
+            ret = -1;
+        }
+        else if (cnx->arena.stats.nb_blocks != 1 || cnx->arena.stats.nb_large != 0) {
+            DBG_PRINTF("Connection uses %zu arena blocks, %" PRIu64 " large objects",
+                cnx->arena.stats.nb_blocks, cnx->arena.stats.nb_large);
+            ret = -1;
+        }
+
+        if (cnx != NULL) {
+            picoquic_delete_cnx(cnx);
+            cnx = NULL;
+        }
+        if (ret == 0) {
+            quic->is_cnx_arena_disabled = 1;
+            if ((cnx = picoquic_create_cnx(quic, picoquic_null_connection_id, picoquic_null_connection_id,
+                (struct sockaddr*)&addr, 0, 0, NULL, NULL, 1)) == NULL) {
+                ret = -1;
+            }
+            else if (cnx->arena.stats.nb_blocks != 0 || cnx->arena.stats.nb_allocations == 0 ||
+                cnx->arena.stats.nb_large != cnx->arena.stats.nb_allocations) {
+                DBG_PRINTF("Disabled arena uses %zu blocks, %" PRIu64 " of %" PRIu64 " objects passed to malloc",
+                    cnx->arena.stats.nb_blocks, cnx->arena.stats.nb_large, cnx->arena.stats.nb_allocations);
+                ret = -1;
+            }
+            if (cnx != NULL) {
+                picoquic_delete_cnx(cnx);
+            }
+        }
+        if (quic != NULL) {
+            picoquic_free(quic);
+        }
+    }
+
+    return ret;
+}
+
+/* Stream churn microbenchmark.
+ * Open and close one million streams on a connection, each with a few ACK
+ * ranges, as a server handling many short requests would. Once the first
+ * chunks are carved, the stream heads and the ACK ranges must be recycled
+ * from the pools of the context without calling the allocator.
+ */
+#define STREAM_CHURN_NB_STREAMS 1000000
+#define STREAM_CHURN_WARM_UP 1000
+
+int stream_churn_test()
+{
+    int ret = 0;
+    struct sockaddr_in addr;
+    picoquic_cnx_t* cnx = NULL;
+    uint64_t stream_chunks = 0;
+    uint64_t sack_chunks = 0;
+    uint64_t start_time = 0;
+    picoquic_quic_t* quic = picoquic_create(8, NULL, NULL, NULL, NULL, NULL, NULL,
+        NULL, NULL, NULL, 0, NULL, NULL, NULL, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(4433);
+
+    if (quic == NULL ||
+        (cnx = picoquic_create_cnx(quic, picoquic_null_connection_id, picoquic_null_connection_id,
+            (struct sockaddr*)&addr, 0, 0, NULL, NULL, 1)) == NULL) {
+        ret = -1;
+    }
+
+    for (int i = 0; ret == 0 && i < STREAM_CHURN_NB_STREAMS; i++) {
+        picoquic_stream_head_t* stream = picoquic_create_stream(cnx, 4 * (uint64_t)i);
+
+        if (i == STREAM_CHURN_WARM_UP) {
+            stream_chunks = quic->stream_slab.stats.nb_chunks_allocated;
+            sack_chunks = quic->sack_item_slab.stats.nb_chunks_allocated;
+            start_time = picoquic_current_time();
+        }
+
+        if (stream == NULL) {
+            DBG_PRINTF("Cannot create stream %d", i);
+            ret = -1;
+        }
+        else {
+            /* Two disjoint ranges, as if a packet was lost */
+            if (picoquic_update_sack_list(&stream->sack_list, 0, 999, 0) != 0 ||
+                picoquic_update_sack_list(&stream->sack_list, 2000, 2999, 0) != 0) {
+                ret = -1;
+            }
+            picoquic_delete_stream(cnx, stream);
+        }
+    }
+
+    if (ret == 0) {
+        uint64_t elapsed = picoquic_current_time() - start_time;
+
+        if (quic->stream_slab.stats.nb_chunks_allocated != stream_chunks ||
+            quic->sack_item_slab.stats.nb_chunks_allocated != sack_chunks) {
+            DBG_PRINTF("Chunks allocated after warm up, streams: %" PRIu64 ", sack items: %" PRIu64,
+                quic->stream_slab.stats.nb_chunks_allocated - stream_chunks,
+                quic->sack_item_slab.stats.nb_chunks_allocated - sack_chunks);
+            ret = -1;
+        }
+        else if (quic->stream_slab.stats.nb_in_use != 0) {
+            DBG_PRINTF("%zu stream heads not recycled", quic->stream_slab.stats.nb_in_use);
+            ret = -1;
+        }
+        else {
+            DBG_PRINTF("Opened and closed %d streams in %" PRIu64 " us",
+                STREAM_CHURN_NB_STREAMS - STREAM_CHURN_WARM_UP, elapsed);
+        }
+    }
+
+    if (cnx != NULL) {
+        picoquic_delete_cnx(cnx);
+    }
+    if (quic != NULL) {
+        picoquic_free(quic);
+    }
+
+    return ret;
+}
+
+/* Huge page pools benchmark.
+ * Simulate the retransmit queue of a connection with a large bandwidth-delay
+ * product: fill the packet pool with tens of thousands of packets, chain them
+ * in random order, as recycled packets are, and walk the chain repeatedly as
+ * the loss detection does. The walk is timed with and without huge page
+ * pools. The timing is only reported, since the effect depends on whether the
+ * system actually provides huge pages. The test verifies the pool layout in
+ * each mode, and that the option cannot be changed while packets are in use.
+ */
+#define HUGE_PAGE_POOL_NB_PACKETS 0x8000
+#define HUGE_PAGE_POOL_NB_WALKS 16
+
+static int huge_page_pool_walk(int use_huge_pages, picoquic_packet_t** packets, uint64_t* elapsed)
+{
+    int ret = 0;
+    uint64_t random_ctx = 0x485547455041474Bull;
+    picoquic_pool_stats_t stats;
+    picoquic_quic_t* quic = picoquic_create(8, NULL, NULL, NULL, NULL, NULL, NULL,
+        NULL, NULL, NULL, 0, NULL, NULL, NULL, 0);
+
+    if (quic == NULL || picoquic_set_huge_page_pools(quic, use_huge_pages) != 0) {
+        ret = -1;
+    }
+
+    for (int i = 0; ret == 0 && i < HUGE_PAGE_POOL_NB_PACKETS; i++) {
+        if ((packets[i] = picoquic_create_packet(quic)) == NULL) {
+            ret = -1;
+        }
+        else {
+            packets[i]->sequence_number = (uint64_t)i;
+            packets[i]->send_time = (uint64_t)i * 10;
+            packets[i]->length = PICOQUIC_MAX_PACKET_SIZE;
+            packets[i]->bytes[0] = (uint8_t)i;
+        }
+    }
+
+    if (ret == 0 && picoquic_set_huge_page_pools(quic, !use_huge_pages) == 0) {
+        DBG_PRINTF("%s", "Pool option changed while packets are in use");
+        ret = -1;
+    }
+
+    if (ret == 0) {
+        uint64_t start_time;
+        uint64_t checksum = 0;
+        picoquic_packet_t* first = NULL;
+
+        /* Shuffle, then chain the packets */
+        for (int i = HUGE_PAGE_POOL_NB_PACKETS - 1; i > 0; i--) {
+            int j = (int)(picoquic_test_random(&random_ctx) % (uint64_t)(i + 1));
+            picoquic_packet_t* x = packets[i];
+            packets[i] = packets[j];
+            packets[j] = x;
+        }
+        for (int i = HUGE_PAGE_POOL_NB_PACKETS - 1; i >= 0; i--) {
+            packets[i]->packet_next = first;
+            first = packets[i];
+        }
+
+        start_time = picoquic_current_time();
+        for (int w = 0; w < HUGE_PAGE_POOL_NB_WALKS; w++) {
+            picoquic_packet_t* p = first;
+            while (p != NULL) {
+                checksum += p->send_time + p->bytes[0];
+                p = p->packet_next;
+            }
+        }
+        *elapsed = picoquic_current_time() - start_time;
+
+        if (checksum == 0) {
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        picoquic_get_packet_pool_stats(quic, &stats);
+        if (stats.chunk_size != ((use_huge_pages) ? PICOSLAB_HUGE_PAGE_SIZE : PICOSLAB_CHUNK_SIZE) ||
+            stats.objects_per_chunk * stats.nb_chunks_allocated < HUGE_PAGE_POOL_NB_PACKETS ||
+            (!use_huge_pages && stats.nb_chunks_hugetlb + stats.nb_chunks_advised != 0) ||
+            stats.nb_chunks_hugetlb + stats.nb_chunks_advised > stats.nb_chunks_allocated) {
+            DBG_PRINTF("Unexpected pool layout, chunks of %zu bytes", stats.chunk_size);
+            ret = -1;
+        }
+        else {
+            DBG_PRINTF("Huge pages %d: %" PRIu64 " chunks of %zu bytes, %zu packets per chunk, %" PRIu64 " hugetlb, %" PRIu64 " advised",
+                use_huge_pages, stats.nb_chunks_allocated, stats.chunk_size, stats.objects_per_chunk,
+                stats.nb_chunks_hugetlb, stats.nb_chunks_advised);
+        }
+    }
+
+    if (quic != NULL) {
+        for (int i = 0; i < HUGE_PAGE_POOL_NB_PACKETS; i++) {
+            if (packets[i] != NULL) {
+                picoquic_recycle_packet(quic, packets[i]);
+                packets[i] = NULL;
+            }
+        }
+        picoquic_free(quic);
+    }
+
+    return ret;
+}
+
+int huge_page_pool_test()
+{
+    int ret = 0;
+    uint64_t elapsed[2] = { 0, 0 };
+    picoquic_packet_t** packets = (picoquic_packet_t**)malloc(sizeof(picoquic_packet_t*) * HUGE_PAGE_POOL_NB_PACKETS);
+
+    if (packets == NULL) {
+        ret = -1;
+    }
+    else {
+        memset(packets, 0, sizeof(picoquic_packet_t*) * HUGE_PAGE_POOL_NB_PACKETS);
+        for (int use_huge_pages = 0; ret == 0 && use_huge_pages < 2; use_huge_pages++) {
+            ret = huge_page_pool_walk(use_huge_pages, packets, &elapsed[use_huge_pages]);
+        }
+        free(packets);
+    }
+
+    if (ret == 0) {
+        DBG_PRINTF("Walked %d packets %d times in %" PRIu64 " us with small chunks, %" PRIu64 " us with huge pages",
+            HUGE_PAGE_POOL_NB_PACKETS, HUGE_PAGE_POOL_NB_WALKS, elapsed[0], elapsed[1]);
+    }
+
+    return ret;
+}
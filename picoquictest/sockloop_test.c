@@ -28,7 +28,9 @@
 #include "picoquictest_internal.h"
 #include "autoqlog.h"
 #include "picoquic_packet_loop.h"
+#include "picoquic_workers.h"
 #include "picosocks.h"
+#include "sockloop_uring.h"
 
 
 #ifndef SLEEP
@@ -62,6 +64,12 @@ typedef struct st_sockloop_test_spec_t {
     int extra_socket_required;
     int prefer_extra_socket;
     int force_migration;
+    int recv_batch_size;
+    int do_send_batch;
+    int use_io_uring;
+    uint64_t pacing_offload_horizon;
+    uint64_t busy_poll_threshold;
+    uint64_t busy_poll_budget;
 } sockloop_test_spec_t;
 
 typedef struct st_sockloop_test_cb_t {
@@ -83,6 +91,10 @@ typedef struct st_sockloop_test_cb_t {
     picoquic_connection_id_t server_cid_before_migration;
     picoquic_connection_id_t client_cid_before_migration;
     picoquic_packet_loop_param_t* param;
+    size_t nb_recv_batches;
+    size_t max_recv_batch;
+    size_t nb_sc_duration_reports;
+    packet_loop_system_call_duration_t sc_duration;
 } sockloop_test_cb_t;
 
 int sockloop_test_received_finished(picoquic_test_tls_api_ctx_t* test_ctx)
@@ -144,12 +156,19 @@ int sockloop_test_cb(picoquic_quic_t* quic, picoquic_packet_loop_cb_enum cb_mode
                 if (cb_ctx->param->extra_socket_required) {
                     options->provide_alt_port = 1;
                 }
+                if (cb_ctx->param->busy_poll_threshold > 0) {
+                    options->do_system_call_duration = 1;
+                }
             }
             DBG_PRINTF("%s", "Waiting for packets.\n");
             break;
         }
         case picoquic_packet_loop_after_receive:
             /* Post receive callback */
+            cb_ctx->nb_recv_batches++;
+            if (*((size_t*)callback_arg) > cb_ctx->max_recv_batch) {
+                cb_ctx->max_recv_batch = *((size_t*)callback_arg);
+            }
             if (cnx_client->cnx_state == picoquic_state_disconnected) {
                 DBG_PRINTF("%s", "The connection is closed!\n");
                 ret = PICOQUIC_NO_ERROR_TERMINATE_PACKET_LOOP;
@@ -242,6 +261,10 @@ int sockloop_test_cb(picoquic_quic_t* quic, picoquic_packet_loop_cb_enum cb_mode
             break;
         case picoquic_packet_loop_port_update:
             break;
+        case picoquic_packet_loop_system_call_duration:
+            cb_ctx->nb_sc_duration_reports++;
+            memcpy(&cb_ctx->sc_duration, callback_arg, sizeof(packet_loop_system_call_duration_t));
+            break;
             /* TODO: consider adding the delay computation callback! */
         case picoquic_packet_loop_time_check: {
             packet_loop_time_check_arg_t* time_check_arg = (packet_loop_time_check_arg_t*) callback_arg;
@@ -522,7 +545,12 @@ int sockloop_test_one(sockloop_test_spec_t *spec)
             param.simulate_eio = spec->simulate_eio;
             param.extra_socket_required = spec->extra_socket_required;
             param.prefer_extra_socket = spec->prefer_extra_socket;
-            
+            param.recv_batch_size = spec->recv_batch_size;
+            param.do_send_batch = spec->do_send_batch;
+            param.use_io_uring = spec->use_io_uring;
+            param.pacing_offload_horizon = spec->pacing_offload_horizon;
+            param.busy_poll_threshold = spec->busy_poll_threshold;
+            param.busy_poll_budget = spec->busy_poll_budget;
 
             loop_cb.force_migration = spec->force_migration;
             loop_cb.param = &param;
@@ -570,6 +598,10 @@ int sockloop_test_one(sockloop_test_spec_t *spec)
                             }
                         }
                     }
+                    if (ret == 0 && thread_ctx->is_io_uring_used != spec->use_io_uring) {
+                        DBG_PRINTF("io_uring requested: %d, used: %d", spec->use_io_uring, thread_ctx->is_io_uring_used);
+                        ret = -1;
+                    }
                     picoquic_delete_network_thread(thread_ctx);
                 }
             }
@@ -590,6 +622,26 @@ int sockloop_test_one(sockloop_test_spec_t *spec)
         else if (spec->force_migration != 0 && sockloop_test_verify_migration(&loop_cb, test_ctx->cnx_client) != 0) {
             ret = -1;
         }
+        else if (loop_cb.nb_recv_batches == 0 || loop_cb.max_recv_batch == 0) {
+            DBG_PRINTF("%s", "No packets reported after receive");
+            ret = -1;
+        }
+        else if (spec->recv_batch_size > 1 && loop_cb.max_recv_batch > (size_t)spec->recv_batch_size) {
+            DBG_PRINTF("Batch of %zu packets, larger than %d", loop_cb.max_recv_batch, spec->recv_batch_size);
+            ret = -1;
+        }
+#if defined(__linux__)
+        else if (spec->recv_batch_size > 1 && loop_cb.max_recv_batch < 2) {
+            DBG_PRINTF("%s", "Packets were never received in batches");
+            ret = -1;
+        }
+#endif
+        else if (spec->busy_poll_threshold > 0 && (loop_cb.nb_sc_duration_reports == 0 ||
+            loop_cb.sc_duration.nb_spin == 0)) {
+            DBG_PRINTF("Busy poll: %zu reports, %" PRIu64 " spins", loop_cb.nb_sc_duration_reports,
+                loop_cb.sc_duration.nb_spin);
+            ret = -1;
+        }
         else {
             ret = tls_api_one_scenario_verify(test_ctx);
         }
@@ -730,4 +782,970 @@ int sockloop_thread_name_test()
     spec.thread_name = "picoquic loop";
 
     return(sockloop_test_one(&spec));
-}
\ No newline at end of file
+}
+
+int sockloop_recvmmsg_test()
+{
+    sockloop_test_spec_t spec;
+    sockloop_test_set_spec(&spec, 9);
+    spec.socket_buffer_size = 0xffff;
+    spec.scenario = sockloop_test_scenario_1M;
+    spec.scenario_size = sizeof(sockloop_test_scenario_1M);
+    spec.recv_batch_size = 16;
+
+    return(sockloop_test_one(&spec));
+}
+
+int sockloop_sendmmsg_test()
+{
+    sockloop_test_spec_t spec;
+    sockloop_test_set_spec(&spec, 10);
+    spec.socket_buffer_size = 0xffff;
+    spec.scenario = sockloop_test_scenario_1M;
+    spec.scenario_size = sizeof(sockloop_test_scenario_1M);
+    /* Without GSO, each pass of the send loop queues several messages */
+    spec.do_not_use_gso = 1;
+    spec.do_send_batch = 1;
+
+    return(sockloop_test_one(&spec));
+}
+
+/* Transfer with pacing offloaded to the kernel. On loopback, the
+ * departure times are not enforced unless the fq qdisc is installed,
+ * but the stack prepares packets ahead of time and the loop sets
+ * the SCM_TXTIME control messages.
+ */
+int sockloop_txtime_test()
+{
+    sockloop_test_spec_t spec;
+    sockloop_test_set_spec(&spec, 12);
+    spec.socket_buffer_size = 0xffff;
+    spec.scenario = sockloop_test_scenario_1M;
+    spec.scenario_size = sizeof(sockloop_test_scenario_1M);
+    spec.pacing_offload_horizon = 2000;
+
+    return(sockloop_test_one(&spec));
+}
+
+/* Transfer with the adaptive busy poll. The next wake time is often
+ * less than a millisecond away during the transfer, so the loop spins
+ * some of the time, and reports the spin and block times when it exits.
+ */
+int sockloop_busy_poll_test()
+{
+    sockloop_test_spec_t spec;
+    sockloop_test_set_spec(&spec, 13);
+    spec.socket_buffer_size = 0xffff;
+    spec.scenario = sockloop_test_scenario_1M;
+    spec.scenario_size = sizeof(sockloop_test_scenario_1M);
+    spec.busy_poll_threshold = 2000;
+    spec.busy_poll_budget = 500;
+
+    return(sockloop_test_one(&spec));
+}
+
+static test_api_stream_desc_t sockloop_test_scenario_10M[] = {
+    { 4, 0, 257, 5000000 },
+    { 8, 4, 257, 5000000 }
+};
+
+/* Run the same loopback transfer with the select based loop and with the
+ * io_uring backend, and report the throughput of both. The network thread
+ * reports whether the ring was actually used. If the kernel does not
+ * support io_uring, the second run is skipped.
+ */
+int sockloop_uring_test()
+{
+    int ret = 0;
+    int nb_runs = 1;
+    uint64_t duration[2] = { 0, 0 };
+
+#ifdef PICOQUIC_PACKET_LOOP_USE_IO_URING
+    if (picoquic_uring_is_available()) {
+        nb_runs = 2;
+    }
+#endif
+    if (nb_runs < 2) {
+        DBG_PRINTF("%s", "io_uring is not available, skipping the io_uring run.");
+    }
+
+    for (int i = 0; ret == 0 && i < nb_runs; i++) {
+        sockloop_test_spec_t spec;
+        uint64_t start_time = picoquic_current_time();
+
+        sockloop_test_set_spec(&spec, 11);
+        spec.socket_buffer_size = 0xffff;
+        spec.scenario = sockloop_test_scenario_10M;
+        spec.scenario_size = sizeof(sockloop_test_scenario_10M);
+        spec.use_background_thread = 1;
+        spec.use_io_uring = i;
+        ret = sockloop_test_one(&spec);
+        duration[i] = picoquic_current_time() - start_time;
+    }
+
+    if (ret == 0 && nb_runs == 2) {
+        DBG_PRINTF("Loopback transfer of 10MB, select: %" PRIu64 "us, io_uring: %" PRIu64 "us",
+            duration[0], duration[1]);
+    }
+
+    return ret;
+}
+
+/* Verify that UDP GRO is enabled on Linux sockets opened by the packet
+ * loop, by sending a GSO burst over the loopback interface and checking
+ * that the burst is received in a single coalesced buffer, with the
+ * segment size documented in the control message.
+ */
+int sockloop_gro_test()
+{
+    int ret = 0;
+#if defined(_WINDOWS) || !defined(UDP_GRO)
+    /* UDP_GRO is only supported on Linux */
+#else
+    picoquic_socket_ctx_t recv_ctx[PICOQUIC_PACKET_LOOP_SOCKETS_MAX];
+    picoquic_socket_ctx_t send_ctx[PICOQUIC_PACKET_LOOP_SOCKETS_MAX];
+    int nb_recv_sockets = 0;
+    int nb_send_sockets = 0;
+    const size_t segment_size = 1200;
+    const size_t nb_segments = 5;
+    const size_t last_segment_size = 500;
+    size_t send_length = segment_size * (nb_segments - 1) + last_segment_size;
+    uint8_t* buffer = (uint8_t*)malloc(0x10000);
+
+    memset(recv_ctx, 0, sizeof(recv_ctx));
+    memset(send_ctx, 0, sizeof(send_ctx));
+
+    if (buffer == NULL) {
+        ret = -1;
+    }
+    else if ((nb_recv_sockets = picoquic_packet_loop_open_sockets(0, AF_INET6, 0, 0, 0, recv_ctx)) <= 0 ||
+        (nb_send_sockets = picoquic_packet_loop_open_sockets(0, AF_INET6, 0, 0, 0, send_ctx)) <= 0) {
+        DBG_PRINTF("%s", "Cannot open the sockets");
+        ret = -1;
+    }
+    else if (!recv_ctx[0].supports_udp_recv_coalesced) {
+        DBG_PRINTF("%s", "UDP GRO is not enabled on the socket");
+        ret = -1;
+    }
+    else {
+        struct sockaddr_storage addr_dest;
+        int sock_err = 0;
+
+        (void)sockloop_test_addr_config(&addr_dest, AF_INET6, recv_ctx[0].port);
+        for (size_t i = 0; i < send_length; i++) {
+            buffer[i] = (uint8_t)(i / segment_size);
+        }
+        if (picoquic_sendmsg(send_ctx[0].fd, (struct sockaddr*)&addr_dest, NULL, 0,
+            (const char*)buffer, (int)send_length, (int)segment_size, &sock_err) != (int)send_length) {
+            DBG_PRINTF("Cannot send GSO burst, err=%d", sock_err);
+            ret = -1;
+        }
+        else {
+            fd_set readfds;
+            struct timeval tv;
+
+            FD_ZERO(&readfds);
+            FD_SET(recv_ctx[0].fd, &readfds);
+            tv.tv_sec = 1;
+            tv.tv_usec = 0;
+
+            if (select((int)recv_ctx[0].fd + 1, &readfds, NULL, NULL, &tv) <= 0) {
+                DBG_PRINTF("%s", "GSO burst not received");
+                ret = -1;
+            }
+            else {
+                struct sockaddr_storage addr_from;
+                struct sockaddr_storage addr_to;
+                int dest_if = 0;
+                unsigned char received_ecn = 0;
+                size_t udp_coalesced_size = 0;
+                int bytes_recv = picoquic_recvmsg_ex(recv_ctx[0].fd, &addr_from, &addr_to, &dest_if,
+                    &received_ecn, buffer, 0x10000, &udp_coalesced_size);
+
+                if (bytes_recv != (int)send_length) {
+                    DBG_PRINTF("Received %d bytes instead of %zu", bytes_recv, send_length);
+                    ret = -1;
+                }
+                else if (udp_coalesced_size != segment_size) {
+                    DBG_PRINTF("Coalesced size %zu instead of %zu", udp_coalesced_size, segment_size);
+                    ret = -1;
+                }
+                else {
+                    for (size_t i = 0; ret == 0 && i < send_length; i++) {
+                        if (buffer[i] != (uint8_t)(i / segment_size)) {
+                            DBG_PRINTF("Unexpected byte at index %zu", i);
+                            ret = -1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < nb_recv_sockets; i++) {
+        picoquic_packet_loop_close_socket(&recv_ctx[i]);
+    }
+    for (int i = 0; i < nb_send_sockets; i++) {
+        picoquic_packet_loop_close_socket(&send_ctx[i]);
+    }
+    if (buffer != NULL) {
+        free(buffer);
+    }
+#endif
+    return ret;
+}
+
+/* Verify that the cBPF program attached to a SO_REUSEPORT group selects
+ * the socket based on the destination CID. All packets are sent from the
+ * same socket, so selection by hash would deliver them all to the same
+ * receive socket. Short header packets with an even worker byte shall
+ * reach the first socket of the group, those with an odd byte the second.
+ */
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+static int sockloop_cid_steering_recv(picoquic_socket_ctx_t* recv_ctx, int nb_ctx, uint8_t* buffer, size_t buffer_size)
+{
+    int rank = -1;
+    fd_set readfds;
+    struct timeval tv;
+    int sockmax = 0;
+
+    FD_ZERO(&readfds);
+    for (int i = 0; i < nb_ctx; i++) {
+        FD_SET(recv_ctx[i].fd, &readfds);
+        if ((int)recv_ctx[i].fd > sockmax) {
+            sockmax = (int)recv_ctx[i].fd;
+        }
+    }
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+
+    if (select(sockmax + 1, &readfds, NULL, NULL, &tv) > 0) {
+        for (int i = 0; i < nb_ctx; i++) {
+            if (FD_ISSET(recv_ctx[i].fd, &readfds)) {
+                struct sockaddr_storage addr_from;
+                struct sockaddr_storage addr_to;
+                int dest_if = 0;
+                unsigned char received_ecn = 0;
+
+                if (picoquic_recvmsg(recv_ctx[i].fd, &addr_from, &addr_to, &dest_if,
+                    &received_ecn, buffer, (int)buffer_size) > 0 && rank < 0) {
+                    rank = i;
+                }
+            }
+        }
+    }
+    return rank;
+}
+#endif
+
+int sockloop_cid_steering_test()
+{
+    int ret = 0;
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+    picoquic_socket_ctx_t recv_ctx[2][PICOQUIC_PACKET_LOOP_SOCKETS_MAX];
+    picoquic_socket_ctx_t send_ctx[PICOQUIC_PACKET_LOOP_SOCKETS_MAX];
+    picoquic_socket_ctx_t group_ctx[2];
+    int nb_recv_sockets[2] = { 0, 0 };
+    int nb_send_sockets = 0;
+    picoquic_packet_loop_param_t param;
+    uint8_t buffer[256];
+
+    memset(recv_ctx, 0, sizeof(recv_ctx));
+    memset(send_ctx, 0, sizeof(send_ctx));
+    memset(&param, 0, sizeof(param));
+    param.local_af = AF_INET6;
+    param.reuse_port = 1;
+    param.do_not_use_gso = 1;
+    param.cid_steering_nb_workers = 2;
+    param.cid_steering_offset = 1;
+
+    /* The first socket picks the port, the second joins the group and attaches the program */
+    if ((nb_recv_sockets[0] = picoquic_packet_loop_open_sockets_ex(&param, recv_ctx[0])) <= 0) {
+        ret = -1;
+    }
+    else {
+        param.local_port = recv_ctx[0][0].port;
+        if ((nb_recv_sockets[1] = picoquic_packet_loop_open_sockets_ex(&param, recv_ctx[1])) <= 0 ||
+            (nb_send_sockets = picoquic_packet_loop_open_sockets(0, AF_INET6, 0, 0, 1, send_ctx)) <= 0) {
+            ret = -1;
+        }
+    }
+    if (ret != 0) {
+        DBG_PRINTF("%s", "Cannot open the sockets");
+    }
+    else {
+        struct sockaddr_storage addr_dest;
+
+        group_ctx[0] = recv_ctx[0][0];
+        group_ctx[1] = recv_ctx[1][0];
+        (void)sockloop_test_addr_config(&addr_dest, AF_INET6, param.local_port);
+
+        for (int i = 0; ret == 0 && i < 8; i++) {
+            int sock_err = 0;
+            int rank;
+
+            memset(buffer, 0, sizeof(buffer));
+            buffer[0] = 0x41;
+            buffer[1] = 0xaa;
+            buffer[2] = (uint8_t)i;
+            if (picoquic_sendmsg(send_ctx[0].fd, (struct sockaddr*)&addr_dest, NULL, 0,
+                (const char*)buffer, 64, 0, &sock_err) != 64) {
+                DBG_PRINTF("Cannot send packet %d, err=%d", i, sock_err);
+                ret = -1;
+            }
+            else if ((rank = sockloop_cid_steering_recv(group_ctx, 2, buffer, sizeof(buffer))) != (i & 1)) {
+                DBG_PRINTF("Packet %d received on socket %d", i, rank);
+                ret = -1;
+            }
+        }
+
+        if (ret == 0) {
+            /* Long header packets are selected by hash, but must still be received */
+            int sock_err = 0;
+
+            memset(buffer, 0, sizeof(buffer));
+            buffer[0] = 0xc0;
+            buffer[5] = 8;
+            buffer[7] = 1;
+            if (picoquic_sendmsg(send_ctx[0].fd, (struct sockaddr*)&addr_dest, NULL, 0,
+                (const char*)buffer, 64, 0, &sock_err) != 64 ||
+                sockloop_cid_steering_recv(group_ctx, 2, buffer, sizeof(buffer)) < 0) {
+                DBG_PRINTF("%s", "Long header packet not received");
+                ret = -1;
+            }
+        }
+    }
+
+    for (int j = 0; j < 2; j++) {
+        for (int i = 0; i < nb_recv_sockets[j]; i++) {
+            picoquic_packet_loop_close_socket(&recv_ctx[j][i]);
+        }
+    }
+    for (int i = 0; i < nb_send_sockets; i++) {
+        picoquic_packet_loop_close_socket(&send_ctx[i]);
+    }
+#endif
+    return ret;
+}
+
+/* Verify the multi-worker server with real threads. Two workers share
+ * the port. Several client sockets each send one long header packet
+ * whose CID points to each worker. The kernel selects the worker socket
+ * from a hash of the addresses, so for each client socket exactly one
+ * of the two packets reaches the wrong worker and must be handed off.
+ * The threads are created and joined through test functions, to verify
+ * that all of them are joined when the workers are deleted.
+ */
+#define SOCKLOOP_WORKERS_NB 2
+#define SOCKLOOP_WORKERS_NB_SENDERS 8
+#define SOCKLOOP_WORKERS_PORT 3466
+
+static int sockloop_workers_nb_created = 0;
+static int sockloop_workers_nb_joined = 0;
+
+static int sockloop_workers_thread_create(void** thread_id, picoquic_thread_fn thread_fn, void* arg)
+{
+    int ret = picoquic_create_thread((picoquic_thread_t*)thread_id, thread_fn, arg);
+
+    if (ret == 0) {
+        sockloop_workers_nb_created++;
+    }
+    return ret;
+}
+
+static void sockloop_workers_thread_delete(void** thread_id)
+{
+    picoquic_delete_thread((picoquic_thread_t*)thread_id);
+    sockloop_workers_nb_joined++;
+}
+
+static int sockloop_workers_get_total(picoquic_workers_t* workers, picoquic_workers_stats_t* total)
+{
+    int ret = 0;
+
+    memset(total, 0, sizeof(picoquic_workers_stats_t));
+    for (int i = 0; ret == 0 && i < SOCKLOOP_WORKERS_NB; i++) {
+        picoquic_workers_stats_t stats;
+
+        if ((ret = picoquic_workers_get_stats(workers, i, &stats)) == 0) {
+            total->nb_packets_forwarded += stats.nb_packets_forwarded;
+            total->nb_packets_handed_off += stats.nb_packets_handed_off;
+            total->nb_packets_dropped += stats.nb_packets_dropped;
+        }
+    }
+    return ret;
+}
+
+int sockloop_workers_test()
+{
+    int ret = 0;
+#ifndef _WINDOWS
+    uint64_t current_time = picoquic_current_time();
+    picoquic_quic_t* quic[SOCKLOOP_WORKERS_NB];
+    picoquic_workers_t* workers = NULL;
+    picoquic_socket_ctx_t send_ctx[SOCKLOOP_WORKERS_NB_SENDERS];
+    int nb_send_sockets = 0;
+    picoquic_packet_loop_param_t param;
+    picoquic_workers_stats_t total;
+    uint8_t buffer[PICOQUIC_ENFORCED_INITIAL_MTU];
+
+    memset(quic, 0, sizeof(quic));
+    memset(send_ctx, 0, sizeof(send_ctx));
+    memset(&param, 0, sizeof(param));
+    memset(&total, 0, sizeof(total));
+    param.local_af = AF_INET;
+    param.local_port = SOCKLOOP_WORKERS_PORT;
+    sockloop_workers_nb_created = 0;
+    sockloop_workers_nb_joined = 0;
+
+    for (int i = 0; ret == 0 && i < SOCKLOOP_WORKERS_NB; i++) {
+        if ((quic[i] = picoquic_create(8, NULL, NULL, NULL, PICOQUIC_TEST_ALPN, NULL, NULL, NULL, NULL, NULL,
+            current_time, NULL, NULL, NULL, 0)) == NULL) {
+            ret = -1;
+        }
+    }
+
+    if (ret == 0 && (workers = picoquic_start_workers(SOCKLOOP_WORKERS_NB, quic, &param,
+        sockloop_workers_thread_create, sockloop_workers_thread_delete, NULL, "worker",
+        NULL, NULL, &ret)) == NULL) {
+        DBG_PRINTF("Cannot start the workers, ret = 0x%x", ret);
+        ret = (ret == 0) ? -1 : ret;
+    }
+
+    if (ret == 0 && picoquic_workers_nb_ready(workers) != SOCKLOOP_WORKERS_NB) {
+        DBG_PRINTF("%d workers ready instead of %d", picoquic_workers_nb_ready(workers), SOCKLOOP_WORKERS_NB);
+        ret = -1;
+    }
+
+    for (int i = 0; ret == 0 && i < SOCKLOOP_WORKERS_NB_SENDERS; i++) {
+        if (picoquic_packet_loop_open_sockets(0, AF_INET, 0, 0, 1, &send_ctx[i]) != 1) {
+            DBG_PRINTF("Cannot open send socket %d", i);
+            ret = -1;
+        }
+        else {
+            nb_send_sockets++;
+        }
+    }
+
+    if (ret == 0) {
+        struct sockaddr_storage addr_dest;
+
+        (void)sockloop_test_addr_config(&addr_dest, AF_INET, SOCKLOOP_WORKERS_PORT);
+        for (int i = 0; ret == 0 && i < nb_send_sockets; i++) {
+            for (int rank = 0; ret == 0 && rank < SOCKLOOP_WORKERS_NB; rank++) {
+                int sock_err = 0;
+
+                /* Long header packet with an 8 bytes CID, the worker byte
+                 * follows the configuration byte. The version is not supported,
+                 * the worker only answers with a version negotiation. */
+                memset(buffer, 0, sizeof(buffer));
+                buffer[0] = 0xc0;
+                picoformat_32(buffer + 1, 0x0a1a2a3a);
+                buffer[5] = 8;
+                buffer[6 + PICOQUIC_WORKERS_CID_SERVER_ID_OFFSET] = (uint8_t)rank;
+                buffer[7 + PICOQUIC_WORKERS_CID_SERVER_ID_OFFSET] = (uint8_t)i;
+                if (picoquic_sendmsg(send_ctx[i].fd, (struct sockaddr*)&addr_dest, NULL, 0,
+                    (const char*)buffer, (int)sizeof(buffer), 0, &sock_err) != (int)sizeof(buffer)) {
+                    DBG_PRINTF("Cannot send packet %d to worker %d, err=%d", i, rank, sock_err);
+                    ret = -1;
+                }
+            }
+        }
+    }
+
+    if (ret == 0) {
+        for (int i = 0; ret == 0 && i < 2000; i++) {
+            if ((ret = sockloop_workers_get_total(workers, &total)) == 0 &&
+                total.nb_packets_handed_off >= SOCKLOOP_WORKERS_NB_SENDERS) {
+                break;
+            }
+            SLEEP(1);
+        }
+        if (ret == 0 && (total.nb_packets_forwarded != SOCKLOOP_WORKERS_NB_SENDERS ||
+            total.nb_packets_handed_off != SOCKLOOP_WORKERS_NB_SENDERS || total.nb_packets_dropped != 0)) {
+            DBG_PRINTF("Forwarded %" PRIu64 ", handed off %" PRIu64 ", dropped %" PRIu64 ", expected %d, %d, 0",
+                total.nb_packets_forwarded, total.nb_packets_handed_off, total.nb_packets_dropped,
+                SOCKLOOP_WORKERS_NB_SENDERS, SOCKLOOP_WORKERS_NB_SENDERS);
+            ret = -1;
+        }
+    }
+
+    if (workers != NULL) {
+        picoquic_delete_workers(workers);
+        if (ret == 0 && (sockloop_workers_nb_created != SOCKLOOP_WORKERS_NB ||
+            sockloop_workers_nb_joined != SOCKLOOP_WORKERS_NB)) {
+            DBG_PRINTF("%d threads created, %d joined, expected %d", sockloop_workers_nb_created,
+                sockloop_workers_nb_joined, SOCKLOOP_WORKERS_NB);
+            ret = -1;
+        }
+    }
+
+    for (int i = 0; i < nb_send_sockets; i++) {
+        picoquic_packet_loop_close_socket(&send_ctx[i]);
+    }
+
+    for (int i = 0; i < SOCKLOOP_WORKERS_NB; i++) {
+        if (quic[i] != NULL) {
+            picoquic_free(quic[i]);
+        }
+    }
+#endif
+    return ret;
+}
+
+/* Verify that commands posted to the network thread from several producer
+ * threads are all executed, in the network thread, and that the wake up
+ * signals are coalesced while commands are pending.
+ */
+#define SOCKLOOP_COMMAND_PRODUCERS 4
+#define SOCKLOOP_COMMAND_PER_PRODUCER 2000
+
+typedef struct st_sockloop_command_test_t {
+    picoquic_network_thread_ctx_t* thread_ctx;
+    int nb_executed;
+    int nb_wake_up;
+    int nb_errors;
+    int last_value[SOCKLOOP_COMMAND_PRODUCERS];
+} sockloop_command_test_t;
+
+typedef struct st_sockloop_command_producer_t {
+    sockloop_command_test_t* test;
+    int producer_id;
+    int nb_queue_full;
+    int ret;
+} sockloop_command_producer_t;
+
+static int sockloop_command_test_fn(picoquic_quic_t* quic, void* command_ctx)
+{
+    /* The context encodes the producer id and the sequence number */
+    uintptr_t v = (uintptr_t)command_ctx;
+    sockloop_command_test_t* test = (sockloop_command_test_t*)picoquic_get_default_callback_context(quic);
+    int producer_id = (int)(v % SOCKLOOP_COMMAND_PRODUCERS);
+    int value = (int)(v / SOCKLOOP_COMMAND_PRODUCERS);
+
+    if (value != test->last_value[producer_id] + 1) {
+        test->nb_errors++;
+    }
+    test->last_value[producer_id] = value;
+    test->nb_executed++;
+    return 0;
+}
+
+static int sockloop_command_test_cb(picoquic_quic_t* quic, picoquic_packet_loop_cb_enum cb_mode,
+    void* callback_ctx, void* callback_arg)
+{
+    sockloop_command_test_t* test = (sockloop_command_test_t*)callback_ctx;
+#ifdef _WINDOWS
+    UNREFERENCED_PARAMETER(quic);
+    UNREFERENCED_PARAMETER(callback_arg);
+#endif
+    if (cb_mode == picoquic_packet_loop_wake_up) {
+        test->nb_wake_up++;
+    }
+    return 0;
+}
+
+static picoquic_thread_return_t sockloop_command_producer(void* v_ctx)
+{
+    sockloop_command_producer_t* producer = (sockloop_command_producer_t*)v_ctx;
+
+    for (int i = 1; producer->ret == 0 && i <= SOCKLOOP_COMMAND_PER_PRODUCER; i++) {
+        uintptr_t v = (uintptr_t)i * SOCKLOOP_COMMAND_PRODUCERS + producer->producer_id;
+        int ret;
+
+        while ((ret = picoquic_network_thread_call(producer->test->thread_ctx,
+            sockloop_command_test_fn, (void*)v)) == PICOQUIC_ERROR_NETWORK_QUEUE_FULL) {
+            producer->nb_queue_full++;
+            SLEEP(0);
+        }
+        producer->ret = ret;
+    }
+    picoquic_thread_do_return;
+}
+
+int sockloop_commands_test()
+{
+    int ret = 0;
+    uint64_t current_time = picoquic_current_time();
+    sockloop_command_test_t test;
+    sockloop_command_producer_t producer[SOCKLOOP_COMMAND_PRODUCERS];
+    picoquic_thread_t producer_thread[SOCKLOOP_COMMAND_PRODUCERS];
+    int nb_started = 0;
+    picoquic_packet_loop_param_t param;
+    picoquic_quic_t* quic;
+
+    memset(&test, 0, sizeof(test));
+    memset(producer, 0, sizeof(producer));
+    memset(&param, 0, sizeof(param));
+    param.local_af = AF_INET;
+    param.command_queue_size = 64;
+
+    quic = picoquic_create(8, NULL, NULL, NULL, PICOQUIC_TEST_ALPN, NULL, &test, NULL, NULL, NULL,
+        current_time, NULL, NULL, NULL, 0);
+    if (quic == NULL) {
+        ret = -1;
+    }
+    else if ((test.thread_ctx = picoquic_start_network_thread(quic, &param, sockloop_command_test_cb, &test, &ret)) == NULL) {
+        ret = (ret == 0) ? -1 : ret;
+    }
+    else {
+        for (int i = 0; i < 2000 && !test.thread_ctx->thread_is_ready; i++) {
+            SLEEP(1);
+        }
+        if (!test.thread_ctx->thread_is_ready) {
+            DBG_PRINTF("%s", "Cannot start the network thread in 2000ms");
+            ret = -1;
+        }
+        for (int i = 0; ret == 0 && i < SOCKLOOP_COMMAND_PRODUCERS; i++) {
+            producer[i].test = &test;
+            producer[i].producer_id = i;
+            if ((ret = picoquic_create_thread(&producer_thread[i], sockloop_command_producer, &producer[i])) == 0) {
+                nb_started++;
+            }
+        }
+        for (int i = 0; i < nb_started; i++) {
+            picoquic_delete_thread(&producer_thread[i]);
+            if (producer[i].ret != 0) {
+                DBG_PRINTF("Producer %d returns 0x%x", i, producer[i].ret);
+                ret = -1;
+            }
+        }
+        for (int i = 0; ret == 0 && i < 2000 &&
+            test.nb_executed < SOCKLOOP_COMMAND_PRODUCERS * SOCKLOOP_COMMAND_PER_PRODUCER; i++) {
+            SLEEP(1);
+        }
+        if (ret == 0) {
+            if (test.nb_executed != SOCKLOOP_COMMAND_PRODUCERS * SOCKLOOP_COMMAND_PER_PRODUCER) {
+                DBG_PRINTF("Executed %d commands instead of %d", test.nb_executed,
+                    SOCKLOOP_COMMAND_PRODUCERS * SOCKLOOP_COMMAND_PER_PRODUCER);
+                ret = -1;
+            }
+            else if (test.nb_errors != 0) {
+                DBG_PRINTF("%d commands executed out of order", test.nb_errors);
+                ret = -1;
+            }
+            else if (test.nb_wake_up >= test.nb_executed) {
+                DBG_PRINTF("%d wake up for %d commands", test.nb_wake_up, test.nb_executed);
+                ret = -1;
+            }
+        }
+        picoquic_delete_network_thread(test.thread_ctx);
+    }
+
+    if (quic != NULL) {
+        picoquic_free(quic);
+    }
+    return ret;
+}
+
+/* Verify that the wake up calls are coalesced: a burst of calls to
+ * picoquic_wake_up_network_thread results in few wake up events, but
+ * no burst is lost, even if it starts just after the previous
+ * event was processed.
+ */
+#define SOCKLOOP_WAKE_UP_BURSTS 64
+#define SOCKLOOP_WAKE_UP_PER_BURST 100
+
+int sockloop_wake_up_test()
+{
+    int ret = 0;
+    uint64_t current_time = picoquic_current_time();
+    sockloop_command_test_t test;
+    picoquic_packet_loop_param_t param;
+    picoquic_quic_t* quic;
+
+    memset(&test, 0, sizeof(test));
+    memset(&param, 0, sizeof(param));
+    param.local_af = AF_INET;
+
+    quic = picoquic_create(8, NULL, NULL, NULL, PICOQUIC_TEST_ALPN, NULL, &test, NULL, NULL, NULL,
+        current_time, NULL, NULL, NULL, 0);
+    if (quic == NULL) {
+        ret = -1;
+    }
+    else if ((test.thread_ctx = picoquic_start_network_thread(quic, &param, sockloop_command_test_cb, &test, &ret)) == NULL) {
+        ret = (ret == 0) ? -1 : ret;
+    }
+    else {
+        for (int i = 0; i < 2000 && !test.thread_ctx->thread_is_ready; i++) {
+            SLEEP(1);
+        }
+        if (!test.thread_ctx->thread_is_ready) {
+            DBG_PRINTF("%s", "Cannot start the network thread in 2000ms");
+            ret = -1;
+        }
+        for (int burst = 0; ret == 0 && burst < SOCKLOOP_WAKE_UP_BURSTS; burst++) {
+            int nb_wake_up_before = test.nb_wake_up;
+
+            for (int i = 0; ret == 0 && i < SOCKLOOP_WAKE_UP_PER_BURST; i++) {
+                ret = picoquic_wake_up_network_thread(test.thread_ctx);
+            }
+            /* Wait until the network thread processed the burst. */
+            for (int i = 0; ret == 0 && i < 2000 &&
+                (test.nb_wake_up == nb_wake_up_before || test.thread_ctx->wake_up_pending); i++) {
+                SLEEP(1);
+            }
+            if (ret == 0 && test.nb_wake_up == nb_wake_up_before) {
+                DBG_PRINTF("Wake up burst %d was lost", burst);
+                ret = -1;
+            }
+        }
+        if (ret == 0 && test.nb_wake_up >= SOCKLOOP_WAKE_UP_BURSTS * SOCKLOOP_WAKE_UP_PER_BURST) {
+            DBG_PRINTF("%d wake up events for %d calls", test.nb_wake_up,
+                SOCKLOOP_WAKE_UP_BURSTS * SOCKLOOP_WAKE_UP_PER_BURST);
+            ret = -1;
+        }
+        picoquic_delete_network_thread(test.thread_ctx);
+    }
+
+    if (quic != NULL) {
+        picoquic_free(quic);
+    }
+    return ret;
+}
+
+/* Verify that each type of connection command posted to the network thread
+ * has the expected effect on the connection. The effect is checked by a
+ * callback command queued just after the tested command: the queue is FIFO,
+ * so the check runs in the network thread after the command was executed.
+ */
+typedef enum {
+    sockloop_command_type_add_to_stream = 0,
+    sockloop_command_type_mark_active,
+    sockloop_command_type_datagram,
+    sockloop_command_type_close
+} sockloop_command_type_enum;
+
+#define SOCKLOOP_COMMAND_TYPE_STREAM_ID 4
+#define SOCKLOOP_COMMAND_TYPE_ERROR 0x1234
+
+typedef struct st_sockloop_command_type_test_t {
+    sockloop_command_type_enum command_type;
+    picoquic_network_thread_ctx_t* thread_ctx;
+    picoquic_cnx_t* cnx;
+    uint8_t data[64];
+    int stream_ctx;
+    int is_checked;
+    int check_ret;
+} sockloop_command_type_test_t;
+
+static int sockloop_command_type_cnx_cb(picoquic_cnx_t* cnx,
+    uint64_t stream_id, uint8_t* bytes, size_t length,
+    picoquic_call_back_event_t fin_or_event, void* callback_ctx, void* v_stream_ctx)
+{
+#ifdef _WINDOWS
+    UNREFERENCED_PARAMETER(cnx);
+    UNREFERENCED_PARAMETER(stream_id);
+    UNREFERENCED_PARAMETER(bytes);
+    UNREFERENCED_PARAMETER(length);
+    UNREFERENCED_PARAMETER(fin_or_event);
+    UNREFERENCED_PARAMETER(callback_ctx);
+    UNREFERENCED_PARAMETER(v_stream_ctx);
+#endif
+    return 0;
+}
+
+static int sockloop_command_type_check_stream(sockloop_command_type_test_t* test)
+{
+    int ret = 0;
+    picoquic_stream_head_t* stream = picoquic_find_stream(test->cnx, SOCKLOOP_COMMAND_TYPE_STREAM_ID);
+
+    if (stream == NULL) {
+        DBG_PRINTF("Stream %d was not created", SOCKLOOP_COMMAND_TYPE_STREAM_ID);
+        ret = -1;
+    }
+    else if (test->command_type == sockloop_command_type_add_to_stream) {
+        size_t queued = 0;
+
+        for (picoquic_stream_queue_node_t* node = stream->send_queue; node != NULL; node = node->next_stream_data) {
+            if (memcmp(node->bytes, test->data + queued, node->length) != 0) {
+                ret = -1;
+            }
+            queued += node->length;
+        }
+        if (ret != 0 || queued != sizeof(test->data) || !stream->fin_requested) {
+            DBG_PRINTF("Stream queue %zu bytes, fin %d, data %s", queued, stream->fin_requested,
+                (ret == 0) ? "ok" : "differs");
+            ret = -1;
+        }
+    }
+    else if (!stream->is_active || stream->app_stream_ctx != (void*)&test->stream_ctx) {
+        DBG_PRINTF("Stream active %d, context %s", stream->is_active,
+            (stream->app_stream_ctx == (void*)&test->stream_ctx) ? "ok" : "differs");
+        ret = -1;
+    }
+    return ret;
+}
+
+static int sockloop_command_type_check_datagram(sockloop_command_type_test_t* test)
+{
+    int ret = 0;
+    picoquic_misc_frame_header_t* frame = test->cnx->first_datagram;
+
+    /* The queued frame ends with the datagram content */
+    if (frame == NULL || frame->next_misc_frame != NULL || frame->length <= sizeof(test->data) ||
+        memcmp(((uint8_t*)(frame + 1)) + frame->length - sizeof(test->data), test->data, sizeof(test->data)) != 0) {
+        DBG_PRINTF("%s", "The datagram was not queued as expected");
+        ret = -1;
+    }
+    return ret;
+}
+
+static int sockloop_command_type_check_close(sockloop_command_type_test_t* test)
+{
+    int ret = 0;
+
+    /* The connection was not established, so closing it fails the handshake
+     * with an application error. */
+    if (test->cnx->cnx_state < picoquic_state_handshake_failure ||
+        test->cnx->local_error != PICOQUIC_TRANSPORT_APPLICATION_ERROR) {
+        DBG_PRINTF("After close, state %d, local error 0x%" PRIx64, test->cnx->cnx_state, test->cnx->local_error);
+        ret = -1;
+    }
+    return ret;
+}
+
+static int sockloop_command_type_check_fn(picoquic_quic_t* quic, void* command_ctx)
+{
+    sockloop_command_type_test_t* test = (sockloop_command_type_test_t*)command_ctx;
+#ifdef _WINDOWS
+    UNREFERENCED_PARAMETER(quic);
+#endif
+
+    switch (test->command_type) {
+    case sockloop_command_type_add_to_stream:
+    case sockloop_command_type_mark_active:
+        test->check_ret = sockloop_command_type_check_stream(test);
+        break;
+    case sockloop_command_type_datagram:
+        test->check_ret = sockloop_command_type_check_datagram(test);
+        break;
+    case sockloop_command_type_close:
+        test->check_ret = sockloop_command_type_check_close(test);
+        break;
+    default:
+        test->check_ret = -1;
+        break;
+    }
+    test->is_checked = 1;
+    return 0;
+}
+
+static int sockloop_command_type_post(sockloop_command_type_test_t* test)
+{
+    int ret = 0;
+
+    switch (test->command_type) {
+    case sockloop_command_type_add_to_stream:
+        ret = picoquic_network_thread_add_to_stream(test->thread_ctx, test->cnx, SOCKLOOP_COMMAND_TYPE_STREAM_ID,
+            test->data, sizeof(test->data), 1);
+        break;
+    case sockloop_command_type_mark_active:
+        ret = picoquic_network_thread_mark_active_stream(test->thread_ctx, test->cnx, SOCKLOOP_COMMAND_TYPE_STREAM_ID,
+            1, &test->stream_ctx);
+        break;
+    case sockloop_command_type_datagram:
+        ret = picoquic_network_thread_queue_datagram(test->thread_ctx, test->cnx, test->data, sizeof(test->data));
+        break;
+    case sockloop_command_type_close:
+        ret = picoquic_network_thread_close(test->thread_ctx, test->cnx, SOCKLOOP_COMMAND_TYPE_ERROR);
+        break;
+    default:
+        ret = -1;
+        break;
+    }
+    if (ret == 0) {
+        ret = picoquic_network_thread_call(test->thread_ctx, sockloop_command_type_check_fn, test);
+    }
+    return ret;
+}
+
+static int sockloop_command_type_test(sockloop_command_type_enum command_type)
+{
+    int ret = 0;
+    uint64_t current_time = picoquic_current_time();
+    sockloop_command_test_t loop_test;
+    sockloop_command_type_test_t test;
+    picoquic_packet_loop_param_t param;
+    struct sockaddr_storage server_addr;
+    picoquic_quic_t* quic;
+
+    memset(&loop_test, 0, sizeof(loop_test));
+    memset(&test, 0, sizeof(test));
+    memset(&param, 0, sizeof(param));
+    param.local_af = AF_INET;
+    param.command_queue_size = 64;
+    test.command_type = command_type;
+    for (size_t i = 0; i < sizeof(test.data); i++) {
+        test.data[i] = (uint8_t)(i + 1);
+    }
+
+    quic = picoquic_create(8, NULL, NULL, NULL, PICOQUIC_TEST_ALPN, NULL, &loop_test, NULL, NULL, NULL,
+        current_time, NULL, NULL, NULL, 0);
+    if (quic == NULL) {
+        ret = -1;
+    }
+    else if ((ret = picoquic_store_text_addr(&server_addr, "127.0.0.1", 4443)) != 0 ||
+        (test.cnx = picoquic_create_cnx(quic, picoquic_null_connection_id, picoquic_null_connection_id,
+            (struct sockaddr*)&server_addr, current_time, 0, PICOQUIC_TEST_SNI, PICOQUIC_TEST_ALPN, 1)) == NULL) {
+        DBG_PRINTF("%s", "Could not create the client connection");
+        ret = -1;
+    }
+    else {
+        picoquic_set_callback(test.cnx, sockloop_command_type_cnx_cb, &test);
+        if ((test.thread_ctx = picoquic_start_network_thread(quic, &param, sockloop_command_test_cb, &loop_test, &ret)) == NULL) {
+            ret = (ret == 0) ? -1 : ret;
+        }
+        else {
+            loop_test.thread_ctx = test.thread_ctx;
+            for (int i = 0; i < 2000 && !test.thread_ctx->thread_is_ready; i++) {
+                SLEEP(1);
+            }
+            if (!test.thread_ctx->thread_is_ready) {
+                DBG_PRINTF("%s", "Cannot start the network thread in 2000ms");
+                ret = -1;
+            }
+            if (ret == 0) {
+                ret = sockloop_command_type_post(&test);
+            }
+            for (int i = 0; ret == 0 && i < 2000 && !test.is_checked; i++) {
+                SLEEP(1);
+            }
+            if (ret == 0) {
+                if (!test.is_checked) {
+                    DBG_PRINTF("Command %d was not executed in 2000ms", command_type);
+                    ret = -1;
+                }
+                else {
+                    ret = test.check_ret;
+                }
+            }
+            picoquic_delete_network_thread(test.thread_ctx);
+        }
+    }
+
+    if (quic != NULL) {
+        picoquic_free(quic);
+    }
+    return ret;
+}
+
+int sockloop_command_add_to_stream_test()
+{
+    return sockloop_command_type_test(sockloop_command_type_add_to_stream);
+}
+
+int sockloop_command_mark_active_test()
+{
+    return sockloop_command_type_test(sockloop_command_type_mark_active);
+}
+
+int sockloop_command_datagram_test()
+{
+    return sockloop_command_type_test(sockloop_command_type_datagram);
+}
+
+int sockloop_command_close_test()
+{
+    return sockloop_command_type_test(sockloop_command_type_close);
+}
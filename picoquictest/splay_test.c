@@ -25,8 +25,11 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "picoquic.h"
 #include "picoquic_utils.h"
 #include "picosplay.h"
+#include "picowheel.h"
 
 typedef struct st_int_node_t {
     int v;
@@ -251,3 +254,286 @@ int splay_test() {
 
     return ret;
 }
+
+/* Timer wheel test.
+ * Insert, move and remove nodes at random times, at scales ranging from
+ * microseconds to hours, and advance the wheel in random steps. After each
+ * operation, verify that the wheel returns an expired node if any node is
+ * due, or else the node with the lowest wake time.
+ */
+#define PICOWHEEL_TEST_NODES 256
+#define PICOWHEEL_TEST_ROUNDS 100000
+
+static uint64_t picowheel_test_delay(uint64_t* random_ctx)
+{
+    uint64_t r = picoquic_test_random(random_ctx);
+    /* Random number of bits between 0 and 42, i.e., up to 50 days */
+    int nb_bits = (int)(r % 43);
+
+    return (nb_bits == 0) ? 0 : (r >> 8) & ((1ull << nb_bits) - 1);
+}
+
+static int picowheel_test_check(picowheel_t* wheel, picowheel_node_t* nodes, size_t nb_nodes)
+{
+    int ret = 0;
+    picowheel_node_t* first = picowheel_first(wheel);
+    picowheel_node_t* due = picowheel_first_due(wheel, wheel->current_time);
+    picowheel_node_t* min_node = NULL;
+    size_t count = 0;
+
+    for (size_t i = 0; i < nb_nodes; i++) {
+        if (picowheel_is_inserted(&nodes[i])) {
+            count++;
+            if (min_node == NULL || nodes[i].wake_time < min_node->wake_time) {
+                min_node = &nodes[i];
+            }
+        }
+    }
+
+    if (count != picowheel_count(wheel)) {
+        DBG_PRINTF("Wheel count %zu instead of %zu", picowheel_count(wheel), count);
+        ret = -1;
+    }
+    else if (min_node == NULL) {
+        if (first != NULL || due != NULL) {
+            DBG_PRINTF("%s", "Empty wheel returns a node");
+            ret = -1;
+        }
+    }
+    else if (min_node->wake_time <= wheel->current_time) {
+        if (first == NULL || due == NULL || first->wake_time > wheel->current_time ||
+            due->wake_time > wheel->current_time) {
+            DBG_PRINTF("Expired node not found, time %" PRIu64, wheel->current_time);
+            ret = -1;
+        }
+    }
+    else if (due != NULL) {
+        DBG_PRINTF("Node at %" PRIu64 " due at %" PRIu64, due->wake_time, wheel->current_time);
+        ret = -1;
+    }
+    else if (first == NULL || first->wake_time != min_node->wake_time) {
+        DBG_PRINTF("First node at %" PRIu64 " instead of %" PRIu64,
+            (first == NULL) ? 0 : first->wake_time, min_node->wake_time);
+        ret = -1;
+    }
+
+    return ret;
+}
+
+int picowheel_test()
+{
+    int ret = 0;
+    uint64_t random_ctx = 0x7768656574657374ull;
+    picowheel_t wheel;
+    picowheel_node_t nodes[PICOWHEEL_TEST_NODES];
+
+    memset(nodes, 0, sizeof(nodes));
+    picowheel_init(&wheel, 1000000);
+
+    for (int round = 0; ret == 0 && round < PICOWHEEL_TEST_ROUNDS; round++) {
+        uint64_t r = picoquic_test_random(&random_ctx);
+        picowheel_node_t* node = &nodes[(r >> 8) % PICOWHEEL_TEST_NODES];
+
+        switch (r % 8) {
+        case 0:
+            picowheel_remove(&wheel, node);
+            break;
+        case 1:
+            picowheel_advance(&wheel, wheel.current_time + picowheel_test_delay(&random_ctx));
+            break;
+        case 2:
+            /* Serve the first node, as the sender does */
+            if ((node = picowheel_first(&wheel)) != NULL) {
+                if (node->wake_time > wheel.current_time) {
+                    picowheel_advance(&wheel, node->wake_time);
+                }
+                picowheel_insert(&wheel, node, wheel.current_time + picowheel_test_delay(&random_ctx));
+            }
+            break;
+        default:
+            picowheel_insert(&wheel, node, wheel.current_time + picowheel_test_delay(&random_ctx));
+            break;
+        }
+        ret = picowheel_test_check(&wheel, nodes, PICOWHEEL_TEST_NODES);
+        if (ret != 0) {
+            DBG_PRINTF("Wheel test fails at round %d", round);
+        }
+    }
+
+    /* Nodes at the maximum time are kept, and found */
+    for (int i = 0; ret == 0 && i < PICOWHEEL_TEST_NODES; i++) {
+        picowheel_insert(&wheel, &nodes[i], UINT64_MAX - (uint64_t)i);
+    }
+    if (ret == 0 && picowheel_first(&wheel) != &nodes[PICOWHEEL_TEST_NODES - 1]) {
+        DBG_PRINTF("%s", "Cannot find the first of the late nodes");
+        ret = -1;
+    }
+    for (int i = 0; ret == 0 && i < PICOWHEEL_TEST_NODES; i++) {
+        picowheel_remove(&wheel, &nodes[i]);
+    }
+    if (ret == 0 && (picowheel_count(&wheel) != 0 || picowheel_first(&wheel) != NULL)) {
+        DBG_PRINTF("%s", "Wheel not empty after removing all nodes");
+        ret = -1;
+    }
+
+    return ret;
+}
+
+/* Wake scheduler benchmark.
+ * Simulate a server with 100K connections. At each step, the earliest
+ * connection is served and rescheduled, and another connection, chosen at
+ * random, is rescheduled as if a packet had been received. The delays
+ * are a mix of pacing delays, ACK and retransmission timers, and idle
+ * timers. The same schedule runs with the splay tree and with the wheel,
+ * and the cost per step is reported. The test fails if a connection is
+ * served out of order.
+ */
+#define WAKE_BENCH_NB_CNX 100000
+#define WAKE_BENCH_STEPS 1000000
+
+typedef struct st_wake_bench_cnx_t {
+    uint64_t wake_time;
+    picosplay_node_t splay_node;
+    picowheel_node_t wheel_node;
+} wake_bench_cnx_t;
+
+static int64_t wake_bench_compare(void* l, void* r)
+{
+    uint64_t ltime = ((wake_bench_cnx_t*)l)->wake_time;
+    uint64_t rtime = ((wake_bench_cnx_t*)r)->wake_time;
+
+    return (ltime < rtime) ? -1 : ((ltime > rtime) ? 1 : 0);
+}
+
+static picosplay_node_t* wake_bench_create_node(void* value)
+{
+    return &((wake_bench_cnx_t*)value)->splay_node;
+}
+
+static void* wake_bench_node_value(picosplay_node_t* node)
+{
+    return (node == NULL) ? NULL : (void*)((char*)node - offsetof(wake_bench_cnx_t, splay_node));
+}
+
+static void wake_bench_delete_node(void* tree, picosplay_node_t* node)
+{
+#ifdef _WINDOWS
+    UNREFERENCED_PARAMETER(tree);
+#endif
+    memset(node, 0, sizeof(picosplay_node_t));
+}
+
+static uint64_t wake_bench_delay(uint64_t* random_ctx)
+{
+    uint64_t r = picoquic_test_random(random_ctx);
+    uint64_t delay;
+
+    if (r % 10 < 6) {
+        /* Pacing, 1 to 200 microseconds */
+        delay = 1 + (r >> 8) % 200;
+    }
+    else if (r % 10 < 9) {
+        /* ACK or retransmission timer, 1 to 100 milliseconds */
+        delay = 1000 + (r >> 8) % 100000;
+    }
+    else {
+        /* Idle or keep alive timer, 1 to 30 seconds */
+        delay = 1000000 + (r >> 8) % 30000000;
+    }
+
+    return delay;
+}
+
+static int wake_bench_run(wake_bench_cnx_t* cnx, int use_wheel, uint64_t* elapsed)
+{
+    int ret = 0;
+    uint64_t random_ctx = 0x77616b6562656e63ull;
+    uint64_t current_time = 0;
+    picosplay_tree_t tree;
+    picowheel_t wheel;
+    uint64_t start_time;
+
+    picosplay_init_tree(&tree, wake_bench_compare, wake_bench_create_node,
+        wake_bench_delete_node, wake_bench_node_value);
+    picowheel_init(&wheel, current_time);
+    memset(cnx, 0, WAKE_BENCH_NB_CNX * sizeof(wake_bench_cnx_t));
+    for (size_t i = 0; i < WAKE_BENCH_NB_CNX; i++) {
+        cnx[i].wake_time = wake_bench_delay(&random_ctx);
+        if (use_wheel) {
+            picowheel_insert(&wheel, &cnx[i].wheel_node, cnx[i].wake_time);
+        }
+        else {
+            picosplay_insert(&tree, &cnx[i]);
+        }
+    }
+
+    start_time = picoquic_current_time();
+    for (int step = 0; ret == 0 && step < WAKE_BENCH_STEPS; step++) {
+        wake_bench_cnx_t* served;
+        wake_bench_cnx_t* received = &cnx[picoquic_test_random(&random_ctx) % WAKE_BENCH_NB_CNX];
+        uint64_t received_delay = wake_bench_delay(&random_ctx);
+        uint64_t served_delay = wake_bench_delay(&random_ctx);
+
+        if (use_wheel) {
+            picowheel_node_t* node = picowheel_first(&wheel);
+
+            served = (wake_bench_cnx_t*)((char*)node - offsetof(wake_bench_cnx_t, wheel_node));
+            if (served->wake_time > current_time) {
+                current_time = served->wake_time;
+                picowheel_advance(&wheel, current_time);
+            }
+        }
+        else {
+            served = (wake_bench_cnx_t*)wake_bench_node_value(picosplay_first(&tree));
+            if (served->wake_time > current_time) {
+                current_time = served->wake_time;
+            }
+        }
+        if (served->wake_time < current_time) {
+            DBG_PRINTF("Connection served at %" PRIu64 " instead of %" PRIu64, current_time, served->wake_time);
+            ret = -1;
+        }
+        else if (use_wheel) {
+            picowheel_insert(&wheel, &served->wheel_node, current_time + served_delay);
+            picowheel_insert(&wheel, &received->wheel_node, current_time + received_delay);
+            served->wake_time = served->wheel_node.wake_time;
+            received->wake_time = received->wheel_node.wake_time;
+        }
+        else {
+            picosplay_delete_hint(&tree, &served->splay_node);
+            served->wake_time = current_time + served_delay;
+            picosplay_insert(&tree, served);
+            picosplay_delete_hint(&tree, &received->splay_node);
+            received->wake_time = current_time + received_delay;
+            picosplay_insert(&tree, received);
+        }
+    }
+    *elapsed = picoquic_current_time() - start_time;
+    picosplay_empty_tree(&tree);
+
+    return ret;
+}
+
+int wake_wheel_bench_test()
+{
+    int ret = 0;
+    wake_bench_cnx_t* cnx = (wake_bench_cnx_t*)malloc(WAKE_BENCH_NB_CNX * sizeof(wake_bench_cnx_t));
+    uint64_t elapsed[2] = { 0, 0 };
+
+    if (cnx == NULL) {
+        ret = -1;
+    }
+    else {
+        for (int use_wheel = 0; ret == 0 && use_wheel < 2; use_wheel++) {
+            ret = wake_bench_run(cnx, use_wheel, &elapsed[use_wheel]);
+        }
+        if (ret == 0) {
+            DBG_PRINTF("%d connections, ns per step: splay %.1f, wheel %.1f", WAKE_BENCH_NB_CNX,
+                (double)elapsed[0] * 1000.0 / (double)WAKE_BENCH_STEPS,
+                (double)elapsed[1] * 1000.0 / (double)WAKE_BENCH_STEPS);
+        }
+        free(cnx);
+    }
+
+    return ret;
+}
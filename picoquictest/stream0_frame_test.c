@@ -906,6 +906,297 @@ int stream_output_test()
     return ret;
 }
 
+/* Test the per priority queues of output streams. Thousands of streams have
+ * data queued but are blocked by flow control. A few are unblocked by
+ * MAX_STREAM_DATA frames, and are then served in FIFO or round robin order
+ * depending on their priority.
+ */
+#define STREAM_READY_QUEUE_NB_STREAMS 4096
+
+const uint8_t* picoquic_decode_max_stream_data_frame(picoquic_cnx_t* cnx, const uint8_t* bytes, const uint8_t* bytes_max);
+
+static int stream_ready_queue_credit(picoquic_cnx_t* cnx, uint64_t stream_id, uint64_t maxdata)
+{
+    int ret = 0;
+    uint8_t frame[32];
+    uint8_t* bytes = frame;
+    uint8_t* bytes_max = frame + sizeof(frame);
+
+    if ((bytes = picoquic_frames_uint8_encode(bytes, bytes_max, picoquic_frame_type_max_stream_data)) == NULL ||
+        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, stream_id)) == NULL ||
+        (bytes = picoquic_frames_varint_encode(bytes, bytes_max, maxdata)) == NULL ||
+        picoquic_decode_max_stream_data_frame(cnx, frame, bytes) == NULL) {
+        DBG_PRINTF("Cannot decode max stream data for stream %d\n", (int)stream_id);
+        ret = -1;
+    }
+
+    return ret;
+}
+
+static int stream_ready_queue_expect(picoquic_cnx_t* cnx, uint64_t expected_id)
+{
+    int ret = 0;
+    picoquic_stream_head_t* stream = picoquic_find_ready_stream(cnx);
+
+    if (expected_id == UINT64_MAX) {
+        if (stream != NULL) {
+            DBG_PRINTF("Unexpected ready stream[%d]\n", (int)stream->stream_id);
+            ret = -1;
+        }
+    }
+    else if (stream == NULL || stream->stream_id != expected_id) {
+        DBG_PRINTF("Expected stream[%d], got %d\n", (int)expected_id, (stream == NULL) ? -1 : (int)stream->stream_id);
+        ret = -1;
+    }
+
+    return ret;
+}
+
+static int stream_ready_queue_send(picoquic_cnx_t* cnx, uint64_t expected_id, uint64_t* simulated_time)
+{
+    int ret = stream_ready_queue_expect(cnx, expected_id);
+
+    if (ret == 0) {
+        uint8_t buffer[64];
+        int more_data = 0;
+        int is_pure_ack = 1;
+        int is_still_active = 0;
+
+        *simulated_time += 1000;
+        (void)picoquic_format_stream_frame(cnx, picoquic_find_stream(cnx, expected_id), buffer, buffer + sizeof(buffer),
+            &more_data, &is_pure_ack, &is_still_active, &ret);
+    }
+
+    return ret;
+}
+
+int stream_ready_queue_test()
+{
+    int ret = 0;
+    picoquic_quic_t* quic = NULL;
+    picoquic_cnx_t* cnx = NULL;
+    uint64_t simulated_time = 0;
+    struct sockaddr_in saddr;
+    uint8_t data[256];
+
+    memset(data, 0x5a, sizeof(data));
+    memset(&saddr, 0, sizeof(struct sockaddr_in));
+    saddr.sin_family = AF_INET;
+    saddr.sin_port = 1000;
+
+    quic = picoquic_create(8, NULL, NULL, NULL, NULL, NULL,
+        NULL, NULL, NULL, NULL, simulated_time,
+        &simulated_time, NULL, NULL, 0);
+
+    if (quic == NULL) {
+        DBG_PRINTF("%s", "Cannot create QUIC context\n");
+        ret = -1;
+    }
+    else if ((cnx = picoquic_create_cnx(quic,
+        picoquic_null_connection_id, picoquic_null_connection_id, (struct sockaddr*)&saddr,
+        simulated_time, 0, "test-sni", "test-alpn", 1)) == NULL) {
+        DBG_PRINTF("%s", "Cannot create connection\n");
+        ret = -1;
+    }
+    else {
+        picoquic_set_callback(cnx, stream_output_test_callback, NULL);
+        /* Plenty of connection credits, no stream credits */
+        cnx->maxdata_remote = 0x1000000;
+        cnx->remote_parameters.initial_max_stream_data_bidi_remote = 0;
+        cnx->max_stream_id_bidir_remote = STREAM_ID_FROM_RANK(STREAM_READY_QUEUE_NB_STREAMS, cnx->client_mode, 0);
+
+        for (uint64_t i = 0; ret == 0 && i < STREAM_READY_QUEUE_NB_STREAMS; i++) {
+            ret = picoquic_add_to_stream(cnx, 4 * i, data, sizeof(data), 0);
+        }
+
+        if (ret == 0) {
+            cnx->stream_blocked = 0;
+            ret = stream_ready_queue_expect(cnx, UINT64_MAX);
+            if (ret == 0 && !cnx->stream_blocked) {
+                DBG_PRINTF("%s", "Streams blocked, not signalled\n");
+                ret = -1;
+            }
+        }
+        /* Unblock three streams, served in FIFO order at the default priority */
+        if (ret == 0 &&
+            (ret = stream_ready_queue_credit(cnx, 400, 1024)) == 0 &&
+            (ret = stream_ready_queue_credit(cnx, 12000, 1024)) == 0 &&
+            (ret = stream_ready_queue_credit(cnx, 200, 1024)) == 0) {
+            ret = stream_ready_queue_send(cnx, 200, &simulated_time);
+            if (ret == 0) {
+                ret = stream_ready_queue_send(cnx, 200, &simulated_time);
+            }
+        }
+        /* Move two of them to a round robin priority */
+        if (ret == 0 &&
+            (ret = picoquic_set_stream_priority(cnx, 12000, 2)) == 0 &&
+            (ret = picoquic_set_stream_priority(cnx, 400, 2)) == 0) {
+            uint64_t rr_order[4] = { 400, 12000, 400, 12000 };
+
+            for (int i = 0; ret == 0 && i < 4; i++) {
+                ret = stream_ready_queue_send(cnx, rr_order[i], &simulated_time);
+            }
+        }
+        /* A blocked stream with a pending stop sending takes precedence */
+        if (ret == 0 &&
+            (ret = picoquic_set_stream_priority(cnx, 28, 2)) == 0 &&
+            (ret = picoquic_stop_sending(cnx, 28, 0)) == 0) {
+            ret = stream_ready_queue_send(cnx, 28, &simulated_time);
+            if (ret == 0) {
+                ret = stream_ready_queue_send(cnx, 400, &simulated_time);
+            }
+        }
+        /* Once the round robin streams have sent all their data, the FIFO level is served */
+        if (ret == 0) {
+            for (int i = 0; ret == 0 && i < 12; i++) {
+                picoquic_stream_head_t* stream = picoquic_find_ready_stream(cnx);
+
+                if (stream == NULL || stream->stream_priority != 2) {
+                    break;
+                }
+                ret = stream_ready_queue_send(cnx, stream->stream_id, &simulated_time);
+            }
+            if (ret == 0) {
+                ret = stream_ready_queue_expect(cnx, 200);
+            }
+        }
+    }
+
+    if (cnx != NULL) {
+        picoquic_delete_cnx(cnx);
+    }
+    if (quic != NULL) {
+        picoquic_free(quic);
+    }
+
+    return ret;
+}
+
+/* Test weighted scheduling. Three streams at the same round robin level
+ * have weights 70, 20 and 10. The packets have different sizes, but the
+ * deficit round robin is counted in bytes, so the streams shall receive
+ * shares of the data close to 70%, 20% and 10%. After weighted scheduling is
+ * turned off, the streams are served in plain round robin order.
+ */
+#define STREAM_WEIGHTED_TOTAL 400000
+
+int stream_weighted_test()
+{
+    int ret = 0;
+    picoquic_quic_t* quic = NULL;
+    picoquic_cnx_t* cnx = NULL;
+    uint64_t simulated_time = 0;
+    struct sockaddr_in saddr;
+    uint8_t data[1024];
+    uint64_t stream_id[3] = { 0, 4, 8 };
+    uint8_t weight[3] = { 70, 20, 10 };
+    size_t packet_size[3] = { 1440, 300, 800 };
+    uint64_t total_sent = 0;
+
+    memset(data, 0x5a, sizeof(data));
+    memset(&saddr, 0, sizeof(struct sockaddr_in));
+    saddr.sin_family = AF_INET;
+    saddr.sin_port = 1000;
+
+    quic = picoquic_create(8, NULL, NULL, NULL, NULL, NULL,
+        NULL, NULL, NULL, NULL, simulated_time,
+        &simulated_time, NULL, NULL, 0);
+
+    if (quic == NULL) {
+        DBG_PRINTF("%s", "Cannot create QUIC context\n");
+        ret = -1;
+    }
+    else if ((cnx = picoquic_create_cnx(quic,
+        picoquic_null_connection_id, picoquic_null_connection_id, (struct sockaddr*)&saddr,
+        simulated_time, 0, "test-sni", "test-alpn", 1)) == NULL) {
+        DBG_PRINTF("%s", "Cannot create connection\n");
+        ret = -1;
+    }
+    else {
+        picoquic_set_callback(cnx, stream_output_test_callback, NULL);
+        cnx->maxdata_remote = 0x1000000;
+        cnx->remote_parameters.initial_max_stream_data_bidi_remote = 0x1000000;
+        cnx->max_stream_id_bidir_remote = STREAM_ID_FROM_RANK(3, cnx->client_mode, 0);
+        picoquic_set_weighted_scheduling(cnx, 1);
+
+        for (int i = 0; ret == 0 && i < 3; i++) {
+            for (int j = 0; ret == 0 && j < 512; j++) {
+                ret = picoquic_add_to_stream(cnx, stream_id[i], data, sizeof(data), 0);
+            }
+            if (ret == 0) {
+                ret = picoquic_set_stream_priority(cnx, stream_id[i], 4);
+            }
+            if (ret == 0) {
+                ret = picoquic_set_stream_weight(cnx, stream_id[i], weight[i]);
+            }
+        }
+
+        for (int i = 0; ret == 0 && total_sent < STREAM_WEIGHTED_TOTAL; i++) {
+            uint8_t buffer[1440];
+            int more_data = 0;
+            int is_pure_ack = 1;
+            int is_still_active = 0;
+            picoquic_stream_head_t* stream = picoquic_find_ready_stream(cnx);
+            uint8_t* bytes_next;
+
+            if (stream == NULL) {
+                DBG_PRINTF("No stream ready after %d frames\n", i);
+                ret = -1;
+            }
+            else {
+                simulated_time += 1000;
+                bytes_next = picoquic_format_stream_frame(cnx, stream, buffer, buffer + packet_size[i % 3],
+                    &more_data, &is_pure_ack, &is_still_active, &ret);
+                if (ret == 0 && bytes_next == buffer) {
+                    DBG_PRINTF("Nothing sent on stream %d\n", (int)stream->stream_id);
+                    ret = -1;
+                }
+                total_sent = cnx->data_sent;
+            }
+        }
+
+        for (int i = 0; ret == 0 && i < 3; i++) {
+            picoquic_stream_head_t* stream = picoquic_find_stream(cnx, stream_id[i]);
+            uint64_t share = (stream == NULL) ? 0 : (stream->sent_offset * 1000) / total_sent;
+
+            if (share < (uint64_t)weight[i] * 10 - 10 || share > (uint64_t)weight[i] * 10 + 10) {
+                DBG_PRINTF("Stream %d weight %d, share %d/1000\n", (int)stream_id[i], weight[i], (int)share);
+                ret = -1;
+            }
+        }
+
+        if (ret == 0) {
+            int nb_frames[3] = { 0, 0, 0 };
+
+            picoquic_set_weighted_scheduling(cnx, 0);
+            for (int i = 0; ret == 0 && i < 30; i++) {
+                picoquic_stream_head_t* stream = picoquic_find_ready_stream(cnx);
+
+                if (stream == NULL) {
+                    ret = -1;
+                }
+                else {
+                    nb_frames[stream->stream_id / 4]++;
+                    ret = stream_ready_queue_send(cnx, stream->stream_id, &simulated_time);
+                }
+            }
+            if (ret == 0 && (nb_frames[0] != 10 || nb_frames[1] != 10 || nb_frames[2] != 10)) {
+                DBG_PRINTF("Round robin frames: %d, %d, %d\n", nb_frames[0], nb_frames[1], nb_frames[2]);
+                ret = -1;
+            }
+        }
+    }
+
+    if (cnx != NULL) {
+        picoquic_delete_cnx(cnx);
+    }
+    if (quic != NULL) {
+        picoquic_free(quic);
+    }
+
+    return ret;
+}
+
 /* Test the STREAM ID and STREAM RANK macros
  */
 
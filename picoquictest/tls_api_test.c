@@ -1759,7 +1759,7 @@ int tls_api_one_sim_round(picoquic_test_tls_api_ctx_t* test_ctx,
                     size_t size_sent = 0;
                     uint8_t *  send_buffer = test_ctx->send_buffer;
                     if (p_segment_size == NULL) {
-                        segment_size = PICOQUIC_MAX_PACKET_SIZE;
+                        segment_size = send_length;
                     }
                     while (ret == 0 && size_sent < send_length) {
                         picoquictest_sim_packet_t* packet = picoquictest_sim_link_create_packet();
@@ -2991,10 +2991,10 @@ int tls_api_one_scenario_verify(picoquic_test_tls_api_ctx_t* test_ctx)
             ret = -1;
         }
 
-        if (ret == 0 && test_ctx->qclient->nb_data_nodes_allocated > test_ctx->qclient->nb_data_nodes_in_pool) {
+        if (ret == 0 && test_ctx->qclient->nb_data_nodes_in_use > 0) {
             ret = -1;
         } else 
-        if (ret == 0 && test_ctx->qserver->nb_data_nodes_allocated > test_ctx->qserver->nb_data_nodes_in_pool) {
+        if (ret == 0 && test_ctx->qserver->nb_data_nodes_in_use > 0) {
             ret = -1;
         }
     }
@@ -4678,10 +4678,10 @@ int stop_sending_test_one(int discard, int reset_loss)
         }
     }
 
-    if (ret == 0 && test_ctx->qclient->nb_data_nodes_allocated > test_ctx->qclient->nb_data_nodes_in_pool) {
+    if (ret == 0 && test_ctx->qclient->nb_data_nodes_in_use > 0) {
         ret = -1;
     }
-    else if (ret == 0 && test_ctx->qserver->nb_data_nodes_allocated > test_ctx->qserver->nb_data_nodes_in_pool) {
+    else if (ret == 0 && test_ctx->qserver->nb_data_nodes_in_use > 0) {
         ret = -1;
     }
 
@@ -4805,6 +4805,90 @@ int mtu_max_test()
     return ret;
 }
 
+/*
+* MTU jumbo test. Set the packet size of both contexts for a link with
+* jumbo frames, check that the packet buffers are sized accordingly and
+* that path MTU discovery finds the MTU of the interface.
+*/
+
+int mtu_jumbo_test()
+{
+    uint64_t simulated_time = 0;
+    uint64_t loss_mask = 0;
+    const size_t jumbo_size = 9000;
+    picoquic_test_tls_api_ctx_t* test_ctx = NULL;
+    int ret = tls_api_init_ctx_ex2(&test_ctx, PICOQUIC_INTERNAL_TEST_VERSION_1,
+        PICOQUIC_TEST_SNI, PICOQUIC_TEST_ALPN, &simulated_time, NULL, NULL, 0, 1, 0, NULL, 0, 0,
+        PICOQUIC_MAX_PACKET_SIZE_LIMIT, 0);
+
+    if (ret == 0) {
+        if (picoquic_get_max_packet_size(test_ctx->qserver) != PICOQUIC_MAX_PACKET_SIZE) {
+            DBG_PRINTF("Default max packet size %zu", picoquic_get_max_packet_size(test_ctx->qserver));
+            ret = -1;
+        }
+        else if (picoquic_set_max_packet_size(test_ctx->qserver, PICOQUIC_ENFORCED_INITIAL_MTU - 1) == 0 ||
+            picoquic_set_max_packet_size(test_ctx->qserver, PICOQUIC_MAX_PACKET_SIZE_LIMIT + 1) == 0) {
+            DBG_PRINTF("%s", "Invalid max packet size accepted");
+            ret = -1;
+        }
+        else if ((ret = picoquic_set_max_packet_size(test_ctx->qserver, jumbo_size)) != 0 ||
+            (ret = picoquic_set_max_packet_size(test_ctx->qclient, jumbo_size)) != 0) {
+            DBG_PRINTF("Cannot set max packet size, ret = 0x%x", ret);
+        }
+        else {
+            picoquic_set_mtu_max(test_ctx->qserver, (uint32_t)jumbo_size + 28);
+            picoquic_set_mtu_max(test_ctx->qclient, (uint32_t)jumbo_size + 28);
+            /* The client connection was created before setting the size */
+            test_ctx->cnx_client->local_parameters.max_packet_size = (uint32_t)jumbo_size;
+            test_ctx->c_to_s_link->path_mtu = jumbo_size;
+            test_ctx->s_to_c_link->path_mtu = jumbo_size;
+            ret = picoquic_start_client_cnx(test_ctx->cnx_client);
+        }
+    }
+
+    if (ret == 0) {
+        ret = tls_api_connection_loop(test_ctx, &loss_mask, 0, &simulated_time);
+    }
+
+    if (ret == 0) {
+        ret = test_api_init_send_recv_scenario(test_ctx, test_scenario_mtu_discovery, sizeof(test_scenario_mtu_discovery));
+    }
+
+    if (ret == 0) {
+        ret = tls_api_data_sending_loop(test_ctx, &loss_mask, &simulated_time, 0);
+    }
+
+    if (ret == 0) {
+        if (test_ctx->cnx_client->path[0]->send_mtu != jumbo_size ||
+            test_ctx->cnx_server->path[0]->send_mtu != jumbo_size) {
+            DBG_PRINTF("MTU client %zu, server %zu, expected %zu",
+                test_ctx->cnx_client->path[0]->send_mtu, test_ctx->cnx_server->path[0]->send_mtu, jumbo_size);
+            ret = -1;
+        }
+        else if (test_ctx->cnx_client->max_mtu_received != jumbo_size) {
+            DBG_PRINTF("Client received max %zu bytes, expected %zu",
+                test_ctx->cnx_client->max_mtu_received, jumbo_size);
+            ret = -1;
+        }
+        else if (picoquic_set_max_packet_size(test_ctx->qserver, PICOQUIC_MAX_PACKET_SIZE) !=
+            PICOQUIC_ERROR_CANNOT_CHANGE_ACTIVE_CONTEXT) {
+            DBG_PRINTF("%s", "Max packet size reduced while connections are active");
+            ret = -1;
+        }
+    }
+
+    if (ret == 0) {
+        ret = tls_api_one_scenario_body_verify(test_ctx, &simulated_time, 0);
+    }
+
+    if (test_ctx != NULL) {
+        tls_api_delete_ctx(test_ctx);
+        test_ctx = NULL;
+    }
+
+    return ret;
+}
+
 /*
 * MTU drop test. Perform a long duration transmission.
 * Verify that MTU was properly set to expected value, then
@@ -11871,6 +11955,72 @@ int test_stateless_blowback()
     return ret;
 }
 
+/* Test that a stateless reset sent in response to a jumbo packet with an
+ * unknown CID fits in the stateless packet buffer.
+ */
+int stateless_reset_jumbo_test()
+{
+    uint64_t simulated_time = 0;
+    picoquic_test_tls_api_ctx_t* test_ctx = NULL;
+    uint8_t* bytes = NULL;
+    uint8_t* send_buffer = NULL;
+    size_t length = 9000;
+    size_t send_length = 0;
+    struct sockaddr_in addr_peer, addr_srv;
+    int ret = tls_api_init_ctx(&test_ctx, PICOQUIC_INTERNAL_TEST_VERSION_1, PICOQUIC_TEST_SNI, PICOQUIC_TEST_ALPN,
+        &simulated_time, NULL, NULL, 0, 1, 0);
+
+    if (ret == 0) {
+        bytes = (uint8_t*)malloc(PICOQUIC_MAX_PACKET_SIZE_LIMIT);
+        send_buffer = (uint8_t*)malloc(PICOQUIC_MAX_PACKET_SIZE_LIMIT);
+        if (bytes == NULL || send_buffer == NULL) {
+            ret = -1;
+        }
+        else if ((ret = picoquic_set_max_packet_size(test_ctx->qserver, PICOQUIC_MAX_PACKET_SIZE_LIMIT)) != 0) {
+            DBG_PRINTF("Cannot set max packet size, ret = 0x%x", ret);
+        }
+    }
+
+    if (ret == 0) {
+        /* Format a jumbo 1 RTT packet with an unknown CID and submit it */
+        memset(bytes, 0x5a, length);
+        bytes[0] = 0x40;
+        picoquic_set_test_address(&addr_peer, 0x01010101, 1234);
+        picoquic_set_test_address(&addr_srv, 0x02020202, 4567);
+        ret = picoquic_incoming_packet(test_ctx->qserver, bytes, length, (struct sockaddr*)&addr_peer,
+            (struct sockaddr*)&addr_srv, 0, 0, simulated_time);
+    }
+
+    if (ret == 0) {
+        picoquic_cnx_t* cnx;
+        picoquic_connection_id_t cid_log;
+        struct sockaddr_storage s_addr_to, s_addr_from;
+        int if_index;
+        ret = picoquic_prepare_next_packet(test_ctx->qserver, simulated_time, send_buffer, PICOQUIC_MAX_PACKET_SIZE_LIMIT,
+            &send_length, &s_addr_to, &s_addr_from, &if_index, &cid_log, &cnx);
+        if (ret == 0 && (send_length <= PICOQUIC_RESET_PACKET_MIN_SIZE || send_length >= PICOQUIC_MAX_PACKET_SIZE)) {
+            DBG_PRINTF("Stateless reset length %zu, expected between %d and %d",
+                send_length, PICOQUIC_RESET_PACKET_MIN_SIZE, PICOQUIC_MAX_PACKET_SIZE);
+            ret = -1;
+        }
+    }
+
+    if (bytes != NULL) {
+        free(bytes);
+    }
+
+    if (send_buffer != NULL) {
+        free(send_buffer);
+    }
+
+    if (test_ctx != NULL) {
+        tls_api_delete_ctx(test_ctx);
+        test_ctx = NULL;
+    }
+
+    return ret;
+}
+
 /* Test that random padding of coalesced packets has no unexpected side effects.
  */
 char const* random_padding_text_log = "random_padding_log.txt";